@@ -0,0 +1,29 @@
+
+#include "gkd-control.h"
+
+#include "egg/egg-secure-memory.h"
+
+#include <pwd.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+int
+main (int argc, char *argv[])
+{
+	const char *directory;
+	gchar *diagnostics;
+
+	directory = g_getenv ("GNOME_KEYRING_CONTROL");
+	g_return_val_if_fail (directory, 1);
+
+	diagnostics = gkd_control_diagnostics (directory);
+	if (!diagnostics)
+		return 1;
+
+	g_print ("%s", diagnostics);
+	g_free (diagnostics);
+
+	return 0;
+}
@@ -320,3 +320,37 @@ gkd_control_quit (const gchar *directory,
 
 	return TRUE;
 }
+
+gchar*
+gkd_control_diagnostics (const gchar *directory)
+{
+	gchar *diagnostics = NULL;
+	EggBuffer buffer;
+	gsize offset = 4;
+	gboolean ret;
+	guint32 res;
+
+	egg_buffer_init_full (&buffer, 128, g_realloc);
+	egg_buffer_add_uint32 (&buffer, 0);
+	egg_buffer_add_uint32 (&buffer, GKD_CONTROL_OP_DIAGNOSTICS);
+	egg_buffer_set_uint32 (&buffer, 0, buffer.len);
+
+	g_return_val_if_fail (!egg_buffer_has_error (&buffer), NULL);
+
+	ret = control_chat (directory, 0, &buffer);
+
+	if (ret)
+		ret = egg_buffer_get_uint32 (&buffer, offset, &offset, &res);
+	if (ret && res == GKD_CONTROL_RESULT_OK)
+		ret = egg_buffer_get_string (&buffer, offset, &offset, &diagnostics, g_realloc);
+
+	egg_buffer_uninit (&buffer);
+
+	if (!ret || res != GKD_CONTROL_RESULT_OK) {
+		g_message ("couldn't get diagnostics from keyring daemon");
+		g_free (diagnostics);
+		return NULL;
+	}
+
+	return diagnostics;
+}
@@ -25,7 +25,8 @@ enum {
 	GKD_CONTROL_OP_INITIALIZE,
 	GKD_CONTROL_OP_UNLOCK,
 	GKD_CONTROL_OP_CHANGE,
-	GKD_CONTROL_OP_QUIT
+	GKD_CONTROL_OP_QUIT,
+	GKD_CONTROL_OP_DIAGNOSTICS
 };
 
 enum {
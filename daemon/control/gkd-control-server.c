@@ -201,6 +201,7 @@ static void
 control_process (EggBuffer *req, GIOChannel *channel)
 {
 	ControlData *cdata = NULL;
+	gchar *diagnostics;
 	guint32 res;
 	guint32 op;
 
@@ -235,6 +236,14 @@ control_process (EggBuffer *req, GIOChannel *channel)
 		egg_buffer_add_uint32 (&cdata->buffer, 0);
 		egg_buffer_add_uint32 (&cdata->buffer, res);
 		break;
+	case GKD_CONTROL_OP_DIAGNOSTICS:
+		diagnostics = gkd_main_get_memory_diagnostics ();
+		cdata = control_data_new ();
+		egg_buffer_add_uint32 (&cdata->buffer, 0);
+		egg_buffer_add_uint32 (&cdata->buffer, GKD_CONTROL_RESULT_OK);
+		egg_buffer_add_string (&cdata->buffer, diagnostics);
+		g_free (diagnostics);
+		break;
 	default:
 		g_message ("received unsupported request operation on control socket: %d", (int)op);
 		break;
@@ -46,4 +46,6 @@ gboolean          gkd_control_change_lock   (const gchar *directory,
 gboolean          gkd_control_quit          (const gchar *directory,
                                              GkdControlFlags flags);
 
+gchar*            gkd_control_diagnostics   (const gchar *directory);
+
 #endif /* __GKD_CONTROL_H__ */
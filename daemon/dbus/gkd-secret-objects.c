@@ -44,10 +44,21 @@ enum {
 	PROP_SERVICE
 };
 
+#define MAX_CACHED_SEARCHES 32
+
+typedef struct {
+	GBytes *key;
+	GckSession *session;
+	CK_OBJECT_HANDLE handle;
+	GkdSecretObjects *objects;
+} CachedSearch;
+
 struct _GkdSecretObjects {
 	GObject parent;
 	GkdSecretService *service;
 	GckSlot *pkcs11_slot;
+	GHashTable *searches;           /* key -> link in searches_lru */
+	GQueue searches_lru;            /* CachedSearch, most recently used first */
 };
 
 static gchar *    object_path_for_item          (const gchar *base,
@@ -57,6 +68,9 @@ static gchar *    object_path_for_collection    (GckObject *collection);
 
 static gchar *    collection_path_for_item      (GckObject *item);
 
+static void       cached_search_remove          (GkdSecretObjects *self,
+                                                 CachedSearch *cached);
+
 G_DEFINE_TYPE (GkdSecretObjects, gkd_secret_objects, G_TYPE_OBJECT);
 
 /* -----------------------------------------------------------------------------
@@ -428,6 +442,213 @@ item_cleanup_search_results (GckSession *session, GList *items,
 	*unlocked = g_list_reverse (*unlocked);
 }
 
+static void
+on_cached_search_session_gone (gpointer user_data,
+                               GObject *where_the_object_was)
+{
+	CachedSearch *cached = user_data;
+
+	/* The search object went away with the session */
+	cached->session = NULL;
+	cached_search_remove (cached->objects, cached);
+}
+
+static void
+cached_search_remove (GkdSecretObjects *self,
+                      CachedSearch *cached)
+{
+	GckObject *search;
+	GList *link;
+
+	link = g_hash_table_lookup (self->searches, cached->key);
+	g_return_if_fail (link != NULL && link->data == cached);
+
+	g_hash_table_remove (self->searches, cached->key);
+	g_queue_delete_link (&self->searches_lru, link);
+
+	if (cached->session) {
+		g_object_weak_unref (G_OBJECT (cached->session), on_cached_search_session_gone, cached);
+		search = gck_object_from_handle (cached->session, cached->handle);
+		gck_object_destroy (search, NULL, NULL);
+		g_object_unref (search);
+	}
+
+	g_bytes_unref (cached->key);
+	g_slice_free (CachedSearch, cached);
+}
+
+static void
+cached_search_add (GkdSecretObjects *self,
+                   GckSession *session,
+                   GBytes *key,
+                   CK_OBJECT_HANDLE handle)
+{
+	CachedSearch *cached;
+
+	cached = g_slice_new0 (CachedSearch);
+	cached->key = g_bytes_ref (key);
+	cached->session = session;
+	cached->handle = handle;
+	cached->objects = self;
+	g_object_weak_ref (G_OBJECT (session), on_cached_search_session_gone, cached);
+
+	g_queue_push_head (&self->searches_lru, cached);
+	g_hash_table_insert (self->searches, cached->key, self->searches_lru.head);
+
+	while (g_queue_get_length (&self->searches_lru) > MAX_CACHED_SEARCHES)
+		cached_search_remove (self, g_queue_peek_tail (&self->searches_lru));
+}
+
+static GBytes *
+cached_search_key (GckSession *session,
+                   const GckAttribute *fields,
+                   const gchar *identifier)
+{
+	CK_SESSION_HANDLE handle;
+	GByteArray *key;
+	GList *pairs = NULL;
+	const gchar *name;
+	const gchar *at, *end;
+	GList *l;
+
+	at = (const gchar *)fields->value;
+	end = at + fields->length;
+
+	while (at < end) {
+		name = at;
+		at = memchr (at, 0, end - at);
+		if (at == NULL || (at = memchr (at + 1, 0, end - (at + 1))) == NULL) {
+			g_list_free (pairs);
+			return NULL;
+		}
+		pairs = g_list_prepend (pairs, (gpointer)name);
+		at++;
+	}
+
+	/* The order of the fields makes no difference to the matches */
+	pairs = g_list_sort (g_list_reverse (pairs), (GCompareFunc)strcmp);
+
+	handle = gck_session_get_handle (session);
+	key = g_byte_array_new ();
+	g_byte_array_append (key, (const guint8 *)&handle, sizeof (handle));
+	if (identifier != NULL)
+		g_byte_array_append (key, (const guint8 *)identifier, strlen (identifier));
+	g_byte_array_append (key, (const guint8 *)"", 1);
+
+	for (l = pairs; l != NULL; l = g_list_next (l)) {
+		name = l->data;
+		at = name + strlen (name) + 1;
+		g_byte_array_append (key, (const guint8 *)name, (at + strlen (at) + 1) - name);
+	}
+
+	g_list_free (pairs);
+	return g_byte_array_free_to_bytes (key);
+}
+
+/*
+ * Search objects in the secret store stay up to date as items come and go,
+ * so rather than creating one for every search we keep the recently used
+ * ones around, and just read their matches the next time around.
+ */
+static void
+objects_refresh_token (GckSession *session)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GError *error = NULL;
+	gulong *handles;
+	gulong n_handles;
+
+	/*
+	 * Looking for token objects is what has the module check the keyring
+	 * files for changes. Search objects never live on the token, so this
+	 * finds nothing, and only refreshes.
+	 */
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_G_SEARCH);
+	gck_builder_add_boolean (&builder, CKA_TOKEN, TRUE);
+	handles = gck_session_find_handles (session, gck_builder_end (&builder),
+	                                    NULL, &n_handles, &error);
+	if (error != NULL) {
+		g_message ("couldn't refresh secret items: %s", egg_error_message (error));
+		g_clear_error (&error);
+	}
+
+	g_free (handles);
+}
+
+static gpointer
+objects_search_matched (GkdSecretObjects *self,
+                        GckSession *session,
+                        const GckAttribute *fields,
+                        const gchar *identifier,
+                        gsize *n_data,
+                        GError **error)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	CachedSearch *cached;
+	GckObject *search;
+	GError *err = NULL;
+	gpointer data;
+	GList *link;
+	GBytes *key;
+
+	key = cached_search_key (session, fields, identifier);
+
+	link = key ? g_hash_table_lookup (self->searches, key) : NULL;
+	if (link != NULL) {
+		cached = link->data;
+
+		/* The search picks up any changes to the keyring files */
+		objects_refresh_token (session);
+
+		search = gck_object_from_handle (session, cached->handle);
+		data = gck_object_get_data (search, CKA_G_MATCHED, NULL, n_data, &err);
+		g_object_unref (search);
+
+		if (err == NULL) {
+			g_queue_unlink (&self->searches_lru, link);
+			g_queue_push_head_link (&self->searches_lru, link);
+			g_bytes_unref (key);
+			return data;
+		}
+
+		/* Something happened to the search object, make a new one */
+		g_clear_error (&err);
+		cached_search_remove (self, cached);
+	}
+
+	gck_builder_add_attribute (&builder, fields);
+	if (identifier != NULL)
+		gck_builder_add_string (&builder, CKA_G_COLLECTION, identifier);
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_G_SEARCH);
+	gck_builder_add_boolean (&builder, CKA_TOKEN, FALSE);
+
+	/* Create the search object */
+	search = gck_session_create_object (session, gck_builder_end (&builder), NULL, error);
+	if (search == NULL) {
+		if (key)
+			g_bytes_unref (key);
+		return NULL;
+	}
+
+	/* Get the matched item handles, and keep the search object for next time */
+	data = gck_object_get_data (search, CKA_G_MATCHED, NULL, n_data, &err);
+	if (err == NULL && key != NULL)
+		cached_search_add (self, session, key, gck_object_get_handle (search));
+	else
+		gck_object_destroy (search, NULL, NULL);
+
+	g_object_unref (search);
+	if (key)
+		g_bytes_unref (key);
+
+	if (err != NULL) {
+		g_propagate_error (error, err);
+		return NULL;
+	}
+
+	return data;
+}
+
 static DBusMessage*
 collection_property_get (GkdSecretObjects *self, GckObject *object, DBusMessage *message)
 {
@@ -550,21 +771,13 @@ collection_find_matching_item (GkdSecretObjects *self,
                                const gchar *identifier,
                                const GckAttribute *fields)
 {
-	GckBuilder builder = GCK_BUILDER_INIT;
 	GckObject *result = NULL;
 	GError *error = NULL;
-	GckObject *search;
 	gpointer data;
 	gsize n_data;
 
 	/* Find items matching the collection and fields */
-	gck_builder_add_attribute (&builder, fields);
-	gck_builder_add_string (&builder, CKA_G_COLLECTION, identifier);
-	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_G_SEARCH);
-	gck_builder_add_boolean (&builder, CKA_TOKEN, FALSE);
-
-	/* Create the search object */
-	search = gck_session_create_object (session, gck_builder_end (&builder), NULL, &error);
+	data = objects_search_matched (self, session, fields, identifier, &n_data, &error);
 
 	if (error != NULL) {
 		g_warning ("couldn't search for matching item: %s", egg_error_message (error));
@@ -572,11 +785,6 @@ collection_find_matching_item (GkdSecretObjects *self,
 		return NULL;
 	}
 
-	/* Get the matched item handles, and delete the search object */
-	data = gck_object_get_data (search, CKA_G_MATCHED, NULL, &n_data, NULL);
-	gck_object_destroy (search, NULL, NULL);
-	g_object_unref (search);
-
 	if (n_data >= sizeof (CK_OBJECT_HANDLE))
 		result = gck_object_from_handle (session, *((CK_OBJECT_HANDLE_PTR)data));
 
@@ -889,7 +1097,8 @@ gkd_secret_objects_constructor (GType type, guint n_props, GObjectConstructParam
 static void
 gkd_secret_objects_init (GkdSecretObjects *self)
 {
-
+	self->searches = g_hash_table_new (g_bytes_hash, g_bytes_equal);
+	g_queue_init (&self->searches_lru);
 }
 
 static void
@@ -897,6 +1106,9 @@ gkd_secret_objects_dispose (GObject *obj)
 {
 	GkdSecretObjects *self = GKD_SECRET_OBJECTS (obj);
 
+	while (!g_queue_is_empty (&self->searches_lru))
+		cached_search_remove (self, g_queue_peek_head (&self->searches_lru));
+
 	if (self->pkcs11_slot) {
 		g_object_unref (self->pkcs11_slot);
 		self->pkcs11_slot = NULL;
@@ -918,6 +1130,9 @@ gkd_secret_objects_finalize (GObject *obj)
 
 	g_assert (!self->pkcs11_slot);
 	g_assert (!self->service);
+	g_assert (g_queue_is_empty (&self->searches_lru));
+
+	g_hash_table_destroy (self->searches);
 
 	G_OBJECT_CLASS (gkd_secret_objects_parent_class)->finalize (obj);
 }
@@ -1321,11 +1536,11 @@ gkd_secret_objects_handle_search_items (GkdSecretObjects *self,
 	GckBuilder builder = GCK_BUILDER_INIT;
 	DBusMessageIter iter;
 	DBusMessageIter array;
-	GckObject *search;
+	GckAttributes *fields;
 	GckSession *session;
 	DBusMessage *reply;
 	GError *error = NULL;
-	gchar *identifier;
+	gchar *identifier = NULL;
 	gpointer data;
 	gsize n_data;
 	GList *locked, *unlocked;
@@ -1345,21 +1560,21 @@ gkd_secret_objects_handle_search_items (GkdSecretObjects *self,
 	}
 
 	if (base != NULL) {
-		if (!parse_object_path (self, base, &identifier, NULL))
+		if (!parse_object_path (self, base, &identifier, NULL)) {
+			gck_builder_clear (&builder);
 			g_return_val_if_reached (NULL);
-		gck_builder_add_string (&builder, CKA_G_COLLECTION, identifier);
-		g_free (identifier);
+		}
 	}
 
-	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_G_SEARCH);
-	gck_builder_add_boolean (&builder, CKA_TOKEN, FALSE);
-
 	/* The session we're using to access the object */
 	session = gkd_secret_service_get_pkcs11_session (self->service, dbus_message_get_sender (message));
 	g_return_val_if_fail (session, NULL);
 
-	/* Create the search object */
-	search = gck_session_create_object (session, gck_builder_end (&builder), NULL, &error);
+	fields = gck_attributes_ref_sink (gck_builder_end (&builder));
+	data = objects_search_matched (self, session, gck_attributes_find (fields, CKA_G_FIELDS),
+	                               identifier, &n_data, &error);
+	gck_attributes_unref (fields);
+	g_free (identifier);
 
 	if (error != NULL) {
 		reply = dbus_message_new_error_printf (message, DBUS_ERROR_FAILED,
@@ -1369,19 +1584,6 @@ gkd_secret_objects_handle_search_items (GkdSecretObjects *self,
 		return reply;
 	}
 
-	/* Get the matched item handles, and delete the search object */
-	data = gck_object_get_data (search, CKA_G_MATCHED, NULL, &n_data, &error);
-	gck_object_destroy (search, NULL, NULL);
-	g_object_unref (search);
-
-	if (error != NULL) {
-		reply = dbus_message_new_error_printf (message, DBUS_ERROR_FAILED,
-		                                       "Couldn't retrieve matched items: %s",
-		                                       egg_error_message (error));
-		g_clear_error (&error);
-		return reply;
-	}
-
 	/* Build a list of object handles */
 	items = gck_objects_from_handle_array (session, data, n_data / sizeof (CK_OBJECT_HANDLE));
 	g_free (data);
@@ -1421,12 +1623,14 @@ gkd_secret_objects_handle_get_secrets (GkdSecretObjects *self, DBusMessage *mess
 {
 	DBusError derr = DBUS_ERROR_INIT;
 	GkdSecretSession *session;
-	GkdSecretSecret *secret;
+	GkdSecretSecret **secrets;
 	DBusMessage *reply;
 	GckObject *item;
 	DBusMessageIter iter, array, dict;
 	const char *session_path;
 	const char *caller;
+	GPtrArray *items;
+	GPtrArray *found;
 	char **paths;
 	int n_paths, i;
 
@@ -1441,47 +1645,52 @@ gkd_secret_objects_handle_get_secrets (GkdSecretObjects *self, DBusMessage *mess
 
 	session = gkd_secret_service_lookup_session (self->service, session_path,
 	                                             dbus_message_get_sender (message));
-	if (session == NULL)
+	if (session == NULL) {
+		dbus_free_string_array (paths);
 		return dbus_message_new_error (message, SECRET_ERROR_NO_SESSION, "The session does not exist");
+	}
 
-	reply = dbus_message_new_method_return (message);
-	dbus_message_iter_init_append (reply, &iter);
-	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{o(oayays)}", &array);
+	items = g_ptr_array_new_with_free_func (g_object_unref);
+	found = g_ptr_array_new ();
 
+	/* Try to find the items, if one doesn't exist, just ignore it */
 	for (i = 0; i < n_paths; ++i) {
-
-		/* Try to find the item, if it doesn't exist, just ignore */
 		item = gkd_secret_objects_lookup_item (self, caller, paths[i]);
-		if (!item)
-			continue;
+		if (item) {
+			g_ptr_array_add (items, item);
+			g_ptr_array_add (found, paths[i]);
+		}
+	}
 
-		secret = gkd_secret_session_get_item_secret (session, item, &derr);
-		g_object_unref (item);
+	/* Wrap all the secrets in one go, locked items are left out */
+	secrets = gkd_secret_session_get_item_secrets (session, (GckObject **)items->pdata,
+	                                               items->len, &derr);
+	g_ptr_array_unref (items);
 
-		if (secret == NULL) {
-			/* We ignore is locked, and just leave out from response */
-			if (dbus_error_has_name (&derr, SECRET_ERROR_IS_LOCKED)) {
-				dbus_error_free (&derr);
-				continue;
+	if (secrets == NULL) {
+		reply = dbus_message_new_error (message, derr.name, derr.message);
+		dbus_error_free (&derr);
 
-			/* All other errors stop the operation */
-			} else {
-				dbus_message_unref (reply);
-				reply = dbus_message_new_error (message, derr.name, derr.message);
-				dbus_error_free (&derr);
-				break;
-			}
+	} else {
+		reply = dbus_message_new_method_return (message);
+		dbus_message_iter_init_append (reply, &iter);
+		dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{o(oayays)}", &array);
+
+		for (i = 0; i < (int)found->len; ++i) {
+			if (secrets[i] == NULL)
+				continue;
+			dbus_message_iter_open_container (&array, DBUS_TYPE_DICT_ENTRY, NULL, &dict);
+			dbus_message_iter_append_basic (&dict, DBUS_TYPE_OBJECT_PATH, &(found->pdata[i]));
+			gkd_secret_secret_append (secrets[i], &dict);
+			gkd_secret_secret_free (secrets[i]);
+			dbus_message_iter_close_container (&array, &dict);
 		}
 
-		dbus_message_iter_open_container (&array, DBUS_TYPE_DICT_ENTRY, NULL, &dict);
-		dbus_message_iter_append_basic (&dict, DBUS_TYPE_OBJECT_PATH, &(paths[i]));
-		gkd_secret_secret_append (secret, &dict);
-		gkd_secret_secret_free (secret);
-		dbus_message_iter_close_container (&array, &dict);
+		dbus_message_iter_close_container (&iter, &array);
+		g_free (secrets);
 	}
 
-	if (i == n_paths)
-		dbus_message_iter_close_container (&iter, &array);
+	g_ptr_array_unref (found);
 	dbus_free_string_array (paths);
 
 	return reply;
@@ -1173,6 +1173,9 @@ gkd_secret_service_constructor (GType type, guint n_props, GObjectConstructParam
 	self->objects = g_object_new (GKD_SECRET_TYPE_OBJECTS,
 	                              "pkcs11-slot", slot, "service", self, NULL);
 
+	/* Clients tend to open sessions as soon as we appear on the bus */
+	gkd_secret_session_prepare_keys ();
+
 	/* Register for signals that let us know when clients leave the bus */
 	self->match_rule = g_strdup_printf ("type='signal',member=NameOwnerChanged,"
 	                                    "interface='" DBUS_INTERFACE_DBUS "'");
@@ -29,13 +29,22 @@
 #include "gkd-secret-util.h"
 #include "gkd-dbus-util.h"
 
+#include "daemon/gkd-pkcs11.h"
+
+#include "egg/egg-cleanup.h"
 #include "egg/egg-dh.h"
 #include "egg/egg-error.h"
+#include "egg/egg-secure-memory.h"
 
 #include "pkcs11/pkcs11i.h"
 
+#include <gcrypt.h>
+
 #include <string.h>
 
+/* Length of X25519 private and public keys */
+#define X25519_KEY_LENGTH 32
+
 enum {
 	PROP_0,
 	PROP_CALLER,
@@ -67,6 +76,37 @@ G_DEFINE_TYPE_WITH_CODE (GkdSecretSession, gkd_secret_session, G_TYPE_OBJECT,
 
 static guint unique_session_number = 0;
 
+EGG_SECURE_DECLARE (secret_session);
+
+/*
+ * Generating a DH key pair is a full size modular exponentiation, which
+ * is too slow to do on the main loop when lots of clients open sessions
+ * at once, such as at login. So we keep some pre-generated pairs for each
+ * group around, and refill them from a thread. Each pair is used once.
+ */
+
+#define DH_POOL_SIZE 32
+
+/* The group used by the dh-ietf1024-sha256-aes128-cbc-pkcs7 algorithm */
+#define DH_SESSION_GROUP "ietf-ike-grp-modp-1024"
+
+typedef struct {
+	gcry_mpi_t pub;
+	gcry_mpi_t priv;
+} DhPair;
+
+typedef struct {
+	gcry_mpi_t prime;
+	gcry_mpi_t base;
+	GQueue pairs;
+	gboolean filling;
+} DhPool;
+
+static GMutex dh_pool_mutex;
+static GHashTable *dh_pools = NULL;
+static GThreadPool *dh_pool_thread = NULL;
+static gboolean dh_pool_stopping = FALSE;
+
 /* -----------------------------------------------------------------------------
  * INTERNAL
  */
@@ -79,35 +119,279 @@ take_session_key (GkdSecretSession *self, GckObject *key, CK_MECHANISM_TYPE mech
 	self->mech_type = mech;
 }
 
+static void
+dh_pair_free (gpointer data)
+{
+	DhPair *pair = data;
+	gcry_mpi_release (pair->pub);
+	gcry_mpi_release (pair->priv);
+	g_slice_free (DhPair, pair);
+}
+
+static void
+dh_pool_free (gpointer data)
+{
+	DhPool *pool = data;
+	gcry_mpi_release (pool->prime);
+	gcry_mpi_release (pool->base);
+	g_queue_foreach (&pool->pairs, (GFunc)dh_pair_free, NULL);
+	g_queue_clear (&pool->pairs);
+	g_slice_free (DhPool, pool);
+}
+
+static void
+dh_pool_fill (gpointer data,
+              gpointer unused)
+{
+	DhPool *pool = data;
+	DhPair *pair;
+	gcry_mpi_t pub, priv;
+
+	for (;;) {
+		g_mutex_lock (&dh_pool_mutex);
+		if (dh_pool_stopping || g_queue_get_length (&pool->pairs) >= DH_POOL_SIZE) {
+			pool->filling = FALSE;
+			g_mutex_unlock (&dh_pool_mutex);
+			break;
+		}
+		g_mutex_unlock (&dh_pool_mutex);
+
+		/* The prime and base are never modified once the pool exists */
+		if (!egg_dh_gen_pair (pool->prime, pool->base, 0, &pub, &priv)) {
+			g_mutex_lock (&dh_pool_mutex);
+			pool->filling = FALSE;
+			g_mutex_unlock (&dh_pool_mutex);
+			break;
+		}
+
+		pair = g_slice_new (DhPair);
+		pair->pub = pub;
+		pair->priv = priv;
+
+		g_mutex_lock (&dh_pool_mutex);
+		g_queue_push_tail (&pool->pairs, pair);
+		g_mutex_unlock (&dh_pool_mutex);
+	}
+}
+
+static void
+dh_pool_cleanup (gpointer unused)
+{
+	g_mutex_lock (&dh_pool_mutex);
+	dh_pool_stopping = TRUE;
+	g_mutex_unlock (&dh_pool_mutex);
+
+	/* Waits for a fill in progress to notice the above */
+	if (dh_pool_thread)
+		g_thread_pool_free (dh_pool_thread, TRUE, TRUE);
+	dh_pool_thread = NULL;
+
+	if (dh_pools)
+		g_hash_table_destroy (dh_pools);
+	dh_pools = NULL;
+
+	dh_pool_stopping = FALSE;
+}
+
+/* Called with dh_pool_mutex held */
+static DhPool*
+dh_pool_lookup (const gchar *group)
+{
+	GError *error = NULL;
+	DhPool *pool;
+
+	if (!dh_pools) {
+		dh_pools = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, dh_pool_free);
+		dh_pool_thread = g_thread_pool_new (dh_pool_fill, NULL, 1, FALSE, &error);
+		if (!dh_pool_thread) {
+			g_warning ("couldn't create thread to generate dh keys: %s",
+			           egg_error_message (error));
+			g_clear_error (&error);
+		}
+		egg_cleanup_register (dh_pool_cleanup, NULL);
+	}
+
+	pool = g_hash_table_lookup (dh_pools, group);
+	if (pool == NULL) {
+		pool = g_slice_new0 (DhPool);
+		if (!egg_dh_default_params (group, &pool->prime, &pool->base)) {
+			g_slice_free (DhPool, pool);
+			return NULL;
+		}
+		g_queue_init (&pool->pairs);
+		g_hash_table_insert (dh_pools, g_strdup (group), pool);
+	}
+
+	return pool;
+}
+
+/* Called with dh_pool_mutex held */
+static void
+dh_pool_refill (DhPool *pool)
+{
+	if (pool->filling || !dh_pool_thread ||
+	    g_queue_get_length (&pool->pairs) >= DH_POOL_SIZE)
+		return;
+
+	pool->filling = TRUE;
+	g_thread_pool_push (dh_pool_thread, pool, NULL);
+}
+
+static gboolean
+dh_pool_take_pair (const gchar *group,
+                   gcry_mpi_t *prime,
+                   gcry_mpi_t *base,
+                   gcry_mpi_t *pub,
+                   gcry_mpi_t *priv)
+{
+	DhPair *pair;
+	DhPool *pool;
+	gboolean ret;
+
+	g_mutex_lock (&dh_pool_mutex);
+
+	pool = dh_pool_lookup (group);
+	if (pool == NULL) {
+		g_mutex_unlock (&dh_pool_mutex);
+		g_warning ("couldn't load dh parameter group: %s", group);
+		return FALSE;
+	}
+
+	*prime = gcry_mpi_copy (pool->prime);
+	*base = gcry_mpi_copy (pool->base);
+
+	pair = g_queue_pop_head (&pool->pairs);
+	dh_pool_refill (pool);
+
+	g_mutex_unlock (&dh_pool_mutex);
+
+	/* Pool ran dry, generate one here */
+	if (pair == NULL) {
+		ret = egg_dh_gen_pair (*prime, *base, 0, pub, priv);
+		if (ret == FALSE) {
+			gcry_mpi_release (*prime);
+			gcry_mpi_release (*base);
+		}
+		return ret;
+	}
+
+	*pub = pair->pub;
+	*priv = pair->priv;
+	g_slice_free (DhPair, pair);
+	return TRUE;
+}
+
+static void
+add_mpi_attribute (GckBuilder *builder,
+                   gulong attr_type,
+                   gcry_mpi_t mpi,
+                   gboolean secure)
+{
+	gcry_error_t gcry;
+	guchar *value;
+	gsize n_value;
+
+	gcry = gcry_mpi_print (GCRYMPI_FMT_USG, NULL, 0, &n_value, mpi);
+	g_return_if_fail (gcry == 0);
+	value = secure ? egg_secure_alloc (n_value) : g_malloc (n_value);
+	gcry = gcry_mpi_print (GCRYMPI_FMT_USG, value, n_value, &n_value, mpi);
+	g_return_if_fail (gcry == 0);
+
+	gck_builder_add_data (builder, attr_type, value, n_value);
+
+	if (secure) {
+		egg_secure_clear (value, n_value);
+		egg_secure_free (value);
+	} else {
+		g_free (value);
+	}
+}
+
 static gboolean
 aes_create_dh_keys (GckSession *session, const gchar *group,
-                    GckObject **pub_key, GckObject **priv_key)
+                    gpointer *pub_value, gsize *n_pub_value,
+                    GckObject **priv_key)
 {
 	GckBuilder builder = GCK_BUILDER_INIT;
-	GckAttributes *attrs;
-	gconstpointer prime, base;
-	gsize n_prime, n_base;
+	gcry_mpi_t prime, base, pub, priv;
 	GError *error = NULL;
-	gboolean ret;
+	gcry_error_t gcry;
 
-	if (!egg_dh_default_params_raw (group, &prime, &n_prime, &base, &n_base)) {
-		g_warning ("couldn't load dh parameter group: %s", group);
+	if (!dh_pool_take_pair (group, &prime, &base, &pub, &priv))
+		return FALSE;
+
+	/* Import the private half into the caller's session */
+	gck_builder_init_full (&builder, GCK_BUILDER_SECURE_MEMORY);
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_PRIVATE_KEY);
+	gck_builder_add_ulong (&builder, CKA_KEY_TYPE, CKK_DH);
+	gck_builder_add_boolean (&builder, CKA_TOKEN, FALSE);
+	add_mpi_attribute (&builder, CKA_PRIME, prime, FALSE);
+	add_mpi_attribute (&builder, CKA_BASE, base, FALSE);
+	add_mpi_attribute (&builder, CKA_VALUE, priv, TRUE);
+
+	*priv_key = gck_session_create_object (session, gck_builder_end (&builder), NULL, &error);
+
+	/* And the public half goes to the peer */
+	gcry = gcry_mpi_print (GCRYMPI_FMT_USG, NULL, 0, n_pub_value, pub);
+	g_return_val_if_fail (gcry == 0, FALSE);
+	*pub_value = g_malloc (*n_pub_value);
+	gcry = gcry_mpi_print (GCRYMPI_FMT_USG, *pub_value, *n_pub_value, n_pub_value, pub);
+	g_return_val_if_fail (gcry == 0, FALSE);
+
+	gcry_mpi_release (prime);
+	gcry_mpi_release (base);
+	gcry_mpi_release (pub);
+	gcry_mpi_release (priv);
+
+	if (*priv_key == NULL) {
+		g_warning ("couldn't create dh private key: %s", egg_error_message (error));
+		g_clear_error (&error);
+		g_free (*pub_value);
+		*pub_value = NULL;
 		return FALSE;
 	}
 
-	gck_builder_add_data (&builder, CKA_PRIME, prime, n_prime);
-	gck_builder_add_data (&builder, CKA_BASE, base, n_base);
-	attrs = gck_attributes_ref_sink (gck_builder_end (&builder));
+	return TRUE;
+}
+
+static gboolean
+x25519_create_key (GckSession *session, gpointer *pub_value,
+                   gsize *n_pub_value, GckObject **priv_key)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GError *error = NULL;
+	gcry_error_t gcry;
+	guchar *priv;
+
+	priv = egg_secure_alloc (X25519_KEY_LENGTH);
+	gcry_randomize (priv, X25519_KEY_LENGTH, GCRY_STRONG_RANDOM);
+
+	/* The public key is the private scalar times the base point */
+	*pub_value = g_malloc (X25519_KEY_LENGTH);
+	*n_pub_value = X25519_KEY_LENGTH;
+	gcry = gcry_ecc_mul_point (GCRY_ECC_CURVE25519, *pub_value, priv, NULL);
+	if (gcry != 0) {
+		g_warning ("couldn't create x25519 public key: %s", gcry_strerror (gcry));
+		egg_secure_free (priv);
+		g_free (*pub_value);
+		*pub_value = NULL;
+		return FALSE;
+	}
 
-	/* Perform the DH key generation */
-	ret = gck_session_generate_key_pair (session, CKM_DH_PKCS_KEY_PAIR_GEN, attrs, attrs,
-	                                     pub_key, priv_key, NULL, &error);
+	gck_builder_init_full (&builder, GCK_BUILDER_SECURE_MEMORY);
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_PRIVATE_KEY);
+	gck_builder_add_ulong (&builder, CKA_KEY_TYPE, CKK_EC_MONTGOMERY);
+	gck_builder_add_boolean (&builder, CKA_TOKEN, FALSE);
+	gck_builder_add_data (&builder, CKA_VALUE, priv, X25519_KEY_LENGTH);
+	egg_secure_free (priv);
 
-	gck_attributes_unref (attrs);
+	*priv_key = gck_session_create_object (session, gck_builder_end (&builder), NULL, &error);
 
-	if (ret == FALSE) {
-		g_warning ("couldn't generate dh key pair: %s", egg_error_message (error));
+	if (*priv_key == NULL) {
+		g_warning ("couldn't create x25519 private key: %s", egg_error_message (error));
 		g_clear_error (&error);
+		g_free (*pub_value);
+		*pub_value = NULL;
 		return FALSE;
 	}
 
@@ -115,7 +399,7 @@ aes_create_dh_keys (GckSession *session, const gchar *group,
 }
 
 static gboolean
-aes_derive_key (GckSession *session, GckObject *priv_key,
+aes_derive_key (GckSession *session, GckObject *priv_key, CK_MECHANISM_TYPE agreement,
                 gconstpointer input, gsize n_input, GckObject **aes_key)
 {
 	GckBuilder builder = GCK_BUILDER_INIT;
@@ -124,11 +408,11 @@ aes_derive_key (GckSession *session, GckObject *priv_key,
 	GckObject *dh_key;
 
 	/*
-	 * First we have to generate a secret key from the DH key. The
-	 * length of this key depends on the size of our DH prime
+	 * First we have to generate a secret key from the key agreement.
+	 * For DH the length of this key depends on the size of our prime
 	 */
 
-	mech.type = CKM_DH_PKCS_DERIVE;
+	mech.type = agreement;
 	mech.parameter = input;
 	mech.n_parameter = n_input;
 
@@ -167,12 +451,12 @@ aes_derive_key (GckSession *session, GckObject *priv_key,
 }
 
 static DBusMessage*
-aes_negotiate (GkdSecretSession *self, DBusMessage *message, gconstpointer input, gsize n_input)
+aes_negotiate (GkdSecretSession *self, DBusMessage *message, CK_MECHANISM_TYPE agreement,
+               gconstpointer input, gsize n_input)
 {
 	DBusMessageIter iter, variant, array;
 	GckSession *session;
-	GckObject *pub, *priv, *key;
-	GError *error = NULL;
+	GckObject *priv, *key;
 	DBusMessage *reply;
 	gpointer output;
 	gsize n_output;
@@ -181,24 +465,15 @@ aes_negotiate (GkdSecretSession *self, DBusMessage *message, gconstpointer input
 	session = gkd_secret_service_get_pkcs11_session (self->service, self->caller);
 	g_return_val_if_fail (session, NULL);
 
-	if (!aes_create_dh_keys (session, "ietf-ike-grp-modp-1024", &pub, &priv))
+	if (agreement == CKM_G_X25519_DERIVE)
+		ret = x25519_create_key (session, &output, &n_output, &priv);
+	else
+		ret = aes_create_dh_keys (session, DH_SESSION_GROUP, &output, &n_output, &priv);
+	if (!ret)
 		return dbus_message_new_error_printf (message, DBUS_ERROR_FAILED,
 		                                       "Failed to create necessary crypto keys.");
 
-	/* Get the output data */
-	output = gck_object_get_data (pub, CKA_VALUE, NULL, &n_output, &error);
-	gck_object_destroy (pub, NULL, NULL);
-	g_object_unref (pub);
-
-	if (output == NULL) {
-		g_warning ("couldn't get public key DH value: %s", egg_error_message (error));
-		g_clear_error (&error);
-		g_object_unref (priv);
-		return dbus_message_new_error_printf (message, DBUS_ERROR_FAILED,
-		                                      "Failed to retrieve necessary crypto keys.");
-	}
-
-	ret = aes_derive_key (session, priv, input, n_input, &key);
+	ret = aes_derive_key (session, priv, agreement, input, n_input, &key);
 
 	gck_object_destroy (priv, NULL, NULL);
 	g_object_unref (priv);
@@ -464,6 +739,19 @@ gkd_secret_dispatch_iface (GkdSecretDispatchIface *iface)
  * PUBLIC
  */
 
+void
+gkd_secret_session_prepare_keys (void)
+{
+	DhPool *pool;
+
+	/* Start generating key pairs for the sessions clients will open */
+	g_mutex_lock (&dh_pool_mutex);
+	pool = dh_pool_lookup (DH_SESSION_GROUP);
+	if (pool != NULL)
+		dh_pool_refill (pool);
+	g_mutex_unlock (&dh_pool_mutex);
+}
+
 GkdSecretSession*
 gkd_secret_session_new (GkdSecretService *service, const gchar *caller)
 {
@@ -477,9 +765,7 @@ gpointer
 gkd_secret_session_begin (GkdSecretSession *self, const gchar *group,
                           gsize *n_output)
 {
-	GError *error = NULL;
 	GckSession *session;
-	GckObject *public;
 	gpointer output;
 
 	g_return_val_if_fail (GKD_SECRET_IS_SESSION (self), NULL);
@@ -490,20 +776,9 @@ gkd_secret_session_begin (GkdSecretSession *self, const gchar *group,
 	session = gkd_secret_session_get_pkcs11_session (self);
 	g_return_val_if_fail (session, NULL);
 
-	if (!aes_create_dh_keys (session, group, &public, &self->private))
+	if (!aes_create_dh_keys (session, group, &output, n_output, &self->private))
 		return NULL;
 
-	/* Get the output data */
-	output = gck_object_get_data (public, CKA_VALUE, NULL, n_output, &error);
-	gck_object_destroy (public, NULL, NULL);
-	g_object_unref (public);
-
-	if (output == NULL) {
-		g_warning ("couldn't get public key DH value: %s", egg_error_message (error));
-		g_clear_error (&error);
-		return NULL;
-	}
-
 	return output;
 }
 
@@ -519,7 +794,8 @@ gkd_secret_session_complete (GkdSecretSession *self, gconstpointer peer,
 	session = gkd_secret_session_get_pkcs11_session (self);
 	g_return_val_if_fail (session, FALSE);
 
-	if (!aes_derive_key (session, self->private, peer, n_peer, &self->key))
+	if (!aes_derive_key (session, self->private, CKM_DH_PKCS_DERIVE,
+	                     peer, n_peer, &self->key))
 		return FALSE;
 
 	self->mech_type = CKM_AES_CBC_PAD;
@@ -559,7 +835,18 @@ gkd_secret_session_handle_open (GkdSecretSession *self, DBusMessage *message)
 			                               "The session algorithm input argument was invalid");
 		dbus_message_iter_recurse (&variant, &array);
 		dbus_message_iter_get_fixed_array (&array, &input, &n_input);
-		reply = aes_negotiate (self, message, input, n_input);
+		reply = aes_negotiate (self, message, CKM_DH_PKCS_DERIVE, input, n_input);
+
+	} else if (g_str_equal (algorithm, "x25519-hkdf-sha256-aes128-cbc-pkcs7")) {
+		if (!g_str_equal ("ay", dbus_message_iter_get_signature (&variant)))
+			return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS,
+			                               "The session algorithm input argument was invalid");
+		dbus_message_iter_recurse (&variant, &array);
+		dbus_message_iter_get_fixed_array (&array, &input, &n_input);
+		if (n_input != X25519_KEY_LENGTH)
+			return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS,
+			                               "The session algorithm input argument was invalid");
+		reply = aes_negotiate (self, message, CKM_G_X25519_DERIVE, input, n_input);
 
 	} else {
 		reply = dbus_message_new_error_printf (message, DBUS_ERROR_NOT_SUPPORTED,
@@ -639,6 +926,94 @@ gkd_secret_session_get_item_secret (GkdSecretSession *self, GckObject *item,
 	return gkd_secret_secret_new_take_memory (self, iv, n_iv, value, n_value);
 }
 
+GkdSecretSecret**
+gkd_secret_session_get_item_secrets (GkdSecretSession *self, GckObject **items,
+                                     guint n_items, DBusError *derr)
+{
+	GkdSecretSecret **secrets;
+	CK_OBJECT_HANDLE_PTR objects;
+	CK_ULONG_PTR results;
+	CK_ULONG_PTR lengths;
+	CK_SESSION_HANDLE handle;
+	CK_ULONG n_value = 0;
+	GckSession *session;
+	guchar *value = NULL;
+	guchar *ivs = NULL;
+	gsize n_iv = 0;
+	guchar *at;
+	guint i;
+	CK_RV rv;
+
+	g_return_val_if_fail (GKD_SECRET_IS_SESSION (self), NULL);
+	g_return_val_if_fail (items != NULL || n_items == 0, NULL);
+
+	g_assert (GCK_IS_OBJECT (self->key));
+
+	secrets = g_new0 (GkdSecretSecret *, n_items + 1);
+	if (n_items == 0)
+		return secrets;
+
+	session = gck_object_get_session (items[0]);
+	g_return_val_if_fail (session, NULL);
+	handle = gck_session_get_handle (session);
+	g_object_unref (session);
+
+	objects = g_new (CK_OBJECT_HANDLE, n_items);
+	results = g_new0 (CK_ULONG, n_items);
+	lengths = g_new0 (CK_ULONG, n_items);
+	for (i = 0; i < n_items; i++)
+		objects[i] = gck_object_get_handle (items[i]);
+
+	if (self->mech_type == CKM_AES_CBC_PAD) {
+		n_iv = 16;
+		ivs = g_malloc (n_iv * n_items);
+		gcry_create_nonce (ivs, n_iv * n_items);
+	}
+
+	/* All the items are wrapped in one call, until the output fits */
+	for (;;) {
+		rv = gkd_pkcs11_wrap_secrets (handle, self->mech_type, gck_object_get_handle (self->key),
+		                              objects, n_items, ivs, n_iv, results, lengths,
+		                              value, &n_value);
+		if ((rv == CKR_OK && value != NULL) || (rv != CKR_OK && rv != CKR_BUFFER_TOO_SMALL))
+			break;
+		value = g_realloc (value, MAX (n_value, 1));
+	}
+
+	if (rv != CKR_OK) {
+		g_message ("couldn't wrap item secrets: %s", gck_message_from_rv (rv));
+		dbus_set_error_const (derr, DBUS_ERROR_FAILED, "Couldn't get item secrets");
+		g_free (secrets);
+		secrets = NULL;
+	}
+
+	for (at = value, i = 0; secrets != NULL && i < n_items; i++) {
+		if (results[i] == CKR_OK) {
+			secrets[i] = gkd_secret_secret_new (self, ivs ? ivs + (i * n_iv) : NULL,
+			                                    n_iv, at, lengths[i]);
+			at += lengths[i];
+
+		/* Locked items, or items that went away, are just left out */
+		} else if (results[i] != CKR_USER_NOT_LOGGED_IN &&
+		           results[i] != CKR_OBJECT_HANDLE_INVALID) {
+			g_message ("couldn't wrap item secret: %s", gck_message_from_rv (results[i]));
+			dbus_set_error_const (derr, DBUS_ERROR_FAILED, "Couldn't get item secret");
+			while (i > 0)
+				gkd_secret_secret_free (secrets[--i]);
+			g_free (secrets);
+			secrets = NULL;
+		}
+	}
+
+	g_free (value);
+	g_free (objects);
+	g_free (results);
+	g_free (lengths);
+	g_free (ivs);
+
+	return secrets;
+}
+
 gboolean
 gkd_secret_session_set_item_secret (GkdSecretSession *self, GckObject *item,
                                     GkdSecretSecret *secret, DBusError *derr)
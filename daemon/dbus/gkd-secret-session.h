@@ -40,6 +40,8 @@ struct _GkdSecretSessionClass {
 
 GType               gkd_secret_session_get_type                (void);
 
+void                gkd_secret_session_prepare_keys            (void);
+
 GkdSecretSession*   gkd_secret_session_new                     (GkdSecretService *service,
                                                                 const gchar *caller);
 
@@ -61,6 +63,11 @@ GkdSecretSecret*    gkd_secret_session_get_item_secret         (GkdSecretSession
                                                                 GckObject *item,
                                                                 DBusError *derr);
 
+GkdSecretSecret**   gkd_secret_session_get_item_secrets        (GkdSecretSession *self,
+                                                                GckObject **items,
+                                                                guint n_items,
+                                                                DBusError *derr);
+
 gboolean            gkd_secret_session_set_item_secret         (GkdSecretSession *self,
                                                                 GckObject *item,
                                                                 GkdSecretSecret *secret,
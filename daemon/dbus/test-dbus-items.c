@@ -33,6 +33,7 @@
 #include <gio/gio.h>
 
 #include <fcntl.h>
+#include <string.h>
 
 typedef struct {
 	TestService service;
@@ -185,6 +186,151 @@ test_created_modified_properties (Test *test,
 	g_free (item);
 }
 
+static gchar *
+create_item (Test *test,
+             const gchar *label,
+             const gchar *secret)
+{
+	GVariantBuilder builder;
+	GError *error = NULL;
+	GVariant *retval;
+	GVariant *props;
+	gchar *item;
+	gchar *prompt;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", SECRET_ITEM_INTERFACE ".Label", g_variant_new_string (label));
+	props = g_variant_builder_end (&builder);
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      "/org/freedesktop/secrets/collection/test",
+	                                      SECRET_COLLECTION_INTERFACE,
+	                                      "CreateItem",
+	                                      g_variant_new ("(@a{sv}@(oayays)b)", props,
+	                                                     test_service_build_secret (&test->service, secret), FALSE),
+	                                      G_VARIANT_TYPE ("(oo)"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+	g_assert_no_error (error);
+
+	g_variant_get (retval, "(oo)", &item, &prompt);
+	g_assert_cmpstr (prompt, ==, "/");
+	g_variant_unref (retval);
+	g_free (prompt);
+
+	return item;
+}
+
+static GVariant *
+get_secrets (Test *test,
+             const gchar **paths,
+             gint n_paths)
+{
+	GError *error = NULL;
+	GVariant *retval;
+	GVariant *secrets;
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      SECRET_SERVICE_PATH,
+	                                      SECRET_SERVICE_INTERFACE,
+	                                      "GetSecrets",
+	                                      g_variant_new ("(@aoo)",
+	                                                     g_variant_new_objv (paths, n_paths),
+	                                                     test->service.session),
+	                                      G_VARIANT_TYPE ("(a{o(oayays)})"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+	g_assert_no_error (error);
+
+	g_variant_get (retval, "(@a{o(oayays)})", &secrets);
+	g_variant_unref (retval);
+
+	return secrets;
+}
+
+static void
+test_get_secrets (Test *test,
+                  gconstpointer unused)
+{
+	const gchar *paths[4];
+	gchar *items[3];
+	GVariant *secrets;
+	GVariant *secret;
+	GVariant *value;
+	gchar *name;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (items); i++) {
+		name = g_strdup_printf ("secret %u", i);
+		items[i] = create_item (test, name, name);
+		paths[i] = items[i];
+		g_free (name);
+	}
+
+	/* Items that don't exist are left out */
+	paths[3] = "/org/freedesktop/secrets/collection/test/nonexistant";
+
+	secrets = get_secrets (test, paths, G_N_ELEMENTS (paths));
+	g_assert_cmpuint (g_variant_n_children (secrets), ==, G_N_ELEMENTS (items));
+
+	for (i = 0; i < G_N_ELEMENTS (items); i++) {
+		secret = g_variant_lookup_value (secrets, items[i], G_VARIANT_TYPE ("(oayays)"));
+		g_assert (secret != NULL);
+
+		value = g_variant_get_child_value (secret, 2);
+		name = g_strdup_printf ("secret %u", i);
+		egg_assert_cmpmem (g_variant_get_data (value), g_variant_get_size (value), ==,
+		                   name, strlen (name));
+		g_variant_unref (value);
+		g_variant_unref (secret);
+		g_free (name);
+		g_free (items[i]);
+	}
+
+	g_variant_unref (secrets);
+}
+
+static void
+test_get_secrets_perf (Test *test,
+                       gconstpointer unused)
+{
+	const guint counts[] = { 10, 100, 500 };
+	const gchar **paths;
+	GVariant *secrets;
+	gchar **items;
+	gchar *name;
+	gdouble elapsed;
+	guint n_items;
+	guint i, j;
+
+	if (!g_test_perf ())
+		return;
+
+	n_items = counts[G_N_ELEMENTS (counts) - 1];
+	items = g_new0 (gchar *, n_items + 1);
+	for (i = 0; i < n_items; i++) {
+		name = g_strdup_printf ("secret %u", i);
+		items[i] = create_item (test, name, name);
+		g_free (name);
+	}
+
+	paths = (const gchar **)items;
+	for (i = 0; i < G_N_ELEMENTS (counts); i++) {
+		g_test_timer_start ();
+		for (j = 0; j < 10; j++) {
+			secrets = get_secrets (test, paths, counts[i]);
+			g_assert_cmpuint (g_variant_n_children (secrets), ==, counts[i]);
+			g_variant_unref (secrets);
+		}
+		elapsed = g_test_timer_elapsed () / 10;
+
+		g_test_minimized_result (elapsed, "GetSecrets of %u items: %.2f msec",
+		                         counts[i], elapsed * 1000);
+	}
+
+	g_strfreev (items);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -195,6 +341,10 @@ main (int argc, char **argv)
 
 	g_test_add ("/secret-item/created-modified-properties", Test, NULL,
 	            setup, test_created_modified_properties, teardown);
+	g_test_add ("/secret-item/get-secrets", Test, NULL,
+	            setup, test_get_secrets, teardown);
+	g_test_add ("/secret-item/get-secrets-perf", Test, NULL,
+	            setup, test_get_secrets_perf, teardown);
 
 	return egg_tests_run_with_loop ();
 }
@@ -118,6 +118,123 @@ test_collection_search_items_combined (Test *test,
 	g_variant_unref (items);
 }
 
+static GVariant *
+search_collection_items (Test *test,
+                         GVariant *attrs)
+{
+	GError *error = NULL;
+	GVariant *retval;
+	GVariant *items;
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      "/org/freedesktop/secrets/collection/test",
+	                                      SECRET_COLLECTION_INTERFACE,
+	                                      "SearchItems",
+	                                      g_variant_new ("(@a{ss})", attrs),
+	                                      G_VARIANT_TYPE ("(ao)"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START,
+	                                      -1, NULL, &error);
+	g_assert_no_error (error);
+
+	g_variant_get (retval, "(@ao)", &items);
+	g_variant_unref (retval);
+
+	return items;
+}
+
+static void
+test_collection_search_items_repeated (Test *test,
+                                       gconstpointer unused)
+{
+	GVariantBuilder builder;
+	GError *error = NULL;
+	GVariant *retval;
+	GVariant *attrs;
+	GVariant *props;
+	GVariant *items;
+	gchar *item;
+	gchar *prompt;
+
+	/* Unlock the test collection */
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      SECRET_SERVICE_PATH,
+	                                      INTERNAL_SERVICE_INTERFACE,
+	                                      "UnlockWithMasterPassword",
+	                                      g_variant_new ("(o@(oayays))",
+	                                                     "/org/freedesktop/secrets/collection/test",
+	                                                     test_service_build_secret (&test->service, "booo")),
+	                                      G_VARIANT_TYPE ("()"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START,
+	                                      -1, NULL, &error);
+	g_assert_no_error (error);
+	g_variant_unref (retval);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
+	g_variant_builder_add (&builder, "{ss}", "one", "1");
+	g_variant_builder_add (&builder, "{ss}", "two", "2");
+	attrs = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+	/* Nothing yet, and the same again */
+	items = search_collection_items (test, attrs);
+	g_assert_cmpuint (g_variant_n_children (items), ==, 0);
+	g_variant_unref (items);
+	items = search_collection_items (test, attrs);
+	g_assert_cmpuint (g_variant_n_children (items), ==, 0);
+	g_variant_unref (items);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", SECRET_ITEM_INTERFACE ".Label", g_variant_new_string ("The Label"));
+	g_variant_builder_add (&builder, "{sv}", SECRET_ITEM_INTERFACE ".Attributes", attrs);
+	props = g_variant_builder_end (&builder);
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      "/org/freedesktop/secrets/collection/test",
+	                                      SECRET_COLLECTION_INTERFACE,
+	                                      "CreateItem",
+	                                      g_variant_new ("(@a{sv}@(oayays)b)", props,
+	                                                     test_service_build_secret (&test->service, "the secret"), TRUE),
+	                                      G_VARIANT_TYPE ("(oo)"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+	g_assert_no_error (error);
+
+	g_variant_get (retval, "(oo)", &item, &prompt);
+	g_assert_cmpstr (prompt, ==, "/");
+	g_variant_unref (retval);
+	g_free (prompt);
+
+	/* The repeated search sees the new item */
+	items = search_collection_items (test, attrs);
+	g_assert_cmpuint (g_variant_n_children (items), ==, 1);
+	g_variant_unref (items);
+
+	/* As does one with the attributes in a different order */
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
+	g_variant_builder_add (&builder, "{ss}", "two", "2");
+	g_variant_builder_add (&builder, "{ss}", "one", "1");
+	items = search_collection_items (test, g_variant_builder_end (&builder));
+	g_assert_cmpuint (g_variant_n_children (items), ==, 1);
+	g_variant_unref (items);
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      item, SECRET_ITEM_INTERFACE, "Delete",
+	                                      g_variant_new ("()"), G_VARIANT_TYPE ("(o)"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+	g_assert_no_error (error);
+	g_variant_unref (retval);
+
+	/* And that it went away */
+	items = search_collection_items (test, attrs);
+	g_assert_cmpuint (g_variant_n_children (items), ==, 0);
+	g_variant_unref (items);
+
+	g_variant_unref (attrs);
+	g_free (item);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -130,6 +247,8 @@ main (int argc, char **argv)
 	            setup, test_service_search_items_unlocked_separate, teardown);
 	g_test_add ("/secret-search/collection-search-items-combined", Test, NULL,
 	            setup, test_collection_search_items_combined, teardown);
+	g_test_add ("/secret-search/collection-search-items-repeated", Test, NULL,
+	            setup, test_collection_search_items_repeated, teardown);
 
 	return egg_tests_run_with_loop ();
 }
@@ -0,0 +1,421 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* test-dbus-session.c: Test opening secret service sessions
+
+   Copyright (C) 2026 agent <agent@local>
+
+   The Gnome Keyring Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Keyring Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   <http://www.gnu.org/licenses/>.
+
+   Author: agent <agent@local>
+*/
+
+#include "config.h"
+
+#include "gkd-secret-types.h"
+
+#include "test-service.h"
+
+#include "egg/egg-hkdf.h"
+#include "egg/egg-libgcrypt.h"
+#include "egg/egg-secure-memory.h"
+#include "egg/egg-testing.h"
+
+#include <gcrypt.h>
+
+#include <string.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+#define AES_ALGORITHM "dh-ietf1024-sha256-aes128-cbc-pkcs7"
+#define X25519_ALGORITHM "x25519-hkdf-sha256-aes128-cbc-pkcs7"
+
+#define N_BURST 100
+
+typedef struct {
+	TestService service;
+} Test;
+
+typedef struct {
+	Test *test;
+	gint64 started;
+	gint64 latency_total;
+	gint64 latency_max;
+	guint outstanding;
+} Burst;
+
+static void
+setup (Test *test,
+       gconstpointer unused)
+{
+	test_service_setup (&test->service);
+}
+
+static void
+teardown (Test *test,
+          gconstpointer unused)
+{
+	test_service_teardown (&test->service);
+}
+
+static GVariant *
+build_aes_open (void)
+{
+	/*
+	 * The generator of the group is a valid public value, and we
+	 * never need to decrypt anything with these sessions.
+	 */
+	const guchar peer[] = { 0x02 };
+
+	return g_variant_new ("(s@v)", AES_ALGORITHM,
+	                      g_variant_new_variant (g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+	                                                                        peer, sizeof (peer), 1)));
+}
+
+static GVariant *
+build_x25519_open (gsize n_peer)
+{
+	/* The public key of Bob from RFC 7748 section 6.1 */
+	const guchar peer[] = {
+		0xde, 0x9e, 0xdb, 0x7d, 0x7b, 0x7d, 0xc1, 0xb4, 0xd3, 0x5b, 0x61, 0xc2, 0xec, 0xe4, 0x35, 0x37,
+		0x3f, 0x83, 0x43, 0xc8, 0x5b, 0x78, 0x67, 0x4d, 0xad, 0xfc, 0x7e, 0x14, 0x6f, 0x88, 0x2b, 0x4f,
+	};
+
+	g_assert_cmpuint (n_peer, <=, sizeof (peer));
+	return g_variant_new ("(s@v)", X25519_ALGORITHM,
+	                      g_variant_new_variant (g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+	                                                                        peer, n_peer, 1)));
+}
+
+static GVariant *
+build_open (const gchar *algorithm)
+{
+	if (g_str_equal (algorithm, X25519_ALGORITHM))
+		return build_x25519_open (32);
+	else
+		return build_aes_open ();
+}
+
+static GBytes *
+open_session_full (Test *test,
+                   const gchar *algorithm,
+                   gchar **session)
+{
+	GError *error = NULL;
+	GVariant *retval;
+	GVariant *output;
+	GVariant *value;
+	GBytes *bytes;
+	gchar *path;
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      SECRET_SERVICE_PATH,
+	                                      SECRET_SERVICE_INTERFACE,
+	                                      "OpenSession", build_open (algorithm),
+	                                      G_VARIANT_TYPE ("(vo)"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START,
+	                                      -1, NULL, &error);
+	g_assert_no_error (error);
+
+	g_variant_get (retval, "(@vo)", &output, &path);
+	g_assert (g_str_has_prefix (path, SECRET_SESSION_PREFIX));
+
+	value = g_variant_get_variant (output);
+	g_assert (g_variant_is_of_type (value, G_VARIANT_TYPE ("ay")));
+	bytes = g_variant_get_data_as_bytes (value);
+
+	g_variant_unref (value);
+	g_variant_unref (output);
+	g_variant_unref (retval);
+
+	if (session)
+		*session = path;
+	else
+		g_free (path);
+
+	return bytes;
+}
+
+static GBytes *
+open_session (Test *test,
+              const gchar *algorithm)
+{
+	return open_session_full (test, algorithm, NULL);
+}
+
+static void
+test_open_aes (Test *test,
+               gconstpointer unused)
+{
+	GBytes *first;
+	GBytes *second;
+
+	first = open_session (test, AES_ALGORITHM);
+	second = open_session (test, AES_ALGORITHM);
+
+	/* A 1024 bit public value, and never the same key pair twice */
+	g_assert_cmpuint (g_bytes_get_size (first), >, 64);
+	g_assert_cmpuint (g_bytes_get_size (first), <=, 128);
+	g_assert (!g_bytes_equal (first, second));
+
+	g_bytes_unref (first);
+	g_bytes_unref (second);
+}
+
+static void
+test_open_x25519 (Test *test,
+                  gconstpointer unused)
+{
+	GBytes *first;
+	GBytes *second;
+
+	first = open_session (test, X25519_ALGORITHM);
+	second = open_session (test, X25519_ALGORITHM);
+
+	g_assert_cmpuint (g_bytes_get_size (first), ==, 32);
+	g_assert_cmpuint (g_bytes_get_size (second), ==, 32);
+	g_assert (!g_bytes_equal (first, second));
+
+	g_bytes_unref (first);
+	g_bytes_unref (second);
+}
+
+static void
+test_open_x25519_bad_length (Test *test,
+                             gconstpointer unused)
+{
+	GError *error = NULL;
+	GVariant *retval;
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      SECRET_SERVICE_PATH,
+	                                      SECRET_SERVICE_INTERFACE,
+	                                      "OpenSession", build_x25519_open (31),
+	                                      G_VARIANT_TYPE ("(vo)"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START,
+	                                      -1, NULL, &error);
+	g_assert_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+	g_assert (retval == NULL);
+	g_clear_error (&error);
+}
+
+static gchar *
+create_item (Test *test,
+             const gchar *secret)
+{
+	GVariantBuilder builder;
+	GError *error = NULL;
+	GVariant *retval;
+	gchar *item;
+	gchar *prompt;
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      SECRET_SERVICE_PATH,
+	                                      INTERNAL_SERVICE_INTERFACE,
+	                                      "UnlockWithMasterPassword",
+	                                      g_variant_new ("(o@(oayays))",
+	                                                     "/org/freedesktop/secrets/collection/test",
+	                                                     test_service_build_secret (&test->service, "booo")),
+	                                      G_VARIANT_TYPE ("()"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START,
+	                                      -1, NULL, &error);
+	g_assert_no_error (error);
+	g_variant_unref (retval);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", SECRET_ITEM_INTERFACE ".Label",
+	                       g_variant_new_string ("Session Item"));
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      "/org/freedesktop/secrets/collection/test",
+	                                      SECRET_COLLECTION_INTERFACE,
+	                                      "CreateItem",
+	                                      g_variant_new ("(a{sv}@(oayays)b)", &builder,
+	                                                     test_service_build_secret (&test->service, secret), TRUE),
+	                                      G_VARIANT_TYPE ("(oo)"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+	g_assert_no_error (error);
+
+	g_variant_get (retval, "(oo)", &item, &prompt);
+	g_assert_cmpstr (prompt, ==, "/");
+	g_variant_unref (retval);
+	g_free (prompt);
+
+	return item;
+}
+
+static void
+test_x25519_get_secret (Test *test,
+                        gconstpointer unused)
+{
+	/* The private key of Bob from RFC 7748 section 6.1, see build_x25519_open() */
+	const guchar priv[] = {
+		0x5d, 0xab, 0x08, 0x7e, 0x62, 0x4a, 0x8a, 0x4b, 0x79, 0xe1, 0x7f, 0x8b, 0x83, 0x80, 0x0e, 0xe6,
+		0x6f, 0x3b, 0xb1, 0x29, 0x26, 0x18, 0xb6, 0xfd, 0x1c, 0x2f, 0x8b, 0x27, 0xff, 0x88, 0xe0, 0xeb,
+	};
+
+	guchar shared[32];
+	guchar key[16];
+	GError *error = NULL;
+	GVariant *retval;
+	GVariant *params;
+	GVariant *value;
+	gcry_cipher_hd_t cih;
+	gcry_error_t gcry;
+	GBytes *peer;
+	gchar *session;
+	gchar *item;
+	guchar *plain;
+	gsize n_plain;
+	guchar pad;
+
+	item = create_item (test, "the secret");
+	peer = open_session_full (test, X25519_ALGORITHM, &session);
+	g_assert_cmpuint (g_bytes_get_size (peer), ==, 32);
+
+	/* The client side of the key agreement */
+	gcry = gcry_ecc_mul_point (GCRY_ECC_CURVE25519, shared, priv,
+	                           g_bytes_get_data (peer, NULL));
+	g_assert_cmpint (gcry, ==, 0);
+	if (!egg_hkdf_perform ("sha256", shared, sizeof (shared), NULL, 0,
+	                       NULL, 0, key, sizeof (key)))
+		g_assert_not_reached ();
+
+	retval = g_dbus_connection_call_sync (test->service.connection,
+	                                      test->service.bus_name,
+	                                      item, SECRET_ITEM_INTERFACE,
+	                                      "GetSecret", g_variant_new ("(o)", session),
+	                                      G_VARIANT_TYPE ("((oayays))"),
+	                                      G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+	g_assert_no_error (error);
+
+	g_variant_get (retval, "((o@ay@ays))", NULL, &params, &value, NULL);
+	g_assert_cmpuint (g_variant_get_size (params), ==, 16);
+	g_assert_cmpuint (g_variant_get_size (value) % 16, ==, 0);
+	g_assert_cmpuint (g_variant_get_size (value), >, 0);
+
+	/* The value is encrypted with AES-128-CBC, the parameter is the IV */
+	n_plain = g_variant_get_size (value);
+	plain = g_memdup (g_variant_get_data (value), n_plain);
+	gcry = gcry_cipher_open (&cih, GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_CBC, 0);
+	g_assert_cmpint (gcry, ==, 0);
+	gcry = gcry_cipher_setkey (cih, key, sizeof (key));
+	g_assert_cmpint (gcry, ==, 0);
+	gcry = gcry_cipher_setiv (cih, g_variant_get_data (params), 16);
+	g_assert_cmpint (gcry, ==, 0);
+	gcry = gcry_cipher_decrypt (cih, plain, n_plain, NULL, 0);
+	g_assert_cmpint (gcry, ==, 0);
+	gcry_cipher_close (cih);
+
+	/* And then PKCS#7 padded */
+	pad = plain[n_plain - 1];
+	g_assert_cmpuint (pad, >=, 1);
+	g_assert_cmpuint (pad, <=, 16);
+	egg_assert_cmpmem (plain, n_plain - pad, ==, "the secret", 10);
+
+	g_variant_unref (params);
+	g_variant_unref (value);
+	g_variant_unref (retval);
+	g_bytes_unref (peer);
+	g_free (session);
+	g_free (item);
+	g_free (plain);
+}
+
+static void
+on_burst_opened (GObject *source,
+                 GAsyncResult *result,
+                 gpointer user_data)
+{
+	Burst *burst = user_data;
+	GError *error = NULL;
+	GVariant *retval;
+	gint64 latency;
+
+	retval = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+	g_assert_no_error (error);
+	g_variant_unref (retval);
+
+	latency = g_get_monotonic_time () - burst->started;
+	burst->latency_total += latency;
+	burst->latency_max = MAX (burst->latency_max, latency);
+
+	g_assert_cmpuint (burst->outstanding, >, 0);
+	if (--burst->outstanding == 0)
+		egg_test_wait_stop ();
+}
+
+static void
+test_open_burst (Test *test,
+                 gconstpointer algorithm)
+{
+	Burst burst = { test, 0, };
+	gint64 total;
+	guint i;
+
+	if (!g_test_perf ())
+		return;
+
+	/* Like lots of applications starting up at login */
+	burst.started = g_get_monotonic_time ();
+	for (i = 0; i < N_BURST; i++) {
+		burst.outstanding++;
+		g_dbus_connection_call (test->service.connection,
+		                        test->service.bus_name,
+		                        SECRET_SERVICE_PATH,
+		                        SECRET_SERVICE_INTERFACE,
+		                        "OpenSession", build_open (algorithm),
+		                        G_VARIANT_TYPE ("(vo)"),
+		                        G_DBUS_CALL_FLAGS_NO_AUTO_START,
+		                        -1, NULL, on_burst_opened, &burst);
+	}
+
+	egg_test_wait ();
+	g_assert_cmpuint (burst.outstanding, ==, 0);
+	total = g_get_monotonic_time () - burst.started;
+
+	g_test_message ("%d %s sessions: mean latency %.2f ms, total %.2f ms",
+	                N_BURST, (const gchar *)algorithm, (burst.latency_total / (gdouble)N_BURST) / 1000.0,
+	                total / 1000.0);
+	g_test_minimized_result (burst.latency_max / 1000.0,
+	                         "max latency: %.2f ms", burst.latency_max / 1000.0);
+}
+
+int
+main (int argc, char **argv)
+{
+#if !GLIB_CHECK_VERSION(2,35,0)
+	g_type_init ();
+#endif
+	g_test_init (&argc, &argv, NULL);
+	egg_libgcrypt_initialize ();
+
+	g_test_add ("/secret-session/open_aes", Test, NULL,
+	            setup, test_open_aes, teardown);
+	g_test_add ("/secret-session/open_x25519", Test, NULL,
+	            setup, test_open_x25519, teardown);
+	g_test_add ("/secret-session/open_x25519_bad_length", Test, NULL,
+	            setup, test_open_x25519_bad_length, teardown);
+	g_test_add ("/secret-session/x25519_get_secret", Test, NULL,
+	            setup, test_x25519_get_secret, teardown);
+	g_test_add ("/secret-session/open_burst", Test, AES_ALGORITHM,
+	            setup, test_open_burst, teardown);
+	g_test_add ("/secret-session/open_burst_x25519", Test, X25519_ALGORITHM,
+	            setup, test_open_burst, teardown);
+
+	return egg_tests_run_with_loop ();
+}
@@ -217,10 +217,27 @@ static gboolean do_warning = TRUE;
 
 G_LOCK_DEFINE_STATIC (memory_mutex);
 
+/* Time spent waiting for the lock above, protected by it */
+static guint64 memory_lock_waits = 0;
+static gint64 memory_lock_wait_time = 0;
+
+/* Allocations that couldn't be satisfied by secure memory */
+G_LOCK_DEFINE_STATIC (memory_fallback);
+static guint64 memory_fallbacks = 0;
+static guint64 memory_fallback_bytes = 0;
+
 static void
 egg_memory_lock (void)
 {
+	gint64 start;
+
+	if (G_TRYLOCK (memory_mutex))
+		return;
+
+	start = g_get_monotonic_time ();
 	G_LOCK (memory_mutex);
+	memory_lock_waits++;
+	memory_lock_wait_time += g_get_monotonic_time () - start;
 }
 
 static void
@@ -242,6 +259,11 @@ egg_memory_fallback (void *p, size_t sz)
 
 	/* We were asked to allocate */
 	if (!p) {
+		G_LOCK (memory_fallback);
+		memory_fallbacks++;
+		memory_fallback_bytes += sz;
+		G_UNLOCK (memory_fallback);
+
 		if (do_warning) {
 			g_message (WARNING);
 			do_warning = FALSE;
@@ -340,22 +362,25 @@ prepare_logging ()
 	g_set_printerr_handler (printerr_handler);
 }
 
-#ifdef WITH_DEBUG
-
-static void
-dump_diagnostics (void)
+gchar *
+gkd_main_get_memory_diagnostics (void)
 {
 	egg_secure_rec *records;
 	egg_secure_rec *rec;
+	egg_secure_stats stats;
 	unsigned int count, i;
 	GHashTable *table;
 	GHashTableIter iter;
+	GString *result;
 	gsize request = 0;
 	gsize block = 0;
+	guint64 waits, fallbacks, fallback_bytes;
+	gint64 wait_time;
 
-	g_printerr ("------------------- Secure Memory --------------------\n");
-	g_printerr (" Tag                          Used            Space\n");
-	g_printerr ("------------------------------------------------------\n");
+	result = g_string_new (NULL);
+	g_string_append (result, "------------------- Secure Memory --------------------\n");
+	g_string_append (result, " Tag                          Used            Space\n");
+	g_string_append (result, "------------------------------------------------------\n");
 
 	records = egg_secure_records (&count);
 	table = g_hash_table_new (g_str_hash, g_str_equal);
@@ -375,19 +400,61 @@ dump_diagnostics (void)
 
 	g_hash_table_iter_init (&iter, table);
 	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&rec))
-		g_printerr (" %-20s %12lu %16lu\n", rec->tag,
-		            (unsigned long)rec->request_length,
-		            (unsigned long)rec->block_length);
+		g_string_append_printf (result, " %-20s %12lu %16lu\n", rec->tag,
+		                        (unsigned long)rec->request_length,
+		                        (unsigned long)rec->block_length);
 
 	if (count > 0)
-		g_printerr ("------------------------------------------------------\n");
+		g_string_append (result, "------------------------------------------------------\n");
 
-	g_printerr (" %-20s %12lu %16lu\n", "Total",
-	            (unsigned long)request, (unsigned long)block);
-	g_printerr ("------------------------------------------------------\n");
+	g_string_append_printf (result, " %-20s %12lu %16lu\n", "Total",
+	                        (unsigned long)request, (unsigned long)block);
+	g_string_append (result, "------------------------------------------------------\n");
 
 	g_hash_table_destroy (table);
 	free (records);
+
+	egg_secure_get_stats (&stats);
+
+	egg_memory_lock ();
+	waits = memory_lock_waits;
+	wait_time = memory_lock_wait_time;
+	egg_memory_unlock ();
+
+	G_LOCK (memory_fallback);
+	fallbacks = memory_fallbacks;
+	fallback_bytes = memory_fallback_bytes;
+	G_UNLOCK (memory_fallback);
+
+	g_string_append_printf (result, " %-20s %12lu %16lu\n", "Locked (peak)",
+	                        (unsigned long)stats.locked_length, (unsigned long)stats.locked_peak);
+	g_string_append_printf (result, " %-20s %12lu %16lu\n", "Requested (peak)",
+	                        (unsigned long)stats.request_length, (unsigned long)stats.request_peak);
+	g_string_append_printf (result, " %-20s %12lu\n", "Blocks",
+	                        (unsigned long)stats.n_blocks);
+	g_string_append_printf (result, " %-20s %12lu %16lu\n", "Unused cells",
+	                        (unsigned long)stats.n_unused, (unsigned long)stats.unused_length);
+	g_string_append_printf (result, " %-20s %12s %16lu\n", "Largest unused", "",
+	                        (unsigned long)stats.largest_unused);
+	g_string_append_printf (result, " %-20s %12" G_GUINT64_FORMAT " %16" G_GUINT64_FORMAT "\n",
+	                        "Fallbacks", fallbacks, fallback_bytes);
+	g_string_append_printf (result, " %-20s %12" G_GUINT64_FORMAT " %13" G_GINT64_FORMAT " us\n",
+	                        "Lock waits", waits, wait_time);
+	g_string_append (result, "------------------------------------------------------\n");
+
+	return g_string_free (result, FALSE);
+}
+
+#ifdef WITH_DEBUG
+
+static void
+dump_diagnostics (void)
+{
+	gchar *diagnostics;
+
+	diagnostics = gkd_main_get_memory_diagnostics ();
+	g_printerr ("%s", diagnostics);
+	g_free (diagnostics);
 }
 
 #endif /* WITH_DEBUG */
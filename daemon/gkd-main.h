@@ -27,4 +27,6 @@ void           gkd_main_quit                    (void);
 
 void           gkd_main_complete_initialization (const gchar *components);
 
+gchar *        gkd_main_get_memory_diagnostics  (void);
+
 #endif /* GKD_MAIN_H_ */
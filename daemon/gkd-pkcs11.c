@@ -211,3 +211,30 @@ gkd_pkcs11_get_base_functions (void)
 {
 	return pkcs11_base;
 }
+
+CK_RV
+gkd_pkcs11_wrap_secrets (CK_SESSION_HANDLE session,
+                         CK_MECHANISM_TYPE mechanism,
+                         CK_OBJECT_HANDLE wrapping_key,
+                         CK_OBJECT_HANDLE_PTR objects,
+                         CK_ULONG n_objects,
+                         CK_BYTE_PTR ivs,
+                         CK_ULONG n_iv,
+                         CK_ULONG_PTR results,
+                         CK_ULONG_PTR lengths,
+                         CK_BYTE_PTR output,
+                         CK_ULONG_PTR n_output)
+{
+	CK_FUNCTION_LIST_PTR funcs;
+	CK_RV rv;
+
+	/* Go straight to the secret store, below the wrap layer */
+	rv = gkm_wrap_layer_map_session (session, &funcs, &session);
+	if (rv != CKR_OK)
+		return rv;
+	if (funcs != gkm_secret_store_get_functions ())
+		return CKR_FUNCTION_NOT_SUPPORTED;
+
+	return gkm_secret_store_wrap_batch (session, mechanism, wrapping_key, objects, n_objects,
+	                                    ivs, n_iv, results, lengths, output, n_output);
+}
@@ -35,4 +35,16 @@ CK_FUNCTION_LIST_PTR   gkd_pkcs11_get_functions        (void);
 
 CK_FUNCTION_LIST_PTR   gkd_pkcs11_get_base_functions   (void);
 
+CK_RV                  gkd_pkcs11_wrap_secrets         (CK_SESSION_HANDLE session,
+                                                        CK_MECHANISM_TYPE mechanism,
+                                                        CK_OBJECT_HANDLE wrapping_key,
+                                                        CK_OBJECT_HANDLE_PTR objects,
+                                                        CK_ULONG n_objects,
+                                                        CK_BYTE_PTR ivs,
+                                                        CK_ULONG n_iv,
+                                                        CK_ULONG_PTR results,
+                                                        CK_ULONG_PTR lengths,
+                                                        CK_BYTE_PTR output,
+                                                        CK_ULONG_PTR n_output);
+
 #endif /* GKD_PKCS11_H_ */
@@ -539,13 +539,13 @@ gkd_gpg_agent_ops_getpass (GkdGpgAgentCall *call, gchar *args)
 	if (is_null_argument (description))
 		description = NULL;
 
-	session = gkd_gpg_agent_checkout_main_session ();
+	session = gkd_gpg_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	password = do_get_password (session, id, errmsg, prompt, description,
 	                            flags & GKD_GPG_AGENT_REPEAT);
 
-	gkd_gpg_agent_checkin_main_session (session);
+	gkd_gpg_agent_checkin_session (session);
 
 	if (password == NULL) {
 		gkd_gpg_agent_send_reply (call, FALSE, "111 cancelled");
@@ -583,13 +583,13 @@ gkd_gpg_agent_ops_clrpass (GkdGpgAgentCall *call, gchar *args)
 		g_warning ("received invalid clear pass request: %s", args);
 	}
 
-	session = gkd_gpg_agent_checkout_main_session ();
+	session = gkd_gpg_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	/* Ignore the result, always return success */
 	do_clear_password (session, id);
 
-	gkd_gpg_agent_checkin_main_session (session);
+	gkd_gpg_agent_checkin_session (session);
 
 	gkd_gpg_agent_send_reply (call, TRUE, NULL);
 	return TRUE;
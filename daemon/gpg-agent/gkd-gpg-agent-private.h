@@ -73,9 +73,9 @@ typedef struct _GkdGpgAgentCall {
 
 gboolean              gkd_gpg_agent_initialize_with_module          (GckModule *module);
 
-GckSession*          gkd_gpg_agent_checkout_main_session           (void);
+GckSession*          gkd_gpg_agent_checkout_session                (void);
 
-void                  gkd_gpg_agent_checkin_main_session            (GckSession* session);
+void                  gkd_gpg_agent_checkin_session                 (GckSession* session);
 
 gboolean              gkd_gpg_agent_send_reply                      (GkdGpgAgentCall *call,
                                                                      gboolean ok,
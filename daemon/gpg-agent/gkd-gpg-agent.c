@@ -220,45 +220,119 @@ run_client_thread (gpointer data)
  * SESSION MANAGEMENT
  */
 
-/* The main PKCS#11 session that owns objects, and the mutex/cond for waiting on it */
-static GckSession *pkcs11_main_session = NULL;
-static gboolean pkcs11_main_checked = FALSE;
-static GMutex *pkcs11_main_mutex = NULL;
-static GCond *pkcs11_main_cond = NULL;
+/* Default and upper bound on the number of sessions in the pool */
+#define DEFAULT_SESSIONS 4
+#define MAX_SESSIONS 32
+
+/*
+ * A pool of logged in PKCS#11 sessions, so that a client waiting on a password
+ * prompt doesn't hold up everyone else. More sessions are opened on demand,
+ * up to pkcs11_pool_max, and are only closed on uninitialize.
+ */
+static GckSlot *pkcs11_pool_slot = NULL;
+static GQueue pkcs11_pool_idle = G_QUEUE_INIT;
+static guint pkcs11_pool_open = 0;
+static guint pkcs11_pool_max = DEFAULT_SESSIONS;
+static GMutex pkcs11_pool_mutex;
+static GCond pkcs11_pool_cond;
+
+/* Counters for time spent waiting on checkout, in microseconds */
+static guint64 pkcs11_pool_checkouts = 0;
+static guint64 pkcs11_pool_waits = 0;
+static gint64 pkcs11_pool_wait_total = 0;
+static gint64 pkcs11_pool_wait_max = 0;
+
+static guint
+session_pool_size (void)
+{
+	const gchar *env;
+	gint64 size;
+
+	env = g_getenv ("GNOME_KEYRING_AGENT_SESSIONS");
+	if (env == NULL || !env[0])
+		return DEFAULT_SESSIONS;
+
+	size = g_ascii_strtoll (env, NULL, 10);
+	return CLAMP (size, 1, MAX_SESSIONS);
+}
+
+static GckSession*
+session_pool_open (GckSlot *slot)
+{
+	GckSession *session;
+	GError *error = NULL;
+
+	session = gck_slot_open_session (slot, GCK_SESSION_READ_WRITE | GCK_SESSION_AUTHENTICATE,
+	                                 NULL, &error);
+	if (!session) {
+		g_warning ("couldn't create pkcs#11 session: %s", egg_error_message (error));
+		g_clear_error (&error);
+	}
+
+	return session;
+}
 
 GckSession*
-gkd_gpg_agent_checkout_main_session (void)
+gkd_gpg_agent_checkout_session (void)
 {
-	GckSession *result;
+	GckSession *result = NULL;
+	gboolean waited = FALSE;
+	gint64 start = 0;
+	gint64 waiting;
+
+	g_mutex_lock (&pkcs11_pool_mutex);
+
+	g_assert (GCK_IS_SLOT (pkcs11_pool_slot));
+
+	while ((result = g_queue_pop_head (&pkcs11_pool_idle)) == NULL) {
+
+		/* Room to grow the pool, open one without holding the lock */
+		if (pkcs11_pool_open < pkcs11_pool_max) {
+			pkcs11_pool_open++;
+			g_mutex_unlock (&pkcs11_pool_mutex);
+			result = session_pool_open (pkcs11_pool_slot);
+			g_mutex_lock (&pkcs11_pool_mutex);
+			if (result)
+				break;
+
+			/* Don't try again, make do with what we have */
+			pkcs11_pool_open--;
+			pkcs11_pool_max = pkcs11_pool_open;
+			continue;
+		}
 
-	g_mutex_lock (pkcs11_main_mutex);
+		if (!waited) {
+			start = g_get_monotonic_time ();
+			waited = TRUE;
+		}
+		g_cond_wait (&pkcs11_pool_cond, &pkcs11_pool_mutex);
+	}
 
-		g_assert (GCK_IS_SESSION (pkcs11_main_session));
-		while (pkcs11_main_checked)
-			g_cond_wait (pkcs11_main_cond, pkcs11_main_mutex);
-		pkcs11_main_checked = TRUE;
-		result = g_object_ref (pkcs11_main_session);
+	pkcs11_pool_checkouts++;
+	if (waited) {
+		waiting = g_get_monotonic_time () - start;
+		pkcs11_pool_waits++;
+		pkcs11_pool_wait_total += waiting;
+		pkcs11_pool_wait_max = MAX (pkcs11_pool_wait_max, waiting);
+	}
 
-	g_mutex_unlock (pkcs11_main_mutex);
+	g_mutex_unlock (&pkcs11_pool_mutex);
 
 	return result;
 }
 
 void
-gkd_gpg_agent_checkin_main_session (GckSession *session)
+gkd_gpg_agent_checkin_session (GckSession *session)
 {
 	g_assert (GCK_IS_SESSION (session));
 
-	g_mutex_lock (pkcs11_main_mutex);
-
-		g_assert (session == pkcs11_main_session);
-		g_assert (pkcs11_main_checked);
+	g_mutex_lock (&pkcs11_pool_mutex);
 
-		g_object_unref (session);
-		pkcs11_main_checked = FALSE;
-		g_cond_signal (pkcs11_main_cond);
+		g_assert (g_queue_get_length (&pkcs11_pool_idle) < pkcs11_pool_open);
+		g_queue_push_head (&pkcs11_pool_idle, session);
+		g_cond_signal (&pkcs11_pool_cond);
 
-	g_mutex_unlock (pkcs11_main_mutex);
+	g_mutex_unlock (&pkcs11_pool_mutex);
 }
 
 /* --------------------------------------------------------------------------------------
@@ -373,22 +447,23 @@ gkd_gpg_agent_shutdown (void)
 void
 gkd_gpg_agent_uninitialize (void)
 {
-	gboolean ret;
+	GckSession *session;
+
+	g_mutex_lock (&pkcs11_pool_mutex);
 
-	g_assert (pkcs11_main_mutex);
-	ret = g_mutex_trylock (pkcs11_main_mutex);
-	g_assert (ret);
+		g_assert (GCK_IS_SLOT (pkcs11_pool_slot));
+		g_assert (g_queue_get_length (&pkcs11_pool_idle) == pkcs11_pool_open);
+		while ((session = g_queue_pop_head (&pkcs11_pool_idle)) != NULL)
+			g_object_unref (session);
+		pkcs11_pool_open = 0;
+		g_object_unref (pkcs11_pool_slot);
+		pkcs11_pool_slot = NULL;
 
-		g_assert (GCK_IS_SESSION (pkcs11_main_session));
-		g_assert (!pkcs11_main_checked);
-		g_object_unref (pkcs11_main_session);
-		pkcs11_main_session = NULL;
+		g_debug ("gpg agent session checkouts: %" G_GUINT64_FORMAT ", waited: %" G_GUINT64_FORMAT
+		         ", total wait: %" G_GINT64_FORMAT " us, longest wait: %" G_GINT64_FORMAT " us",
+		         pkcs11_pool_checkouts, pkcs11_pool_waits, pkcs11_pool_wait_total, pkcs11_pool_wait_max);
 
-	g_mutex_unlock (pkcs11_main_mutex);
-	g_mutex_clear (pkcs11_main_mutex);
-	g_free (pkcs11_main_mutex);
-	g_cond_clear (pkcs11_main_cond);
-	g_free (pkcs11_main_cond);
+	g_mutex_unlock (&pkcs11_pool_mutex);
 
 	g_assert (pkcs11_module);
 	g_object_unref (pkcs11_module);
@@ -437,23 +512,26 @@ gkd_gpg_agent_initialize_with_module (GckModule *module)
 	}
 
 	/* Try and open a session */
-	session = gck_slot_open_session (slot, GCK_SESSION_READ_WRITE | GCK_SESSION_AUTHENTICATE, NULL, &error);
-	g_object_unref (slot);
-
+	session = session_pool_open (slot);
 	if (!session) {
 		g_warning ("couldn't select a usable pkcs#11 slot for the gpg agent to use");
-		g_clear_error (&error);
+		g_object_unref (slot);
 		return FALSE;
 	}
 
 	pkcs11_module = g_object_ref (module);
 
-	pkcs11_main_mutex = g_new0 (GMutex, 1);
-	g_mutex_init (pkcs11_main_mutex);
-	pkcs11_main_cond = g_new0 (GCond, 1);
-	g_cond_init (pkcs11_main_cond);
-	pkcs11_main_checked = FALSE;
-	pkcs11_main_session = session;
+	g_mutex_lock (&pkcs11_pool_mutex);
+
+		g_assert (!pkcs11_pool_slot);
+		pkcs11_pool_slot = slot;
+		pkcs11_pool_max = session_pool_size ();
+		pkcs11_pool_open = 1;
+		g_queue_push_head (&pkcs11_pool_idle, session);
+		pkcs11_pool_checkouts = pkcs11_pool_waits = 0;
+		pkcs11_pool_wait_total = pkcs11_pool_wait_max = 0;
+
+	g_mutex_unlock (&pkcs11_pool_mutex);
 
 	cache_settings = g_settings_new ("org.gnome.crypto.cache");
 
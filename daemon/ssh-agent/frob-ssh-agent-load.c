@@ -0,0 +1,219 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* frob-ssh-agent-load.c - Hammer an SSH agent with short lived connections
+
+   Copyright (C) 2026 agent <agent@local>
+
+   Gnome keyring is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   Gnome keyring is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Each connection asks for the identities and then disconnects, like
+ * ssh and git do. Reports connections per second, and the latency of
+ * connecting and getting the answer:
+ *
+ *   SSH_AUTH_SOCK=/tmp/ssh ./frob-ssh-agent-load [connections] [threads]
+ */
+
+#include "config.h"
+
+#include "gkd-ssh-agent-private.h"
+
+#include "egg/egg-buffer.h"
+#include "egg/egg-secure-memory.h"
+
+#include <glib.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+typedef struct {
+	guint count;
+	gint64 *latencies;
+	guint failures;
+} Worker;
+
+static struct sockaddr_un agent_addr;
+
+static gboolean
+transact (int sock, EggBuffer *req, EggBuffer *resp)
+{
+	guint32 length;
+	gsize done;
+	gssize res;
+
+	egg_buffer_set_uint32 (req, 0, req->len - 4);
+
+	for (done = 0; done < req->len; done += res) {
+		res = write (sock, req->buf + done, req->len - done);
+		if (res < 0 && errno == EINTR)
+			res = 0;
+		else if (res <= 0)
+			return FALSE;
+	}
+
+	egg_buffer_reset (resp);
+	egg_buffer_resize (resp, 4);
+	for (done = 0; done < resp->len; done += res) {
+		res = read (sock, resp->buf + done, resp->len - done);
+		if (res < 0 && errno == EINTR)
+			res = 0;
+		else if (res <= 0)
+			return FALSE;
+
+		/* Once we have the length, read the rest */
+		if (done + res == 4 && resp->len == 4) {
+			if (!egg_buffer_get_uint32 (resp, 0, NULL, &length))
+				return FALSE;
+			egg_buffer_resize (resp, length + 4);
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+identities_once (EggBuffer *req,
+                 EggBuffer *resp)
+{
+	gboolean ret;
+	guchar code;
+	int sock;
+
+	sock = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return FALSE;
+
+	ret = connect (sock, (struct sockaddr *)&agent_addr, sizeof (agent_addr)) == 0 &&
+	      transact (sock, req, resp) &&
+	      egg_buffer_get_byte (resp, 4, NULL, &code) &&
+	      code == GKD_SSH_RES_IDENTITIES_ANSWER;
+
+	close (sock);
+	return ret;
+}
+
+static gpointer
+run_worker (gpointer data)
+{
+	Worker *worker = data;
+	EggBuffer req, resp;
+	gint64 start;
+	guint i;
+
+	egg_buffer_init_full (&req, 64, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&resp, 1024, (EggBufferAllocator)g_realloc);
+	egg_buffer_add_uint32 (&req, 0);
+	egg_buffer_add_byte (&req, GKD_SSH_OP_REQUEST_IDENTITIES);
+
+	for (i = 0; i < worker->count; i++) {
+		start = g_get_monotonic_time ();
+		if (!identities_once (&req, &resp))
+			worker->failures++;
+		worker->latencies[i] = g_get_monotonic_time () - start;
+	}
+
+	egg_buffer_uninit (&req);
+	egg_buffer_uninit (&resp);
+	return NULL;
+}
+
+static gint
+compare_latency (gconstpointer a,
+                 gconstpointer b)
+{
+	gint64 la = *((gint64 *)a);
+	gint64 lb = *((gint64 *)b);
+	return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+int
+main (int argc, char *argv[])
+{
+	const gchar *path;
+	GThread **threads;
+	Worker *workers;
+	gint64 *all;
+	GTimer *timer;
+	gdouble elapsed;
+	guint n_connections;
+	guint n_threads;
+	guint failures;
+	guint total;
+	guint i, j;
+
+	n_connections = argc > 1 ? atoi (argv[1]) : 10000;
+	n_threads = argc > 2 ? atoi (argv[2]) : 8;
+	if (n_threads == 0 || n_connections < n_threads) {
+		g_message ("usage: frob-ssh-agent-load [connections] [threads]");
+		return 2;
+	}
+
+	path = g_getenv ("SSH_AUTH_SOCK");
+	if (!path) {
+		g_message ("SSH_AUTH_SOCK is not set");
+		return 1;
+	}
+
+	memset (&agent_addr, 0, sizeof (agent_addr));
+	agent_addr.sun_family = AF_UNIX;
+	strncpy (agent_addr.sun_path, path, sizeof (agent_addr.sun_path) - 1);
+
+	workers = g_new0 (Worker, n_threads);
+	threads = g_new0 (GThread *, n_threads);
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < n_threads; i++) {
+		workers[i].count = n_connections / n_threads;
+		workers[i].latencies = g_new0 (gint64, workers[i].count);
+		threads[i] = g_thread_new ("load", run_worker, workers + i);
+	}
+
+	for (i = 0; i < n_threads; i++)
+		g_thread_join (threads[i]);
+
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	/* All the latencies together, sorted for the percentiles */
+	total = failures = 0;
+	all = g_new0 (gint64, n_connections);
+	for (i = 0; i < n_threads; i++) {
+		for (j = 0; j < workers[i].count; j++)
+			all[total++] = workers[i].latencies[j];
+		failures += workers[i].failures;
+		g_free (workers[i].latencies);
+	}
+
+	qsort (all, total, sizeof (gint64), compare_latency);
+
+	g_print ("%u connections in %.3f sec: %.1f connections/sec, %u failed\n",
+	         total, elapsed, total / elapsed, failures);
+	g_print ("latency p50: %.3f msec, p99: %.3f msec, max: %.3f msec\n",
+	         all[total / 2] / 1000.0, all[(total * 99) / 100] / 1000.0,
+	         all[total - 1] / 1000.0);
+
+	g_timer_destroy (timer);
+	g_free (threads);
+	g_free (workers);
+	g_free (all);
+
+	return failures ? 1 : 0;
+}
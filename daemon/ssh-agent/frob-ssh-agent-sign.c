@@ -0,0 +1,162 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* frob-ssh-agent-sign.c - Measure signatures per second through an SSH agent
+
+   Copyright (C) 2026 agent <agent@local>
+
+   Gnome keyring is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   Gnome keyring is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/*
+ * Run against gkd-ssh-agent-standalone, once as is and once with
+ * GNOME_KEYRING_SSH_NO_KEY_CACHE=1 in its environment, to compare
+ * signing with and without the key cache:
+ *
+ *   SSH_AUTH_SOCK=/tmp/ssh ./frob-ssh-agent-sign [count]
+ */
+
+#include "config.h"
+
+#include "gkd-ssh-agent-private.h"
+
+#include "egg/egg-buffer.h"
+#include "egg/egg-secure-memory.h"
+
+#include <glib.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+static gboolean
+transact (int sock, EggBuffer *req, EggBuffer *resp)
+{
+	guint32 length;
+	gsize done;
+	gssize res;
+
+	egg_buffer_set_uint32 (req, 0, req->len - 4);
+
+	for (done = 0; done < req->len; done += res) {
+		res = write (sock, req->buf + done, req->len - done);
+		if (res < 0 && errno == EINTR)
+			res = 0;
+		else if (res <= 0)
+			return FALSE;
+	}
+
+	egg_buffer_reset (resp);
+	egg_buffer_resize (resp, 4);
+	for (done = 0; done < resp->len; done += res) {
+		res = read (sock, resp->buf + done, resp->len - done);
+		if (res < 0 && errno == EINTR)
+			res = 0;
+		else if (res <= 0)
+			return FALSE;
+
+		/* Once we have the length, read the rest */
+		if (done + res == 4 && resp->len == 4) {
+			if (!egg_buffer_get_uint32 (resp, 0, NULL, &length))
+				return FALSE;
+			egg_buffer_resize (resp, length + 4);
+		}
+	}
+
+	return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	const gchar *path;
+	const guchar *blob;
+	EggBuffer req, resp;
+	gsize n_blob, offset;
+	guint32 n_keys;
+	GTimer *timer;
+	gdouble elapsed;
+	guchar code;
+	guint count;
+	guint i;
+	int sock;
+
+	count = argc > 1 ? atoi (argv[1]) : 1000;
+
+	path = g_getenv ("SSH_AUTH_SOCK");
+	if (!path) {
+		g_message ("SSH_AUTH_SOCK is not set");
+		return 1;
+	}
+
+	sock = socket (AF_UNIX, SOCK_STREAM, 0);
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strncpy (addr.sun_path, path, sizeof (addr.sun_path) - 1);
+	if (connect (sock, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		g_message ("couldn't connect to agent: %s: %s", path, g_strerror (errno));
+		return 1;
+	}
+
+	egg_buffer_init_full (&req, 1024, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&resp, 1024, (EggBufferAllocator)g_realloc);
+
+	/* Use the first identity the agent has */
+	egg_buffer_add_uint32 (&req, 0);
+	egg_buffer_add_byte (&req, GKD_SSH_OP_REQUEST_IDENTITIES);
+	if (!transact (sock, &req, &resp) ||
+	    !egg_buffer_get_byte (&resp, 4, &offset, &code) ||
+	    code != GKD_SSH_RES_IDENTITIES_ANSWER ||
+	    !egg_buffer_get_uint32 (&resp, offset, &offset, &n_keys) ||
+	    n_keys == 0 ||
+	    !egg_buffer_get_byte_array (&resp, offset, &offset, &blob, &n_blob)) {
+		g_message ("agent has no identities to sign with");
+		return 1;
+	}
+
+	egg_buffer_reset (&req);
+	egg_buffer_add_uint32 (&req, 0);
+	egg_buffer_add_byte (&req, GKD_SSH_OP_SIGN_REQUEST);
+	egg_buffer_add_byte_array (&req, blob, n_blob);
+	egg_buffer_add_byte_array (&req, (const guchar *)"session data to sign", 20);
+	egg_buffer_add_uint32 (&req, 0);
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < count; i++) {
+		if (!transact (sock, &req, &resp) ||
+		    !egg_buffer_get_byte (&resp, 4, NULL, &code) ||
+		    code != GKD_SSH_RES_SIGN_RESPONSE) {
+			g_message ("signing failed after %u signatures", i);
+			return 1;
+		}
+	}
+
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_print ("%u signatures in %.3f sec: %.1f signatures/sec\n",
+	         count, elapsed, count / elapsed);
+
+	g_timer_destroy (timer);
+	egg_buffer_uninit (&req);
+	egg_buffer_uninit (&resp);
+	close (sock);
+
+	return 0;
+}
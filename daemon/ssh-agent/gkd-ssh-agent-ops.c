@@ -30,8 +30,10 @@
 #include "pkcs11/pkcs11i.h"
 
 #include "egg/egg-error.h"
+#include "egg/egg-file-tracker.h"
 #include "egg/egg-secure-memory.h"
 
+#include <gcrypt.h>
 #include <glib.h>
 
 #include <ctype.h>
@@ -45,6 +47,20 @@ typedef gboolean (*ObjectForeachFunc) (GckObject *object, gpointer user_data);
 
 EGG_SECURE_DECLARE (ssh_agent_ops);
 
+/* Public key blob (GBytes) -> private key (GckObject) used to sign with it */
+G_LOCK_DEFINE_STATIC (key_cache);
+static GHashTable *key_cache = NULL;
+
+/*
+ * The serialized answer to REQUEST_IDENTITIES. Dropped whenever we change
+ * the keys, and when a file changes in the watched key directory.
+ */
+G_LOCK_DEFINE_STATIC (identities_cache);
+static GBytes *identities_cache = NULL;
+static guint identities_generation = 0;
+static EggFileTracker *identities_tracker = NULL;
+static gboolean identities_changed = FALSE;
+
 /* ---------------------------------------------------------------------------- */
 
 
@@ -112,6 +128,12 @@ build_like_attributes (GckAttributes *attrs, CK_OBJECT_CLASS klass)
 		copy_attribute (attrs, CKA_VALUE, &builder);
 		break;
 
+	case CKK_EC:
+	case CKK_EC_EDWARDS:
+		copy_attribute (attrs, CKA_EC_PARAMS, &builder);
+		copy_attribute (attrs, CKA_EC_POINT, &builder);
+		break;
+
 	default:
 		g_return_val_if_reached (NULL);
 		break;
@@ -259,6 +281,217 @@ return_private_matching (GckObject *object, gpointer user_data)
 	return (*result == NULL);
 }
 
+static gboolean
+key_cache_enabled (void)
+{
+	static gsize inited = 0;
+	static gboolean enabled = TRUE;
+
+	/* Allows benchmarking the agent without the caches */
+	if (g_once_init_enter (&inited)) {
+		enabled = g_getenv ("GNOME_KEYRING_SSH_NO_KEY_CACHE") == NULL;
+		g_once_init_leave (&inited, 1);
+	}
+
+	return enabled;
+}
+
+static GckObject*
+lookup_cached_key (const guchar *blob, gsize n_blob)
+{
+	GckObject *key = NULL;
+	GBytes *bytes;
+
+	if (!key_cache_enabled ())
+		return NULL;
+
+	bytes = g_bytes_new_static (blob, n_blob);
+
+	G_LOCK (key_cache);
+	if (key_cache)
+		key = g_hash_table_lookup (key_cache, bytes);
+	if (key)
+		g_object_ref (key);
+	G_UNLOCK (key_cache);
+
+	g_bytes_unref (bytes);
+	return key;
+}
+
+static void
+cache_key (const guchar *blob, gsize n_blob, GckObject *key)
+{
+	g_assert (GCK_IS_OBJECT (key));
+
+	if (!key_cache_enabled ())
+		return;
+
+	G_LOCK (key_cache);
+	if (!key_cache)
+		key_cache = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+		                                   (GDestroyNotify)g_bytes_unref, g_object_unref);
+	g_hash_table_replace (key_cache, g_bytes_new (blob, n_blob), g_object_ref (key));
+	G_UNLOCK (key_cache);
+}
+
+static void
+uncache_key (const guchar *blob, gsize n_blob)
+{
+	GBytes *bytes;
+
+	bytes = g_bytes_new_static (blob, n_blob);
+
+	G_LOCK (key_cache);
+	if (key_cache)
+		g_hash_table_remove (key_cache, bytes);
+	G_UNLOCK (key_cache);
+
+	g_bytes_unref (bytes);
+}
+
+void
+gkd_ssh_agent_clear_key_cache (void)
+{
+	GHashTable *cache;
+
+	G_LOCK (key_cache);
+	cache = key_cache;
+	key_cache = NULL;
+	G_UNLOCK (key_cache);
+
+	/* Outside the lock, this releases the sessions */
+	if (cache)
+		g_hash_table_destroy (cache);
+}
+
+static void
+on_identities_file_changed (EggFileTracker *tracker,
+                            const gchar *path,
+                            gpointer unused)
+{
+	/* Called from egg_file_tracker_refresh() with the lock held */
+	identities_changed = TRUE;
+}
+
+void
+gkd_ssh_agent_watch_identities (const gchar *directory)
+{
+	EggFileTracker *previous;
+
+	g_return_if_fail (directory);
+
+	G_LOCK (identities_cache);
+
+	previous = identities_tracker;
+
+	/* Private key files matter as well as the *.pub ones */
+	identities_tracker = egg_file_tracker_new (directory, NULL, NULL);
+	g_signal_connect (identities_tracker, "file-added", G_CALLBACK (on_identities_file_changed), NULL);
+	g_signal_connect (identities_tracker, "file-changed", G_CALLBACK (on_identities_file_changed), NULL);
+	g_signal_connect (identities_tracker, "file-removed", G_CALLBACK (on_identities_file_changed), NULL);
+	identities_changed = TRUE;
+
+	G_UNLOCK (identities_cache);
+
+	if (previous)
+		g_object_unref (previous);
+}
+
+void
+gkd_ssh_agent_unwatch_identities (void)
+{
+	EggFileTracker *tracker;
+
+	G_LOCK (identities_cache);
+	tracker = identities_tracker;
+	identities_tracker = NULL;
+	G_UNLOCK (identities_cache);
+
+	if (tracker)
+		g_object_unref (tracker);
+}
+
+static GBytes*
+lookup_cached_identities (guint *generation)
+{
+	GBytes *answer = NULL;
+	GBytes *stale = NULL;
+
+	G_LOCK (identities_cache);
+
+	/* Cheap when inotify is available, only reads pending events */
+	if (identities_tracker)
+		egg_file_tracker_refresh (identities_tracker, FALSE);
+
+	if (identities_changed) {
+		stale = identities_cache;
+		identities_cache = NULL;
+		identities_generation++;
+		identities_changed = FALSE;
+	}
+
+	if (identities_cache)
+		answer = g_bytes_ref (identities_cache);
+	*generation = identities_generation;
+
+	G_UNLOCK (identities_cache);
+
+	if (stale)
+		g_bytes_unref (stale);
+
+	return answer;
+}
+
+static void
+cache_identities (guint generation, const guchar *answer, gsize n_answer)
+{
+	GBytes *previous = NULL;
+
+	if (!key_cache_enabled ())
+		return;
+
+	G_LOCK (identities_cache);
+
+	/* Don't cache an answer if the keys changed while building it */
+	if (generation == identities_generation) {
+		previous = identities_cache;
+		identities_cache = g_bytes_new (answer, n_answer);
+	}
+
+	G_UNLOCK (identities_cache);
+
+	if (previous)
+		g_bytes_unref (previous);
+}
+
+void
+gkd_ssh_agent_clear_identities_cache (void)
+{
+	GBytes *answer;
+
+	G_LOCK (identities_cache);
+	answer = identities_cache;
+	identities_cache = NULL;
+	identities_generation++;
+	G_UNLOCK (identities_cache);
+
+	if (answer)
+		g_bytes_unref (answer);
+}
+
+static gboolean
+is_stale_key_error (GError *error)
+{
+	/* The cached key went away, or its session did */
+	return g_error_matches (error, GCK_ERROR, CKR_OBJECT_HANDLE_INVALID) ||
+	       g_error_matches (error, GCK_ERROR, CKR_KEY_HANDLE_INVALID) ||
+	       g_error_matches (error, GCK_ERROR, CKR_SESSION_HANDLE_INVALID) ||
+	       g_error_matches (error, GCK_ERROR, CKR_SESSION_CLOSED) ||
+	       g_error_matches (error, GCK_ERROR, CKR_USER_NOT_LOGGED_IN) ||
+	       g_error_matches (error, GCK_ERROR, CKR_TOKEN_NOT_PRESENT) ||
+	       g_error_matches (error, GCK_ERROR, CKR_DEVICE_REMOVED);
+}
+
 static gboolean
 load_identity_v1_attributes (GckObject *object, gpointer user_data)
 {
@@ -300,13 +533,15 @@ load_identity_v2_attributes (GckObject *object, gpointer user_data)
 	gboolean valid = TRUE;
 	gboolean token;
 	GList **all_attrs;
+	gulong key_type;
 
 	g_return_val_if_fail (GCK_IS_OBJECT (object), FALSE);
 	g_return_val_if_fail (user_data, FALSE);
 
 	attrs = gck_object_get (object, NULL, &error, CKA_ID, CKA_LABEL, CKA_KEY_TYPE, CKA_MODULUS,
 	                        CKA_PUBLIC_EXPONENT, CKA_PRIME, CKA_SUBPRIME, CKA_BASE,
-	                        CKA_VALUE, CKA_CLASS, CKA_MODULUS_BITS, CKA_TOKEN, GCK_INVALID);
+	                        CKA_VALUE, CKA_EC_PARAMS, CKA_EC_POINT, CKA_CLASS, CKA_MODULUS_BITS,
+	                        CKA_TOKEN, GCK_INVALID);
 	if (error) {
 		g_warning ("error retrieving attributes for public key: %s", egg_error_message (error));
 		g_clear_error (&error);
@@ -321,6 +556,11 @@ load_identity_v2_attributes (GckObject *object, gpointer user_data)
 			valid = FALSE;
 	}
 
+	/* Skip keys we can't represent, such as EC keys on other curves */
+	if (!gck_attributes_find_ulong (attrs, CKA_KEY_TYPE, &key_type) ||
+	    !gkd_ssh_agent_proto_algo_to_keytype (key_type, attrs))
+		valid = FALSE;
+
 	/* Figure out if it's a token object or not */
 	if (!gck_attributes_find_boolean (attrs, CKA_TOKEN, &token))
 		token = FALSE;
@@ -632,7 +872,6 @@ op_add_identity (GkdSshAgentCall *call)
 		return FALSE;
 	}
 
-	g_free (stype);
 	gck_builder_init_full (&pub, GCK_BUILDER_SECURE_MEMORY);
 	gck_builder_init_full (&priv, GCK_BUILDER_NONE);
 
@@ -643,11 +882,19 @@ op_add_identity (GkdSshAgentCall *call)
 	case CKK_DSA:
 		ret = gkd_ssh_agent_proto_read_pair_dsa (call->req, &offset, &priv, &pub);
 		break;
+	case CKK_EC:
+		ret = gkd_ssh_agent_proto_read_pair_ecdsa (call->req, &offset, stype, &priv, &pub);
+		break;
+	case CKK_EC_EDWARDS:
+		ret = gkd_ssh_agent_proto_read_pair_ed25519 (call->req, &offset, &priv, &pub);
+		break;
 	default:
 		g_assert_not_reached ();
 		return FALSE;
 	}
 
+	g_free (stype);
+
 	if (!ret) {
 		g_warning ("couldn't read incoming SSH private key");
 		gck_builder_clear (&pub);
@@ -674,16 +921,18 @@ op_add_identity (GkdSshAgentCall *call)
 	}
 
 	/*
-	 * This is the session that owns these objects. Only
-	 * one thread can use it at a time.
+	 * Session objects are shared between all the sessions
+	 * in the pool, so any one of them will do.
 	 */
 
-	session = gkd_ssh_agent_checkout_main_session ();
+	session = gkd_ssh_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	ret = replace_key_pair (session, &priv, &pub);
+	gkd_ssh_agent_clear_key_cache ();
+	gkd_ssh_agent_clear_identities_cache ();
 
-	gkd_ssh_agent_checkin_main_session (session);
+	gkd_ssh_agent_checkin_session (session);
 
 	gck_builder_clear (&priv);
 	gck_builder_clear (&pub);
@@ -735,16 +984,18 @@ op_v1_add_identity (GkdSshAgentCall *call)
 	}
 
 	/*
-	 * This is the session that owns these objects. Only
-	 * one thread can use it at a time.
+	 * Session objects are shared between all the sessions
+	 * in the pool, so any one of them will do.
 	 */
 
-	session = gkd_ssh_agent_checkout_main_session ();
+	session = gkd_ssh_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	ret = replace_key_pair (session, &priv, &pub);
+	gkd_ssh_agent_clear_key_cache ();
+	gkd_ssh_agent_clear_identities_cache ();
 
-	gkd_ssh_agent_checkin_main_session (session);
+	gkd_ssh_agent_checkin_session (session);
 
 	gck_builder_clear (&pub);
 	gck_builder_clear (&priv);
@@ -754,7 +1005,7 @@ op_v1_add_identity (GkdSshAgentCall *call)
 }
 
 static gboolean
-op_request_identities (GkdSshAgentCall *call)
+write_identities_answer (GList *modules, EggBuffer *resp)
 {
 	GckBuilder builder = GCK_BUILDER_INIT;
 	GckEnumerator *en;
@@ -769,7 +1020,7 @@ op_request_identities (GkdSshAgentCall *call)
 	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_PUBLIC_KEY);
 
 	/* Find all the keys (we filter out v1 later) */
-	en = gck_modules_enumerate_objects (call->modules, gck_builder_end (&builder),
+	en = gck_modules_enumerate_objects (modules, gck_builder_end (&builder),
 	                                    GCK_SESSION_AUTHENTICATE | GCK_SESSION_READ_WRITE);
 	g_return_val_if_fail (en, FALSE);
 
@@ -783,13 +1034,13 @@ op_request_identities (GkdSshAgentCall *call)
 
 	if (error) {
 		g_warning ("couldn't enumerate ssh keys: %s", egg_error_message (error));
-		egg_buffer_add_byte (call->resp, GKD_SSH_RES_FAILURE);
+		g_list_free_full (all_attrs, (GDestroyNotify)gck_attributes_unref);
 		g_clear_error (&error);
-		return TRUE;
+		return FALSE;
 	}
 
-	egg_buffer_add_byte (call->resp, GKD_SSH_RES_IDENTITIES_ANSWER);
-	egg_buffer_add_uint32 (call->resp, g_list_length (all_attrs));
+	egg_buffer_add_byte (resp, GKD_SSH_RES_IDENTITIES_ANSWER);
+	egg_buffer_add_uint32 (resp, g_list_length (all_attrs));
 
 	for (l = all_attrs; l; l = g_list_next (l)) {
 
@@ -800,17 +1051,17 @@ op_request_identities (GkdSshAgentCall *call)
 			comment = NULL;
 
 		/* Add a space for the key blob length */
-		blobpos = call->resp->len;
-		egg_buffer_add_uint32 (call->resp, 0);
+		blobpos = resp->len;
+		egg_buffer_add_uint32 (resp, 0);
 
 		/* Write out the key */
-		gkd_ssh_agent_proto_write_public (call->resp, attrs);
+		gkd_ssh_agent_proto_write_public (resp, attrs);
 
 		/* Write back the blob length */
-		egg_buffer_set_uint32 (call->resp, blobpos, (call->resp->len - blobpos) - 4);
+		egg_buffer_set_uint32 (resp, blobpos, (resp->len - blobpos) - 4);
 
 		/* And now a per key comment */
-		egg_buffer_add_string (call->resp, comment ? comment : "");
+		egg_buffer_add_string (resp, comment ? comment : "");
 
 		g_free (comment);
 		gck_attributes_unref (attrs);
@@ -821,6 +1072,34 @@ op_request_identities (GkdSshAgentCall *call)
 	return TRUE;
 }
 
+static gboolean
+op_request_identities (GkdSshAgentCall *call)
+{
+	GBytes *answer;
+	guint generation;
+	gsize offset;
+
+	/* Most ssh connections start with this, so usually served from here */
+	answer = lookup_cached_identities (&generation);
+	if (answer != NULL) {
+		egg_buffer_append (call->resp, g_bytes_get_data (answer, NULL),
+		                   g_bytes_get_size (answer));
+		g_bytes_unref (answer);
+		return TRUE;
+	}
+
+	offset = call->resp->len;
+	if (!write_identities_answer (call->modules, call->resp)) {
+		egg_buffer_add_byte (call->resp, GKD_SSH_RES_FAILURE);
+		return TRUE;
+	}
+
+	if (!egg_buffer_has_error (call->resp))
+		cache_identities (generation, call->resp->buf + offset, call->resp->len - offset);
+
+	return TRUE;
+}
+
 static gboolean
 op_v1_request_identities (GkdSshAgentCall *call)
 {
@@ -944,6 +1223,27 @@ make_raw_sign_hash (GChecksumType algo, const guchar *data, gsize n_data,
 	return hash;
 }
 
+static guchar*
+make_ecdsa_sign_hash (int algo, const guchar *data, gsize n_data,
+                      gsize *n_result)
+{
+	gsize n_hash;
+	guchar *hash;
+
+	g_assert (data);
+	g_assert (n_result);
+
+	/* GChecksum has no SHA-384 in the GLib we depend on */
+	n_hash = gcry_md_get_algo_dlen (algo);
+	g_return_val_if_fail (n_hash > 0, NULL);
+
+	hash = g_malloc0 (n_hash);
+	gcry_md_hash_buffer (algo, hash, data, n_data);
+
+	*n_result = n_hash;
+	return hash;
+}
+
 static guchar*
 unlock_and_sign (GckSession *session, GckObject *key, gulong mech_type, const guchar *input,
                  gsize n_input, gsize *n_result, GError **err)
@@ -990,6 +1290,7 @@ op_sign_request (GkdSshAgentCall *call)
 	GError *error = NULL;
 	GckObject *key = NULL;
 	const guchar *data;
+	const guchar *blob;
 	const gchar *salgo;
 	GckSession *session;
 	guchar *result;
@@ -997,6 +1298,7 @@ op_sign_request (GkdSshAgentCall *call)
 	guint32 flags;
 	gsize offset;
 	gboolean ret = FALSE;
+	gboolean cached;
 	guint blobpos, sz;
 	guint8 *hash;
 	gulong algo, mech;
@@ -1006,9 +1308,13 @@ op_sign_request (GkdSshAgentCall *call)
 	offset = 5;
 
 	/* The key packet size */
-	if (!egg_buffer_get_uint32 (call->req, offset, &offset, &sz))
+	if (!egg_buffer_get_uint32 (call->req, offset, &offset, &sz) ||
+	    sz > call->req->len - offset)
 		return FALSE;
 
+	/* The raw key blob is what we cache the private key by */
+	blob = call->req->buf + offset;
+
 	/* The key itself */
 	if (!gkd_ssh_agent_proto_read_public (call->req, &offset, &builder, &algo)) {
 		gck_builder_clear (&builder);
@@ -1022,8 +1328,21 @@ op_sign_request (GkdSshAgentCall *call)
 		mech = CKM_RSA_PKCS;
 	else if (algo == CKK_DSA)
 		mech = CKM_DSA;
-	else
+	else if (algo == CKK_EC)
+		mech = CKM_ECDSA;
+	else if (algo == CKK_EC_EDWARDS)
+		mech = CKM_EDDSA;
+	else {
+		gck_attributes_unref (attrs);
 		g_return_val_if_reached (FALSE);
+	}
+
+	/* For EC keys the key type string depends on the curve */
+	salgo = gkd_ssh_agent_proto_algo_to_keytype (algo, attrs);
+	if (salgo == NULL) {
+		gck_attributes_unref (attrs);
+		g_return_val_if_reached (FALSE);
+	}
 
 	if (!egg_buffer_get_byte_array (call->req, offset, &offset, &data, &n_data) ||
 	    !egg_buffer_get_uint32 (call->req, offset, &offset, &flags)) {
@@ -1031,15 +1350,6 @@ op_sign_request (GkdSshAgentCall *call)
 		return FALSE;
 	}
 
-	/* Lookup the key */
-	search_keys_like_attributes (call->modules, NULL, attrs, CKO_PUBLIC_KEY, return_private_matching, &key);
-	gck_attributes_unref (attrs);
-
-	if (!key) {
-		egg_buffer_add_byte (call->resp, GKD_SSH_RES_FAILURE);
-		return TRUE;
-	}
-
 	/* Usually we hash the data with SHA1 */
 	if (flags & GKD_SSH_FLAG_OLD_SIGNATURE)
 		halgo = G_CHECKSUM_MD5;
@@ -1049,16 +1359,55 @@ op_sign_request (GkdSshAgentCall *call)
 	/* Build the hash */
 	if (mech == CKM_RSA_PKCS)
 		hash = make_pkcs1_sign_hash (halgo, data, n_data, &n_hash);
-	else
+	else if (mech == CKM_ECDSA)
+		hash = make_ecdsa_sign_hash (gkd_ssh_agent_proto_ecdsa_hash_algo (attrs),
+		                             data, n_data, &n_hash);
+	else if (mech == CKM_EDDSA) {
+		/* EdDSA does its own hashing */
+		hash = g_memdup (data, n_data);
+		n_hash = n_data;
+	} else {
 		hash = make_raw_sign_hash (halgo, data, n_data, &n_hash);
+	}
 
-	session = gck_object_get_session (key);
-	g_return_val_if_fail (session, FALSE);
+	for (;;) {
 
-	result = unlock_and_sign (session, key, mech, hash, n_hash, &n_result, &error);
+		/* Lookup the key, which enumerates all the slots when not cached */
+		key = lookup_cached_key (blob, sz);
+		cached = (key != NULL);
+		if (!key) {
+			search_keys_like_attributes (call->modules, NULL, attrs, CKO_PUBLIC_KEY,
+			                             return_private_matching, &key);
+			if (key)
+				cache_key (blob, sz, key);
+		}
 
-	g_object_unref (session);
-	g_object_unref (key);
+		if (!key) {
+			gck_attributes_unref (attrs);
+			g_free (hash);
+			egg_buffer_add_byte (call->resp, GKD_SSH_RES_FAILURE);
+			return TRUE;
+		}
+
+		session = gck_object_get_session (key);
+		g_return_val_if_fail (session, FALSE);
+
+		result = unlock_and_sign (session, key, mech, hash, n_hash, &n_result, &error);
+
+		g_object_unref (session);
+		g_object_unref (key);
+
+		/* Key was removed or its token logged out, so look it up again */
+		if (cached && error && is_stale_key_error (error)) {
+			uncache_key (blob, sz);
+			g_clear_error (&error);
+			continue;
+		}
+
+		break;
+	}
+
+	gck_attributes_unref (attrs);
 	g_free (hash);
 
 	if (error) {
@@ -1076,8 +1425,6 @@ op_sign_request (GkdSshAgentCall *call)
 	blobpos = call->resp->len;
 	egg_buffer_add_uint32 (call->resp, 0);
 
-	salgo = gkd_ssh_agent_proto_algo_to_keytype (algo);
-	g_assert (salgo);
 	egg_buffer_add_string (call->resp, salgo);
 
 	switch (algo) {
@@ -1089,6 +1436,14 @@ op_sign_request (GkdSshAgentCall *call)
 		ret = gkd_ssh_agent_proto_write_signature_dsa (call->resp, result, n_result);
 		break;
 
+	case CKK_EC:
+		ret = gkd_ssh_agent_proto_write_signature_ecdsa (call->resp, result, n_result);
+		break;
+
+	case CKK_EC_EDWARDS:
+		ret = gkd_ssh_agent_proto_write_signature_ed25519 (call->resp, result, n_result);
+		break;
+
 	default:
 		g_assert_not_reached ();
 	}
@@ -1226,11 +1581,11 @@ op_remove_identity (GkdSshAgentCall *call)
 	attrs = gck_attributes_ref_sink (gck_builder_end (&builder));
 
 	/*
-	 * This is the session that owns these objects. Only
-	 * one thread can use it at a time.
+	 * Session objects are shared between all the sessions
+	 * in the pool, so any one of them will do.
 	 */
 
-	session = gkd_ssh_agent_checkout_main_session ();
+	session = gkd_ssh_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	search_keys_like_attributes (NULL, session, attrs, CKO_PUBLIC_KEY, return_first_matching, &key);
@@ -1238,10 +1593,12 @@ op_remove_identity (GkdSshAgentCall *call)
 
 	if (key != NULL) {
 		remove_by_public_key (session, key, TRUE);
+		gkd_ssh_agent_clear_key_cache ();
+		gkd_ssh_agent_clear_identities_cache ();
 		g_object_unref (key);
 	}
 
-	gkd_ssh_agent_checkin_main_session (session);
+	gkd_ssh_agent_checkin_session (session);
 
 	egg_buffer_add_byte (call->resp, GKD_SSH_RES_SUCCESS);
 
@@ -1267,11 +1624,11 @@ op_v1_remove_identity (GkdSshAgentCall *call)
 	attrs = gck_attributes_ref_sink (gck_builder_end (&builder));
 
 	/*
-	 * This is the session that owns these objects. Only
-	 * one thread can use it at a time.
+	 * Session objects are shared between all the sessions
+	 * in the pool, so any one of them will do.
 	 */
 
-	session = gkd_ssh_agent_checkout_main_session ();
+	session = gkd_ssh_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	search_keys_like_attributes (NULL, session, attrs, CKO_PUBLIC_KEY, return_first_matching, &key);
@@ -1279,10 +1636,12 @@ op_v1_remove_identity (GkdSshAgentCall *call)
 
 	if (key != NULL) {
 		remove_by_public_key (session, key, FALSE);
+		gkd_ssh_agent_clear_key_cache ();
+		gkd_ssh_agent_clear_identities_cache ();
 		g_object_unref (key);
 	}
 
-	gkd_ssh_agent_checkin_main_session (session);
+	gkd_ssh_agent_checkin_session (session);
 
 	egg_buffer_add_byte (call->resp, GKD_SSH_RES_SUCCESS);
 	return TRUE;
@@ -1298,11 +1657,11 @@ op_remove_all_identities (GkdSshAgentCall *call)
 	GckAttributes *attrs;
 
 	/*
-	 * This is the session that owns these objects. Only
-	 * one thread can use it at a time.
+	 * Session objects are shared between all the sessions
+	 * in the pool, so any one of them will do.
 	 */
 
-	session = gkd_ssh_agent_checkout_main_session ();
+	session = gkd_ssh_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	/* Find all session SSH public keys */
@@ -1320,9 +1679,11 @@ op_remove_all_identities (GkdSshAgentCall *call)
 		for (l = objects; l; l = g_list_next (l))
 			remove_by_public_key (session, l->data, TRUE);
 		gck_list_unref_free (objects);
+		gkd_ssh_agent_clear_key_cache ();
+		gkd_ssh_agent_clear_identities_cache ();
 	}
 
-	gkd_ssh_agent_checkin_main_session (session);
+	gkd_ssh_agent_checkin_session (session);
 
 	egg_buffer_add_byte (call->resp, GKD_SSH_RES_SUCCESS);
 	return TRUE;
@@ -1338,11 +1699,11 @@ op_v1_remove_all_identities (GkdSshAgentCall *call)
 	GckAttributes *attrs;
 
 	/*
-	 * This is the session that owns these objects. Only
-	 * one thread can use it at a time.
+	 * Session objects are shared between all the sessions
+	 * in the pool, so any one of them will do.
 	 */
 
-	session = gkd_ssh_agent_checkout_main_session ();
+	session = gkd_ssh_agent_checkout_session ();
 	g_return_val_if_fail (session, FALSE);
 
 	/* Find all session SSH v1 public keys */
@@ -1362,9 +1723,22 @@ op_v1_remove_all_identities (GkdSshAgentCall *call)
 		for (l = objects; l; l = g_list_next (l))
 			remove_by_public_key (session, l->data, FALSE);
 		gck_list_unref_free (objects);
+		gkd_ssh_agent_clear_key_cache ();
+		gkd_ssh_agent_clear_identities_cache ();
 	}
 
-	gkd_ssh_agent_checkin_main_session (session);
+	gkd_ssh_agent_checkin_session (session);
+
+	egg_buffer_add_byte (call->resp, GKD_SSH_RES_SUCCESS);
+	return TRUE;
+}
+
+static gboolean
+op_lock_or_unlock (GkdSshAgentCall *call)
+{
+	/* Not implemented, but what keys are usable may have changed */
+	gkd_ssh_agent_clear_key_cache ();
+	gkd_ssh_agent_clear_identities_cache ();
 
 	egg_buffer_add_byte (call->resp, GKD_SSH_RES_SUCCESS);
 	return TRUE;
@@ -1414,8 +1788,8 @@ const GkdSshAgentOperation gkd_ssh_agent_operations[GKD_SSH_OP_MAX] = {
      op_remove_all_identities,                   /* GKR_SSH_OP_REMOVE_ALL_IDENTITIES */
      op_not_implemented_failure,                 /* GKR_SSH_OP_ADD_SMARTCARD_KEY */
      op_not_implemented_failure,                 /* GKR_SSH_OP_REMOVE_SMARTCARD_KEY */
-     op_not_implemented_success,                 /* GKR_SSH_OP_LOCK */
-     op_not_implemented_success,                 /* GKR_SSH_OP_UNLOCK */
+     op_lock_or_unlock,                          /* GKR_SSH_OP_LOCK */
+     op_lock_or_unlock,                          /* GKR_SSH_OP_UNLOCK */
      op_v1_add_identity,                         /* GKR_SSH_OP_ADD_RSA_ID_CONSTRAINED */
      op_add_identity,                            /* GKR_SSH_OP_ADD_ID_CONSTRAINED */
      op_not_implemented_failure,                 /* GKR_SSH_OP_ADD_SMARTCARD_KEY_CONSTRAINED */
@@ -26,6 +26,7 @@
 #include "egg/egg-buffer.h"
 
 #include "pkcs11/pkcs11.h"
+#include "pkcs11/pkcs11i.h"
 
 #include <gck/gck.h>
 
@@ -87,15 +88,23 @@ typedef struct _GkdSshAgentCall {
 typedef gboolean (*GkdSshAgentOperation) (GkdSshAgentCall *call);
 extern const GkdSshAgentOperation gkd_ssh_agent_operations[GKD_SSH_OP_MAX];
 
+void                  gkd_ssh_agent_clear_key_cache                 (void);
+
+void                  gkd_ssh_agent_clear_identities_cache          (void);
+
+void                  gkd_ssh_agent_watch_identities                (const gchar *directory);
+
+void                  gkd_ssh_agent_unwatch_identities              (void);
+
 /* -----------------------------------------------------------------------------
  * gkd-ssh-agent.c
  */
 
 gboolean              gkd_ssh_agent_initialize_with_module          (GckModule *module);
 
-GckSession*           gkd_ssh_agent_checkout_main_session           (void);
+GckSession*           gkd_ssh_agent_checkout_session                (void);
 
-void                  gkd_ssh_agent_checkin_main_session            (GckSession* session);
+void                  gkd_ssh_agent_checkin_session                 (GckSession* session);
 
 /* -----------------------------------------------------------------------------
  * gkd-ssh-agent-proto.c
@@ -103,7 +112,10 @@ void                  gkd_ssh_agent_checkin_main_session            (GckSession*
 
 gulong                gkd_ssh_agent_proto_keytype_to_algo           (const gchar *salgo);
 
-const gchar*          gkd_ssh_agent_proto_algo_to_keytype           (gulong algo);
+const gchar*          gkd_ssh_agent_proto_algo_to_keytype           (gulong algo,
+                                                                     GckAttributes *attrs);
+
+int                   gkd_ssh_agent_proto_ecdsa_hash_algo           (GckAttributes *attrs);
 
 gboolean              gkd_ssh_agent_proto_read_mpi                  (EggBuffer *req,
                                                                      gsize *offset,
@@ -138,6 +150,15 @@ gboolean              gkd_ssh_agent_proto_read_public_dsa           (EggBuffer *
                                                                      gsize *offset,
                                                                      GckBuilder *attrs);
 
+gboolean              gkd_ssh_agent_proto_read_public_ecdsa         (EggBuffer *req,
+                                                                     gsize *offset,
+                                                                     const gchar *stype,
+                                                                     GckBuilder *attrs);
+
+gboolean              gkd_ssh_agent_proto_read_public_ed25519       (EggBuffer *req,
+                                                                     gsize *offset,
+                                                                     GckBuilder *attrs);
+
 gboolean              gkd_ssh_agent_proto_read_public_v1            (EggBuffer *req,
                                                                      gsize *offset,
                                                                      GckBuilder *attrs);
@@ -152,6 +173,17 @@ gboolean              gkd_ssh_agent_proto_read_pair_dsa             (EggBuffer *
                                                                      GckBuilder *priv,
                                                                      GckBuilder *pub);
 
+gboolean              gkd_ssh_agent_proto_read_pair_ecdsa           (EggBuffer *req,
+                                                                     gsize *offset,
+                                                                     const gchar *stype,
+                                                                     GckBuilder *priv,
+                                                                     GckBuilder *pub);
+
+gboolean              gkd_ssh_agent_proto_read_pair_ed25519         (EggBuffer *req,
+                                                                     gsize *offset,
+                                                                     GckBuilder *priv,
+                                                                     GckBuilder *pub);
+
 gboolean              gkd_ssh_agent_proto_read_pair_v1              (EggBuffer *req,
                                                                      gsize *offset,
                                                                      GckBuilder *priv,
@@ -166,6 +198,12 @@ gboolean              gkd_ssh_agent_proto_write_public_rsa          (EggBuffer *
 gboolean              gkd_ssh_agent_proto_write_public_dsa          (EggBuffer *resp,
                                                                      GckAttributes *attrs);
 
+gboolean              gkd_ssh_agent_proto_write_public_ecdsa        (EggBuffer *resp,
+                                                                     GckAttributes *attrs);
+
+gboolean              gkd_ssh_agent_proto_write_public_ed25519      (EggBuffer *resp,
+                                                                     GckAttributes *attrs);
+
 gboolean              gkd_ssh_agent_proto_write_public_v1           (EggBuffer *resp,
                                                                      GckAttributes *attrs);
 
@@ -177,4 +215,12 @@ gboolean              gkd_ssh_agent_proto_write_signature_dsa       (EggBuffer *
                                                                      CK_BYTE_PTR signature,
                                                                      CK_ULONG n_signature);
 
+gboolean              gkd_ssh_agent_proto_write_signature_ecdsa     (EggBuffer *resp,
+                                                                     CK_BYTE_PTR signature,
+                                                                     CK_ULONG n_signature);
+
+gboolean              gkd_ssh_agent_proto_write_signature_ed25519   (EggBuffer *resp,
+                                                                     CK_BYTE_PTR signature,
+                                                                     CK_ULONG n_signature);
+
 #endif /*GKDSSHPRIVATE_H_*/
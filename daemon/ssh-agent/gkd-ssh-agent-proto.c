@@ -26,33 +26,187 @@
 
 #include "egg/egg-buffer.h"
 
+#include "pkcs11/gkm/gkm-sexp.h"
+
 #include <gck/gck.h>
 
+#include <gcrypt.h>
 #include <glib.h>
 
 #include <string.h>
 
+#define ED25519_KEY_LEN 32
+
+/* The curve of an ecdsa-sha2-* key, from its CKA_EC_PARAMS */
+static const GkmSexpCurve*
+find_curve_by_params (GckAttributes *attrs)
+{
+	const GkmSexpCurve *curves;
+	const GckAttribute *attr;
+	guint n_curves, i;
+
+	attr = gck_attributes_find (attrs, CKA_EC_PARAMS);
+	if (attr == NULL || gck_attribute_is_invalid (attr))
+		return NULL;
+
+	curves = gkm_sexp_get_curves (&n_curves);
+	for (i = 0; i < n_curves; i++) {
+		if (curves[i].ssh_keytype && attr->length == curves[i].n_params &&
+		    memcmp (attr->value, curves[i].params, attr->length) == 0)
+			return curves + i;
+	}
+
+	return NULL;
+}
+
+static void
+add_ed25519_params (GckBuilder *attrs)
+{
+	gconstpointer params;
+	gsize n_params;
+
+	if (!gkm_sexp_ec_params_for_curve (GKM_SEXP_CURVE_ED25519, &params, &n_params))
+		g_return_if_reached ();
+	gck_builder_add_data (attrs, CKA_EC_PARAMS, params, n_params);
+}
+
+static void
+add_ec_point (GckBuilder *attrs, const guchar *point, gsize n_point)
+{
+	guchar *der;
+	gsize n_der;
+
+	g_assert (n_point <= 0xFFFF);
+
+	/* CKA_EC_POINT is a DER encoded OCTET STRING */
+	der = g_malloc (n_point + 4);
+	der[0] = 0x04;
+	if (n_point < 0x80) {
+		der[1] = n_point;
+		n_der = 2;
+	} else if (n_point < 0x100) {
+		der[1] = 0x81;
+		der[2] = n_point;
+		n_der = 3;
+	} else {
+		der[1] = 0x82;
+		der[2] = (n_point >> 8) & 0xFF;
+		der[3] = n_point & 0xFF;
+		n_der = 4;
+	}
+
+	memcpy (der + n_der, point, n_point);
+	gck_builder_add_data (attrs, CKA_EC_POINT, der, n_der + n_point);
+	g_free (der);
+}
+
+static const guchar*
+find_ec_point (GckAttributes *attrs, gsize *n_point)
+{
+	const GckAttribute *attr;
+	const guchar *der;
+	gsize len, n_len;
+
+	attr = gck_attributes_find (attrs, CKA_EC_POINT);
+	if (attr == NULL || gck_attribute_is_invalid (attr) || attr->length < 2)
+		return NULL;
+
+	der = attr->value;
+	if (der[0] != 0x04)
+		return NULL;
+
+	if (der[1] < 0x80) {
+		len = der[1];
+		n_len = 1;
+	} else if (der[1] == 0x81 && attr->length >= 3) {
+		len = der[2];
+		n_len = 2;
+	} else if (der[1] == 0x82 && attr->length >= 4) {
+		len = (der[2] << 8) | der[3];
+		n_len = 3;
+	} else {
+		return NULL;
+	}
+
+	if (1 + n_len + len != attr->length)
+		return NULL;
+
+	*n_point = len;
+	return der + 1 + n_len;
+}
+
+static gboolean
+add_mpint (EggBuffer *resp, const guchar *value, gsize n_value)
+{
+	guchar *data;
+	gsize n_extra;
+
+	/* Minimal encoding, with a leading zero if the high bit is set */
+	while (n_value > 0 && value[0] == 0) {
+		++value;
+		--n_value;
+	}
+
+	n_extra = (n_value && (value[0] & 0x80)) ? 1 : 0;
+	data = egg_buffer_add_byte_array_empty (resp, n_value + n_extra);
+	if (data == NULL)
+		return FALSE;
+
+	memset (data, 0, n_extra);
+	memcpy (data + n_extra, value, n_value);
+	return TRUE;
+}
+
 gulong
 gkd_ssh_agent_proto_keytype_to_algo (const gchar *salgo)
 {
+	const GkmSexpCurve *curves;
+	guint n_curves, i;
+
 	g_return_val_if_fail (salgo, G_MAXULONG);
 	if (strcmp (salgo, "ssh-rsa") == 0)
 		return CKK_RSA;
 	else if (strcmp (salgo, "ssh-dss") == 0)
 		return CKK_DSA;
+	else if (strcmp (salgo, "ssh-ed25519") == 0)
+		return CKK_EC_EDWARDS;
+	curves = gkm_sexp_get_curves (&n_curves);
+	for (i = 0; i < n_curves; i++) {
+		if (curves[i].ssh_keytype && strcmp (salgo, curves[i].ssh_keytype) == 0)
+			return CKK_EC;
+	}
 	return G_MAXULONG;
 }
 
 const gchar*
-gkd_ssh_agent_proto_algo_to_keytype (gulong algo)
+gkd_ssh_agent_proto_algo_to_keytype (gulong algo,
+                                     GckAttributes *attrs)
 {
+	const GkmSexpCurve *curve;
+
 	if (algo == CKK_RSA)
 		return "ssh-rsa";
 	else if (algo == CKK_DSA)
 		return "ssh-dss";
+	else if (algo == CKK_EC_EDWARDS)
+		return "ssh-ed25519";
+	else if (algo == CKK_EC) {
+		/* The key type depends on the curve */
+		curve = attrs ? find_curve_by_params (attrs) : NULL;
+		return curve ? curve->ssh_keytype : NULL;
+	}
 	return NULL;
 }
 
+int
+gkd_ssh_agent_proto_ecdsa_hash_algo (GckAttributes *attrs)
+{
+	const GkmSexpCurve *curve;
+
+	curve = find_curve_by_params (attrs);
+	return curve ? curve->ssh_hash_algo : 0;
+}
+
 gboolean
 gkd_ssh_agent_proto_read_mpi (EggBuffer *req, gsize *offset,
                               GckBuilder *builder,
@@ -196,7 +350,6 @@ gkd_ssh_agent_proto_read_public (EggBuffer *req,
 		return FALSE;
 	}
 
-	g_free (stype);
 	switch (alg) {
 	case CKK_RSA:
 		ret = gkd_ssh_agent_proto_read_public_rsa (req, offset, attrs);
@@ -204,11 +357,19 @@ gkd_ssh_agent_proto_read_public (EggBuffer *req,
 	case CKK_DSA:
 		ret = gkd_ssh_agent_proto_read_public_dsa (req, offset, attrs);
 		break;
+	case CKK_EC:
+		ret = gkd_ssh_agent_proto_read_public_ecdsa (req, offset, stype, attrs);
+		break;
+	case CKK_EC_EDWARDS:
+		ret = gkd_ssh_agent_proto_read_public_ed25519 (req, offset, attrs);
+		break;
 	default:
 		g_assert_not_reached ();
 		return FALSE;
 	}
 
+	g_free (stype);
+
 	if (!ret) {
 		g_warning ("couldn't read incoming SSH private key");
 		return FALSE;
@@ -395,6 +556,185 @@ gkd_ssh_agent_proto_read_public_dsa (EggBuffer *req,
 	return TRUE;
 }
 
+static const GkmSexpCurve*
+read_ec_params (EggBuffer *req,
+                gsize *offset,
+                const gchar *stype,
+                GckBuilder *attrs)
+{
+	const GkmSexpCurve *curves;
+	const GkmSexpCurve *ret = NULL;
+	gchar *identifier;
+	guint n_curves, i;
+
+	if (!egg_buffer_get_string (req, *offset, offset, &identifier, (EggBufferAllocator)g_realloc))
+		return NULL;
+
+	/* The curve identifier must agree with the key type */
+	curves = gkm_sexp_get_curves (&n_curves);
+	for (i = 0; i < n_curves; i++) {
+		if (curves[i].ssh_keytype && strcmp (stype, curves[i].ssh_keytype) == 0 &&
+		    strcmp (identifier, curves[i].ssh_identifier) == 0) {
+			gck_builder_add_data (attrs, CKA_EC_PARAMS, curves[i].params,
+			                      curves[i].n_params);
+			ret = curves + i;
+			break;
+		}
+	}
+
+	g_free (identifier);
+	return ret;
+}
+
+/* Only uncompressed points, which is all that OpenSSH sends */
+static gboolean
+check_ec_point (const GkmSexpCurve *curve,
+                const guchar *q,
+                gsize n_q)
+{
+	g_assert (curve);
+
+	return n_q == 1 + 2 * curve->n_field && q[0] == 0x04;
+}
+
+gboolean
+gkd_ssh_agent_proto_read_pair_ecdsa (EggBuffer *req,
+                                     gsize *offset,
+                                     const gchar *stype,
+                                     GckBuilder *priv_attrs,
+                                     GckBuilder *pub_attrs)
+{
+	const GckAttribute *attr;
+	const guchar *q;
+	gsize n_q;
+	const GkmSexpCurve *curve;
+
+	g_assert (req);
+	g_assert (offset);
+	g_assert (priv_attrs);
+	g_assert (pub_attrs);
+
+	curve = read_ec_params (req, offset, stype, priv_attrs);
+	if (curve == NULL ||
+	    !egg_buffer_get_byte_array (req, *offset, offset, &q, &n_q) ||
+	    !check_ec_point (curve, q, n_q) ||
+	    !gkd_ssh_agent_proto_read_mpi (req, offset, priv_attrs, CKA_VALUE))
+		return FALSE;
+
+	/* The point is needed on both, the private key is identified by it */
+	add_ec_point (priv_attrs, q, n_q);
+
+	/* Copy attributes to the public key */
+	attr = gck_builder_find (priv_attrs, CKA_EC_PARAMS);
+	gck_builder_add_attribute (pub_attrs, attr);
+	attr = gck_builder_find (priv_attrs, CKA_EC_POINT);
+	gck_builder_add_attribute (pub_attrs, attr);
+
+	/* Add in your basic other required attributes */
+	gck_builder_add_ulong (priv_attrs, CKA_CLASS, CKO_PRIVATE_KEY);
+	gck_builder_add_ulong (priv_attrs, CKA_KEY_TYPE, CKK_EC);
+	gck_builder_add_ulong (pub_attrs, CKA_CLASS, CKO_PUBLIC_KEY);
+	gck_builder_add_ulong (pub_attrs, CKA_KEY_TYPE, CKK_EC);
+
+	return TRUE;
+}
+
+gboolean
+gkd_ssh_agent_proto_read_public_ecdsa (EggBuffer *req,
+                                       gsize *offset,
+                                       const gchar *stype,
+                                       GckBuilder *attrs)
+{
+	const guchar *q;
+	gsize n_q;
+	const GkmSexpCurve *curve;
+
+	g_assert (req);
+	g_assert (offset);
+	g_assert (attrs);
+
+	curve = read_ec_params (req, offset, stype, attrs);
+	if (curve == NULL ||
+	    !egg_buffer_get_byte_array (req, *offset, offset, &q, &n_q) ||
+	    !check_ec_point (curve, q, n_q))
+		return FALSE;
+
+	add_ec_point (attrs, q, n_q);
+
+	/* Add in your basic other required attributes */
+	gck_builder_add_ulong (attrs, CKA_CLASS, CKO_PUBLIC_KEY);
+	gck_builder_add_ulong (attrs, CKA_KEY_TYPE, CKK_EC);
+
+	return TRUE;
+}
+
+gboolean
+gkd_ssh_agent_proto_read_pair_ed25519 (EggBuffer *req,
+                                       gsize *offset,
+                                       GckBuilder *priv_attrs,
+                                       GckBuilder *pub_attrs)
+{
+	const GckAttribute *attr;
+	const guchar *pk, *sk;
+	gsize n_pk, n_sk;
+
+	g_assert (req);
+	g_assert (offset);
+	g_assert (priv_attrs);
+	g_assert (pub_attrs);
+
+	/* The secret part is the seed followed by the public key again */
+	if (!egg_buffer_get_byte_array (req, *offset, offset, &pk, &n_pk) ||
+	    n_pk != ED25519_KEY_LEN ||
+	    !egg_buffer_get_byte_array (req, *offset, offset, &sk, &n_sk) ||
+	    n_sk != ED25519_KEY_LEN * 2)
+		return FALSE;
+
+	add_ed25519_params (priv_attrs);
+	add_ec_point (priv_attrs, pk, n_pk);
+	gck_builder_add_data (priv_attrs, CKA_VALUE, sk, ED25519_KEY_LEN);
+
+	/* Copy attributes to the public key */
+	attr = gck_builder_find (priv_attrs, CKA_EC_PARAMS);
+	gck_builder_add_attribute (pub_attrs, attr);
+	attr = gck_builder_find (priv_attrs, CKA_EC_POINT);
+	gck_builder_add_attribute (pub_attrs, attr);
+
+	/* Add in your basic other required attributes */
+	gck_builder_add_ulong (priv_attrs, CKA_CLASS, CKO_PRIVATE_KEY);
+	gck_builder_add_ulong (priv_attrs, CKA_KEY_TYPE, CKK_EC_EDWARDS);
+	gck_builder_add_ulong (pub_attrs, CKA_CLASS, CKO_PUBLIC_KEY);
+	gck_builder_add_ulong (pub_attrs, CKA_KEY_TYPE, CKK_EC_EDWARDS);
+
+	return TRUE;
+}
+
+gboolean
+gkd_ssh_agent_proto_read_public_ed25519 (EggBuffer *req,
+                                         gsize *offset,
+                                         GckBuilder *attrs)
+{
+	const guchar *pk;
+	gsize n_pk;
+
+	g_assert (req);
+	g_assert (offset);
+	g_assert (attrs);
+
+	if (!egg_buffer_get_byte_array (req, *offset, offset, &pk, &n_pk) ||
+	    n_pk != ED25519_KEY_LEN)
+		return FALSE;
+
+	add_ed25519_params (attrs);
+	add_ec_point (attrs, pk, n_pk);
+
+	/* Add in your basic other required attributes */
+	gck_builder_add_ulong (attrs, CKA_CLASS, CKO_PUBLIC_KEY);
+	gck_builder_add_ulong (attrs, CKA_KEY_TYPE, CKK_EC_EDWARDS);
+
+	return TRUE;
+}
+
 gboolean
 gkd_ssh_agent_proto_write_public (EggBuffer *resp, GckAttributes *attrs)
 {
@@ -408,8 +748,8 @@ gkd_ssh_agent_proto_write_public (EggBuffer *resp, GckAttributes *attrs)
 	if (!gck_attributes_find_ulong (attrs, CKA_KEY_TYPE, &algo))
 		g_return_val_if_reached (FALSE);
 
-	salgo = gkd_ssh_agent_proto_algo_to_keytype (algo);
-	g_assert (salgo);
+	salgo = gkd_ssh_agent_proto_algo_to_keytype (algo, attrs);
+	g_return_val_if_fail (salgo, FALSE);
 	egg_buffer_add_string (resp, salgo);
 
 	switch (algo) {
@@ -421,6 +761,14 @@ gkd_ssh_agent_proto_write_public (EggBuffer *resp, GckAttributes *attrs)
 		ret = gkd_ssh_agent_proto_write_public_dsa (resp, attrs);
 		break;
 
+	case CKK_EC:
+		ret = gkd_ssh_agent_proto_write_public_ecdsa (resp, attrs);
+		break;
+
+	case CKK_EC_EDWARDS:
+		ret = gkd_ssh_agent_proto_write_public_ed25519 (resp, attrs);
+		break;
+
 	default:
 		g_return_val_if_reached (FALSE);
 		break;
@@ -487,6 +835,41 @@ gkd_ssh_agent_proto_write_public_dsa (EggBuffer *resp, GckAttributes *attrs)
 	return TRUE;
 }
 
+gboolean
+gkd_ssh_agent_proto_write_public_ecdsa (EggBuffer *resp, GckAttributes *attrs)
+{
+	const guchar *q;
+	gsize n_q;
+	const GkmSexpCurve *curve;
+
+	g_assert (resp);
+	g_assert (attrs);
+
+	curve = find_curve_by_params (attrs);
+	g_return_val_if_fail (curve, FALSE);
+
+	q = find_ec_point (attrs, &n_q);
+	g_return_val_if_fail (q, FALSE);
+
+	egg_buffer_add_string (resp, curve->ssh_identifier);
+	return egg_buffer_add_byte_array (resp, q, n_q);
+}
+
+gboolean
+gkd_ssh_agent_proto_write_public_ed25519 (EggBuffer *resp, GckAttributes *attrs)
+{
+	const guchar *q;
+	gsize n_q;
+
+	g_assert (resp);
+	g_assert (attrs);
+
+	q = find_ec_point (attrs, &n_q);
+	g_return_val_if_fail (q && n_q == ED25519_KEY_LEN, FALSE);
+
+	return egg_buffer_add_byte_array (resp, q, n_q);
+}
+
 gboolean
 gkd_ssh_agent_proto_write_public_v1 (EggBuffer *resp, GckAttributes *attrs)
 {
@@ -532,3 +915,30 @@ gkd_ssh_agent_proto_write_signature_dsa (EggBuffer *resp, CK_BYTE_PTR signature,
 	g_return_val_if_fail (n_signature == 40, FALSE);
 	return egg_buffer_add_byte_array (resp, signature, n_signature);
 }
+
+gboolean
+gkd_ssh_agent_proto_write_signature_ecdsa (EggBuffer *resp, CK_BYTE_PTR signature, CK_ULONG n_signature)
+{
+	gsize blobpos;
+	gsize n_part;
+
+	/* PKCS#11 gives us r || s, SSH wants two mpints in a string */
+	g_return_val_if_fail (n_signature > 0 && n_signature % 2 == 0, FALSE);
+	n_part = n_signature / 2;
+
+	blobpos = resp->len;
+	egg_buffer_add_uint32 (resp, 0);
+
+	if (!add_mpint (resp, signature, n_part) ||
+	    !add_mpint (resp, signature + n_part, n_part))
+		return FALSE;
+
+	return egg_buffer_set_uint32 (resp, blobpos, (resp->len - blobpos) - 4);
+}
+
+gboolean
+gkd_ssh_agent_proto_write_signature_ed25519 (EggBuffer *resp, CK_BYTE_PTR signature, CK_ULONG n_signature)
+{
+	g_return_val_if_fail (n_signature == ED25519_KEY_LEN * 2, FALSE);
+	return egg_buffer_add_byte_array (resp, signature, n_signature);
+}
@@ -28,6 +28,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -49,201 +50,530 @@ static GList *pkcs11_modules = NULL;
 
 EGG_SECURE_DECLARE (ssh_agent);
 
-static gboolean
-read_all (int fd, guchar *buf, int len)
+/* --------------------------------------------------------------------------------------
+ * CLIENT CONNECTIONS
+ *
+ * One thread watches all the client sockets without blocking. Once a whole
+ * request packet has arrived it is handed to a bounded pool of worker
+ * threads, and the response is written back out by the watching thread.
+ * Signing may have to prompt for a password to unlock the key, so sign
+ * requests go to a separate pool without a limit instead, and can't hold
+ * up the other clients. Each client has at most one request being
+ * processed, so responses go out in the same order as the requests came in.
+ */
+
+typedef struct _Client {
+	int sock;
+	gboolean busy;               /* A worker is processing a request */
+	gboolean failed;             /* Disconnect once the output is written */
+	EggBuffer input;             /* Partially received packets, may contain keys */
+	EggBuffer output;            /* Responses not yet written */
+	EggBuffer req;
+	EggBuffer resp;
+	GkdSshAgentCall call;
+} Client;
+
+/* Largest request packet we accept from a client */
+#define MAX_PACKET_SIZE (256 * 1024)
+
+/* Upper limit on connected clients, and on other requests processed at once */
+#define MAX_CLIENTS 1024
+#define MAX_WORKERS 16
+
+static GThread *client_thread = NULL;
+static GThreadPool *client_workers = NULL;
+static GThreadPool *client_signers = NULL;
+static int client_wakeup[2] = { -1, -1 };
+static gint client_count = 0;
+
+/* Only touched by the client thread while it's running */
+static GPtrArray *socket_clients = NULL;
+
+/* Protects the variables below, and the busy flag of each client */
+static GMutex client_mutex;
+static GPtrArray *client_incoming = NULL;
+static gboolean client_quit = FALSE;
+
+static Client*
+client_new (int sock)
+{
+	Client *client;
+
+	client = g_slice_new0 (Client);
+	client->sock = sock;
+	egg_buffer_init_full (&client->input, 128, egg_secure_realloc);
+	egg_buffer_init_full (&client->output, 128, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&client->req, 128, egg_secure_realloc);
+	egg_buffer_init_full (&client->resp, 128, (EggBufferAllocator)g_realloc);
+	client->call.sock = sock;
+	client->call.req = &client->req;
+	client->call.resp = &client->resp;
+	client->call.modules = gck_list_ref_copy (pkcs11_modules);
+
+	g_atomic_int_inc (&client_count);
+	return client;
+}
+
+static void
+client_free (Client *client)
 {
-	int all = len;
+	egg_buffer_uninit (&client->input);
+	egg_buffer_uninit (&client->output);
+	egg_buffer_uninit (&client->req);
+	egg_buffer_uninit (&client->resp);
+	gck_list_unref_free (client->call.modules);
+
+	close (client->sock);
+	g_slice_free (Client, client);
+	g_atomic_int_add (&client_count, -1);
+}
+
+static void
+client_wake (void)
+{
+	guchar ch = 0;
 	int res;
 
-	while (len > 0) {
+	do {
+		res = write (client_wakeup[1], &ch, 1);
+	} while (res < 0 && errno == EINTR);
+}
 
-		res = read (fd, buf, len);
+static void
+run_client_request (gpointer data,
+                    gpointer unused)
+{
+	Client *client = data;
+	gboolean ret = FALSE;
+	guchar op;
 
-		if (res < 0) {
-			if (errno == EAGAIN || errno == EINTR)
-				continue;
-			g_warning ("couldn't read %u bytes from client: %s", all,
-			           g_strerror (errno));
-			return FALSE;
-		} else if (res == 0) {
-			return FALSE;
-		} else  {
-			len -= res;
-			buf += res;
-		}
+	/* 1. Decode the operation */
+	if (egg_buffer_get_byte (client->call.req, 4, NULL, &op) &&
+	    op < GKD_SSH_OP_MAX) {
+		g_assert (gkd_ssh_agent_operations[op]);
+
+		/* 2. Execute the right operation */
+		egg_buffer_reset (client->call.resp);
+		egg_buffer_add_uint32 (client->call.resp, 0);
+		ret = (gkd_ssh_agent_operations[op]) (&client->call) &&
+		      egg_buffer_set_uint32 (client->call.resp, 0, client->call.resp->len - 4);
 	}
 
-	return TRUE;
+	/* 3. Queue the reply to be written out */
+	if (ret)
+		egg_buffer_append (&client->output, client->call.resp->buf, client->call.resp->len);
+	else
+		client->failed = TRUE;
+
+	egg_buffer_reset (client->call.req);
+
+	g_mutex_lock (&client_mutex);
+	client->busy = FALSE;
+	g_mutex_unlock (&client_mutex);
+
+	client_wake ();
 }
 
+/* These return FALSE when the client should be disconnected */
+
 static gboolean
-write_all (int fd, const guchar *buf, int len)
+client_read (Client *client)
 {
-	int all = len;
 	int res;
 
-	while (len > 0) {
+	if (!egg_buffer_reserve (&client->input, client->input.len + 4096)) {
+		g_warning ("couldn't allocate buffer for SSH agent request");
+		return FALSE;
+	}
 
-		res = write (fd, buf, len);
-		if (res < 0) {
-			if (errno == EAGAIN && errno == EINTR)
-				continue;
-			if (errno != EPIPE)
-				g_warning ("couldn't write %u bytes to client: %s", all,
-				           g_strerror (errno));
-			return FALSE;
-		} else if (res == 0) {
-			g_warning ("couldn't write %u bytes to client", all);
-			return FALSE;
-		} else  {
-			len -= res;
-			buf += res;
-		}
+	res = read (client->sock, client->input.buf + client->input.len, 4096);
+	if (res == 0) {
+		return FALSE;
+	} else if (res < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return TRUE;
+		g_warning ("couldn't read from client: %s", g_strerror (errno));
+		return FALSE;
 	}
 
+	egg_buffer_add_empty (&client->input, res);
 	return TRUE;
 }
 
 static gboolean
-read_packet_with_size (GkdSshAgentCall *call)
+client_write (Client *client)
 {
-	int fd;
-	guint32 packet_size;
-
-	fd = call->sock;
+	int res;
 
-	egg_buffer_resize (call->req, 4);
-	if (!read_all (fd, call->req->buf, 4))
+	res = write (client->sock, client->output.buf, client->output.len);
+	if (res < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return TRUE;
+		if (errno != EPIPE)
+			g_warning ("couldn't write to client: %s", g_strerror (errno));
 		return FALSE;
+	}
+
+	memmove (client->output.buf, client->output.buf + res, client->output.len - res);
+	client->output.len -= res;
+	return TRUE;
+}
+
+static gboolean
+client_dispatch (Client *client)
+{
+	guint32 packet_size;
+	guchar op;
 
-	if (!egg_buffer_get_uint32 (call->req, 0, NULL, &packet_size) ||
-	    packet_size < 1) {
+	if (client->input.len < 4)
+		return TRUE;
+
+	if (!egg_buffer_get_uint32 (&client->input, 0, NULL, &packet_size) ||
+	    packet_size < 1 || packet_size > MAX_PACKET_SIZE) {
 		g_warning ("invalid packet size from client");
 		return FALSE;
 	}
 
-	egg_buffer_resize (call->req, packet_size + 4);
-	if (!read_all (fd, call->req->buf + 4, packet_size))
-		return FALSE;
+	if (client->input.len - 4 < packet_size)
+		return TRUE;
+
+	/* Move the whole packet over to the request */
+	egg_buffer_reset (&client->req);
+	egg_buffer_append (&client->req, client->input.buf, packet_size + 4);
+	egg_secure_clear (client->input.buf, packet_size + 4);
+	memmove (client->input.buf, client->input.buf + packet_size + 4,
+	         client->input.len - (packet_size + 4));
+	client->input.len -= packet_size + 4;
+
+	g_mutex_lock (&client_mutex);
+	client->busy = TRUE;
+	g_mutex_unlock (&client_mutex);
+
+	if (egg_buffer_get_byte (&client->req, 4, NULL, &op) && op == GKD_SSH_OP_SIGN_REQUEST)
+		g_thread_pool_push (client_signers, client, NULL);
+	else
+		g_thread_pool_push (client_workers, client, NULL);
+	return TRUE;
+}
+
+static gboolean
+client_process (Client *client,
+                gushort revents)
+{
+	if (revents & POLLOUT && client->output.len > 0) {
+		if (!client_write (client))
+			return FALSE;
+	}
+
+	/* A failed request gets disconnected once its output is gone */
+	if (client->failed)
+		return client->output.len > 0;
+
+	if (revents & (POLLIN | POLLHUP | POLLERR)) {
+		if (!client_read (client))
+			return FALSE;
+	}
+
+	/* The next request, once the previous response is out */
+	if (client->output.len == 0)
+		return client_dispatch (client);
 
 	return TRUE;
 }
 
 static gpointer
-run_client_thread (gpointer data)
+run_client_thread (gpointer unused)
 {
-	gint *socket = data;
-	GkdSshAgentCall call;
-	EggBuffer req;
-	EggBuffer resp;
-	guchar op;
+	struct pollfd *fds = NULL;
+	Client *client;
+	guchar buf[64];
+	guint i, n_fds;
+	gboolean quit;
 
-	memset (&call, 0, sizeof (call));
-	call.sock = g_atomic_int_get (socket);
-	g_assert (call.sock != -1);
+	for (;;) {
+		n_fds = 0;
 
-	egg_buffer_init_full (&req, 128, egg_secure_realloc);
-	egg_buffer_init_full (&resp, 128, (EggBufferAllocator)g_realloc);
-	call.req = &req;
-	call.resp = &resp;
-	call.modules = gck_list_ref_copy (pkcs11_modules);
+		g_mutex_lock (&client_mutex);
 
-	for (;;) {
+		quit = client_quit;
+		for (i = 0; i < client_incoming->len; i++)
+			g_ptr_array_add (socket_clients, client_incoming->pdata[i]);
+		g_ptr_array_set_size (client_incoming, 0);
 
-		egg_buffer_reset (call.req);
+		fds = g_renew (struct pollfd, fds, socket_clients->len + 1);
+		fds[n_fds].fd = client_wakeup[0];
+		fds[n_fds].events = POLLIN;
+		fds[n_fds++].revents = 0;
 
-		/* 1. Read in the request */
-		if (!read_packet_with_size (&call))
-			break;
+		/* Busy clients are left alone until their request is done */
+		for (i = 0; i < socket_clients->len; i++) {
+			client = socket_clients->pdata[i];
+			fds[n_fds].fd = client->busy ? -1 : client->sock;
+			fds[n_fds].events = 0;
 
-		/* 2. Now decode the operation */
-		if (!egg_buffer_get_byte (call.req, 4, NULL, &op))
-			break;
-		if (op >= GKD_SSH_OP_MAX)
-			break;
-		g_assert (gkd_ssh_agent_operations[op]);
+			/* Don't read ahead while a response or a whole packet is waiting */
+			if (client->output.len > 0)
+				fds[n_fds].events = POLLOUT;
+			else if (client->input.len < MAX_PACKET_SIZE + 4)
+				fds[n_fds].events = POLLIN;
 
-		/* 3. Execute the right operation */
-		egg_buffer_reset (call.resp);
-		egg_buffer_add_uint32 (call.resp, 0);
-		if (!(gkd_ssh_agent_operations[op]) (&call))
-			break;
-		if (!egg_buffer_set_uint32 (call.resp, 0, call.resp->len - 4))
+			fds[n_fds++].revents = 0;
+		}
+
+		g_mutex_unlock (&client_mutex);
+
+		if (quit)
 			break;
 
-		/* 4. Write the reply back out */
-		if (!write_all (call.sock, call.resp->buf, call.resp->len))
+		if (poll (fds, n_fds, -1) < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			g_warning ("couldn't watch SSH agent clients: %s", g_strerror (errno));
 			break;
-	}
+		}
 
-	egg_buffer_uninit (&req);
-	egg_buffer_uninit (&resp);
-	gck_list_unref_free (call.modules);
-	call.modules = NULL;
+		/* Drain the wakeup pipe, we look at all the clients anyway */
+		if (fds[0].revents)
+			while (read (client_wakeup[0], buf, sizeof (buf)) > 0);
+
+		/* Go backwards, so removing doesn't upset the indexes */
+		for (i = socket_clients->len; i > 0; i--) {
+			client = socket_clients->pdata[i - 1];
+			if (fds[i].fd == -1)
+				continue;
 
-	close (call.sock);
-	g_atomic_int_set (socket, -1);
+			/* Look at everyone, since a request may have finished */
+			if (!client_process (client, fds[i].revents)) {
+				g_ptr_array_remove_index_fast (socket_clients, i - 1);
+				client_free (client);
+			}
+		}
+	}
 
+	g_free (fds);
 	return NULL;
 }
 
+static gboolean
+start_client_thread (void)
+{
+	GError *error = NULL;
+	gint n_workers;
+	int i;
+
+	if (pipe (client_wakeup) < 0) {
+		g_warning ("couldn't create wakeup pipe: %s", g_strerror (errno));
+		return FALSE;
+	}
+
+	for (i = 0; i < 2; i++) {
+		fcntl (client_wakeup[i], F_SETFD, FD_CLOEXEC);
+		fcntl (client_wakeup[i], F_SETFL, O_NONBLOCK);
+	}
+
+	n_workers = CLAMP (g_get_num_processors () * 2, 4, MAX_WORKERS);
+	client_workers = g_thread_pool_new (run_client_request, NULL, n_workers, FALSE, &error);
+	if (!client_workers) {
+		g_warning ("couldn't create SSH agent worker threads: %s", egg_error_message (error));
+		g_clear_error (&error);
+		return FALSE;
+	}
+
+	/* At most one per client, each of which may be waiting on a prompt */
+	client_signers = g_thread_pool_new (run_client_request, NULL, -1, FALSE, &error);
+	if (!client_signers) {
+		g_warning ("couldn't create SSH agent worker threads: %s", egg_error_message (error));
+		g_clear_error (&error);
+		return FALSE;
+	}
+
+	socket_clients = g_ptr_array_new ();
+	client_incoming = g_ptr_array_new ();
+	client_quit = FALSE;
+
+	client_thread = g_thread_try_new ("ssh-agent", run_client_thread, NULL, &error);
+	if (!client_thread) {
+		g_warning ("couldn't create SSH agent thread: %s", egg_error_message (error));
+		g_clear_error (&error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+stop_client_thread (void)
+{
+	guint i;
+	int j;
+
+	if (client_thread) {
+		g_mutex_lock (&client_mutex);
+		client_quit = TRUE;
+		g_mutex_unlock (&client_mutex);
+		client_wake ();
+		g_thread_join (client_thread);
+		client_thread = NULL;
+	}
+
+	/* Forcibly shutdown the connections, and wait for any requests */
+	if (socket_clients) {
+		for (i = 0; i < socket_clients->len; i++)
+			shutdown (((Client *)socket_clients->pdata[i])->sock, SHUT_RDWR);
+	}
+
+	if (client_workers) {
+		g_thread_pool_free (client_workers, FALSE, TRUE);
+		client_workers = NULL;
+	}
+
+	if (client_signers) {
+		g_thread_pool_free (client_signers, FALSE, TRUE);
+		client_signers = NULL;
+	}
+
+	if (socket_clients) {
+		g_ptr_array_foreach (socket_clients, (GFunc)client_free, NULL);
+		g_ptr_array_free (socket_clients, TRUE);
+		socket_clients = NULL;
+	}
+
+	if (client_incoming) {
+		g_ptr_array_foreach (client_incoming, (GFunc)client_free, NULL);
+		g_ptr_array_free (client_incoming, TRUE);
+		client_incoming = NULL;
+	}
+
+	for (j = 0; j < 2; j++) {
+		if (client_wakeup[j] != -1)
+			close (client_wakeup[j]);
+		client_wakeup[j] = -1;
+	}
+}
+
 /* --------------------------------------------------------------------------------------
  * SESSION MANAGEMENT
  */
 
-/* The main PKCS#11 session that owns objects, and the mutex/cond for waiting on it */
-static GckSession *pkcs11_main_session = NULL;
-static gboolean pkcs11_main_checked = FALSE;
-static GMutex *pkcs11_main_mutex = NULL;
-static GCond *pkcs11_main_cond = NULL;
+/* Default and upper bound on the number of sessions in the pool */
+#define DEFAULT_SESSIONS 4
+#define MAX_SESSIONS 32
+
+/*
+ * A pool of logged in PKCS#11 sessions. The session objects we create live in
+ * the apartment of the slot, so they're visible from any session in the pool.
+ * More sessions are opened on demand, up to pkcs11_pool_max. Sessions are only
+ * closed on uninitialize, since closing one destroys the objects it created.
+ */
+static GckSlot *pkcs11_pool_slot = NULL;
+static GQueue pkcs11_pool_idle = G_QUEUE_INIT;
+static guint pkcs11_pool_open = 0;
+static guint pkcs11_pool_max = DEFAULT_SESSIONS;
+static GMutex pkcs11_pool_mutex;
+static GCond pkcs11_pool_cond;
+
+/* Counters for time spent waiting on checkout, in microseconds */
+static guint64 pkcs11_pool_checkouts = 0;
+static guint64 pkcs11_pool_waits = 0;
+static gint64 pkcs11_pool_wait_total = 0;
+static gint64 pkcs11_pool_wait_max = 0;
+
+static guint
+session_pool_size (void)
+{
+	const gchar *env;
+	gint64 size;
+
+	env = g_getenv ("GNOME_KEYRING_AGENT_SESSIONS");
+	if (env == NULL || !env[0])
+		return DEFAULT_SESSIONS;
+
+	size = g_ascii_strtoll (env, NULL, 10);
+	return CLAMP (size, 1, MAX_SESSIONS);
+}
+
+static GckSession*
+session_pool_open (GckSlot *slot)
+{
+	GckSession *session;
+	GError *error = NULL;
+
+	session = gck_slot_open_session (slot, GCK_SESSION_AUTHENTICATE, NULL, &error);
+	if (!session) {
+		g_warning ("couldn't create pkcs#11 session: %s", egg_error_message (error));
+		g_clear_error (&error);
+	}
+
+	return session;
+}
 
 GckSession*
-gkd_ssh_agent_checkout_main_session (void)
+gkd_ssh_agent_checkout_session (void)
 {
-	GckSession *result;
+	GckSession *result = NULL;
+	gboolean waited = FALSE;
+	gint64 start = 0;
+	gint64 waiting;
+
+	g_mutex_lock (&pkcs11_pool_mutex);
+
+	g_assert (GCK_IS_SLOT (pkcs11_pool_slot));
+
+	while ((result = g_queue_pop_head (&pkcs11_pool_idle)) == NULL) {
+
+		/* Room to grow the pool, open one without holding the lock */
+		if (pkcs11_pool_open < pkcs11_pool_max) {
+			pkcs11_pool_open++;
+			g_mutex_unlock (&pkcs11_pool_mutex);
+			result = session_pool_open (pkcs11_pool_slot);
+			g_mutex_lock (&pkcs11_pool_mutex);
+			if (result)
+				break;
+
+			/* Don't try again, make do with what we have */
+			pkcs11_pool_open--;
+			pkcs11_pool_max = pkcs11_pool_open;
+			continue;
+		}
 
-	g_mutex_lock (pkcs11_main_mutex);
+		if (!waited) {
+			start = g_get_monotonic_time ();
+			waited = TRUE;
+		}
+		g_cond_wait (&pkcs11_pool_cond, &pkcs11_pool_mutex);
+	}
 
-		g_assert (GCK_IS_SESSION (pkcs11_main_session));
-		while (pkcs11_main_checked)
-			g_cond_wait (pkcs11_main_cond, pkcs11_main_mutex);
-		pkcs11_main_checked = TRUE;
-		result = g_object_ref (pkcs11_main_session);
+	pkcs11_pool_checkouts++;
+	if (waited) {
+		waiting = g_get_monotonic_time () - start;
+		pkcs11_pool_waits++;
+		pkcs11_pool_wait_total += waiting;
+		pkcs11_pool_wait_max = MAX (pkcs11_pool_wait_max, waiting);
+	}
 
-	g_mutex_unlock (pkcs11_main_mutex);
+	g_mutex_unlock (&pkcs11_pool_mutex);
 
 	return result;
 }
 
 void
-gkd_ssh_agent_checkin_main_session (GckSession *session)
+gkd_ssh_agent_checkin_session (GckSession *session)
 {
 	g_assert (GCK_IS_SESSION (session));
 
-	g_mutex_lock (pkcs11_main_mutex);
+	g_mutex_lock (&pkcs11_pool_mutex);
 
-		g_assert (session == pkcs11_main_session);
-		g_assert (pkcs11_main_checked);
+		g_assert (g_queue_get_length (&pkcs11_pool_idle) < pkcs11_pool_open);
+		g_queue_push_head (&pkcs11_pool_idle, session);
+		g_cond_signal (&pkcs11_pool_cond);
 
-		g_object_unref (session);
-		pkcs11_main_checked = FALSE;
-		g_cond_signal (pkcs11_main_cond);
-
-	g_mutex_unlock (pkcs11_main_mutex);
+	g_mutex_unlock (&pkcs11_pool_mutex);
 }
 
 /* --------------------------------------------------------------------------------------
  * MAIN THREAD
  */
 
-typedef struct _Client {
-	GThread *thread;
-	gint sock;
-} Client;
-
-/* Each client thread in this list */
-static GList *socket_clients = NULL;
-
 /* The main socket we listen on */
 static int socket_fd = -1;
 
@@ -256,94 +586,74 @@ gkd_ssh_agent_accept (void)
 	Client *client;
 	struct sockaddr_un addr;
 	socklen_t addrlen;
-	GError *error = NULL;
-	GList *l;
 	int new_fd;
 
 	g_return_if_fail (socket_fd != -1);
 
-	/* Cleanup any completed dispatch threads */
-	for (l = socket_clients; l; l = g_list_next (l)) {
-		client = l->data;
-		if (g_atomic_int_get (&client->sock) == -1) {
-			g_thread_join (client->thread);
-			g_slice_free (Client, client);
-			l->data = NULL;
-		}
-	}
-	socket_clients = g_list_remove_all (socket_clients, NULL);
-
 	addrlen = sizeof (addr);
 	new_fd = accept (socket_fd, (struct sockaddr*) &addr, &addrlen);
-	if (socket_fd < 0) {
+	if (new_fd < 0) {
 		g_warning ("cannot accept SSH agent connection: %s", strerror (errno));
 		return;
 	}
 
-	client = g_slice_new0 (Client);
-	client->sock = new_fd;
-
-	/* And create a new thread/process */
-	client->thread = g_thread_new ("ssh-agent", run_client_thread, &client->sock);
-	if (!client->thread) {
-		g_warning ("couldn't create thread SSH agent connection: %s",
-		           egg_error_message (error));
-		g_slice_free (Client, client);
+	if (g_atomic_int_get (&client_count) >= MAX_CLIENTS) {
+		g_message ("too many SSH agent connections, refusing another");
+		close (new_fd);
 		return;
 	}
 
-	socket_clients = g_list_append (socket_clients, client);
+	fcntl (new_fd, F_SETFD, FD_CLOEXEC);
+	fcntl (new_fd, F_SETFL, fcntl (new_fd, F_GETFL) | O_NONBLOCK);
+
+	client = client_new (new_fd);
+
+	/* Hand it over to the client thread */
+	g_mutex_lock (&client_mutex);
+	g_ptr_array_add (client_incoming, client);
+	g_mutex_unlock (&client_mutex);
+
+	client_wake ();
 }
 
 void
 gkd_ssh_agent_shutdown (void)
 {
-	Client *client;
-	GList *l;
-
 	if (socket_fd != -1)
 		close (socket_fd);
+	socket_fd = -1;
 
 	if (*socket_path)
 		unlink (socket_path);
 
-	/* Stop all of the dispatch threads */
-	for (l = socket_clients; l; l = g_list_next (l)) {
-		client = l->data;
-
-		/* Forcibly shutdown the connection */
-		if (client->sock != -1)
-			shutdown (client->sock, SHUT_RDWR);
-		g_thread_join (client->thread);
-
-		/* This is always closed by client thread */
-		g_assert (client->sock == -1);
-		g_slice_free (Client, client);
-	}
-
-	g_list_free (socket_clients);
-	socket_clients = NULL;
+	/* Stop the client thread and any requests */
+	stop_client_thread ();
 }
 
 void
 gkd_ssh_agent_uninitialize (void)
 {
-	gboolean ret;
+	GckSession *session;
 
-	g_assert (pkcs11_main_mutex);
-	ret = g_mutex_trylock (pkcs11_main_mutex);
-	g_assert (ret);
+	g_mutex_lock (&pkcs11_pool_mutex);
 
-		g_assert (GCK_IS_SESSION (pkcs11_main_session));
-		g_assert (!pkcs11_main_checked);
-		g_object_unref (pkcs11_main_session);
-		pkcs11_main_session = NULL;
+		g_assert (GCK_IS_SLOT (pkcs11_pool_slot));
+		g_assert (g_queue_get_length (&pkcs11_pool_idle) == pkcs11_pool_open);
+		while ((session = g_queue_pop_head (&pkcs11_pool_idle)) != NULL)
+			g_object_unref (session);
+		pkcs11_pool_open = 0;
+		g_object_unref (pkcs11_pool_slot);
+		pkcs11_pool_slot = NULL;
 
-	g_mutex_unlock (pkcs11_main_mutex);
-	g_mutex_clear (pkcs11_main_mutex);
-	g_free (pkcs11_main_mutex);
-	g_cond_clear (pkcs11_main_cond);
-	g_free (pkcs11_main_cond);
+		g_debug ("ssh agent session checkouts: %" G_GUINT64_FORMAT ", waited: %" G_GUINT64_FORMAT
+		         ", total wait: %" G_GINT64_FORMAT " us, longest wait: %" G_GINT64_FORMAT " us",
+		         pkcs11_pool_checkouts, pkcs11_pool_waits, pkcs11_pool_wait_total, pkcs11_pool_wait_max);
+
+	g_mutex_unlock (&pkcs11_pool_mutex);
+
+	gkd_ssh_agent_unwatch_identities ();
+	gkd_ssh_agent_clear_key_cache ();
+	gkd_ssh_agent_clear_identities_cache ();
 
 	gck_list_unref_free (pkcs11_modules);
 	pkcs11_modules = NULL;
@@ -360,6 +670,18 @@ gkd_ssh_agent_initialize (CK_FUNCTION_LIST_PTR funcs)
 	module = gck_module_new (funcs);
 	ret = gkd_ssh_agent_initialize_with_module (module);
 	g_object_unref (module);
+
+	/* Notice keys the ssh store picks up from its directory */
+	if (ret) {
+		const gchar *directory = "~/.ssh";
+#if WITH_DEBUG
+		const gchar *path = g_getenv ("GNOME_KEYRING_TEST_PATH");
+		if (path && path[0])
+			directory = path;
+#endif
+		gkd_ssh_agent_watch_identities (directory);
+	}
+
 	return ret;
 }
 
@@ -367,9 +689,9 @@ gboolean
 gkd_ssh_agent_initialize_with_module (GckModule *module)
 {
 	GckSession *session = NULL;
+	GckSlot *slot = NULL;
 	GList *slots, *l;
 	GArray *mechs;
-	GError *error = NULL;
 
 	g_assert (GCK_IS_MODULE (module));
 
@@ -382,11 +704,9 @@ gkd_ssh_agent_initialize_with_module (GckModule *module)
 		if (gck_mechanisms_check (mechs, CKM_RSA_PKCS, CKM_DSA, GCK_INVALID)) {
 
 			/* Try and open a session */
-			session = gck_slot_open_session (l->data, GCK_SESSION_AUTHENTICATE, NULL, &error);
-			if (!session) {
-				g_warning ("couldn't create pkcs#11 session: %s", egg_error_message (error));
-				g_clear_error (&error);
-			}
+			session = session_pool_open (l->data);
+			if (session)
+				slot = g_object_ref (l->data);
 		}
 
 		g_array_unref (mechs);
@@ -402,12 +722,17 @@ gkd_ssh_agent_initialize_with_module (GckModule *module)
 	g_assert (!pkcs11_modules);
 	pkcs11_modules = g_list_append (NULL, g_object_ref (module));
 
-	pkcs11_main_mutex = g_new0 (GMutex, 1);
-	g_mutex_init (pkcs11_main_mutex);
-	pkcs11_main_cond = g_new0 (GCond, 1);
-	g_cond_init (pkcs11_main_cond);
-	pkcs11_main_checked = FALSE;
-	pkcs11_main_session = session;
+	g_mutex_lock (&pkcs11_pool_mutex);
+
+		g_assert (!pkcs11_pool_slot);
+		pkcs11_pool_slot = slot;
+		pkcs11_pool_max = session_pool_size ();
+		pkcs11_pool_open = 1;
+		g_queue_push_head (&pkcs11_pool_idle, session);
+		pkcs11_pool_checkouts = pkcs11_pool_waits = 0;
+		pkcs11_pool_wait_total = pkcs11_pool_wait_max = 0;
+
+	g_mutex_unlock (&pkcs11_pool_mutex);
 
 	return TRUE;
 }
@@ -444,6 +769,12 @@ gkd_ssh_agent_startup (const gchar *prefix)
 		return -1;
 	}
 
+	if (!start_client_thread ()) {
+		stop_client_thread ();
+		close (sock);
+		return -1;
+	}
+
 	g_setenv ("SSH_AUTH_SOCK", socket_path, TRUE);
 
 	socket_fd = sock;
@@ -0,0 +1,468 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* test-ssh-agent-identities.c: Test the SSH agent identities answer
+
+   The Gnome Keyring Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Keyring Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include "daemon/ssh-agent/gkd-ssh-agent.h"
+#include "daemon/ssh-agent/gkd-ssh-agent-private.h"
+
+#include "egg/egg-buffer.h"
+#include "egg/egg-secure-memory.h"
+#include "egg/egg-testing.h"
+
+#include "ssh-store/gkm-ssh-store.h"
+
+#include <gck/gck.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <sys/time.h>
+
+#include <errno.h>
+#include <string.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+/* Ed25519 keys from the RFC 8032 test vectors */
+static const guchar KEY_ONE_SEED[32] = {
+	0x9d, 0x61, 0xb1, 0x9d, 0xef, 0xfd, 0x5a, 0x60, 0xba, 0x84, 0x4a, 0xf4, 0x92, 0xec, 0x2c, 0xc4,
+	0x44, 0x49, 0xc5, 0x69, 0x7b, 0x32, 0x69, 0x19, 0x70, 0x3b, 0xac, 0x03, 0x1c, 0xae, 0x7f, 0x60,
+};
+
+static const guchar KEY_ONE_PUBLIC[32] = {
+	0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7, 0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+	0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25, 0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a,
+};
+
+static const guchar KEY_TWO_SEED[32] = {
+	0x4c, 0xcd, 0x08, 0x9b, 0x28, 0xff, 0x96, 0xda, 0x9d, 0xb6, 0xc3, 0x46, 0xec, 0x11, 0x4e, 0x0f,
+	0x5b, 0x8a, 0x31, 0x9f, 0x35, 0xab, 0xa6, 0x24, 0xda, 0x8c, 0xf6, 0xed, 0x4f, 0xb8, 0xa6, 0xfb,
+};
+
+static const guchar KEY_TWO_PUBLIC[32] = {
+	0x3d, 0x40, 0x17, 0xc3, 0xe8, 0x43, 0x89, 0x5a, 0x92, 0xb7, 0x0a, 0xa7, 0x4d, 0x1b, 0x7e, 0xbc,
+	0x9c, 0x98, 0x2c, 0xcf, 0x2e, 0xc4, 0x96, 0x8c, 0xc0, 0xcd, 0x55, 0xf1, 0x2a, 0xf4, 0x66, 0x0c,
+};
+
+/* The key in pkcs11/ssh-store/fixtures/id_ed25519_plain.pub */
+static const guchar FILE_KEY_PUBLIC[32] = {
+	0x50, 0x12, 0xd8, 0x55, 0x55, 0xe7, 0x18, 0x62, 0x08, 0x7e, 0xe7, 0x32, 0x66, 0x26, 0x0a, 0x89,
+	0x7e, 0xc0, 0x2e, 0x2e, 0x86, 0xe8, 0x7c, 0x62, 0x36, 0x19, 0x68, 0x6f, 0x27, 0xca, 0x09, 0xf6,
+};
+
+#define FILE_KEY_COMMENT "A public key comment"
+
+typedef struct {
+	CK_FUNCTION_LIST_PTR funcs;
+	GList *modules;
+	gchar *directory;
+	EggBuffer req;
+	EggBuffer resp;
+} Test;
+
+static void
+setup (Test *test,
+       gconstpointer unused)
+{
+	CK_C_INITIALIZE_ARGS args;
+	GckModule *module;
+	CK_RV rv;
+
+	test->directory = egg_tests_create_scratch_directory (NULL, NULL);
+
+	memset (&args, 0, sizeof (args));
+	args.flags = CKF_OS_LOCKING_OK;
+	args.pReserved = g_strdup_printf ("directory='%s'", test->directory);
+
+	test->funcs = gkm_ssh_store_get_functions ();
+	rv = (test->funcs->C_Initialize) (&args);
+	g_free (args.pReserved);
+	g_assert_cmpint (rv, ==, CKR_OK);
+
+	module = gck_module_new (test->funcs);
+	if (!gkd_ssh_agent_initialize_with_module (module))
+		g_assert_not_reached ();
+	gkd_ssh_agent_watch_identities (test->directory);
+	test->modules = g_list_append (NULL, module);
+
+	egg_buffer_init_full (&test->req, 128, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&test->resp, 128, (EggBufferAllocator)g_realloc);
+}
+
+static void
+teardown (Test *test,
+          gconstpointer unused)
+{
+	CK_RV rv;
+
+	egg_buffer_uninit (&test->req);
+	egg_buffer_uninit (&test->resp);
+
+	gkd_ssh_agent_uninitialize ();
+	gck_list_unref_free (test->modules);
+
+	rv = (test->funcs->C_Finalize) (NULL);
+	g_assert_cmpint (rv, ==, CKR_OK);
+
+	egg_tests_remove_scratch_directory (test->directory);
+	g_free (test->directory);
+}
+
+static void
+begin_request (Test *test,
+               guchar op)
+{
+	egg_buffer_reset (&test->req);
+	egg_buffer_add_uint32 (&test->req, 0);
+	egg_buffer_add_byte (&test->req, op);
+}
+
+static guchar
+transact (Test *test)
+{
+	GkdSshAgentCall call = { -1, test->modules, &test->req, &test->resp };
+	guchar op, code;
+
+	egg_buffer_set_uint32 (&test->req, 0, test->req.len - 4);
+	g_assert (!egg_buffer_has_error (&test->req));
+
+	egg_buffer_reset (&test->resp);
+	egg_buffer_add_uint32 (&test->resp, 0);
+
+	if (!egg_buffer_get_byte (&test->req, 4, NULL, &op))
+		g_assert_not_reached ();
+	g_assert (gkd_ssh_agent_operations[op] (&call));
+
+	g_assert (!egg_buffer_has_error (&test->resp));
+	if (!egg_buffer_get_byte (&test->resp, 4, NULL, &code))
+		g_assert_not_reached ();
+	return code;
+}
+
+static void
+add_public_blob (EggBuffer *buffer,
+                 const guchar *public)
+{
+	gsize blobpos;
+
+	blobpos = buffer->len;
+	egg_buffer_add_uint32 (buffer, 0);
+	egg_buffer_add_string (buffer, "ssh-ed25519");
+	egg_buffer_add_byte_array (buffer, public, 32);
+	egg_buffer_set_uint32 (buffer, blobpos, (buffer->len - blobpos) - 4);
+}
+
+static void
+add_identity (Test *test,
+              const guchar *seed,
+              const guchar *public,
+              const gchar *comment)
+{
+	guchar secret[64];
+
+	/* The secret part is the seed followed by the public key */
+	memcpy (secret, seed, 32);
+	memcpy (secret + 32, public, 32);
+
+	begin_request (test, GKD_SSH_OP_ADD_IDENTITY);
+	egg_buffer_add_string (&test->req, "ssh-ed25519");
+	egg_buffer_add_byte_array (&test->req, public, 32);
+	egg_buffer_add_byte_array (&test->req, secret, sizeof (secret));
+	egg_buffer_add_string (&test->req, comment);
+	g_assert_cmpint (transact (test), ==, GKD_SSH_RES_SUCCESS);
+}
+
+static void
+remove_identity (Test *test,
+                 const guchar *public)
+{
+	begin_request (test, GKD_SSH_OP_REMOVE_IDENTITY);
+	add_public_blob (&test->req, public);
+	g_assert_cmpint (transact (test), ==, GKD_SSH_RES_SUCCESS);
+}
+
+static void
+simple_request (Test *test,
+                guchar op)
+{
+	begin_request (test, op);
+	if (op == GKD_SSH_OP_LOCK || op == GKD_SSH_OP_UNLOCK)
+		egg_buffer_add_string (&test->req, "passphrase");
+	g_assert_cmpint (transact (test), ==, GKD_SSH_RES_SUCCESS);
+}
+
+static void
+copy_key_file (Test *test,
+               const gchar *name)
+{
+	gchar *filename;
+
+	filename = g_build_filename (SRCDIR "/pkcs11/ssh-store/fixtures", name, NULL);
+	egg_tests_copy_scratch_file (test->directory, filename);
+	g_free (filename);
+}
+
+static void
+write_key_file (Test *test,
+                const gchar *name,
+                const gchar *contents)
+{
+	GError *error = NULL;
+	struct timeval tv[2];
+	gchar *filename;
+
+	filename = g_build_filename (test->directory, name, NULL);
+	g_file_set_contents (filename, contents, -1, &error);
+	g_assert_no_error (error);
+
+	/* Make sure the modification time moves on */
+	gettimeofday (tv, NULL);
+	tv[0].tv_sec += 5;
+	memcpy (tv + 1, tv, sizeof (struct timeval));
+	if (utimes (filename, tv) < 0)
+		g_error ("couldn't update file time: %s: %s", filename, g_strerror (errno));
+
+	g_free (filename);
+}
+
+static void
+remove_key_file (Test *test,
+                 const gchar *name)
+{
+	gchar *filename;
+
+	filename = g_build_filename (test->directory, name, NULL);
+	if (g_unlink (filename) < 0)
+		g_error ("couldn't remove file: %s: %s", filename, g_strerror (errno));
+	g_free (filename);
+}
+
+static gint
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+	return strcmp (*(const gchar **)a, *(const gchar **)b);
+}
+
+/* Parses the identities answer into sorted "comment:blob" strings */
+static GPtrArray*
+parse_identities (EggBuffer *resp)
+{
+	GPtrArray *identities;
+	const guchar *blob;
+	gchar *comment;
+	gchar *encoded;
+	gsize n_blob;
+	gsize offset;
+	guint32 count, i;
+	guchar code;
+
+	if (!egg_buffer_get_byte (resp, 4, &offset, &code))
+		g_assert_not_reached ();
+	g_assert_cmpint (code, ==, GKD_SSH_RES_IDENTITIES_ANSWER);
+	if (!egg_buffer_get_uint32 (resp, offset, &offset, &count))
+		g_assert_not_reached ();
+
+	identities = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; i < count; i++) {
+		if (!egg_buffer_get_byte_array (resp, offset, &offset, &blob, &n_blob) ||
+		    !egg_buffer_get_string (resp, offset, &offset, &comment, (EggBufferAllocator)g_realloc))
+			g_assert_not_reached ();
+		encoded = g_base64_encode (blob, n_blob);
+		g_ptr_array_add (identities, g_strdup_printf ("%s:%s", comment, encoded));
+		g_free (encoded);
+		g_free (comment);
+	}
+
+	g_assert_cmpuint (offset, ==, resp->len);
+	g_ptr_array_sort (identities, compare_strings);
+	return identities;
+}
+
+static GPtrArray*
+request_identities (Test *test)
+{
+	begin_request (test, GKD_SSH_OP_REQUEST_IDENTITIES);
+	transact (test);
+	return parse_identities (&test->resp);
+}
+
+static void
+assert_identities_equal (GPtrArray *one,
+                         GPtrArray *two)
+{
+	guint i;
+
+	g_assert_cmpuint (one->len, ==, two->len);
+	for (i = 0; i < one->len; i++)
+		g_assert_cmpstr (one->pdata[i], ==, two->pdata[i]);
+}
+
+/* Checks the (possibly cached) answer against a freshly built one */
+static void
+check_identities (Test *test,
+                  guint n_expected,
+                  ...)
+{
+	GPtrArray *expected;
+	GPtrArray *answer;
+	GPtrArray *fresh;
+	EggBuffer first;
+	const guchar *public;
+	const gchar *comment;
+	gchar *encoded;
+	EggBuffer blob;
+	va_list va;
+	guint i;
+
+	expected = g_ptr_array_new_with_free_func (g_free);
+	egg_buffer_init_full (&blob, 64, (EggBufferAllocator)g_realloc);
+
+	va_start (va, n_expected);
+	for (i = 0; i < n_expected; i++) {
+		comment = va_arg (va, const gchar *);
+		public = va_arg (va, const guchar *);
+		egg_buffer_reset (&blob);
+		add_public_blob (&blob, public);
+		encoded = g_base64_encode (blob.buf + 4, blob.len - 4);
+		g_ptr_array_add (expected, g_strdup_printf ("%s:%s", comment, encoded));
+		g_free (encoded);
+	}
+	va_end (va);
+
+	egg_buffer_uninit (&blob);
+	g_ptr_array_sort (expected, compare_strings);
+
+	answer = request_identities (test);
+	assert_identities_equal (answer, expected);
+
+	gkd_ssh_agent_clear_identities_cache ();
+	fresh = request_identities (test);
+	assert_identities_equal (fresh, expected);
+
+	/* The next answer comes straight from the cache */
+	egg_buffer_init_full (&first, test->resp.len, (EggBufferAllocator)g_realloc);
+	egg_buffer_append (&first, test->resp.buf, test->resp.len);
+	g_ptr_array_unref (request_identities (test));
+	g_assert (egg_buffer_equal (&first, &test->resp));
+	egg_buffer_uninit (&first);
+
+	g_ptr_array_unref (expected);
+	g_ptr_array_unref (answer);
+	g_ptr_array_unref (fresh);
+}
+
+static void
+test_empty (Test *test,
+            gconstpointer unused)
+{
+	check_identities (test, 0);
+}
+
+static void
+test_add_remove (Test *test,
+                 gconstpointer unused)
+{
+	check_identities (test, 0);
+
+	add_identity (test, KEY_ONE_SEED, KEY_ONE_PUBLIC, "one");
+	check_identities (test, 1, "one", KEY_ONE_PUBLIC);
+
+	add_identity (test, KEY_TWO_SEED, KEY_TWO_PUBLIC, "two");
+	check_identities (test, 2, "one", KEY_ONE_PUBLIC, "two", KEY_TWO_PUBLIC);
+
+	remove_identity (test, KEY_ONE_PUBLIC);
+	check_identities (test, 1, "two", KEY_TWO_PUBLIC);
+
+	remove_identity (test, KEY_TWO_PUBLIC);
+	check_identities (test, 0);
+}
+
+static void
+test_replace (Test *test,
+              gconstpointer unused)
+{
+	add_identity (test, KEY_ONE_SEED, KEY_ONE_PUBLIC, "one");
+	check_identities (test, 1, "one", KEY_ONE_PUBLIC);
+
+	/* Adding the same key again replaces it, with the new comment */
+	add_identity (test, KEY_ONE_SEED, KEY_ONE_PUBLIC, "renamed");
+	check_identities (test, 1, "renamed", KEY_ONE_PUBLIC);
+}
+
+static void
+test_lock_remove_all (Test *test,
+                      gconstpointer unused)
+{
+	add_identity (test, KEY_ONE_SEED, KEY_ONE_PUBLIC, "one");
+	add_identity (test, KEY_TWO_SEED, KEY_TWO_PUBLIC, "two");
+	check_identities (test, 2, "one", KEY_ONE_PUBLIC, "two", KEY_TWO_PUBLIC);
+
+	simple_request (test, GKD_SSH_OP_LOCK);
+	check_identities (test, 2, "one", KEY_ONE_PUBLIC, "two", KEY_TWO_PUBLIC);
+
+	simple_request (test, GKD_SSH_OP_UNLOCK);
+	check_identities (test, 2, "one", KEY_ONE_PUBLIC, "two", KEY_TWO_PUBLIC);
+
+	simple_request (test, GKD_SSH_OP_REMOVE_ALL_IDENTITIES);
+	check_identities (test, 0);
+
+	add_identity (test, KEY_TWO_SEED, KEY_TWO_PUBLIC, "two");
+	check_identities (test, 1, "two", KEY_TWO_PUBLIC);
+}
+
+static void
+test_key_files (Test *test,
+                gconstpointer unused)
+{
+	add_identity (test, KEY_ONE_SEED, KEY_ONE_PUBLIC, "one");
+	check_identities (test, 1, "one", KEY_ONE_PUBLIC);
+
+	/* A key dropped into the store directory, not through the agent */
+	copy_key_file (test, "id_ed25519_plain");
+	copy_key_file (test, "id_ed25519_plain.pub");
+	check_identities (test, 2, "one", KEY_ONE_PUBLIC, FILE_KEY_COMMENT, FILE_KEY_PUBLIC);
+
+	/* The comment in the public key file changes */
+	write_key_file (test, "id_ed25519_plain.pub",
+	                "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIFAS2FVV5xhiCH7nMmYmCol+wC4uhuh8YjYZaG8nygn2 edited\n");
+	check_identities (test, 2, "one", KEY_ONE_PUBLIC, "edited", FILE_KEY_PUBLIC);
+
+	/* And the key goes away again */
+	remove_key_file (test, "id_ed25519_plain.pub");
+	remove_key_file (test, "id_ed25519_plain");
+	check_identities (test, 1, "one", KEY_ONE_PUBLIC);
+}
+
+int
+main (int argc, char **argv)
+{
+#if !GLIB_CHECK_VERSION(2,35,0)
+	g_type_init ();
+#endif
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add ("/ssh-agent/identities/empty", Test, NULL, setup, test_empty, teardown);
+	g_test_add ("/ssh-agent/identities/add_remove", Test, NULL, setup, test_add_remove, teardown);
+	g_test_add ("/ssh-agent/identities/replace", Test, NULL, setup, test_replace, teardown);
+	g_test_add ("/ssh-agent/identities/lock_remove_all", Test, NULL, setup, test_lock_remove_all, teardown);
+	g_test_add ("/ssh-agent/identities/key_files", Test, NULL, setup, test_key_files, teardown);
+
+	return g_test_run ();
+}
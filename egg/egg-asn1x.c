@@ -146,6 +146,12 @@ struct _Atlv {
 
 	/* Encoding: sort children of this tlv (ie: SETOF) */
 	guint sorted : 1;
+
+	/* Decoding: structured, but children not parsed out of 'decoded' yet */
+	guint lazy : 1;
+
+	/* Decoding: whether to validate strictly once the contents are decoded */
+	guint strict : 1;
 };
 
 struct _Anode {
@@ -166,6 +172,9 @@ struct _Anode {
 
 	/* Whether we need to prefix a zero byte to make unsigned */
 	guint guarantee_unsigned : 1;
+
+	/* The contents in 'parsed' have not been decoded into children yet */
+	guint pending : 1;
 };
 
 /* Forward Declarations */
@@ -497,6 +506,7 @@ anode_clr_value (GNode *node)
 
 	atlv_free (an->parsed);
 	an->parsed = NULL;
+	an->pending = 0;
 }
 
 static inline void
@@ -848,11 +858,17 @@ atlv_parse_der_tag (guchar cls,
                     gint len,
                     GBytes *data,
                     const guchar **at,
-                    Atlv *tlv)
+                    Atlv *tlv,
+                    gboolean lazy);
+
+static const gchar *
+atlv_parse_der_children (Atlv *tlv,
+                         GBytes *data,
+                         const guchar **at,
+                         const guchar *end,
+                         gboolean lazy)
 {
-	const guchar *end;
 	const gchar *ret;
-	const guchar *beg;
 	guchar ccls;
 	gulong ctag;
 	gint clen;
@@ -860,6 +876,51 @@ atlv_parse_der_tag (guchar cls,
 	Atlv *child;
 	Atlv *last;
 
+	last = NULL;
+	while (*at < end) {
+		if (!atlv_parse_cls_tag_len (*at, end, &ccls, &ctag, &coff, &clen))
+			return "content is not encoded properly";
+
+		/* End if indefinite length? */
+		if (tlv->len < 0 && ccls == ASN1_CLASS_UNIVERSAL && ctag == 0 && clen == 0) {
+			(*at) += coff;
+			break;
+		}
+
+		/* Parse the child */
+		child = atlv_new ();
+		child->strict = tlv->strict;
+		ret = atlv_parse_der_tag (ccls, ctag, coff, clen, data, at, child, lazy);
+		if (ret != NULL) {
+			atlv_free (child);
+			return ret;
+		}
+
+		/* Add the child to the right place */
+		if (last == NULL)
+			tlv->child = child;
+		else
+			last->next = child;
+		last = child;
+	}
+
+	return NULL; /* Success */
+}
+
+static const gchar *
+atlv_parse_der_tag (guchar cls,
+                    gulong tag,
+                    gint off,
+                    gint len,
+                    GBytes *data,
+                    const guchar **at,
+                    Atlv *tlv,
+                    gboolean lazy)
+{
+	const guchar *end;
+	const gchar *ret;
+	const guchar *beg;
+
 	g_assert (at != NULL);
 	g_assert (tlv != NULL);
 
@@ -880,34 +941,19 @@ atlv_parse_der_tag (guchar cls,
 
 	/* Structured TLV, with further TLVs inside */
 	if (cls & ASN1_CLASS_STRUCTURED) {
-		/* If not indefinite length, then calculate end up front */
-		if (len >= 0)
-			end = (*at) + len;
-		last = NULL;
-		while (*at < end) {
-			if (!atlv_parse_cls_tag_len (*at, end, &ccls, &ctag, &coff, &clen))
-				return "content is not encoded properly";
-
-			/* End if indefinite length? */
-			if (len < 0 && ccls == ASN1_CLASS_UNIVERSAL && ctag == 0 && clen == 0) {
-				(*at) += coff;
-				break;
-			}
 
-			/* Parse the child */
-			child = atlv_new ();
-			ret = atlv_parse_der_tag (ccls, ctag, coff, clen, data, at, child);
-			if (ret != NULL) {
-				atlv_free (child);
-				return ret;
-			}
+		/* Leave the contents until they're needed, if we know where they end */
+		if (lazy && len >= 0) {
+			tlv->lazy = 1;
+			(*at) += len;
 
-			/* Add the child to the right place */
-			if (last == NULL)
-				tlv->child = child;
-			else
-				last->next = child;
-			last = child;
+		} else {
+			/* If not indefinite length, then calculate end up front */
+			if (len >= 0)
+				end = (*at) + len;
+			ret = atlv_parse_der_children (tlv, data, at, end, FALSE);
+			if (ret != NULL)
+				return ret;
 		}
 
 	/* Non-structured TLV, just a value */
@@ -926,9 +972,43 @@ atlv_parse_der_tag (guchar cls,
 	return NULL; /* Success */
 }
 
+static const gchar *
+atlv_expand (Atlv *tlv)
+{
+	const guchar *end;
+	const guchar *at;
+	const gchar *ret;
+	gsize size;
+
+	g_assert (tlv != NULL);
+
+	if (!tlv->lazy)
+		return NULL;
+
+	/*
+	 * Parse one more level, straight out of the DER we noted for this
+	 * tlv. Any structured children are themselves left unparsed.
+	 */
+	at = g_bytes_get_data (tlv->decoded, &size);
+	end = at + size;
+	at += tlv->off;
+
+	ret = atlv_parse_der_children (tlv, tlv->decoded, &at, end, TRUE);
+	if (ret != NULL) {
+		atlv_free (tlv->child);
+		tlv->child = NULL;
+		return ret;
+	}
+
+	g_assert (at == end);
+	tlv->lazy = 0;
+	return NULL; /* Success */
+}
+
 static const gchar *
 atlv_parse_der (GBytes *data,
-                Atlv *tlv)
+                Atlv *tlv,
+                gboolean lazy)
 {
 	const guchar *end;
 	const guchar *at;
@@ -946,7 +1026,7 @@ atlv_parse_der (GBytes *data,
 	if (!atlv_parse_cls_tag_len (at, end, &cls, &tag, &off, &len))
 		return "content is not encoded properly";
 
-	ret = atlv_parse_der_tag (cls, tag, off, len, data, &at, tlv);
+	ret = atlv_parse_der_tag (cls, tag, off, len, data, &at, tlv, lazy);
 	if (ret != NULL)
 		return ret;
 
@@ -1163,12 +1243,16 @@ anode_decode_structured (GNode *node,
 }
 
 static gboolean
-anode_decode_one_without_tag (GNode *node,
-                              Atlv *tlv,
-                              gint flags)
+anode_decode_content (GNode *node,
+                      Atlv *tlv,
+                      gint flags)
 {
-	gboolean ret;
-	Anode *an;
+	const gchar *msg;
+
+	/* Contents that were left for later, are needed now */
+	msg = atlv_expand (tlv);
+	if (msg != NULL)
+		return anode_failure (node, msg);
 
 	/* An explicit, wrapped tag */
 	if (anode_calc_explicit_for_flags (node, flags, NULL)) {
@@ -1179,22 +1263,38 @@ anode_decode_one_without_tag (GNode *node,
 		if (tlv->child->next != NULL)
 			return anode_failure (node, "multiple context specific children");
 		flags &= ~FLAG_TAG;
-		ret = anode_decode_one_without_tag (node, tlv->child, flags);
+		return anode_decode_content (node, tlv->child, flags);
 
 	/* Structured value */
 	} else if (tlv->cls & ASN1_CLASS_STRUCTURED) {
-		ret = anode_decode_structured (node, tlv, flags);
+		return anode_decode_structured (node, tlv, flags);
 
 	/* A primitive simple value */
 	} else {
-		ret = anode_decode_primitive (node, tlv, flags);
+		return anode_decode_primitive (node, tlv, flags);
 	}
+}
+
+static gboolean
+anode_decode_one_without_tag (GNode *node,
+                              Atlv *tlv,
+                              gint flags)
+{
+	gboolean ret;
+	Anode *an;
+
+	/* Contents that weren't parsed, are decoded when first accessed */
+	if (tlv->lazy)
+		ret = TRUE;
+	else
+		ret = anode_decode_content (node, tlv, flags);
 
 	/* Mark which tlv we used for this node */
 	if (ret) {
 		an = node->data;
 		atlv_free (an->parsed);
 		an->parsed = atlv_dup (tlv, FALSE);
+		an->pending = tlv->lazy;
 	}
 
 	return ret;
@@ -1292,6 +1392,35 @@ anode_decode_anything (GNode *node,
 	return TRUE;
 }
 
+static gboolean
+anode_decode_pending (GNode *node)
+{
+	Anode *an = node->data;
+	gboolean ret;
+	Atlv *tlv;
+
+	if (!an->pending)
+		return TRUE;
+
+	/*
+	 * Decode the contents that were left in 'parsed' during a lazy
+	 * decode. Setting a value clears 'parsed' so hold on to it here.
+	 */
+	tlv = an->parsed;
+	an->parsed = NULL;
+	an->pending = 0;
+
+	ret = anode_decode_content (node, tlv, anode_def_flags (node));
+
+	atlv_free (an->parsed);
+	an->parsed = tlv;
+
+	if (!ret)
+		return FALSE;
+
+	return anode_validate_anything (node, tlv->strict);
+}
+
 gboolean
 egg_asn1x_decode_full (GNode *asn,
                        GBytes *data,
@@ -1308,7 +1437,8 @@ egg_asn1x_decode_full (GNode *asn,
 	egg_asn1x_clear (asn);
 
 	tlv = atlv_new ();
-	msg = atlv_parse_der (data, tlv);
+	tlv->strict = !(options & EGG_ASN1X_NO_STRICT);
+	msg = atlv_parse_der (data, tlv, options & EGG_ASN1X_LAZY);
 	if (msg == NULL) {
 		ret = anode_decode_anything (asn, tlv);
 
@@ -1472,6 +1602,13 @@ atlv_unparse_der (Atlv *tlv,
 
 		*at = p;
 
+	/* Contents that were never parsed, straight from what was decoded */
+	} else if (tlv->lazy) {
+		buf = g_bytes_get_data (tlv->decoded, &len);
+		g_assert (len == tlv->off + tlv->len);
+		memcpy (*at, buf + tlv->off, tlv->len);
+		(*at) += tlv->len;
+
 	/* Write a bunch of child TLV's */
 	} else {
 		for (ctlv = tlv->child; ctlv != NULL; ctlv = ctlv->next) {
@@ -1832,8 +1969,13 @@ anode_build_anything_for_flags (GNode *node,
                                 gboolean want,
                                 gint flags)
 {
+	Anode *an = node->data;
 	Atlv *tlv;
 
+	/* Contents that were never decoded, go back out as they came in */
+	if (an->pending)
+		return atlv_dup (an->parsed, FALSE);
+
 	switch (anode_def_type (node)) {
 	case EGG_ASN1X_BIT_STRING:
 		tlv = anode_build_bit_string (node);
@@ -2584,6 +2726,9 @@ egg_asn1x_node (GNode *asn, ...)
 	va_start (va, asn);
 
 	for (;;) {
+		if (!anode_decode_pending (node))
+			return NULL;
+
 		type = anode_def_type (node);
 
 		/* Use integer indexes for these */
@@ -2652,6 +2797,9 @@ egg_asn1x_count (GNode *node)
 		return 0;
 	}
 
+	if (!anode_decode_pending (node))
+		return 0;
+
 	for (child = node->children; child; child = child->next) {
 		if (egg_asn1x_have (child))
 			++result;
@@ -2674,6 +2822,9 @@ egg_asn1x_append (GNode *node)
 		return NULL;
 	}
 
+	if (!anode_decode_pending (node))
+		return NULL;
+
 	/* There must be at least one child */
 	child = node->children;
 	g_return_val_if_fail (child, NULL);
@@ -3059,6 +3210,8 @@ egg_asn1x_get_any_into_full (GNode *node,
                              GNode *into,
                              gint options)
 {
+	const gchar *msg;
+	Anode *an;
 	Atlv *tlv;
 
 	g_return_val_if_fail (node != NULL, FALSE);
@@ -3071,6 +3224,9 @@ egg_asn1x_get_any_into_full (GNode *node,
 
 	/* If this node is explicit, then just get the contents */
 	if (anode_calc_explicit_for_flags (node, anode_def_flags (node), NULL)) {
+		msg = atlv_expand (tlv);
+		if (msg != NULL)
+			return anode_failure (node, msg);
 		tlv = tlv->child;
 		g_return_val_if_fail (tlv != NULL, FALSE);
 	}
@@ -3078,6 +3234,11 @@ egg_asn1x_get_any_into_full (GNode *node,
 	if (!anode_decode_anything (into, tlv))
 		return FALSE;
 
+	/* Contents left for later get validated the way asked for here */
+	an = into->data;
+	if (an->pending)
+		an->parsed->strict = !(options & EGG_ASN1X_NO_STRICT);
+
 	return egg_asn1x_validate (into, !(options & EGG_ASN1X_NO_STRICT));
 }
 
@@ -3102,6 +3263,7 @@ egg_asn1x_set_any_from (GNode *node,
 	an = node->data;
 	atlv_free (an->parsed);
 	an->parsed = tlv;
+	an->pending = 0;
 }
 
 GBytes *
@@ -3139,7 +3301,7 @@ egg_asn1x_set_any_raw (GNode *node,
 
 	an = node->data;
 	tlv = atlv_new ();
-	msg = atlv_parse_der (raw, tlv);
+	msg = atlv_parse_der (raw, tlv, FALSE);
 	if (msg == NULL) {
 
 		/* Wrap this in an explicit tag if necessary */
@@ -3147,6 +3309,7 @@ egg_asn1x_set_any_raw (GNode *node,
 
 		atlv_free (an->parsed);
 		an->parsed = tlv;
+		an->pending = 0;
 		return TRUE;
 
 	/* A failure, set the message manually so it doesn't get a prefix */
@@ -3171,8 +3334,11 @@ egg_asn1x_get_element_raw (GNode *node)
 	tlv = an->parsed;
 
 	/* If this node is explicit, then just get the contents */
-	if (tlv && anode_calc_explicit_for_flags (node, anode_def_flags (node), NULL))
+	if (tlv && anode_calc_explicit_for_flags (node, anode_def_flags (node), NULL)) {
+		if (atlv_expand (tlv) != NULL)
+			return NULL;
 		tlv = tlv->child;
+	}
 
 	if (!tlv || !tlv->decoded)
 		return NULL;
@@ -3197,6 +3363,7 @@ egg_asn1x_get_string_as_raw (GNode *node,
                              EggAllocator allocator,
                              gsize *n_string)
 {
+	const gchar *msg;
 	gsize length;
 	guchar *string;
 	GBytes *data;
@@ -3241,6 +3408,12 @@ egg_asn1x_get_string_as_raw (GNode *node,
 
 	tlv = anode_get_parsed (node);
 	if (tlv != NULL) {
+		msg = atlv_expand (tlv);
+		if (msg != NULL) {
+			anode_failure (node, msg);
+			return NULL;
+		}
+
 		if (!anode_read_string_struct (node, tlv, NULL, &length))
 			return NULL;
 
@@ -3678,6 +3851,9 @@ egg_asn1x_get_choice (GNode *node)
 
 	g_return_val_if_fail (node, NULL);
 
+	if (!anode_decode_pending (node))
+		return NULL;
+
 	/* One and only one of the children must be set */
 	for (child = node->children; child; child = child->next) {
 		an = (Anode*)child->data;
@@ -3698,6 +3874,10 @@ egg_asn1x_set_choice (GNode *node,
 	g_return_val_if_fail (node != NULL, FALSE);
 	g_return_val_if_fail (anode_def_type (node) == EGG_ASN1X_CHOICE, FALSE);
 
+	/* Don't let a later decode of the contents undo this */
+	if (!anode_decode_pending (node))
+		return FALSE;
+
 	/* One and only one of the children must be set */
 	for (child = node->children; child; child = child->next) {
 		an = (Anode*)child->data;
@@ -3977,6 +4157,10 @@ anode_validate_anything (GNode *node,
 	gint type;
 	gint flags;
 
+	/* Contents left from a lazy decode are validated once decoded */
+	if (((Anode *)node->data)->pending)
+		return TRUE;
+
 	type = anode_def_type (node);
 	flags = anode_def_flags (node);
 
@@ -4364,31 +4548,54 @@ is_oid_number (const gchar *p)
 	return !must;
 }
 
-GNode*
-egg_asn1x_create (const EggAsn1xDef *defs,
-                  const gchar *type)
+/*
+ * Prepared trees are cached per definition table, and egg_asn1x_create()
+ * hands out copies of them. The definition tables are static, so the
+ * cache lives as long as the process.
+ */
+
+typedef struct {
+	GHashTable *names;
+	GHashTable *templates;
+} TemplateCache;
+
+G_LOCK_DEFINE_STATIC (template_caches);
+static GHashTable *template_caches = NULL;
+
+static TemplateCache *
+template_cache_for_defs (const EggAsn1xDef *defs)
 {
+	TemplateCache *cache;
 	const EggAsn1xDef *def;
-	GNode *root, *parent, *node;
-	int flags;
 
-	g_return_val_if_fail (defs, NULL);
-	g_return_val_if_fail (type, NULL);
+	if (template_caches == NULL)
+		template_caches = g_hash_table_new (g_direct_hash, g_direct_equal);
 
-	/* An OID */
-	if (is_oid_number (type)) {
-		def = match_oid_in_definitions (defs, type);
+	cache = g_hash_table_lookup (template_caches, defs);
+	if (cache == NULL) {
+		cache = g_new0 (TemplateCache, 1);
+		cache->names = g_hash_table_new (g_str_hash, g_str_equal);
+		cache->templates = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                          g_free, NULL);
 
-	/* An Identifier */
-	} else {
+		/* The first definition with a given name wins, as in a linear walk */
 		for (def = adef_first_child (defs); def; def = adef_next_sibling (def)) {
-			if (def->name && g_str_equal (type, def->name))
-				break;
+			if (def->name && !g_hash_table_lookup (cache->names, def->name))
+				g_hash_table_insert (cache->names, (gchar *)def->name, (gpointer)def);
 		}
+
+		g_hash_table_insert (template_caches, (gpointer)defs, cache);
 	}
 
-	if (def == NULL || !def->name || !def->type)
-		return NULL;
+	return cache;
+}
+
+static GNode *
+anode_build_template (const EggAsn1xDef *defs,
+                      const EggAsn1xDef *def)
+{
+	GNode *root, *parent, *node;
+	int flags;
 
 	/* The node for this item */
 	root = anode_new (def);
@@ -4428,6 +4635,60 @@ egg_asn1x_create (const EggAsn1xDef *defs,
 	return root;
 }
 
+GNode*
+egg_asn1x_create (const EggAsn1xDef *defs,
+                  const gchar *type)
+{
+	const EggAsn1xDef *def = NULL;
+	TemplateCache *cache;
+	GNode *template;
+	GNode *other;
+
+	g_return_val_if_fail (defs, NULL);
+	g_return_val_if_fail (type, NULL);
+
+	G_LOCK (template_caches);
+
+	cache = template_cache_for_defs (defs);
+	template = g_hash_table_lookup (cache->templates, type);
+
+	if (template == NULL) {
+
+		/* An OID */
+		if (is_oid_number (type))
+			def = match_oid_in_definitions (defs, type);
+
+		/* An Identifier */
+		else
+			def = g_hash_table_lookup (cache->names, type);
+	}
+
+	G_UNLOCK (template_caches);
+
+	if (template == NULL) {
+		if (def == NULL || !def->name || !def->type)
+			return NULL;
+
+		/* Preparing may create other types, so do it without the lock */
+		template = anode_build_template (defs, def);
+
+		G_LOCK (template_caches);
+
+		other = g_hash_table_lookup (cache->templates, type);
+		if (other == NULL) {
+			g_hash_table_insert (cache->templates, g_strdup (type), template);
+		} else {
+			egg_asn1x_destroy (template);
+			template = other;
+		}
+
+		G_UNLOCK (template_caches);
+	}
+
+	/* Templates are never modified once cached */
+	return anode_clone (template);
+}
+
 GNode*
 egg_asn1x_create_quark (const EggAsn1xDef *defs,
                         GQuark type)
@@ -69,6 +69,7 @@ typedef enum {
 
 enum {
 	EGG_ASN1X_NO_STRICT = 0x01,
+	EGG_ASN1X_LAZY = 0x02,
 } EggAsn1xFlags;
 
 GNode*              egg_asn1x_create                 (const EggAsn1xDef *defs,
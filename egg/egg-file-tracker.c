@@ -31,8 +31,17 @@
 
 #include <sys/stat.h>
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+
+#define WATCH_EVENTS \
+	(IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+	 IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
 typedef struct _UpdateDescendants {
 	EggFileTracker *tracker;
 	GHashTable *checks;
@@ -47,6 +56,10 @@ struct _EggFileTracker {
 	gchar *directory_path;
 	time_t directory_mtime;
 
+	/* Told about changes, instead of looking for them */
+	int watch_fd;
+	int watch_wd;
+
 	/* Matched files */
 	GHashTable *files;
 };
@@ -66,6 +79,18 @@ G_DEFINE_TYPE (EggFileTracker, egg_file_tracker, G_TYPE_OBJECT);
  * HELPERS
  */
 
+static gboolean
+matches_filename (EggFileTracker *self, const gchar *filename)
+{
+	if (filename[0] == '.')
+		return FALSE;
+	if (self->include && !g_pattern_match_string (self->include, filename))
+		return FALSE;
+	if (self->exclude && g_pattern_match_string (self->exclude, filename))
+		return FALSE;
+	return TRUE;
+}
+
 static void
 copy_key_string (gpointer key, gpointer value, gpointer data)
 {
@@ -163,11 +188,7 @@ update_directory (EggFileTracker *self, gboolean force_all, GHashTable *checks)
 	}
 
 	while ((filename = g_dir_read_name (dir)) != NULL) {
-		if (filename[0] == '.')
-			continue;
-		if (self->include && !g_pattern_match_string (self->include, filename))
-			continue;
-		if (self->exclude && g_pattern_match_string (self->exclude, filename))
+		if (!matches_filename (self, filename))
 			continue;
 
 		file = g_build_filename (self->directory_path, filename, NULL);
@@ -203,6 +224,145 @@ update_directory (EggFileTracker *self, gboolean force_all, GHashTable *checks)
 	g_dir_close (dir);
 }
 
+/* -----------------------------------------------------------------------------
+ * WATCHING
+ *
+ * When inotify is available, and the directory exists, we watch it and only
+ * look at the files we were told about. Otherwise we poll as above.
+ */
+
+static void
+unwatch_directory (EggFileTracker *self)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	if (self->watch_wd >= 0)
+		inotify_rm_watch (self->watch_fd, self->watch_wd);
+	self->watch_wd = -1;
+
+	/* Whatever we were told about may not have been seen yet */
+	self->directory_mtime = 0;
+#endif
+}
+
+static void
+watch_directory (EggFileTracker *self)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	if (self->watch_wd >= 0 || !self->directory_path)
+		return;
+
+	if (self->watch_fd == -1) {
+		self->watch_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+
+		/* Poll from now on */
+		if (self->watch_fd < 0) {
+			g_message ("couldn't watch for file changes: %s", g_strerror (errno));
+			self->watch_fd = -2;
+		}
+	}
+
+	/* Fails when the directory doesn't exist yet, we'll try again */
+	if (self->watch_fd >= 0)
+		self->watch_wd = inotify_add_watch (self->watch_fd, self->directory_path, WATCH_EVENTS);
+#endif
+}
+
+/* Returns FALSE if we have to look at everything */
+static gboolean
+read_changes (EggFileTracker *self, GHashTable *changed)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	union {
+		struct inotify_event event;
+		gchar data[4096];
+	} buf;
+	struct inotify_event *event;
+	gboolean rescan = FALSE;
+	gssize len, offset;
+
+	for (;;) {
+		len = read (self->watch_fd, buf.data, sizeof (buf.data));
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				rescan = TRUE;
+			break;
+		} else if (len == 0) {
+			break;
+		}
+
+		for (offset = 0; offset < len; offset += sizeof (struct inotify_event) + event->len) {
+			event = (struct inotify_event *)(buf.data + offset);
+
+			/* We lost events */
+			if (event->mask & IN_Q_OVERFLOW)
+				rescan = TRUE;
+
+			/* Left over from a watch we removed, such as its IN_IGNORED */
+			else if (event->wd != self->watch_wd)
+				continue;
+
+			/* The directory itself went away */
+			else if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT))
+				rescan = TRUE;
+
+			else if (event->len > 0 && matches_filename (self, event->name))
+				g_hash_table_add (changed, g_strdup (event->name));
+		}
+	}
+
+	return !rescan;
+#else
+	return FALSE;
+#endif
+}
+
+static void
+update_changed_file (gpointer key, gpointer unused, gpointer data)
+{
+	EggFileTracker *self = EGG_FILE_TRACKER (data);
+	struct stat sb;
+	gchar *file;
+
+	file = g_build_filename (self->directory_path, key, NULL);
+
+	if (g_hash_table_lookup (self->files, file)) {
+		if (!update_file (self, FALSE, file)) {
+			g_hash_table_remove (self->files, file);
+			g_signal_emit (self, signals[FILE_REMOVED], 0, file);
+		}
+
+	/* We don't do directories */
+	} else if (g_stat (file, &sb) == 0 && !(sb.st_mode & S_IFDIR)) {
+		g_hash_table_replace (self->files, g_strdup (file), GINT_TO_POINTER (sb.st_mtime));
+		g_signal_emit (self, signals[FILE_ADDED], 0, file);
+	}
+
+	g_free (file);
+}
+
+static gboolean
+update_watched (EggFileTracker *self)
+{
+	GHashTable *changed;
+	gboolean ret;
+
+	if (self->watch_wd < 0)
+		return FALSE;
+
+	changed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	ret = read_changes (self, changed);
+	if (ret)
+		g_hash_table_foreach (changed, update_changed_file, self);
+	else
+		unwatch_directory (self);
+
+	g_hash_table_destroy (changed);
+	return ret;
+}
+
 /* -----------------------------------------------------------------------------
  * OBJECT
  */
@@ -211,6 +371,8 @@ static void
 egg_file_tracker_init (EggFileTracker *self)
 {
 	self->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	self->watch_fd = -1;
+	self->watch_wd = -1;
 }
 
 static void
@@ -224,6 +386,9 @@ egg_file_tracker_finalize (GObject *obj)
 		g_pattern_spec_free (self->exclude);
 	g_free (self->directory_path);
 
+	if (self->watch_fd >= 0)
+		close (self->watch_fd);
+
 	g_hash_table_destroy (self->files);
 
 	G_OBJECT_CLASS (egg_file_tracker_parent_class)->finalize (obj);
@@ -290,6 +455,13 @@ egg_file_tracker_refresh (EggFileTracker *self, gboolean force_all)
 
 	g_return_if_fail (EGG_IS_FILE_TRACKER (self));
 
+	/* Nothing to do unless we were told about changes */
+	if (!force_all && update_watched (self))
+		return;
+
+	/* Start watching before looking, so nothing is missed */
+	watch_directory (self);
+
 	/* Copy into our check set */
 	checks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	g_hash_table_foreach (self->files, copy_key_string, checks);
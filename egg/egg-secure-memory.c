@@ -82,6 +82,12 @@ typedef void* word_t;
 /* The amount of extra words we can allocate */
 #define WASTE   4
 
+/*
+ * Unused cells smaller than this many words are kept in a bin for their
+ * exact size, so that small allocations don't walk the free cells.
+ */
+#define SMALL_WORDS 32
+
 /*
  * Track allocated memory or a free block. This structure is not stored
  * in the secure memory area. It is allocated from a pool of other
@@ -98,16 +104,27 @@ typedef struct _Cell {
 
 /*
  * A block of secure memory. This structure is the header in that block.
+ *
+ * Unused cells of less than SMALL_WORDS are in rings binned by their size.
+ * The heads of those rings are stored in the secure pages just before the
+ * words, see sec_small_bins (). Bigger unused cells are in unused_cells.
  */
 typedef struct _Block {
 	word_t *words;              /* Actual memory hangs off here */
 	size_t n_words;             /* Number of words in block */
 	size_t n_used;              /* Number of used allocations */
 	struct _Cell* used_cells;   /* Ring of used allocations */
-	struct _Cell* unused_cells; /* Ring of unused allocations */
+	struct _Cell* unused_cells; /* Ring of big unused allocations */
+	unsigned int unused_small;  /* Bit set for each small bin with cells */
 	struct _Block *next;        /* Next block in list */
 } Block;
 
+/* Usage counters, see egg_secure_get_stats () */
+static size_t locked_length = 0;
+static size_t locked_peak = 0;
+static size_t request_length = 0;
+static size_t request_peak = 0;
+
 /* -----------------------------------------------------------------------------
  * UNUSED STACK
  */
@@ -394,12 +411,86 @@ sec_remove_cell_ring (Cell **ring, Cell *cell)
 	ASSERT (*ring != cell);
 }
 
+static inline Cell**
+sec_small_bins (Block *block)
+{
+	return (Cell **)(block->words - SMALL_WORDS);
+}
+
+/* An unused cell must be removed before changing its size, and inserted after */
+static void
+sec_insert_unused (Block *block, Cell *cell)
+{
+	if (cell->n_words < SMALL_WORDS) {
+		sec_insert_cell_ring (sec_small_bins (block) + cell->n_words, cell);
+		block->unused_small |= (1U << cell->n_words);
+	} else {
+		sec_insert_cell_ring (&block->unused_cells, cell);
+	}
+}
+
+static void
+sec_remove_unused (Block *block, Cell *cell)
+{
+	Cell **bins;
+
+	if (cell->n_words < SMALL_WORDS) {
+		bins = sec_small_bins (block);
+		sec_remove_cell_ring (bins + cell->n_words, cell);
+		if (bins[cell->n_words] == NULL)
+			block->unused_small &= ~(1U << cell->n_words);
+	} else {
+		sec_remove_cell_ring (&block->unused_cells, cell);
+	}
+}
+
+static Cell*
+sec_find_unused (Block *block, size_t n_words)
+{
+	unsigned int mask;
+	Cell *cell;
+
+	/* The smallest binned cell that is big enough */
+	if (n_words < SMALL_WORDS) {
+		mask = block->unused_small >> n_words;
+		if (mask) {
+			while (!(mask & 1)) {
+				mask >>= 1;
+				n_words++;
+			}
+			return sec_small_bins (block)[n_words];
+		}
+	}
+
+	/* First fit among the big cells */
+	cell = block->unused_cells;
+	if (cell) {
+		do {
+			if (cell->n_words >= n_words)
+				return cell;
+			cell = cell->next;
+		} while (cell != block->unused_cells);
+	}
+
+	return NULL;
+}
+
 static inline void*
 sec_cell_to_memory (Cell *cell)
 {
 	return cell->words + 1;
 }
 
+static inline void
+sec_note_requested (size_t added, size_t removed)
+{
+	ASSERT (request_length + added >= removed);
+	request_length += added;
+	request_length -= removed;
+	if (request_length > request_peak)
+		request_peak = request_length;
+}
+
 static inline int
 sec_is_valid_word (Block *block, word_t *word)
 {
@@ -500,9 +591,6 @@ sec_alloc (Block *block,
 	ASSERT (length);
 	ASSERT (tag);
 
-	if (!block->unused_cells)
-		return NULL;
-
 	/*
 	 * Each memory allocation is aligned to a pointer size, and
 	 * then, sandwidched between two pointers to its meta data.
@@ -514,15 +602,7 @@ sec_alloc (Block *block,
 	n_words = sec_size_to_words (length) + 2;
 
 	/* Look for a cell of at least our required size */
-	cell = block->unused_cells;
-	while (cell->n_words < n_words) {
-		cell = cell->next;
-		if (cell == block->unused_cells) {
-			cell = NULL;
-			break;
-		}
-	}
-
+	cell = sec_find_unused (block, n_words);
 	if (!cell)
 		return NULL;
 
@@ -537,6 +617,8 @@ sec_alloc (Block *block,
 		other = pool_alloc ();
 		if (!other)
 			return NULL;
+
+		sec_remove_unused (block, cell);
 		other->n_words = n_words;
 		other->words = cell->words;
 		cell->n_words -= n_words;
@@ -544,16 +626,17 @@ sec_alloc (Block *block,
 
 		sec_write_guards (other);
 		sec_write_guards (cell);
+		sec_insert_unused (block, cell);
 
 		cell = other;
+	} else {
+		sec_remove_unused (block, cell);
 	}
 
-	if (cell->next)
-		sec_remove_cell_ring (&block->unused_cells, cell);
-
 	++block->n_used;
 	cell->tag = tag;
 	cell->requested = length;
+	sec_note_requested (length, 0);
 	sec_insert_cell_ring (&block->used_cells, cell);
 	memory = sec_cell_to_memory (cell);
 
@@ -591,6 +674,7 @@ sec_free (Block *block, void *memory)
 
 	sec_check_guards (cell);
 	sec_clear_noaccess (memory, 0, cell->requested);
+	sec_note_requested (0, cell->requested);
 
 	sec_check_guards (cell);
 	ASSERT (cell->requested > 0);
@@ -604,6 +688,7 @@ sec_free (Block *block, void *memory)
 	if (other && other->requested == 0) {
 		ASSERT (other->tag == NULL);
 		ASSERT (other->next && other->prev);
+		sec_remove_unused (block, other);
 		other->n_words += cell->n_words;
 		sec_write_guards (other);
 		pool_free (cell);
@@ -615,21 +700,19 @@ sec_free (Block *block, void *memory)
 	if (other && other->requested == 0) {
 		ASSERT (other->tag == NULL);
 		ASSERT (other->next && other->prev);
+		sec_remove_unused (block, other);
 		other->n_words += cell->n_words;
 		other->words = cell->words;
-		if (cell->next)
-			sec_remove_cell_ring (&block->unused_cells, cell);
 		sec_write_guards (other);
 		pool_free (cell);
 		cell = other;
 	}
 
-	/* Add to the unused list if not already there */
-	if (!cell->next)
-		sec_insert_cell_ring (&block->unused_cells, cell);
-
+	/* Add to the unused cells for its new size */
 	cell->tag = NULL;
 	cell->requested = 0;
+	sec_insert_unused (block, cell);
+
 	--block->n_used;
 	return NULL;
 }
@@ -707,6 +790,7 @@ sec_realloc (Block *block,
 
 		/* TODO: No shrinking behavior yet */
 		cell->requested = length;
+		sec_note_requested (length, valid);
 		alloc = sec_cell_to_memory (cell);
 
 		/*
@@ -730,16 +814,18 @@ sec_realloc (Block *block,
 
 		/* Eat the whole neighbor if not too big */
 		if (n_words - cell->n_words + WASTE >= other->n_words) {
+			sec_remove_unused (block, other);
 			cell->n_words += other->n_words;
 			sec_write_guards (cell);
-			sec_remove_cell_ring (&block->unused_cells, other);
 			pool_free (other);
 
 		/* Steal from the neighbor */
 		} else {
+			sec_remove_unused (block, other);
 			other->words += n_words - cell->n_words;
 			other->n_words -= n_words - cell->n_words;
 			sec_write_guards (other);
+			sec_insert_unused (block, other);
 			cell->n_words = n_words;
 			sec_write_guards (cell);
 		}
@@ -747,6 +833,7 @@ sec_realloc (Block *block,
 
 	if (cell->n_words >= n_words) {
 		cell->requested = length;
+		sec_note_requested (length, valid);
 		cell->tag = tag;
 		alloc = sec_cell_to_memory (cell);
 		sec_clear_undefined (alloc, valid, length);
@@ -929,6 +1016,7 @@ sec_block_create (size_t size,
 {
 	Block *block;
 	Cell *cell;
+	word_t *pages;
 
 	ASSERT (during_tag);
 
@@ -946,28 +1034,39 @@ sec_block_create (size_t size,
 		return NULL;
 	}
 
+	/* Room for the small bins, and the guards around the allocation */
+	size += (SMALL_WORDS + 2) * sizeof (word_t);
+
 	/* The size above is a minimum, we're free to go bigger */
 	if (size < DEFAULT_BLOCK_SIZE)
 		size = DEFAULT_BLOCK_SIZE;
 
-	block->words = sec_acquire_pages (&size, during_tag);
-	block->n_words = size / sizeof (word_t);
-	if (!block->words) {
+	pages = sec_acquire_pages (&size, during_tag);
+	if (!pages) {
 		pool_free (block);
 		pool_free (cell);
 		return NULL;
 	}
 
+	locked_length += size;
+	if (locked_length > locked_peak)
+		locked_peak = locked_length;
+
 #ifdef WITH_VALGRIND
-	VALGRIND_MAKE_MEM_DEFINED (block->words, size);
+	VALGRIND_MAKE_MEM_DEFINED (pages, size);
 #endif
 
+	/* The small bins come first, then the words to allocate from */
+	memset (pages, 0, SMALL_WORDS * sizeof (word_t));
+	block->words = pages + SMALL_WORDS;
+	block->n_words = size / sizeof (word_t) - SMALL_WORDS;
+
 	/* The first cell to allocate from */
 	cell->words = block->words;
 	cell->n_words = block->n_words;
 	cell->requested = 0;
 	sec_write_guards (cell);
-	sec_insert_cell_ring (&block->unused_cells, cell);
+	sec_insert_unused (block, cell);
 
 	block->next = all_blocks;
 	all_blocks = block;
@@ -979,7 +1078,9 @@ static void
 sec_block_destroy (Block *block)
 {
 	Block *bl, **at;
+	Cell **bins;
 	Cell *cell;
+	size_t i;
 
 	ASSERT (block);
 	ASSERT (block->words);
@@ -1004,8 +1105,19 @@ sec_block_destroy (Block *block)
 		pool_free (cell);
 	}
 
-	/* Release all pages of secure memory */
-	sec_release_pages (block->words, block->n_words * sizeof (word_t));
+	bins = sec_small_bins (block);
+	for (i = 0; i < SMALL_WORDS; i++) {
+		while (bins[i]) {
+			cell = bins[i];
+			sec_remove_cell_ring (bins + i, cell);
+			pool_free (cell);
+		}
+	}
+
+	/* Release all pages of secure memory, including the small bins */
+	ASSERT (locked_length >= (block->n_words + SMALL_WORDS) * sizeof (word_t));
+	locked_length -= (block->n_words + SMALL_WORDS) * sizeof (word_t);
+	sec_release_pages (bins, (block->n_words + SMALL_WORDS) * sizeof (word_t));
 
 	pool_free (block);
 }
@@ -1284,6 +1396,8 @@ egg_secure_records (unsigned int *count)
 	egg_secure_rec *records = NULL;
 	Block *block = NULL;
 	unsigned int total;
+	Cell **bins;
+	size_t i;
 
 	*count = 0;
 
@@ -1292,6 +1406,17 @@ egg_secure_records (unsigned int *count)
 		for (block = all_blocks; block != NULL; block = block->next) {
 			total = 0;
 
+			bins = sec_small_bins (block);
+			for (i = 0; i < SMALL_WORDS; i++) {
+				if (bins[i] == NULL)
+					continue;
+				records = records_for_ring (bins[i], records, count, &total);
+				if (records == NULL)
+					break;
+			}
+			if (i < SMALL_WORDS)
+				break;
+
 			records = records_for_ring (block->unused_cells, records, count, &total);
 			if (records == NULL)
 				break;
@@ -1308,6 +1433,55 @@ egg_secure_records (unsigned int *count)
 	return records;
 }
 
+static void
+stats_for_ring (Cell *cell_ring,
+                egg_secure_stats *stats)
+{
+	Cell *cell;
+	size_t length;
+
+	cell = cell_ring;
+	if (cell == NULL)
+		return;
+
+	do {
+		length = (cell->n_words - 2) * sizeof (word_t);
+		stats->n_unused++;
+		stats->unused_length += length;
+		if (length > stats->largest_unused)
+			stats->largest_unused = length;
+		cell = cell->next;
+	} while (cell != cell_ring);
+}
+
+void
+egg_secure_get_stats (egg_secure_stats *stats)
+{
+	Block *block;
+	Cell **bins;
+	size_t i;
+
+	ASSERT (stats);
+	memset (stats, 0, sizeof (egg_secure_stats));
+
+	DO_LOCK ();
+
+		for (block = all_blocks; block != NULL; block = block->next) {
+			stats->n_blocks++;
+			bins = sec_small_bins (block);
+			for (i = 0; i < SMALL_WORDS; i++)
+				stats_for_ring (bins[i], stats);
+			stats_for_ring (block->unused_cells, stats);
+		}
+
+		stats->locked_length = locked_length;
+		stats->locked_peak = locked_peak;
+		stats->request_length = request_length;
+		stats->request_peak = request_peak;
+
+	DO_UNLOCK ();
+}
+
 char*
 egg_secure_strdup_full (const char *tag,
                         const char *str,
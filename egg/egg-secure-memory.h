@@ -117,4 +117,17 @@ typedef struct {
 
 egg_secure_rec *   egg_secure_records    (unsigned int *count);
 
+typedef struct {
+	size_t n_blocks;         /* Number of blocks of locked memory */
+	size_t locked_length;    /* Bytes of locked memory in those blocks */
+	size_t locked_peak;      /* Most bytes of locked memory at any time */
+	size_t request_length;   /* Bytes requested by live allocations */
+	size_t request_peak;     /* Most bytes requested at any time */
+	size_t n_unused;         /* Number of unused cells, ie: fragments */
+	size_t unused_length;    /* Bytes in unused cells */
+	size_t largest_unused;   /* Bytes in the largest unused cell */
+} egg_secure_stats;
+
+void               egg_secure_get_stats  (egg_secure_stats *stats);
+
 #endif /* EGG_SECURE_MEMORY_H */
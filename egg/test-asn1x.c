@@ -140,6 +140,137 @@ test_decode_encode (Test *test,
 	g_bytes_unref (encoded);
 }
 
+static gboolean
+traverse_and_decode (GNode *node,
+                     gpointer user_data)
+{
+	gboolean *failed = user_data;
+	GNode *found;
+	gint type;
+
+	/* Looking up a node decodes anything that was left for later */
+	type = egg_asn1x_type (node);
+	if (type == EGG_ASN1X_SEQUENCE_OF || type == EGG_ASN1X_SET_OF)
+		found = egg_asn1x_node (node, 0, NULL);
+	else
+		found = egg_asn1x_node (node, NULL);
+
+	if (found == NULL)
+		*failed = TRUE;
+	return FALSE;
+}
+
+static void
+test_lazy_decode_encode (Test *test,
+                         gconstpointer data)
+{
+	const Fixture *fixture = data;
+	gboolean failed = FALSE;
+	GBytes *encoded;
+	GBytes *expected;
+	GNode *asn;
+	gboolean ret;
+
+	asn = egg_asn1x_create (fixture->defs, fixture->identifier);
+	ret = egg_asn1x_decode_full (asn, test->data, EGG_ASN1X_LAZY);
+	egg_asn1x_assert (ret == TRUE, asn);
+
+	/* Nothing has been looked at, so it goes back out as it came in */
+	encoded = egg_asn1x_encode (asn, NULL);
+	egg_asn1x_assert (encoded != NULL, asn);
+	g_assert (g_bytes_equal (encoded, test->data));
+	g_bytes_unref (encoded);
+
+	g_node_traverse (asn, G_PRE_ORDER, G_TRAVERSE_ALL, -1, traverse_and_decode, &failed);
+	egg_asn1x_assert (failed == FALSE, asn);
+
+	/* Once decoded all the way, it encodes just like a normal decode */
+	encoded = egg_asn1x_encode (asn, NULL);
+	egg_asn1x_assert (encoded != NULL, asn);
+	egg_asn1x_destroy (asn);
+
+	asn = egg_asn1x_create_and_decode (fixture->defs, fixture->identifier, test->data);
+	g_assert (asn != NULL);
+	expected = egg_asn1x_encode (asn, NULL);
+	egg_asn1x_assert (expected != NULL, asn);
+	egg_asn1x_destroy (asn);
+
+	g_assert (g_bytes_equal (encoded, expected));
+	g_bytes_unref (encoded);
+	g_bytes_unref (expected);
+}
+
+static void
+test_lazy_certificate (Test *test,
+                       gconstpointer unused)
+{
+	GNode *lazy;
+	GNode *asn;
+	GBytes *one;
+	GBytes *two;
+
+	lazy = egg_asn1x_create_and_decode_full (pkix_asn1_tab, "Certificate", test->data, EGG_ASN1X_LAZY);
+	g_assert (lazy != NULL);
+	asn = egg_asn1x_create_and_decode (pkix_asn1_tab, "Certificate", test->data);
+	g_assert (asn != NULL);
+
+	one = egg_asn1x_get_integer_as_raw (egg_asn1x_node (lazy, "tbsCertificate", "serialNumber", NULL));
+	two = egg_asn1x_get_integer_as_raw (egg_asn1x_node (asn, "tbsCertificate", "serialNumber", NULL));
+	g_assert (one != NULL);
+	g_assert (g_bytes_equal (one, two));
+	g_bytes_unref (one);
+	g_bytes_unref (two);
+
+	/* The raw element refers straight into what was decoded */
+	one = egg_asn1x_get_element_raw (egg_asn1x_node (lazy, "tbsCertificate", "subject", NULL));
+	two = egg_asn1x_get_element_raw (egg_asn1x_node (asn, "tbsCertificate", "subject", NULL));
+	g_assert (one != NULL);
+	g_assert (g_bytes_equal (one, two));
+	g_bytes_unref (one);
+	g_bytes_unref (two);
+
+	g_assert_cmpint (egg_asn1x_get_time_as_long (egg_asn1x_node (lazy, "tbsCertificate", "validity", "notAfter", NULL)), ==,
+	                 egg_asn1x_get_time_as_long (egg_asn1x_node (asn, "tbsCertificate", "validity", "notAfter", NULL)));
+	g_assert_cmpuint (egg_asn1x_count (egg_asn1x_node (lazy, "tbsCertificate", "extensions", NULL)), ==,
+	                  egg_asn1x_count (egg_asn1x_node (asn, "tbsCertificate", "extensions", NULL)));
+
+	one = egg_asn1x_encode (egg_asn1x_node (lazy, "tbsCertificate", "subjectPublicKeyInfo", NULL), NULL);
+	two = egg_asn1x_encode (egg_asn1x_node (asn, "tbsCertificate", "subjectPublicKeyInfo", NULL), NULL);
+	g_assert (one != NULL);
+	g_assert (g_bytes_equal (one, two));
+	g_bytes_unref (one);
+	g_bytes_unref (two);
+
+	/* Partly decoded, but still encodes to exactly the same thing */
+	one = egg_asn1x_encode (lazy, NULL);
+	g_assert (one != NULL);
+	g_assert (g_bytes_equal (one, test->data));
+	g_bytes_unref (one);
+
+	egg_asn1x_destroy (lazy);
+	egg_asn1x_destroy (asn);
+}
+
+static void
+test_lazy_invalid (Test *test,
+                   gconstpointer unused)
+{
+	GNode *asn;
+	gboolean ret;
+
+	asn = egg_asn1x_create (pkix_asn1_tab, "PersonalName");
+
+	/* Only the outer structure is checked up front */
+	ret = egg_asn1x_decode_full (asn, test->data, EGG_ASN1X_LAZY);
+	egg_asn1x_assert (ret == TRUE, asn);
+
+	/* And the problem turns up once the contents are needed */
+	g_assert (egg_asn1x_node (asn, "surname", NULL) == NULL);
+	g_assert (strstr (egg_asn1x_message (asn), "content size is out of bounds") != NULL);
+
+	egg_asn1x_destroy (asn);
+}
+
 static void
 test_personal_name_invalid (Test *test,
                             gconstpointer unused)
@@ -177,6 +308,77 @@ test_pkcs12_decode (Test *test,
 	egg_asn1x_destroy (asn);
 }
 
+static void
+test_create_independent (Test *test,
+                         gconstpointer unused)
+{
+	GNode *asn1;
+	GNode *asn2;
+	gboolean ret;
+
+	asn1 = egg_asn1x_create (pkix_asn1_tab, "Certificate");
+	ret = egg_asn1x_decode (asn1, test->data);
+	egg_asn1x_assert (ret == TRUE, asn1);
+
+	/* A second tree of the same type shares nothing with the first */
+	asn2 = egg_asn1x_create (pkix_asn1_tab, "Certificate");
+	g_assert (asn2 != asn1);
+	g_assert (egg_asn1x_node (asn2, "tbsCertificate", "serialNumber", NULL) !=
+	          egg_asn1x_node (asn1, "tbsCertificate", "serialNumber", NULL));
+	g_assert (egg_asn1x_get_integer_as_raw (egg_asn1x_node (asn2, "tbsCertificate", "serialNumber", NULL)) == NULL);
+
+	egg_asn1x_destroy (asn1);
+
+	ret = egg_asn1x_decode (asn2, test->data);
+	egg_asn1x_assert (ret == TRUE, asn2);
+	egg_asn1x_destroy (asn2);
+}
+
+static void
+decode_certificates_perf (Test *test,
+                          gint options)
+{
+	const guint count = 5000;
+	GNode **asns;
+	GTimer *timer;
+	gdouble elapsed;
+	guint i;
+
+	if (!g_test_perf ())
+		return;
+
+	/* Like a module holding a directory full of certificates */
+	asns = g_new0 (GNode *, count);
+	timer = g_timer_new ();
+	for (i = 0; i < count; i++) {
+		asns[i] = egg_asn1x_create_and_decode_full (pkix_asn1_tab, "Certificate", test->data, options);
+		g_assert (asns[i] != NULL);
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_test_minimized_result (elapsed, "decoded %u certificates in %.3f seconds, %.1f us each",
+	                         count, elapsed, (elapsed * 1000000.0) / count);
+
+	for (i = 0; i < count; i++)
+		egg_asn1x_destroy (asns[i]);
+	g_timer_destroy (timer);
+	g_free (asns);
+}
+
+static void
+test_decode_certificates_perf (Test *test,
+                               gconstpointer unused)
+{
+	decode_certificates_perf (test, 0);
+}
+
+static void
+test_decode_certificates_lazy_perf (Test *test,
+                                    gconstpointer unused)
+{
+	decode_certificates_perf (test, EGG_ASN1X_LAZY);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -191,10 +393,26 @@ main (int argc, char **argv)
 		g_free (name);
 	}
 
+	for (i = 0; i < G_N_ELEMENTS (parse_test_fixtures); i++) {
+		name = g_strdup_printf ("/asn1x/lazy-decode-encode-%s", parse_test_fixtures[i].identifier);
+		g_test_add (name, Test, &parse_test_fixtures[i], setup_parsing, test_lazy_decode_encode, teardown);
+		g_free (name);
+	}
+
 	g_test_add ("/asn1x/pkcs12-decode/1", Test, SRCDIR "/egg/fixtures/test-pkcs12-1.der",
 	            setup, test_pkcs12_decode, teardown);
 	g_test_add ("/asn1x/pkcs5-personal-name/invalid", Test, SRCDIR "/egg/fixtures/test-personalname-invalid.der",
 	            setup, test_personal_name_invalid, teardown);
+	g_test_add ("/asn1x/create-independent", Test, SRCDIR "/egg/fixtures/test-certificate-1.der",
+	            setup, test_create_independent, teardown);
+	g_test_add ("/asn1x/decode-certificates-perf", Test, SRCDIR "/egg/fixtures/test-certificate-1.der",
+	            setup, test_decode_certificates_perf, teardown);
+	g_test_add ("/asn1x/decode-certificates-lazy-perf", Test, SRCDIR "/egg/fixtures/test-certificate-1.der",
+	            setup, test_decode_certificates_lazy_perf, teardown);
+	g_test_add ("/asn1x/lazy-certificate", Test, SRCDIR "/egg/fixtures/test-certificate-1.der",
+	            setup, test_lazy_certificate, teardown);
+	g_test_add ("/asn1x/lazy-invalid", Test, SRCDIR "/egg/fixtures/test-personalname-invalid.der",
+	            setup, test_lazy_invalid, teardown);
 
 	return g_test_run ();
 }
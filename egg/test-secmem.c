@@ -252,6 +252,75 @@ test_strclear (void)
 	egg_secure_free_full (str, 0);
 }
 
+#define PERF_ITERATIONS 200000
+
+static gpointer
+alloc_perf_thread (gpointer data)
+{
+	gpointer window[64] = { NULL, };
+	GRand *rand;
+	gsize size;
+	int i, index;
+
+	rand = g_rand_new_with_seed (GPOINTER_TO_UINT (data));
+
+	/* Small allocations of varying size, a few kept alive at a time */
+	for (i = 0; i < PERF_ITERATIONS; i++) {
+		index = g_rand_int_range (rand, 0, G_N_ELEMENTS (window));
+		egg_secure_free (window[index]);
+		size = g_rand_int_range (rand, 1, 256);
+		window[index] = egg_secure_alloc (size);
+		g_assert (window[index] != NULL);
+		memset (window[index], 0xAA, size);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (window); i++)
+		egg_secure_free (window[i]);
+
+	g_rand_free (rand);
+	return NULL;
+}
+
+static void
+test_alloc_perf (void)
+{
+	GThread *threads[8];
+	gpointer fragments[2048];
+	GTimer *timer;
+	gdouble elapsed;
+	guint n_threads, i;
+
+	if (!g_test_perf ())
+		return;
+
+	/* Leave the free memory fragmented, like a long running daemon */
+	for (i = 0; i < G_N_ELEMENTS (fragments); i++)
+		fragments[i] = egg_secure_alloc (16 + (i % 7) * 8);
+	for (i = 0; i < G_N_ELEMENTS (fragments); i += 2)
+		egg_secure_free (fragments[i]);
+
+	for (n_threads = 1; n_threads <= G_N_ELEMENTS (threads); n_threads *= 2) {
+		timer = g_timer_new ();
+
+		for (i = 0; i < n_threads; i++)
+			threads[i] = g_thread_new ("secmem", alloc_perf_thread, GUINT_TO_POINTER (i + 1));
+		for (i = 0; i < n_threads; i++)
+			g_thread_join (threads[i]);
+
+		elapsed = g_timer_elapsed (timer, NULL);
+		g_timer_destroy (timer);
+
+		g_test_maximized_result (n_threads * PERF_ITERATIONS / elapsed,
+		                         "%u threads: %.0f allocations/sec", n_threads,
+		                         n_threads * PERF_ITERATIONS / elapsed);
+	}
+
+	for (i = 1; i < G_N_ELEMENTS (fragments); i += 2)
+		egg_secure_free (fragments[i]);
+
+	egg_secure_validate ();
+}
+
 int
 main (int argc, char **argv)
 {
@@ -264,6 +333,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/secmem/multialloc", test_multialloc);
 	g_test_add_func ("/secmem/clear", test_clear);
 	g_test_add_func ("/secmem/strclear", test_strclear);
+	g_test_add_func ("/secmem/alloc_perf", test_alloc_perf);
 
 	return g_test_run ();
 }
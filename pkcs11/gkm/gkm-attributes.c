@@ -284,6 +284,52 @@ gkm_attribute_set_mpi (CK_ATTRIBUTE_PTR attr, gcry_mpi_t mpi)
 	return CKR_OK;
 }
 
+CK_RV
+gkm_attribute_set_ec_point (CK_ATTRIBUTE_PTR attr, gconstpointer point, gsize n_point)
+{
+	guchar *at;
+	gsize len;
+
+	g_assert (attr);
+	g_assert (point || !n_point);
+	g_return_val_if_fail (n_point <= 0xFFFF, CKR_GENERAL_ERROR);
+
+	/* CKA_EC_POINT is a DER encoded OCTET STRING */
+	if (n_point < 0x80)
+		len = 2 + n_point;
+	else if (n_point < 0x100)
+		len = 3 + n_point;
+	else
+		len = 4 + n_point;
+
+	if (!attr->pValue) {
+		attr->ulValueLen = len;
+		return CKR_OK;
+	}
+
+	if (len > attr->ulValueLen) {
+		attr->ulValueLen = (CK_ULONG)-1;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	at = attr->pValue;
+	*(at++) = 0x04;
+	if (n_point < 0x80) {
+		*(at++) = n_point;
+	} else if (n_point < 0x100) {
+		*(at++) = 0x81;
+		*(at++) = n_point;
+	} else {
+		*(at++) = 0x82;
+		*(at++) = (n_point >> 8) & 0xFF;
+		*(at++) = n_point & 0xFF;
+	}
+
+	memcpy (at, point, n_point);
+	attr->ulValueLen = len;
+	return CKR_OK;
+}
+
 CK_RV
 gkm_attribute_set_template (CK_ATTRIBUTE_PTR attr, GArray *template)
 {
@@ -540,6 +586,48 @@ gkm_attributes_find_mpi (CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs,
 	return gkm_attribute_get_mpi (attr, value) == CKR_OK;
 }
 
+gboolean
+gkm_attributes_find_ec_point (CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs,
+                              gconstpointer *point, gsize *n_point)
+{
+	CK_ATTRIBUTE_PTR attr;
+	const guchar *at;
+	gsize len, n_len;
+
+	g_return_val_if_fail (attrs || !n_attrs, FALSE);
+	g_return_val_if_fail (point, FALSE);
+	g_return_val_if_fail (n_point, FALSE);
+
+	attr = gkm_attributes_find (attrs, n_attrs, CKA_EC_POINT);
+	if (attr == NULL || !attr->pValue || attr->ulValueLen < 2)
+		return FALSE;
+
+	/* Unwrap the DER OCTET STRING, definite length only */
+	at = attr->pValue;
+	if (at[0] != 0x04)
+		return FALSE;
+
+	if (at[1] < 0x80) {
+		len = at[1];
+		n_len = 1;
+	} else if (at[1] == 0x81 && attr->ulValueLen >= 3) {
+		len = at[2];
+		n_len = 2;
+	} else if (at[1] == 0x82 && attr->ulValueLen >= 4) {
+		len = (at[2] << 8) | at[3];
+		n_len = 3;
+	} else {
+		return FALSE;
+	}
+
+	if (1 + n_len + len != attr->ulValueLen)
+		return FALSE;
+
+	*point = at + 1 + n_len;
+	*n_point = len;
+	return TRUE;
+}
+
 gboolean
 gkm_attributes_find_string (CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs,
                             CK_ATTRIBUTE_TYPE type, gchar **value)
@@ -72,6 +72,10 @@ CK_RV                 gkm_attribute_set_bytes                          (CK_ATTRI
 CK_RV                 gkm_attribute_set_mpi                            (CK_ATTRIBUTE_PTR attr,
                                                                         gcry_mpi_t mpi);
 
+CK_RV                 gkm_attribute_set_ec_point                       (CK_ATTRIBUTE_PTR attr,
+                                                                        gconstpointer point,
+                                                                        gsize n_point);
+
 CK_RV                 gkm_attribute_set_template                       (CK_ATTRIBUTE_PTR attr,
                                                                         GArray *template);
 
@@ -117,6 +121,11 @@ gboolean              gkm_attributes_find_mpi                          (CK_ATTRI
                                                                         CK_ATTRIBUTE_TYPE type,
                                                                         gcry_mpi_t *mpi);
 
+gboolean              gkm_attributes_find_ec_point                     (CK_ATTRIBUTE_PTR attrs,
+                                                                        CK_ULONG n_attrs,
+                                                                        gconstpointer *point,
+                                                                        gsize *n_point);
+
 gboolean              gkm_attributes_find_string                       (CK_ATTRIBUTE_PTR attrs,
                                                                         CK_ULONG n_attrs,
                                                                         CK_ATTRIBUTE_TYPE type,
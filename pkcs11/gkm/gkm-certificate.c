@@ -56,6 +56,17 @@ struct _GkmCertificatePrivate {
 	GNode *asn1;
 	GBytes *der;
 	gchar *label;
+
+	/*
+	 * Worked out once when the certificate is loaded. Key Usage is not
+	 * among these, nothing reads it: the CKA_X_* assertions carry the
+	 * purpose they were given rather than one from the certificate.
+	 */
+	GHashTable *extensions;
+	CK_ULONG category;
+	gboolean category_failed;
+	guchar sha1[20];
+	guchar md5[16];
 };
 
 static GQuark OID_BASIC_CONSTRAINTS;
@@ -88,32 +99,72 @@ init_quarks (void)
 	}
 }
 
-static gint
-find_certificate_extension (GkmCertificate *self, GQuark oid)
+static GHashTable *
+index_certificate_extensions (GNode *asn1)
 {
-	GQuark exoid;
+	GHashTable *extensions;
 	GNode *node;
+	GNode *extension;
+	GQuark oid;
 	guint index;
 
-	g_assert (oid);
-	g_assert (GKM_IS_CERTIFICATE (self));
-	g_assert (self->pv->asn1);
+	extensions = g_hash_table_new (g_direct_hash, g_direct_equal);
+	node = egg_asn1x_node (asn1, "tbsCertificate", "extensions", NULL);
+	if (node == NULL)
+		return extensions;
 
 	for (index = 1; TRUE; ++index) {
 
 		/* Make sure it is present */
-		node = egg_asn1x_node (self->pv->asn1, "tbsCertificate", "extensions", index, NULL);
-		if (node == NULL)
+		extension = egg_asn1x_node (node, index, NULL);
+		if (extension == NULL)
 			break;
 
-		/* See if it's the same */
-		exoid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (node, "extnID", NULL));
+		/* The first extension with a given OID is the one used */
+		oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (extension, "extnID", NULL));
+		if (oid && !g_hash_table_lookup (extensions, GUINT_TO_POINTER (oid)))
+			g_hash_table_insert (extensions, GUINT_TO_POINTER (oid), extension);
+	}
+
+	return extensions;
+}
 
-		if(exoid == oid)
-			return index;
+static void
+calculate_certificate_derived (GkmCertificate *self)
+{
+	GBytes *extension;
+	GkmDataResult res;
+	gboolean is_ca;
+
+	g_assert (self->pv->asn1);
+	g_assert (self->pv->der);
+
+	if (self->pv->extensions)
+		g_hash_table_destroy (self->pv->extensions);
+	self->pv->extensions = index_certificate_extensions (self->pv->asn1);
+
+	/* The category, as far as the Basic Constraints section goes */
+	self->pv->category = 0; /* unspecified */
+	self->pv->category_failed = FALSE;
+	extension = gkm_certificate_get_extension (self, OID_BASIC_CONSTRAINTS, NULL);
+	if (extension != NULL) {
+		res = gkm_data_der_read_basic_constraints (extension, &is_ca, NULL);
+		if (res != GKM_DATA_SUCCESS)
+			self->pv->category_failed = TRUE;
+		else if (is_ca)
+			self->pv->category = 2; /* authority */
+		else
+			self->pv->category = 3; /* other entity */
+		g_bytes_unref (extension);
 	}
 
-	return 0;
+	/* Trust objects are looked up by these */
+	gcry_md_hash_buffer (GCRY_MD_SHA1, self->pv->sha1,
+	                     g_bytes_get_data (self->pv->der, NULL),
+	                     g_bytes_get_size (self->pv->der));
+	gcry_md_hash_buffer (GCRY_MD_MD5, self->pv->md5,
+	                     g_bytes_get_data (self->pv->der, NULL),
+	                     g_bytes_get_size (self->pv->der));
 }
 
 static GkmObject*
@@ -171,8 +222,6 @@ gkm_certificate_real_get_attribute (GkmObject *base, GkmSession *session, CK_ATT
 	GkmCertificate *self = GKM_CERTIFICATE (base);
 	CK_ULONG category;
 	GBytes *cdata;
-	guchar *data;
-	gsize n_data;
 	time_t when;
 	CK_RV rv;
 
@@ -200,15 +249,7 @@ gkm_certificate_real_get_attribute (GkmObject *base, GkmSession *session, CK_ATT
 
 	case CKA_CHECK_VALUE:
 		g_return_val_if_fail (self->pv->der != NULL, CKR_GENERAL_ERROR);
-		n_data = gcry_md_get_algo_dlen (GCRY_MD_SHA1);
-		g_return_val_if_fail (n_data && n_data > 3, CKR_GENERAL_ERROR);
-		data = g_new0 (guchar, n_data);
-		gcry_md_hash_buffer (GCRY_MD_SHA1, data,
-		                     g_bytes_get_data (self->pv->der, NULL),
-		                     g_bytes_get_size (self->pv->der));
-		rv = gkm_attribute_set_data (attr, data, 3);
-		g_free (data);
-		return rv;
+		return gkm_attribute_set_data (attr, self->pv->sha1, 3);
 
 	case CKA_START_DATE:
 	case CKA_END_DATE:
@@ -306,6 +347,8 @@ gkm_certificate_finalize (GObject *obj)
 	if (self->pv->der)
 		g_bytes_unref (self->pv->der);
 	g_free (self->pv->label);
+	if (self->pv->extensions)
+		g_hash_table_destroy (self->pv->extensions);
 	egg_asn1x_destroy (self->pv->asn1);
 
 	G_OBJECT_CLASS (gkm_certificate_parent_class)->finalize (obj);
@@ -446,6 +489,8 @@ gkm_certificate_real_load (GkmSerializable *base,
 	egg_asn1x_destroy (self->pv->asn1);
 	self->pv->asn1 = asn1;
 
+	calculate_certificate_derived (self);
+
 	return TRUE;
 }
 
@@ -475,14 +520,12 @@ gkm_certificate_serializable (GkmSerializableIface *iface)
 gboolean
 gkm_certificate_calc_category (GkmCertificate *self, GkmSession *session, CK_ULONG* category)
 {
-	GBytes *extension;
 	GkmManager *manager;
-	GkmDataResult res;
-	gboolean is_ca;
 	GkmObject *object;
 
-	g_return_val_if_fail (GKM_IS_CERTIFICATE (self), CKR_GENERAL_ERROR);
-	g_return_val_if_fail (category, CKR_GENERAL_ERROR);
+	g_return_val_if_fail (GKM_IS_CERTIFICATE (self), FALSE);
+	g_return_val_if_fail (category, FALSE);
+	g_return_val_if_fail (self->pv->asn1, FALSE);
 
 	/* First see if we have a private key for this certificate */
 	manager = gkm_object_get_manager (GKM_OBJECT (self));
@@ -494,23 +537,11 @@ gkm_certificate_calc_category (GkmCertificate *self, GkmSession *session, CK_ULO
 		}
 	}
 
-	/* Read in the Basic Constraints section */
-	extension = gkm_certificate_get_extension (self, OID_BASIC_CONSTRAINTS, NULL);
-	if (extension != NULL) {
-		res = gkm_data_der_read_basic_constraints (extension, &is_ca, NULL);
-
-		if (res != GKM_DATA_SUCCESS)
-			return FALSE;
-
-		if (is_ca)
-			*category = 2; /* authority */
-		else
-			*category = 3; /* other entity */
-
-	} else {
-		*category = 0; /* unspecified */
-	}
+	/* Otherwise go by the Basic Constraints section, read at load time */
+	if (self->pv->category_failed)
+		return FALSE;
 
+	*category = self->pv->category;
 	return TRUE;
 }
 
@@ -525,38 +556,33 @@ GBytes *
 gkm_certificate_get_extension (GkmCertificate *self, GQuark oid,
                                gboolean *critical)
 {
-	guchar *val;
-	gsize n_val;
-	gint index;
+	GNode *extension;
+	GNode *node;
 
 	g_return_val_if_fail (GKM_IS_CERTIFICATE (self), NULL);
-	g_return_val_if_fail (self->pv->asn1, NULL);
+	g_return_val_if_fail (self->pv->extensions, NULL);
 	g_return_val_if_fail (oid, NULL);
 
-	index = find_certificate_extension (self, oid);
-	if (index <= 0)
+	extension = g_hash_table_lookup (self->pv->extensions, GUINT_TO_POINTER (oid));
+	if (extension == NULL)
 		return NULL;
 
 	/* Read the critical status */
 	if (critical) {
-		val = egg_asn1x_get_string_as_raw (egg_asn1x_node (self->pv->asn1, "tbsCertificate",
-		                                   "extensions", index, "critical", NULL), NULL, &n_val);
+		node = egg_asn1x_node (extension, "critical", NULL);
+		g_return_val_if_fail (node != NULL, NULL);
 
 		/*
 		 * We're pretty liberal in what we accept as critical. The goal
 		 * here is not to accidentally mark as non-critical what some
 		 * other x509 implementation meant to say critical.
 		 */
-		if (!val || n_val < 1 || g_ascii_toupper (val[0]) != 'T')
-			*critical = FALSE;
-		else
-			*critical = TRUE;
-		g_free (val);
+		if (!egg_asn1x_get_boolean (node, critical))
+			*critical = egg_asn1x_have (node);
 	}
 
 	/* And the extension value */
-	return egg_asn1x_get_string_as_bytes (egg_asn1x_node (self->pv->asn1, "tbsCertificate",
-	                                      "extensions", index, "extnValue", NULL));
+	return egg_asn1x_get_string_as_bytes (egg_asn1x_node (extension, "extnValue", NULL));
 }
 
 const gchar*
@@ -607,6 +633,12 @@ gkm_certificate_hash (GkmCertificate *self, int hash_algo, gsize *n_hash)
 	*n_hash = gcry_md_get_algo_dlen (hash_algo);
 	g_return_val_if_fail (*n_hash > 0, NULL);
 
+	/* These were calculated when loading */
+	if (hash_algo == GCRY_MD_SHA1 && *n_hash == sizeof (self->pv->sha1))
+		return g_memdup (self->pv->sha1, *n_hash);
+	if (hash_algo == GCRY_MD_MD5 && *n_hash == sizeof (self->pv->md5))
+		return g_memdup (self->pv->md5, *n_hash);
+
 	hash = g_malloc0 (*n_hash);
 	gcry_md_hash_buffer (hash_algo, hash, g_bytes_get_data (self->pv->der, NULL),
 	                     g_bytes_get_size (self->pv->der));
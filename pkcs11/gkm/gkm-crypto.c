@@ -24,16 +24,21 @@
 #include "gkm-aes-mechanism.h"
 #include "gkm-dh-mechanism.h"
 #include "gkm-dsa-mechanism.h"
+#include "gkm-ecdsa-mechanism.h"
+#include "gkm-eddsa-mechanism.h"
 #include "gkm-hkdf-mechanism.h"
 #include "gkm-null-mechanism.h"
 #include "gkm-rsa-mechanism.h"
 #include "gkm-session.h"
 #include "gkm-sexp.h"
 #include "gkm-sexp-key.h"
+#include "gkm-x25519-mechanism.h"
 
 #include "egg/egg-libgcrypt.h"
 #include "egg/egg-secure-memory.h"
 
+#include "pkcs11/pkcs11i.h"
+
 /* ----------------------------------------------------------------------------
  * PUBLIC
  */
@@ -262,6 +267,8 @@ gkm_crypto_sign (GkmSession *session, CK_MECHANISM_TYPE mech, CK_BYTE_PTR data,
 	case CKM_RSA_PKCS:
 	case CKM_RSA_X_509:
 	case CKM_DSA:
+	case CKM_ECDSA:
+	case CKM_EDDSA:
 		sexp = gkm_session_get_crypto_state (session);
 		g_return_val_if_fail (sexp, CKR_GENERAL_ERROR);
 		return gkm_crypto_sign_xsa (gkm_sexp_get (sexp), mech, data, n_data, signature, n_signature);
@@ -303,6 +310,14 @@ gkm_crypto_sign_xsa (gcry_sexp_t sexp, CK_MECHANISM_TYPE mech, CK_BYTE_PTR data,
 		g_return_val_if_fail (algorithm == GCRY_PK_DSA, CKR_GENERAL_ERROR);
 		rv = gkm_dsa_mechanism_sign (sexp, data, n_data, signature, n_signature);
 		break;
+	case CKM_ECDSA:
+		g_return_val_if_fail (algorithm == GCRY_PK_ECC, CKR_GENERAL_ERROR);
+		rv = gkm_ecdsa_mechanism_sign (sexp, data, n_data, signature, n_signature);
+		break;
+	case CKM_EDDSA:
+		g_return_val_if_fail (algorithm == GCRY_PK_ECC, CKR_GENERAL_ERROR);
+		rv = gkm_eddsa_mechanism_sign (sexp, data, n_data, signature, n_signature);
+		break;
 	default:
 		/* Again shouldn't be reached */
 		g_return_val_if_reached (CKR_GENERAL_ERROR);
@@ -321,6 +336,8 @@ gkm_crypto_verify (GkmSession *session, CK_MECHANISM_TYPE mech, CK_BYTE_PTR data
 	case CKM_RSA_PKCS:
 	case CKM_RSA_X_509:
 	case CKM_DSA:
+	case CKM_ECDSA:
+	case CKM_EDDSA:
 		sexp = gkm_session_get_crypto_state (session);
 		g_return_val_if_fail (sexp, CKR_GENERAL_ERROR);
 		return gkm_crypto_verify_xsa (gkm_sexp_get (sexp), mech, data, n_data, signature, n_signature);
@@ -362,6 +379,14 @@ gkm_crypto_verify_xsa (gcry_sexp_t sexp, CK_MECHANISM_TYPE mech, CK_BYTE_PTR dat
 		g_return_val_if_fail (algorithm == GCRY_PK_DSA, CKR_GENERAL_ERROR);
 		rv = gkm_dsa_mechanism_verify (sexp, data, n_data, signature, n_signature);
 		break;
+	case CKM_ECDSA:
+		g_return_val_if_fail (algorithm == GCRY_PK_ECC, CKR_GENERAL_ERROR);
+		rv = gkm_ecdsa_mechanism_verify (sexp, data, n_data, signature, n_signature);
+		break;
+	case CKM_EDDSA:
+		g_return_val_if_fail (algorithm == GCRY_PK_ECC, CKR_GENERAL_ERROR);
+		rv = gkm_eddsa_mechanism_verify (sexp, data, n_data, signature, n_signature);
+		break;
 	default:
 		/* Again shouldn't be reached */
 		g_return_val_if_reached (CKR_GENERAL_ERROR);
@@ -433,6 +458,25 @@ gkm_crypto_derive_key (GkmSession *session, CK_MECHANISM_PTR mech, GkmObject *ba
 	case CKM_G_HKDF_SHA256_DERIVE:
 		return gkm_hkdf_mechanism_derive (session, "sha256", mech, base,
 		                                  attrs, n_attrs, derived);
+	case CKM_G_X25519_DERIVE:
+		return gkm_x25519_mechanism_derive (session, mech, base, attrs,
+		                                    n_attrs, derived);
+	default:
+		return CKR_MECHANISM_INVALID;
+	}
+}
+
+static CK_RV
+wrap_key_for_mechanism (GkmSession *session, CK_MECHANISM_PTR mech, GkmObject *wrapper,
+                        GkmObject *wrapped, CK_BYTE_PTR output, CK_ULONG_PTR n_output)
+{
+	switch (mech->mechanism) {
+	case CKM_AES_CBC_PAD:
+		return gkm_aes_mechanism_wrap (session, mech, wrapper, wrapped,
+		                               output, n_output);
+	case CKM_G_NULL:
+		return gkm_null_mechanism_wrap (session, mech, wrapper, wrapped,
+		                                output, n_output);
 	default:
 		return CKR_MECHANISM_INVALID;
 	}
@@ -454,16 +498,76 @@ gkm_crypto_wrap_key (GkmSession *session, CK_MECHANISM_PTR mech, GkmObject *wrap
 	if (!gkm_object_has_attribute_boolean (wrapper, session, CKA_WRAP, TRUE))
 		return CKR_KEY_FUNCTION_NOT_PERMITTED;
 
-	switch (mech->mechanism) {
-	case CKM_AES_CBC_PAD:
-		return gkm_aes_mechanism_wrap (session, mech, wrapper, wrapped,
-		                               output, n_output);
-	case CKM_G_NULL:
-		return gkm_null_mechanism_wrap (session, mech, wrapper, wrapped,
-		                                output, n_output);
-	default:
-		return CKR_MECHANISM_INVALID;
+	return wrap_key_for_mechanism (session, mech, wrapper, wrapped, output, n_output);
+}
+
+CK_RV
+gkm_crypto_wrap_batch (GkmSession *session, CK_MECHANISM_TYPE mech, GkmObject *wrapper,
+                       CK_OBJECT_HANDLE_PTR objects, CK_ULONG n_objects, CK_BYTE_PTR ivs,
+                       CK_ULONG n_iv, CK_ULONG_PTR results, CK_ULONG_PTR lengths,
+                       CK_BYTE_PTR output, CK_ULONG_PTR n_output)
+{
+	CK_MECHANISM inner;
+	GkmObject *wrapped;
+	gboolean too_small = FALSE;
+	CK_ULONG total = 0;
+	CK_ULONG length;
+	CK_ULONG i;
+	CK_RV rv;
+
+	g_return_val_if_fail (GKM_IS_SESSION (session), CKR_GENERAL_ERROR);
+	g_return_val_if_fail (GKM_IS_OBJECT (wrapper), CKR_GENERAL_ERROR);
+	g_return_val_if_fail (objects || !n_objects, CKR_GENERAL_ERROR);
+	g_return_val_if_fail (ivs || !n_iv, CKR_GENERAL_ERROR);
+	g_return_val_if_fail (results || !n_objects, CKR_GENERAL_ERROR);
+	g_return_val_if_fail (lengths || !n_objects, CKR_GENERAL_ERROR);
+	g_return_val_if_fail (n_output, CKR_GENERAL_ERROR);
+
+	/* The batch is allowed whenever the mechanism is */
+	if (!gkm_object_has_attribute_ulong (wrapper, session, CKA_ALLOWED_MECHANISMS, mech))
+		return CKR_KEY_TYPE_INCONSISTENT;
+
+	if (!gkm_object_has_attribute_boolean (wrapper, session, CKA_WRAP, TRUE))
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	inner.mechanism = mech;
+	inner.ulParameterLen = n_iv;
+
+	/*
+	 * Objects that fail (ie: locked or gone away) are marked as such, and
+	 * don't fail the batch. Once the buffer is too small we keep going, just
+	 * calculating the length needed.
+	 */
+	for (i = 0; i < n_objects; i++) {
+		inner.pParameter = n_iv ? ivs + (i * n_iv) : NULL;
+
+		rv = gkm_session_lookup_readable_object (session, objects[i], &wrapped);
+		if (rv == CKR_OK) {
+			if (output && !too_small) {
+				length = *n_output - total;
+				rv = wrap_key_for_mechanism (session, &inner, wrapper, wrapped,
+				                             output + total, &length);
+				if (rv == CKR_BUFFER_TOO_SMALL) {
+					too_small = TRUE;
+					rv = CKR_OK;
+				}
+			} else {
+				rv = wrap_key_for_mechanism (session, &inner, wrapper, wrapped,
+				                             NULL, &length);
+			}
+		}
+
+		/* Unknown inner mechanisms fail everything */
+		if (rv == CKR_MECHANISM_INVALID || rv == CKR_MECHANISM_PARAM_INVALID)
+			return rv;
+
+		results[i] = rv;
+		lengths[i] = (rv == CKR_OK) ? length : 0;
+		total += lengths[i];
 	}
+
+	*n_output = total;
+	return too_small ? CKR_BUFFER_TOO_SMALL : CKR_OK;
 }
 
 CK_RV
@@ -507,6 +611,8 @@ gkm_crypto_prepare (GkmSession *session, CK_MECHANISM_TYPE mech, GkmObject *key)
 	case CKM_RSA_PKCS:
 	case CKM_RSA_X_509:
 	case CKM_DSA:
+	case CKM_ECDSA:
+	case CKM_EDDSA:
 		return gkm_crypto_prepare_xsa (session, mech, key);
 	default:
 		g_return_val_if_reached (CKR_GENERAL_ERROR);
@@ -541,6 +647,56 @@ gkm_crypto_initialize (void)
 	egg_libgcrypt_initialize ();
 }
 
+/*
+ * Encrypt or decrypt a whole buffer with CBC, in place if output is the same
+ * as input. One call for the lot lets libgcrypt use its multi-block code.
+ */
+gboolean
+gkm_crypto_cbc_transform (int algo, const guchar *key, const guchar *iv,
+                          gboolean encrypt, guchar *output, const guchar *input,
+                          gsize n_data)
+{
+	gcry_cipher_hd_t cih;
+	gcry_error_t gcry;
+	gsize n_key, n_block;
+
+	g_return_val_if_fail (key != NULL, FALSE);
+	g_return_val_if_fail (iv != NULL, FALSE);
+	g_return_val_if_fail (output != NULL || n_data == 0, FALSE);
+
+	n_key = gcry_cipher_get_algo_keylen (algo);
+	g_return_val_if_fail (n_key, FALSE);
+	n_block = gcry_cipher_get_algo_blklen (algo);
+	g_return_val_if_fail (n_block, FALSE);
+	g_return_val_if_fail (n_data % n_block == 0, FALSE);
+
+	gcry = gcry_cipher_open (&cih, algo, GCRY_CIPHER_MODE_CBC, 0);
+	if (gcry) {
+		g_warning ("couldn't create cipher context: %s", gcry_strerror (gcry));
+		return FALSE;
+	}
+
+	gcry = gcry_cipher_setkey (cih, key, n_key);
+	g_return_val_if_fail (!gcry, FALSE);
+
+	gcry = gcry_cipher_setiv (cih, iv, n_block);
+	g_return_val_if_fail (!gcry, FALSE);
+
+	if (n_data > 0) {
+		/* A null input means in place to libgcrypt */
+		if (input == output)
+			input = NULL;
+		if (encrypt)
+			gcry = gcry_cipher_encrypt (cih, output, n_data, input, input ? n_data : 0);
+		else
+			gcry = gcry_cipher_decrypt (cih, output, n_data, input, input ? n_data : 0);
+		g_return_val_if_fail (!gcry, FALSE);
+	}
+
+	gcry_cipher_close (cih);
+	return TRUE;
+}
+
 gulong
 gkm_crypto_secret_key_length (CK_KEY_TYPE type)
 {
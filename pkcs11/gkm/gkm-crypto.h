@@ -142,6 +142,18 @@ CK_RV                    gkm_crypto_wrap_key                           (GkmSessi
                                                                         CK_BYTE_PTR output,
                                                                         CK_ULONG_PTR n_output);
 
+CK_RV                    gkm_crypto_wrap_batch                         (GkmSession *session,
+                                                                        CK_MECHANISM_TYPE mech,
+                                                                        GkmObject *wrapper,
+                                                                        CK_OBJECT_HANDLE_PTR objects,
+                                                                        CK_ULONG n_objects,
+                                                                        CK_BYTE_PTR ivs,
+                                                                        CK_ULONG n_iv,
+                                                                        CK_ULONG_PTR results,
+                                                                        CK_ULONG_PTR lengths,
+                                                                        CK_BYTE_PTR output,
+                                                                        CK_ULONG_PTR n_output);
+
 CK_RV                    gkm_crypto_unwrap_key                         (GkmSession *session,
                                                                         CK_MECHANISM_PTR mech,
                                                                         GkmObject *wrapper,
@@ -153,4 +165,12 @@ CK_RV                    gkm_crypto_unwrap_key                         (GkmSessi
 
 gulong                   gkm_crypto_secret_key_length                  (CK_KEY_TYPE type);
 
+gboolean                 gkm_crypto_cbc_transform                      (int algo,
+                                                                        const guchar *key,
+                                                                        const guchar *iv,
+                                                                        gboolean encrypt,
+                                                                        guchar *output,
+                                                                        const guchar *input,
+                                                                        gsize n_data);
+
 #endif /* GKM_CRYPTO_H_ */
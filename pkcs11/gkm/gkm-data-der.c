@@ -1158,14 +1158,52 @@ gkm_data_der_write_private_pkcs8_crypted (gcry_sexp_t skey,
  * CERTIFICATES
  */
 
+static gboolean
+check_certificate_name (GNode *asn1,
+                        const gchar *part)
+{
+	GBytes *raw;
+	GNode *node;
+	GNode *name;
+
+	node = egg_asn1x_node (asn1, "tbsCertificate", part, NULL);
+	if (node == NULL)
+		return FALSE;
+
+	raw = egg_asn1x_get_element_raw (node);
+	if (raw == NULL)
+		return FALSE;
+
+	name = egg_asn1x_create_and_decode (pkix_asn1_tab, "Name", raw);
+	g_bytes_unref (raw);
+
+	if (name == NULL)
+		return FALSE;
+
+	egg_asn1x_destroy (name);
+	return TRUE;
+}
+
 GkmDataResult
 gkm_data_der_read_certificate (GBytes *data,
                                GNode **asn1)
 {
-	*asn1 = egg_asn1x_create_and_decode (pkix_asn1_tab, "Certificate", data);
+	/* Most of a certificate is never looked at, so decode parts as needed */
+	*asn1 = egg_asn1x_create_and_decode_full (pkix_asn1_tab, "Certificate", data, EGG_ASN1X_LAZY);
 	if (!*asn1)
 		return GKM_DATA_UNRECOGNIZED;
 
+	/* But do check the outer structure, and the parts that become attributes, up front */
+	if (!egg_asn1x_node (*asn1, "tbsCertificate", "subjectPublicKeyInfo", NULL) ||
+	    !egg_asn1x_node (*asn1, "tbsCertificate", "serialNumber", NULL) ||
+	    !egg_asn1x_node (*asn1, "tbsCertificate", "validity", "notAfter", NULL) ||
+	    !check_certificate_name (*asn1, "subject") ||
+	    !check_certificate_name (*asn1, "issuer")) {
+		egg_asn1x_destroy (*asn1);
+		*asn1 = NULL;
+		return GKM_DATA_UNRECOGNIZED;
+	}
+
 	return GKM_DATA_SUCCESS;
 }
 
@@ -0,0 +1,149 @@
+/*
+ * gnome-keyring
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gkm-crypto.h"
+#include "gkm-eddsa-mechanism.h"
+#include "gkm-session.h"
+#include "gkm-sexp.h"
+#include "gkm-sexp-key.h"
+
+#include "egg/egg-libgcrypt.h"
+#include "egg/egg-secure-memory.h"
+
+#include <string.h>
+
+/* Ed25519 signatures are R || S, 32 bytes each */
+#define EDDSA_PART_LEN 32
+
+/* -----------------------------------------------------------------------------
+ * INTERNAL
+ */
+
+static gboolean
+extract_part (gcry_sexp_t ssig, const gchar *part, CK_BYTE_PTR output)
+{
+	gpointer data;
+	gsize n_data;
+
+	data = gkm_sexp_extract_buffer (ssig, &n_data, "eddsa", part, NULL);
+	if (!data)
+		return FALSE;
+
+	/* Comes back opaque, but right align just in case it's shorter */
+	if (n_data > EDDSA_PART_LEN) {
+		g_free (data);
+		return FALSE;
+	}
+
+	memset (output, 0, EDDSA_PART_LEN - n_data);
+	memcpy (output + (EDDSA_PART_LEN - n_data), data, n_data);
+	g_free (data);
+	return TRUE;
+}
+
+/* ----------------------------------------------------------------------------
+ * PUBLIC
+ */
+
+CK_RV
+gkm_eddsa_mechanism_sign (gcry_sexp_t sexp, CK_BYTE_PTR data, CK_ULONG n_data,
+                          CK_BYTE_PTR signature, CK_ULONG_PTR n_signature)
+{
+	gcry_sexp_t ssig, splain;
+	gcry_error_t gcry;
+
+	g_return_val_if_fail (sexp, CKR_GENERAL_ERROR);
+	g_return_val_if_fail (n_signature, CKR_ARGUMENTS_BAD);
+	g_return_val_if_fail (data || !n_data, CKR_ARGUMENTS_BAD);
+
+	/* If no output, then don't process */
+	if (!signature) {
+		*n_signature = EDDSA_PART_LEN * 2;
+		return CKR_OK;
+	} else if (*n_signature < EDDSA_PART_LEN * 2) {
+		*n_signature = EDDSA_PART_LEN * 2;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	/* EdDSA signs the message itself, the hash is part of the algorithm */
+	gcry = gcry_sexp_build (&splain, NULL, "(data (flags eddsa) (hash-algo sha512) (value %b))",
+	                        (int)n_data, data ? (const void *)data : "");
+	g_return_val_if_fail (gcry == 0, CKR_GENERAL_ERROR);
+
+	/* Do the magic */
+	gcry = gcry_pk_sign (&ssig, splain, sexp);
+	gcry_sexp_release (splain);
+
+	if (gcry) {
+		g_message ("signing of the data failed: %s", gcry_strerror (gcry));
+		return CKR_FUNCTION_FAILED;
+	}
+
+	if (!extract_part (ssig, "r", signature) ||
+	    !extract_part (ssig, "s", signature + EDDSA_PART_LEN)) {
+		gcry_sexp_release (ssig);
+		g_return_val_if_reached (CKR_GENERAL_ERROR);
+	}
+
+	*n_signature = EDDSA_PART_LEN * 2;
+	gcry_sexp_release (ssig);
+	return CKR_OK;
+}
+
+CK_RV
+gkm_eddsa_mechanism_verify (gcry_sexp_t sexp, CK_BYTE_PTR data, CK_ULONG n_data,
+                            CK_BYTE_PTR signature, CK_ULONG n_signature)
+{
+	gcry_sexp_t ssig, splain;
+	gcry_error_t gcry;
+
+	g_return_val_if_fail (sexp, CKR_GENERAL_ERROR);
+	g_return_val_if_fail (signature, CKR_ARGUMENTS_BAD);
+	g_return_val_if_fail (data || !n_data, CKR_ARGUMENTS_BAD);
+
+	if (n_signature != EDDSA_PART_LEN * 2)
+		return CKR_SIGNATURE_LEN_RANGE;
+
+	/* Prepare the input s-expressions */
+	gcry = gcry_sexp_build (&splain, NULL, "(data (flags eddsa) (hash-algo sha512) (value %b))",
+	                        (int)n_data, data ? (const void *)data : "");
+	g_return_val_if_fail (gcry == 0, CKR_GENERAL_ERROR);
+
+	gcry = gcry_sexp_build (&ssig, NULL, "(sig-val (eddsa (r %b) (s %b)))",
+	                        EDDSA_PART_LEN, signature,
+	                        EDDSA_PART_LEN, signature + EDDSA_PART_LEN);
+	g_return_val_if_fail (gcry == 0, CKR_GENERAL_ERROR);
+
+	/* Do the magic */
+	gcry = gcry_pk_verify (ssig, splain, sexp);
+	gcry_sexp_release (splain);
+	gcry_sexp_release (ssig);
+
+	if (gcry_err_code (gcry) == GPG_ERR_BAD_SIGNATURE) {
+		return CKR_SIGNATURE_INVALID;
+	} else if (gcry) {
+		g_message ("verifying of the data failed: %s", gcry_strerror (gcry));
+		return CKR_FUNCTION_FAILED;
+	}
+
+	return CKR_OK;
+}
@@ -0,0 +1,49 @@
+/*
+ * gnome-keyring
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GKM_EDDSA_MECHANISM_H_
+#define GKM_EDDSA_MECHANISM_H_
+
+#include "gkm-types.h"
+
+#include "pkcs11/pkcs11.h"
+#include "pkcs11/pkcs11i.h"
+
+#include <glib.h>
+
+#include <gcrypt.h>
+
+static const CK_MECHANISM_TYPE GKM_EDDSA_MECHANISMS[] = {
+	CKM_EDDSA
+};
+
+CK_RV                    gkm_eddsa_mechanism_sign                      (gcry_sexp_t sexp,
+                                                                        CK_BYTE_PTR data,
+                                                                        CK_ULONG n_data,
+                                                                        CK_BYTE_PTR signature,
+                                                                        CK_ULONG_PTR n_signature);
+
+CK_RV                    gkm_eddsa_mechanism_verify                    (gcry_sexp_t sexp,
+                                                                        CK_BYTE_PTR data,
+                                                                        CK_ULONG n_data,
+                                                                        CK_BYTE_PTR signature,
+                                                                        CK_ULONG n_signature);
+
+#endif /* GKM_EDDSA_MECHANISM_H_ */
@@ -27,6 +27,8 @@
 #include "gkm-session.h"
 #include "gkm-util.h"
 
+#include "pkcs11/pkcs11n.h"
+
 #include <glib.h>
 #include <glib/gi18n.h>
 
@@ -310,9 +312,11 @@ index_update (Index *index, GkmObject *object)
 		ret = read_attribute (object, index->attribute_type, &attr);
 	g_return_if_fail (ret);
 
-	/* No such attribute/property on object */
-	if (attr == NULL)
+	/* No such attribute/property on object, or no longer */
+	if (attr == NULL) {
+		index_remove (index, object);
 		return;
+	}
 
 	prev = g_hash_table_lookup (index->objects, object);
 	if (prev != NULL) {
@@ -496,55 +500,87 @@ find_each_object (gpointer unused, gpointer object, gpointer user_data)
 	(finder->accumulator) (finder, object);
 }
 
+static guint
+index_candidates (Index *index, CK_ATTRIBUTE_PTR attr, gpointer *candidates)
+{
+	GkmObject *object;
+	GHashTable *objects;
+
+	g_assert (index);
+	g_assert (attr);
+	g_assert (candidates);
+
+	if (index->unique) {
+		object = g_hash_table_lookup (index->values, attr);
+		*candidates = object;
+		return object ? 1 : 0;
+	} else {
+		objects = g_hash_table_lookup (index->values, attr);
+		*candidates = objects;
+		return objects ? g_hash_table_size (objects) : 0;
+	}
+}
+
 static void
 find_for_attributes (Finder *finder)
 {
-	GHashTable *objects;
-	CK_ATTRIBUTE_PTR first;
-	GkmObject *object;
-	Index *index;
+	GkmManagerPrivate *pv;
+	Index *index, *best = NULL;
+	gpointer candidates, best_candidates = NULL;
+	guint n_candidates, n_best = 0;
 	GList *l;
+	CK_ULONG i;
 
 	g_assert (finder);
 	g_assert (GKM_IS_MANAGER (finder->manager));
 	g_assert (!finder->n_attrs || finder->attrs);
 
+	pv = finder->manager->pv;
+
 	/* All the objects */
 	if (!finder->n_attrs) {
-		for (l = finder->manager->pv->objects; l; l = g_list_next (l))
+		for (l = pv->objects; l; l = g_list_next (l))
 			(finder->accumulator) (finder, l->data);
 		return;
 	}
 
-	first = finder->attrs;
-	finder->attrs = finder->attrs + 1;
-	finder->n_attrs = finder->n_attrs - 1;
-
-	index = g_hash_table_lookup (finder->manager->pv->index_by_attribute,
-	                             &first->type);
+	/*
+	 * Look at every indexed attribute in the template and start from
+	 * the one with the fewest candidates. The remaining indexed attributes
+	 * are checked with an index lookup per candidate in find_each_object()
+	 * which intersects the indexes.
+	 */
+	for (i = 0; i < finder->n_attrs; ++i) {
+		index = g_hash_table_lookup (pv->index_by_attribute, &finder->attrs[i].type);
+		if (!index)
+			continue;
+
+		n_candidates = index_candidates (index, &finder->attrs[i], &candidates);
+		if (!best || n_candidates < n_best) {
+			best = index;
+			best_candidates = candidates;
+			n_best = n_candidates;
+		}
 
+		/* Nothing can match */
+		if (n_best == 0)
+			break;
+	}
 
 	/* No indexes, have to manually match */
-	if (!index) {
-
-		for (l = finder->manager->pv->objects; l; l = g_list_next (l)) {
-			if (gkm_object_match (l->data, NULL, first))
-				find_each_object (NULL, l->data, finder);
-		}
-
+	if (!best) {
+		for (l = pv->objects; l; l = g_list_next (l))
+			find_each_object (NULL, l->data, finder);
 		return;
 	}
 
 	/* Yay, an index */
-	if (index->unique) {
-		object = g_hash_table_lookup (index->values, first);
-		if (object)
-			find_each_object (NULL, object, finder);
-	} else {
-		objects = g_hash_table_lookup (index->values, first);
-		if (objects)
-			g_hash_table_foreach (objects, find_each_object, finder);
-	}
+	if (n_best == 0)
+		return;
+	else if (best->unique)
+		find_each_object (NULL, best_candidates, finder);
+	else
+		g_hash_table_foreach (best_candidates, find_each_object, finder);
 }
 
 static void
@@ -654,6 +690,10 @@ gkm_manager_init (GkmManager *self)
 	gkm_manager_add_property_index (self, "handle", TRUE);
 	gkm_manager_add_attribute_index (self, CKA_ID, FALSE);
 	gkm_manager_add_attribute_index (self, CKA_CLASS, FALSE);
+
+	/* Trust objects are looked up by certificate hash */
+	gkm_manager_add_attribute_index (self, CKA_CERT_SHA1_HASH, FALSE);
+	gkm_manager_add_attribute_index (self, CKA_CERT_MD5_HASH, FALSE);
 }
 
 static void
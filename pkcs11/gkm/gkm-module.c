@@ -44,6 +44,7 @@
 #include "gkm-timer.h"
 #include "gkm-transaction.h"
 #include "gkm-util.h"
+#include "gkm-x25519-key.h"
 
 enum {
 	PROP_0,
@@ -149,6 +150,18 @@ static const MechanismAndInfo mechanism_list[] = {
 	 */
 	{ CKM_DSA, { 512, 1024, CKF_SIGN | CKF_VERIFY } },
 
+	/*
+	 * CKM_ECDSA
+	 * For ECDSA, min and max are the minimum and maximum curve size in bits
+	 */
+	{ CKM_ECDSA, { 256, 521, CKF_SIGN | CKF_VERIFY } },
+
+	/*
+	 * CKM_EDDSA
+	 * For EdDSA, min and max are the curve size in bits, only Ed25519
+	 */
+	{ CKM_EDDSA, { 255, 255, CKF_SIGN | CKF_VERIFY } },
+
 	/*
 	 * CKM_DH_PKCS_KEY_PAIR_GEN
 	 * For DH derivation the min and max are sizes of prime in bits.
@@ -161,6 +174,12 @@ static const MechanismAndInfo mechanism_list[] = {
 	 */
 	{ CKM_DH_PKCS_DERIVE, { 1, 255, CKF_DERIVE } },
 
+	/*
+	 * CKM_G_X25519_DERIVE
+	 * For X25519 derivation the min and max are sizes of output key in bytes.
+	 */
+	{ CKM_G_X25519_DERIVE, { 1, 32, CKF_DERIVE } },
+
 	/*
 	 * CKM_G_HKDF_DERIVE
 	 * For HKDF derivation the min and max are sizes of prime in bits.
@@ -621,6 +640,7 @@ gkm_module_init (GkmModule *self)
 	gkm_module_register_factory (self, GKM_FACTORY_PRIVATE_XSA_KEY);
 	gkm_module_register_factory (self, GKM_FACTORY_DH_PUBLIC_KEY);
 	gkm_module_register_factory (self, GKM_FACTORY_PUBLIC_XSA_KEY);
+	gkm_module_register_factory (self, GKM_FACTORY_X25519_KEY);
 }
 
 static void
@@ -954,6 +974,30 @@ _gkm_module_get_scary_mutex_that_you_should_not_touch (GkmModule *self)
 	return self->pv->mutex;
 }
 
+/*
+ * Temporarily release the module lock, so that other threads can enter
+ * the module while the caller performs a lengthy operation which doesn't
+ * touch any shared module state (eg: the raw crypto on a prepared key).
+ * Must be balanced with gkm_module_enter(). The caller must hold references
+ * to anything it uses while outside of the lock.
+ */
+
+void
+gkm_module_leave (GkmModule *self)
+{
+	g_return_if_fail (GKM_IS_MODULE (self));
+	if (self->pv->mutex)
+		g_mutex_unlock (self->pv->mutex);
+}
+
+void
+gkm_module_enter (GkmModule *self)
+{
+	g_return_if_fail (GKM_IS_MODULE (self));
+	if (self->pv->mutex)
+		g_mutex_lock (self->pv->mutex);
+}
+
 /* -----------------------------------------------------------------------------
  * PKCS#11
  */
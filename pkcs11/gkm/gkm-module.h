@@ -138,6 +138,10 @@ CK_RV                  gkm_module_logout_so                       (GkmModule *se
 
 CK_RV                  gkm_module_refresh_token                   (GkmModule *self);
 
+void                   gkm_module_leave                           (GkmModule *self);
+
+void                   gkm_module_enter                           (GkmModule *self);
+
 void                   gkm_module_add_token_object                (GkmModule *self,
                                                                    GkmTransaction *transaction,
                                                                    GkmObject *object);
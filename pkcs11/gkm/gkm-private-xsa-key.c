@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include "pkcs11/pkcs11.h"
+#include "pkcs11/pkcs11i.h"
 
 #include "gkm-attributes.h"
 #include "gkm-credential.h"
@@ -29,9 +30,12 @@
 #include "gkm-factory.h"
 #include "gkm-private-xsa-key.h"
 #include "gkm-session.h"
+#include "gkm-sexp.h"
 #include "gkm-transaction.h"
 #include "gkm-util.h"
 
+#include <string.h>
+
 struct _GkmPrivateXsaKeyPrivate {
 	GkmSexp *sexp;
 };
@@ -144,6 +148,62 @@ done:
 	return ret;
 }
 
+static CK_RV
+create_ec_private (CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs, CK_KEY_TYPE type,
+                   gcry_sexp_t *skey)
+{
+	CK_ATTRIBUTE_PTR params;
+	CK_ATTRIBUTE_PTR value;
+	gcry_error_t gcry;
+	gcry_mpi_t d = NULL;
+	const gchar *curve;
+	gconstpointer q;
+	gsize n_q;
+
+	/*
+	 * We need the public point as well as the private value, since it's
+	 * part of the keygrip which CKA_ID is derived from.
+	 */
+	params = gkm_attributes_find (attrs, n_attrs, CKA_EC_PARAMS);
+	value = gkm_attributes_find (attrs, n_attrs, CKA_VALUE);
+	if (!params || !value || !value->pValue ||
+	    !gkm_attributes_find_ec_point (attrs, n_attrs, &q, &n_q))
+		return CKR_TEMPLATE_INCOMPLETE;
+
+	curve = gkm_sexp_curve_for_ec_params (params->pValue, params->ulValueLen);
+	if (curve == NULL)
+		return CKR_ATTRIBUTE_VALUE_INVALID;
+
+	if ((type == CKK_EC_EDWARDS) != (strcmp (curve, GKM_SEXP_CURVE_ED25519) == 0))
+		return CKR_TEMPLATE_INCONSISTENT;
+
+	/* EdDSA secret is the raw seed, ECDSA secret is an integer */
+	if (type == CKK_EC_EDWARDS) {
+		/* Both the seed and the public key are 32 bytes */
+		if (value->ulValueLen != 32 || n_q != 32)
+			return CKR_ATTRIBUTE_VALUE_INVALID;
+		gcry = gcry_sexp_build (skey, NULL,
+		                        "(private-key (ecc (curve %s) (flags eddsa) (q %b) (d %b)))",
+		                        curve, (int)n_q, q, (int)value->ulValueLen, value->pValue);
+	} else {
+		if (!gkm_attributes_find_mpi (attrs, n_attrs, CKA_VALUE, &d))
+			return CKR_ATTRIBUTE_VALUE_INVALID;
+		gcry = gcry_sexp_build (skey, NULL,
+		                        "(private-key (ecc (curve %s) (q %b) (d %m)))",
+		                        curve, (int)n_q, q, d);
+		gcry_mpi_release (d);
+	}
+
+	if (gcry != 0) {
+		g_message ("couldn't create EC key from passed attributes: %s", gcry_strerror (gcry));
+		return CKR_FUNCTION_FAILED;
+	}
+
+	gkm_attributes_consume (attrs, n_attrs, CKA_EC_PARAMS, CKA_EC_POINT,
+	                        CKA_VALUE, G_MAXULONG);
+	return CKR_OK;
+}
+
 static GkmObject*
 factory_create_private_xsa_key (GkmSession *session, GkmTransaction *transaction,
                             CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs)
@@ -396,6 +456,10 @@ gkm_private_xsa_key_create_sexp (GkmSession *session, GkmTransaction *transactio
 	case CKK_DSA:
 		ret = create_dsa_private (attrs, n_attrs, &sexp);
 		break;
+	case CKK_EC:
+	case CKK_EC_EDWARDS:
+		ret = create_ec_private (attrs, n_attrs, type, &sexp);
+		break;
 	default:
 		ret = CKR_ATTRIBUTE_VALUE_INVALID;
 		break;
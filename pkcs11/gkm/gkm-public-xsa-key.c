@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include "pkcs11/pkcs11.h"
+#include "pkcs11/pkcs11i.h"
 
 #include "gkm-attributes.h"
 #define DEBUG_FLAG GKM_DEBUG_OBJECT
@@ -32,6 +33,8 @@
 #include "gkm-transaction.h"
 #include "gkm-util.h"
 
+#include <string.h>
+
 G_DEFINE_TYPE (GkmPublicXsaKey, gkm_public_xsa_key, GKM_TYPE_SEXP_KEY);
 
 /* -----------------------------------------------------------------------------
@@ -140,6 +143,46 @@ done:
 	return ret;
 }
 
+static CK_RV
+create_ec_public (CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs, CK_KEY_TYPE type,
+                  gcry_sexp_t *skey)
+{
+	CK_ATTRIBUTE_PTR params;
+	gcry_error_t gcry;
+	const gchar *curve;
+	gconstpointer q;
+	gsize n_q;
+
+	params = gkm_attributes_find (attrs, n_attrs, CKA_EC_PARAMS);
+	if (!params || !gkm_attributes_find_ec_point (attrs, n_attrs, &q, &n_q))
+		return CKR_TEMPLATE_INCOMPLETE;
+
+	curve = gkm_sexp_curve_for_ec_params (params->pValue, params->ulValueLen);
+	if (curve == NULL)
+		return CKR_ATTRIBUTE_VALUE_INVALID;
+
+	/* Edwards keys only on Edwards curves, and vice versa */
+	if ((type == CKK_EC_EDWARDS) != (strcmp (curve, GKM_SEXP_CURVE_ED25519) == 0))
+		return CKR_TEMPLATE_INCONSISTENT;
+
+	if (type == CKK_EC_EDWARDS)
+		gcry = gcry_sexp_build (skey, NULL,
+		                        "(public-key (ecc (curve %s) (flags eddsa) (q %b)))",
+		                        curve, (int)n_q, q);
+	else
+		gcry = gcry_sexp_build (skey, NULL,
+		                        "(public-key (ecc (curve %s) (q %b)))",
+		                        curve, (int)n_q, q);
+
+	if (gcry != 0) {
+		g_message ("couldn't create EC key from passed attributes: %s", gcry_strerror (gcry));
+		return CKR_FUNCTION_FAILED;
+	}
+
+	gkm_attributes_consume (attrs, n_attrs, CKA_EC_PARAMS, CKA_EC_POINT, G_MAXULONG);
+	return CKR_OK;
+}
+
 static GkmObject*
 factory_create_public_xsa_key (GkmSession *session, GkmTransaction *transaction,
                                CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs)
@@ -286,6 +329,10 @@ gkm_public_xsa_key_create_sexp (GkmSession *session, GkmTransaction *transaction
 	case CKK_DSA:
 		ret = create_dsa_public (attrs, n_attrs, &sexp);
 		break;
+	case CKK_EC:
+	case CKK_EC_EDWARDS:
+		ret = create_ec_public (attrs, n_attrs, type, &sexp);
+		break;
 	default:
 		ret = CKR_ATTRIBUTE_VALUE_INVALID;
 		break;
@@ -23,19 +23,73 @@
 #include "gkm-secret.h"
 
 #include "egg/egg-secure-memory.h"
+#include "egg/egg-symkey.h"
 
 #include <string.h>
 
+/* Keys derived from this secret, most recently used first */
+typedef struct _Derived {
+	int cipher_algo;
+	int hash_algo;
+	guchar *salt;
+	gsize n_salt;
+	int iterations;
+	guchar *key;                 /* Secure memory */
+	gsize n_key;
+	guchar *iv;                  /* Secure memory */
+	gsize n_iv;
+} Derived;
+
+/* Enough for a keyring being read and written again */
+#define MAX_DERIVED 4
+
 struct _GkmSecret {
 	GObject parent;
 	guchar *memory;
 	gsize n_memory;
+	GQueue derived;
+	GMutex mutex;                /* Protects derived */
 };
 
 G_DEFINE_TYPE (GkmSecret, gkm_secret, G_TYPE_OBJECT);
 
 EGG_SECURE_DECLARE (secret);
 
+/* -----------------------------------------------------------------------------
+ * HELPERS
+ */
+
+static void
+derived_free (gpointer data)
+{
+	Derived *derived = data;
+
+	egg_secure_free (derived->key);
+	egg_secure_free (derived->iv);
+	g_free (derived->salt);
+	g_slice_free (Derived, derived);
+}
+
+static GList*
+derived_lookup (GkmSecret *self, int cipher_algo, int hash_algo,
+                const guchar *salt, gsize n_salt, int iterations)
+{
+	Derived *derived;
+	GList *l;
+
+	for (l = self->derived.head; l != NULL; l = g_list_next (l)) {
+		derived = l->data;
+		if (derived->cipher_algo == cipher_algo &&
+		    derived->hash_algo == hash_algo &&
+		    derived->iterations == iterations &&
+		    derived->n_salt == n_salt &&
+		    (n_salt == 0 || memcmp (derived->salt, salt, n_salt) == 0))
+			return l;
+	}
+
+	return NULL;
+}
+
 /* -----------------------------------------------------------------------------
  * OBJECT
  */
@@ -43,7 +97,8 @@ EGG_SECURE_DECLARE (secret);
 static void
 gkm_secret_init (GkmSecret *self)
 {
-
+	g_queue_init (&self->derived);
+	g_mutex_init (&self->mutex);
 }
 
 static void
@@ -53,6 +108,11 @@ gkm_secret_dispose (GObject *obj)
 
 	egg_secure_clear (self->memory, self->n_memory);
 
+	g_mutex_lock (&self->mutex);
+	g_queue_foreach (&self->derived, (GFunc)derived_free, NULL);
+	g_queue_clear (&self->derived);
+	g_mutex_unlock (&self->mutex);
+
 	G_OBJECT_CLASS (gkm_secret_parent_class)->dispose (obj);
 }
 
@@ -65,6 +125,9 @@ gkm_secret_finalize (GObject *obj)
 	self->memory = NULL;
 	self->n_memory = 0;
 
+	g_assert (g_queue_is_empty (&self->derived));
+	g_mutex_clear (&self->mutex);
+
 	G_OBJECT_CLASS (gkm_secret_parent_class)->finalize (obj);
 }
 
@@ -183,3 +246,105 @@ gkm_secret_is_trivially_weak (GkmSecret *self)
 	return gkm_secret_equals (self, NULL, 0) ||
 	       gkm_secret_equals (self, (const guchar*)"", 0);
 }
+
+/*
+ * Same as egg_symkey_generate_simple() with this secret as the password,
+ * except that the result is remembered in secure memory for as long as the
+ * secret is around. A secret never changes, so dropping it (when locking or
+ * changing the password) also drops the derived keys.
+ */
+gboolean
+gkm_secret_derive_simple (GkmSecret *self, int cipher_algo, int hash_algo,
+                          const guchar *salt, gsize n_salt, int iterations,
+                          guchar **key, guchar **iv)
+{
+	Derived *derived;
+	guchar *plain_iv;
+	GList *l;
+
+	g_return_val_if_fail (GKM_IS_SECRET (self), FALSE);
+	g_return_val_if_fail (iterations >= 1, FALSE);
+
+	g_mutex_lock (&self->mutex);
+
+	l = derived_lookup (self, cipher_algo, hash_algo, salt, n_salt, iterations);
+	if (l != NULL) {
+		derived = l->data;
+		g_queue_unlink (&self->derived, l);
+		g_queue_push_head_link (&self->derived, l);
+
+	} else {
+		derived = g_slice_new0 (Derived);
+		if (!egg_symkey_generate_simple (cipher_algo, hash_algo,
+		                                 (const gchar *)self->memory, self->n_memory,
+		                                 salt, n_salt, iterations,
+		                                 &derived->key, &plain_iv)) {
+			g_slice_free (Derived, derived);
+			g_mutex_unlock (&self->mutex);
+			return FALSE;
+		}
+
+		/* The iv comes back in normal memory */
+		derived->n_key = gcry_cipher_get_algo_keylen (cipher_algo);
+		derived->n_iv = gcry_cipher_get_algo_blklen (cipher_algo);
+		derived->iv = egg_secure_alloc (derived->n_iv);
+		memcpy (derived->iv, plain_iv, derived->n_iv);
+		egg_secure_clear (plain_iv, derived->n_iv);
+		g_free (plain_iv);
+
+		derived->cipher_algo = cipher_algo;
+		derived->hash_algo = hash_algo;
+		derived->salt = g_memdup (salt, n_salt);
+		derived->n_salt = n_salt;
+		derived->iterations = iterations;
+
+		g_queue_push_head (&self->derived, derived);
+		while (g_queue_get_length (&self->derived) > MAX_DERIVED)
+			derived_free (g_queue_pop_tail (&self->derived));
+	}
+
+	/* Hand out copies, same as egg_symkey_generate_simple() */
+	if (key) {
+		*key = egg_secure_alloc (derived->n_key);
+		memcpy (*key, derived->key, derived->n_key);
+	}
+	if (iv)
+		*iv = g_memdup (derived->iv, derived->n_iv);
+
+	g_mutex_unlock (&self->mutex);
+	return TRUE;
+}
+
+/*
+ * Find the salt and iterations of the key most recently derived with these
+ * algorithms. Writing with the same ones again means no key derivation.
+ */
+gboolean
+gkm_secret_lookup_derived (GkmSecret *self, int cipher_algo, int hash_algo,
+                           guchar *salt, gsize n_salt, int *iterations)
+{
+	gboolean ret = FALSE;
+	Derived *derived;
+	GList *l;
+
+	g_return_val_if_fail (GKM_IS_SECRET (self), FALSE);
+	g_return_val_if_fail (salt != NULL || n_salt == 0, FALSE);
+	g_return_val_if_fail (iterations != NULL, FALSE);
+
+	g_mutex_lock (&self->mutex);
+
+	for (l = self->derived.head; l != NULL; l = g_list_next (l)) {
+		derived = l->data;
+		if (derived->cipher_algo == cipher_algo &&
+		    derived->hash_algo == hash_algo &&
+		    derived->n_salt == n_salt) {
+			memcpy (salt, derived->salt, n_salt);
+			*iterations = derived->iterations;
+			ret = TRUE;
+			break;
+		}
+	}
+
+	g_mutex_unlock (&self->mutex);
+	return ret;
+}
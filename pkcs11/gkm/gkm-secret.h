@@ -65,4 +65,20 @@ gboolean            gkm_secret_equals                 (GkmSecret *self,
 
 gboolean            gkm_secret_is_trivially_weak      (GkmSecret *self);
 
+gboolean            gkm_secret_derive_simple          (GkmSecret *self,
+                                                       int cipher_algo,
+                                                       int hash_algo,
+                                                       const guchar *salt,
+                                                       gsize n_salt,
+                                                       int iterations,
+                                                       guchar **key,
+                                                       guchar **iv);
+
+gboolean            gkm_secret_lookup_derived         (GkmSecret *self,
+                                                       int cipher_algo,
+                                                       int hash_algo,
+                                                       guchar *salt,
+                                                       gsize n_salt,
+                                                       int *iterations);
+
 #endif /* __GKM_SECRET_H__ */
@@ -78,6 +78,10 @@ struct _GkmSessionPrivate {
 	GDestroyNotify crypto_destroy;
 	CK_MECHANISM_TYPE crypto_mechanism;
 	CK_ATTRIBUTE_TYPE crypto_method;
+	guint crypto_serial;
+
+	/* Held while crypto runs outside of the module lock */
+	GMutex crypto_mutex;
 };
 
 G_DEFINE_TYPE (GkmSession, gkm_session, G_TYPE_OBJECT);
@@ -94,10 +98,14 @@ cleanup_crypto (GkmSession *self)
 {
 	g_assert (self->pv->current_operation == cleanup_crypto);
 
+	/* Wait for any crypto running outside the module lock */
+	g_mutex_lock (&self->pv->crypto_mutex);
 	if (self->pv->crypto_state && self->pv->crypto_destroy)
 		(self->pv->crypto_destroy) (self->pv->crypto_state);
 	self->pv->crypto_state = NULL;
 	self->pv->crypto_destroy = NULL;
+	g_mutex_unlock (&self->pv->crypto_mutex);
+
 	self->pv->crypto_mechanism = 0;
 	self->pv->crypto_method = 0;
 
@@ -177,15 +185,48 @@ prepare_crypto (GkmSession *self, CK_MECHANISM_PTR mech,
 	self->pv->current_operation = cleanup_crypto;
 	self->pv->crypto_mechanism = mech->mechanism;
 	self->pv->crypto_method = method;
+	self->pv->crypto_serial++;
 
 	return CKR_OK;
 }
 
+static CK_RV
+perform_crypto (GkmSession *self, CK_ATTRIBUTE_TYPE method, CK_BYTE_PTR bufone,
+                CK_ULONG n_bufone, CK_BYTE_PTR buftwo, CK_ULONG_PTR n_buftwo)
+{
+	GkmModule *module;
+	CK_RV rv;
+
+	g_assert (self->pv->crypto_state);
+	g_assert (self->pv->crypto_mechanism);
+
+	/*
+	 * Once the crypto state is prepared the operation itself only
+	 * touches that state, so let other threads into the module while
+	 * we do the expensive part. The crypto lock keeps the state alive
+	 * until we're done with it.
+	 */
+
+	module = g_object_ref (self->pv->module);
+	g_mutex_lock (&self->pv->crypto_mutex);
+	gkm_module_leave (module);
+
+	rv = gkm_crypto_perform (self, self->pv->crypto_mechanism, method,
+	                         bufone, n_bufone, buftwo, n_buftwo);
+
+	g_mutex_unlock (&self->pv->crypto_mutex);
+	gkm_module_enter (module);
+	g_object_unref (module);
+
+	return rv;
+}
+
 static CK_RV
 process_crypto (GkmSession *self, CK_ATTRIBUTE_TYPE method, CK_BYTE_PTR bufone,
                 CK_ULONG n_bufone, CK_BYTE_PTR buftwo, CK_ULONG_PTR n_buftwo)
 {
 	CK_RV rv = CKR_OK;
+	guint serial;
 
 	g_assert (GKM_IS_SESSION (self));
 
@@ -194,6 +235,8 @@ process_crypto (GkmSession *self, CK_ATTRIBUTE_TYPE method, CK_BYTE_PTR bufone,
 	if (method != self->pv->crypto_method)
 		return CKR_OPERATION_NOT_INITIALIZED;
 
+	serial = self->pv->crypto_serial;
+
 	if (!bufone || !n_buftwo)
 		rv = CKR_ARGUMENTS_BAD;
 
@@ -205,18 +248,25 @@ process_crypto (GkmSession *self, CK_ATTRIBUTE_TYPE method, CK_BYTE_PTR bufone,
 		}
 	}
 
-	if (rv == CKR_OK) {
-		g_assert (self->pv->crypto_mechanism);
-		rv = gkm_crypto_perform (self, self->pv->crypto_mechanism, method,
-		                         bufone, n_bufone, buftwo, n_buftwo);
-	}
+	/* Keep ourselves around while perform_crypto() is outside the module lock */
+	g_object_ref (self);
+
+	if (rv == CKR_OK)
+		rv = perform_crypto (self, method, bufone, n_bufone, buftwo, n_buftwo);
 
 	/* Under these conditions the operation isn't complete */
 	if (rv == CKR_BUFFER_TOO_SMALL || rv == CKR_USER_NOT_LOGGED_IN ||
-	    (rv == CKR_OK && buftwo == NULL))
+	    (rv == CKR_OK && buftwo == NULL)) {
+		g_object_unref (self);
 		return rv;
+	}
+
+	/* Unless another thread already completed or restarted the operation */
+	if (self->pv->current_operation == cleanup_crypto &&
+	    self->pv->crypto_serial == serial)
+		cleanup_crypto (self);
 
-	cleanup_crypto (self);
+	g_object_unref (self);
 	return rv;
 }
 
@@ -380,6 +430,7 @@ gkm_session_init (GkmSession *self)
 	self->pv = G_TYPE_INSTANCE_GET_PRIVATE (self, GKM_TYPE_SESSION, GkmSessionPrivate);
 	self->pv->objects = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, gkm_util_dispose_unref);
 	self->pv->flags = 0;
+	g_mutex_init (&self->pv->crypto_mutex);
 
 	/* Create the store and register attributes */
 	self->pv->store = GKM_STORE (gkm_memory_store_new ());
@@ -428,6 +479,8 @@ gkm_session_finalize (GObject *obj)
 	g_object_unref (self->pv->store);
 	self->pv->store = NULL;
 
+	g_mutex_clear (&self->pv->crypto_mutex);
+
 	G_OBJECT_CLASS (gkm_session_parent_class)->finalize (obj);
 }
 
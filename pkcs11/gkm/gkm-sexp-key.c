@@ -21,15 +21,20 @@
 #include "config.h"
 
 #include "pkcs11/pkcs11.h"
+#include "pkcs11/pkcs11i.h"
 
 #include "gkm-attributes.h"
 #define DEBUG_FLAG GKM_DEBUG_OBJECT
 #include "gkm-debug.h"
 #include "gkm-dsa-mechanism.h"
+#include "gkm-ecdsa-mechanism.h"
+#include "gkm-eddsa-mechanism.h"
 #include "gkm-rsa-mechanism.h"
 #include "gkm-sexp-key.h"
 #include "gkm-util.h"
 
+#include <string.h>
+
 enum {
 	PROP_0,
 	PROP_BASE_SEXP,
@@ -46,6 +51,40 @@ G_DEFINE_TYPE (GkmSexpKey, gkm_sexp_key, GKM_TYPE_OBJECT);
  * INTERNAL
  */
 
+static gchar*
+ecc_curve_name (GkmSexpKey *self)
+{
+	gcry_sexp_t numbers;
+	gchar *curve;
+	int algorithm;
+
+	g_return_val_if_fail (self->pv->base_sexp, NULL);
+
+	if (!gkm_sexp_parse_key (gkm_sexp_get (self->pv->base_sexp),
+	                         &algorithm, NULL, &numbers))
+		g_return_val_if_reached (NULL);
+
+	curve = NULL;
+	if (algorithm == GCRY_PK_ECC)
+		curve = gkm_sexp_extract_string (numbers, "curve", NULL);
+
+	gcry_sexp_release (numbers);
+	return curve;
+}
+
+static gboolean
+is_edwards_key (GkmSexpKey *self)
+{
+	gchar *curve;
+	gboolean ret;
+
+	curve = ecc_curve_name (self);
+	ret = curve && strcmp (curve, GKM_SEXP_CURVE_ED25519) == 0;
+	g_free (curve);
+
+	return ret;
+}
+
 /* -----------------------------------------------------------------------------
  * KEY
  */
@@ -63,6 +102,9 @@ gkm_sexp_key_real_get_attribute (GkmObject *base, GkmSession *session, CK_ATTRIB
 				return gkm_attribute_set_ulong (attr, CKK_RSA);
 			case GCRY_PK_DSA:
 				return gkm_attribute_set_ulong (attr, CKK_DSA);
+			case GCRY_PK_ECC:
+				return gkm_attribute_set_ulong (attr, is_edwards_key (self) ?
+				                                CKK_EC_EDWARDS : CKK_EC);
 			default:
 				g_return_val_if_reached (CKR_GENERAL_ERROR);
 			};
@@ -100,10 +142,22 @@ gkm_sexp_key_real_get_attribute (GkmObject *base, GkmSession *session, CK_ATTRIB
 		case GCRY_PK_DSA:
 			return gkm_attribute_set_data (attr, (CK_VOID_PTR)GKM_DSA_MECHANISMS,
 			                               sizeof (GKM_DSA_MECHANISMS));
+		case GCRY_PK_ECC:
+			if (is_edwards_key (self))
+				return gkm_attribute_set_data (attr, (CK_VOID_PTR)GKM_EDDSA_MECHANISMS,
+				                               sizeof (GKM_EDDSA_MECHANISMS));
+			return gkm_attribute_set_data (attr, (CK_VOID_PTR)GKM_ECDSA_MECHANISMS,
+			                               sizeof (GKM_ECDSA_MECHANISMS));
 		default:
 			g_return_val_if_reached (CKR_GENERAL_ERROR);
 		};
 
+	case CKA_EC_PARAMS:
+		return gkm_sexp_key_set_ec_params (self, attr);
+
+	case CKA_EC_POINT:
+		return gkm_sexp_key_set_ec_point (self, attr);
+
 	/* Lookup the certificate subject */
 	case CKA_SUBJECT:
 		/* TODO: When we have certificates, implement this */
@@ -255,6 +309,73 @@ gkm_sexp_key_set_part (GkmSexpKey *self, int algo, const char *part, CK_ATTRIBUT
 	return rv;
 }
 
+CK_RV
+gkm_sexp_key_set_ec_params (GkmSexpKey *self, CK_ATTRIBUTE_PTR attr)
+{
+	gconstpointer params;
+	gsize n_params;
+	gchar *curve;
+	CK_RV rv;
+
+	g_return_val_if_fail (GKM_IS_SEXP_KEY (self), CKR_GENERAL_ERROR);
+
+	curve = ecc_curve_name (self);
+	if (curve == NULL) {
+		gkm_debug ("CKR_ATTRIBUTE_TYPE_INVALID: attribute %s not valid for non-EC key",
+		           gkm_log_attr_type (attr->type));
+		return CKR_ATTRIBUTE_TYPE_INVALID;
+	}
+
+	if (gkm_sexp_ec_params_for_curve (curve, &params, &n_params))
+		rv = gkm_attribute_set_data (attr, params, n_params);
+	else
+		rv = CKR_GENERAL_ERROR;
+
+	g_free (curve);
+	return rv;
+}
+
+CK_RV
+gkm_sexp_key_set_ec_point (GkmSexpKey *self, CK_ATTRIBUTE_PTR attr)
+{
+	gcry_sexp_t numbers;
+	const guchar *point;
+	gpointer q;
+	gsize n_q;
+	int algorithm;
+	CK_RV rv;
+
+	g_return_val_if_fail (GKM_IS_SEXP_KEY (self), CKR_GENERAL_ERROR);
+	g_return_val_if_fail (self->pv->base_sexp, CKR_GENERAL_ERROR);
+
+	if (!gkm_sexp_parse_key (gkm_sexp_get (self->pv->base_sexp),
+	                         &algorithm, NULL, &numbers))
+		g_return_val_if_reached (CKR_GENERAL_ERROR);
+
+	if (algorithm != GCRY_PK_ECC) {
+		gcry_sexp_release (numbers);
+		gkm_debug ("CKR_ATTRIBUTE_TYPE_INVALID: attribute %s not valid for non-EC key",
+		           gkm_log_attr_type (attr->type));
+		return CKR_ATTRIBUTE_TYPE_INVALID;
+	}
+
+	q = gkm_sexp_extract_buffer (numbers, &n_q, "q", NULL);
+	gcry_sexp_release (numbers);
+	g_return_val_if_fail (q, CKR_GENERAL_ERROR);
+
+	/* Newer libgcrypt prefixes compressed Ed25519 points with 0x40 */
+	point = q;
+	if (n_q == 33 && point[0] == 0x40) {
+		point++;
+		n_q--;
+	}
+
+	rv = gkm_attribute_set_ec_point (attr, point, n_q);
+	g_free (q);
+
+	return rv;
+}
+
 GkmSexp*
 gkm_sexp_key_acquire_crypto_sexp (GkmSexpKey *self, GkmSession *session)
 {
@@ -22,6 +22,8 @@
 
 #include "gkm-sexp.h"
 
+#include <string.h>
+
 struct _GkmSexp {
 	gint refs;
 	gcry_sexp_t real;
@@ -194,6 +196,35 @@ done:
 	return pubkey;
 }
 
+static gcry_sexp_t
+ecc_numbers_to_public (gcry_sexp_t ecc)
+{
+	gcry_sexp_t pubkey = NULL;
+	gcry_error_t gcry;
+	gchar *curve;
+	gpointer q;
+	gsize n_q;
+
+	curve = gkm_sexp_extract_string (ecc, "curve", NULL);
+	q = gkm_sexp_extract_buffer (ecc, &n_q, "q", NULL);
+
+	if (curve && q) {
+		if (strcmp (curve, GKM_SEXP_CURVE_ED25519) == 0)
+			gcry = gcry_sexp_build (&pubkey, NULL, "(public-key (ecc (curve %s) (flags eddsa) (q %b)))",
+			                        curve, (int)n_q, q);
+		else
+			gcry = gcry_sexp_build (&pubkey, NULL, "(public-key (ecc (curve %s) (q %b)))",
+			                        curve, (int)n_q, q);
+		if (gcry)
+			pubkey = NULL;
+	}
+
+	g_free (curve);
+	g_free (q);
+
+	return pubkey;
+}
+
 gboolean
 gkm_sexp_key_to_public (gcry_sexp_t privkey, gcry_sexp_t *pubkey)
 {
@@ -210,6 +241,9 @@ gkm_sexp_key_to_public (gcry_sexp_t privkey, gcry_sexp_t *pubkey)
 	case GCRY_PK_DSA:
 		*pubkey = dsa_numbers_to_public (numbers);
 		break;
+	case GCRY_PK_ECC:
+		*pubkey = ecc_numbers_to_public (numbers);
+		break;
 	default:
 		g_return_val_if_reached (FALSE);
 	}
@@ -240,6 +274,59 @@ gkm_sexp_extract_mpi (gcry_sexp_t sexp, gcry_mpi_t *mpi, ...)
 	return (*mpi) ? TRUE : FALSE;
 }
 
+gchar*
+gkm_sexp_extract_string (gcry_sexp_t sexp, ...)
+{
+	gcry_sexp_t at = NULL;
+	const gchar *data;
+	gchar *result = NULL;
+	gsize n_data;
+	va_list va;
+
+	g_assert (sexp);
+
+	va_start (va, sexp);
+	at = gkm_sexp_get_childv (sexp, va);
+	va_end (va);
+
+	if (at) {
+		data = gcry_sexp_nth_data (at, 1, &n_data);
+		if (data)
+			result = g_strndup (data, n_data);
+		gcry_sexp_release (at);
+	}
+
+	return result;
+}
+
+gpointer
+gkm_sexp_extract_buffer (gcry_sexp_t sexp, gsize *n_buffer, ...)
+{
+	gcry_sexp_t at = NULL;
+	const gchar *data;
+	gpointer result = NULL;
+	gsize n_data;
+	va_list va;
+
+	g_assert (sexp);
+	g_assert (n_buffer);
+
+	va_start (va, n_buffer);
+	at = gkm_sexp_get_childv (sexp, va);
+	va_end (va);
+
+	if (at) {
+		data = gcry_sexp_nth_data (at, 1, &n_data);
+		if (data) {
+			result = g_memdup (data, n_data);
+			*n_buffer = n_data;
+		}
+		gcry_sexp_release (at);
+	}
+
+	return result;
+}
+
 gcry_sexp_t
 gkm_sexp_get_childv (gcry_sexp_t sexp, va_list va)
 {
@@ -278,3 +365,61 @@ gkm_sexp_dump (gcry_sexp_t sexp)
 	g_printerr ("%s", buf);
 	g_free (buf);
 }
+
+/*
+ * The curves we support, and the DER encoded OID of each, which is
+ * what goes in CKA_EC_PARAMS. The SSH names are only set for the curves
+ * used with ecdsa-sha2-* keys.
+ */
+static const GkmSexpCurve EC_CURVES[] = {
+	{ GKM_SEXP_CURVE_P256, (const guchar *)"\x06\x08\x2a\x86\x48\xce\x3d\x03\x01\x07", 10, 32,
+	  "ecdsa-sha2-nistp256", "nistp256", GCRY_MD_SHA256 },
+	{ GKM_SEXP_CURVE_P384, (const guchar *)"\x06\x05\x2b\x81\x04\x00\x22", 7, 48,
+	  "ecdsa-sha2-nistp384", "nistp384", GCRY_MD_SHA384 },
+	{ GKM_SEXP_CURVE_P521, (const guchar *)"\x06\x05\x2b\x81\x04\x00\x23", 7, 66,
+	  "ecdsa-sha2-nistp521", "nistp521", GCRY_MD_SHA512 },
+	{ GKM_SEXP_CURVE_ED25519, (const guchar *)"\x06\x03\x2b\x65\x70", 5, 32,
+	  NULL, NULL, 0 },
+};
+
+const GkmSexpCurve*
+gkm_sexp_get_curves (guint *n_curves)
+{
+	g_return_val_if_fail (n_curves, NULL);
+	*n_curves = G_N_ELEMENTS (EC_CURVES);
+	return EC_CURVES;
+}
+
+const gchar*
+gkm_sexp_curve_for_ec_params (gconstpointer params, gsize n_params)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (EC_CURVES); i++) {
+		if (EC_CURVES[i].n_params == n_params &&
+		    memcmp (EC_CURVES[i].params, params, n_params) == 0)
+			return EC_CURVES[i].curve;
+	}
+
+	return NULL;
+}
+
+gboolean
+gkm_sexp_ec_params_for_curve (const gchar *curve, gconstpointer *params, gsize *n_params)
+{
+	guint i;
+
+	g_return_val_if_fail (curve, FALSE);
+	g_return_val_if_fail (params, FALSE);
+	g_return_val_if_fail (n_params, FALSE);
+
+	for (i = 0; i < G_N_ELEMENTS (EC_CURVES); i++) {
+		if (g_ascii_strcasecmp (EC_CURVES[i].curve, curve) == 0) {
+			*params = EC_CURVES[i].params;
+			*n_params = EC_CURVES[i].n_params;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
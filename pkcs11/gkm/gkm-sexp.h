@@ -52,9 +52,41 @@ gboolean       gkm_sexp_extract_mpi              (gcry_sexp_t sexp,
                                                   gcry_mpi_t *mpi,
                                                   ...) G_GNUC_NULL_TERMINATED;
 
+gchar*         gkm_sexp_extract_string           (gcry_sexp_t sexp,
+                                                  ...) G_GNUC_NULL_TERMINATED;
+
+gpointer       gkm_sexp_extract_buffer           (gcry_sexp_t sexp,
+                                                  gsize *n_buffer,
+                                                  ...) G_GNUC_NULL_TERMINATED;
+
 gcry_sexp_t    gkm_sexp_get_childv               (gcry_sexp_t sexp,
                                                   va_list va);
 
 void           gkm_sexp_dump                     (gcry_sexp_t sexp);
 
+/* Curve names as libgcrypt knows them */
+#define GKM_SEXP_CURVE_P256       "NIST P-256"
+#define GKM_SEXP_CURVE_P384       "NIST P-384"
+#define GKM_SEXP_CURVE_P521       "NIST P-521"
+#define GKM_SEXP_CURVE_ED25519    "Ed25519"
+
+typedef struct {
+	const gchar *curve;
+	const guchar *params;
+	gsize n_params;
+	gsize n_field;
+	const gchar *ssh_keytype;
+	const gchar *ssh_identifier;
+	int ssh_hash_algo;
+} GkmSexpCurve;
+
+const GkmSexpCurve* gkm_sexp_get_curves          (guint *n_curves);
+
+const gchar*   gkm_sexp_curve_for_ec_params      (gconstpointer params,
+                                                  gsize n_params);
+
+gboolean       gkm_sexp_ec_params_for_curve      (const gchar *curve,
+                                                  gconstpointer *params,
+                                                  gsize *n_params);
+
 #endif /* GKM_SEXP_H_ */
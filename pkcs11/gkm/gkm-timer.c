@@ -28,39 +28,169 @@
 
 struct _GkmTimer {
 	glong when;
+	guint64 serial;
+	gint index;
 	GMutex *mutex;
 	gpointer identifier;
 	GkmTimerFunc callback;
 	gpointer user_data;
 };
 
+/* Values of GkmTimer.index for timers that have left the heap */
+#define TIMER_BATCHED  -1
+#define TIMER_FIRED    -2
+
 static GMutex timer_mutex = { 0, };
-static GQueue *timer_queue = NULL;
+static GPtrArray *timer_heap = NULL;
+static guint64 timer_serial = 0;
 static GThread *timer_thread = NULL;
 static GCond timer_condition;
 static GCond *timer_cond = NULL;
 static gboolean timer_run = FALSE;
 static gint timer_refs = 0;
 
-static gint
-compare_timers (gconstpointer a, gconstpointer b, gpointer user_data)
+/*
+ * The pending timers are kept in a binary min-heap ordered by when they
+ * are due, and then by the order they were started in. Each timer knows
+ * its index in the heap so that it can be cancelled in O(log n).
+ */
+
+static gboolean
+timer_before (GkmTimer *ta, GkmTimer *tb)
 {
-	const GkmTimer *ta = a;
-	const GkmTimer *tb = b;
-	if (ta->when < tb->when)
-		return -1;
-	return ta->when > tb->when;
+	if (ta->when != tb->when)
+		return ta->when < tb->when;
+	return ta->serial < tb->serial;
+}
+
+static void
+heap_set (guint index, GkmTimer *timer)
+{
+	timer_heap->pdata[index] = timer;
+	timer->index = index;
+}
+
+static void
+heap_sift_up (guint index)
+{
+	GkmTimer *timer = timer_heap->pdata[index];
+	GkmTimer *parent;
+
+	while (index > 0) {
+		parent = timer_heap->pdata[(index - 1) / 2];
+		if (!timer_before (timer, parent))
+			break;
+		heap_set (index, parent);
+		index = (index - 1) / 2;
+	}
+
+	heap_set (index, timer);
+}
+
+static void
+heap_sift_down (guint index)
+{
+	GkmTimer *timer = timer_heap->pdata[index];
+	GkmTimer *child;
+	guint pos;
+
+	for (;;) {
+		pos = index * 2 + 1;
+		if (pos >= timer_heap->len)
+			break;
+		child = timer_heap->pdata[pos];
+		if (pos + 1 < timer_heap->len &&
+		    timer_before (timer_heap->pdata[pos + 1], child))
+			child = timer_heap->pdata[++pos];
+		if (!timer_before (child, timer))
+			break;
+		heap_set (index, child);
+		index = pos;
+	}
+
+	heap_set (index, timer);
+}
+
+static void
+heap_insert (GkmTimer *timer)
+{
+	g_ptr_array_add (timer_heap, timer);
+	heap_sift_up (timer_heap->len - 1);
+}
+
+static void
+heap_remove (GkmTimer *timer, gint state)
+{
+	GkmTimer *last;
+	guint index;
+
+	g_assert (timer->index >= 0);
+	g_assert ((guint)timer->index < timer_heap->len);
+
+	index = timer->index;
+	last = g_ptr_array_remove_index (timer_heap, timer_heap->len - 1);
+	timer->index = state;
+
+	/* Move the last timer into the hole, and restore the heap */
+	if (last != timer) {
+		heap_set (index, last);
+		if (index > 0 && timer_before (last, timer_heap->pdata[(index - 1) / 2]))
+			heap_sift_up (index);
+		else
+			heap_sift_down (index);
+	}
+}
+
+static void
+timer_fire_batch (GPtrArray *batch)
+{
+	GkmTimer *timer;
+	GMutex *mutex;
+	guint fired = 0;
+	guint i;
+
+	/*
+	 * Enter each module only once for all its timers that are due,
+	 * and call them in the order they became due.
+	 */
+	while (fired < batch->len) {
+		mutex = NULL;
+		for (i = 0; i < batch->len; i++) {
+			timer = batch->pdata[i];
+			if (timer->index == TIMER_FIRED)
+				continue;
+			if (mutex == NULL) {
+				mutex = timer->mutex;
+				g_mutex_lock (mutex);
+			} else if (timer->mutex != mutex) {
+				continue;
+			}
+
+			if (timer->callback)
+				(timer->callback) (timer, timer->user_data);
+			timer->index = TIMER_FIRED;
+			fired++;
+		}
+
+		g_mutex_unlock (mutex);
+	}
 }
 
 static gpointer
 timer_thread_func (gpointer unused)
 {
+	GPtrArray *batch;
 	GkmTimer *timer;
+	gint64 offset;
+	glong now;
+	guint i;
+
+	batch = g_ptr_array_new ();
 
 	g_mutex_lock (&timer_mutex);
 
 	while (timer_run) {
-		timer = g_queue_peek_head (timer_queue);
+		timer = timer_heap->len ? timer_heap->pdata[0] : NULL;
 
 		/* Nothing in the queue, wait until we have action */
 		if (!timer) {
@@ -68,32 +198,36 @@ timer_thread_func (gpointer unused)
 			continue;
 		}
 
-		if (timer->when) {
-			gint64 when = ((gint64)timer->when) * G_TIME_SPAN_SECOND;
-			gint64 offset = when - g_get_real_time ();
-			if (offset > 0) {
-				g_cond_wait_until (timer_cond, &timer_mutex, g_get_monotonic_time () + offset);
-				continue;
-			}
+		offset = ((gint64)timer->when) * G_TIME_SPAN_SECOND - g_get_real_time ();
+		if (offset > 0) {
+			g_cond_wait_until (timer_cond, &timer_mutex, g_get_monotonic_time () + offset);
+			continue;
 		}
 
-		/* Leave our thread mutex, and enter the module */
-		g_mutex_unlock (&timer_mutex);
-		g_mutex_lock (timer->mutex);
-
-			if (timer->callback)
-				(timer->callback) (timer, timer->user_data);
+		/* Take everything that is due now off the heap */
+		now = g_get_real_time () / G_TIME_SPAN_SECOND;
+		while (timer_heap->len) {
+			timer = timer_heap->pdata[0];
+			if (timer->when > now)
+				break;
+			heap_remove (timer, TIMER_BATCHED);
+			g_ptr_array_add (batch, timer);
+		}
 
-		/* Leave the module, and go back into our thread mutex */
-		g_mutex_unlock (timer->mutex);
+		/* Leave our thread mutex, and enter the modules */
+		g_mutex_unlock (&timer_mutex);
+		timer_fire_batch (batch);
 		g_mutex_lock (&timer_mutex);
 
-		/* There's a chance that the timer may no longer be at head of queue */
-		g_queue_remove (timer_queue, timer);
-		g_slice_free (GkmTimer, timer);
+		/* Cancelling a batched timer only clears its callback, so free here */
+		for (i = 0; i < batch->len; i++)
+			g_slice_free (GkmTimer, batch->pdata[i]);
+		g_ptr_array_set_size (batch, 0);
 	}
 
 	g_mutex_unlock (&timer_mutex);
+
+	g_ptr_array_free (batch, TRUE);
 	return NULL;
 }
 
@@ -108,8 +242,8 @@ gkm_timer_initialize (void)
 			timer_run = TRUE;
 			timer_thread = g_thread_new ("timer", timer_thread_func, NULL);
 			if (timer_thread) {
-				g_assert (timer_queue == NULL);
-				timer_queue = g_queue_new ();
+				g_assert (timer_heap == NULL);
+				timer_heap = g_ptr_array_new ();
 
 				g_assert (timer_cond == NULL);
 				timer_cond = &timer_condition;
@@ -126,7 +260,7 @@ gkm_timer_initialize (void)
 void
 gkm_timer_shutdown (void)
 {
-	GkmTimer *timer;
+	guint i;
 
 	if (g_atomic_int_dec_and_test (&timer_refs)) {
 
@@ -142,16 +276,14 @@ gkm_timer_shutdown (void)
 		g_thread_join (timer_thread);
 		timer_thread = NULL;
 
-		g_assert (timer_queue);
+		g_assert (timer_heap);
 
 		/* Cleanup any outstanding timers */
-		while (!g_queue_is_empty (timer_queue)) {
-			timer = g_queue_pop_head (timer_queue);
-			g_slice_free (GkmTimer, timer);
-		}
+		for (i = 0; i < timer_heap->len; i++)
+			g_slice_free (GkmTimer, timer_heap->pdata[i]);
 
-		g_queue_free (timer_queue);
-		timer_queue = NULL;
+		g_ptr_array_free (timer_heap, TRUE);
+		timer_heap = NULL;
 
 		g_cond_clear (timer_cond);
 		timer_cond = NULL;
@@ -168,7 +300,7 @@ gkm_timer_start (GkmModule *module, glong seconds, GkmTimerFunc callback, gpoint
 	GTimeVal tv;
 
 	g_return_val_if_fail (callback, NULL);
-	g_return_val_if_fail (timer_queue, NULL);
+	g_return_val_if_fail (timer_heap, NULL);
 
 	g_get_current_time (&tv);
 
@@ -182,10 +314,15 @@ gkm_timer_start (GkmModule *module, glong seconds, GkmTimerFunc callback, gpoint
 
 	g_mutex_lock (&timer_mutex);
 
-		g_assert (timer_queue);
-		g_queue_insert_sorted (timer_queue, timer, compare_timers, NULL);
-		g_assert (timer_cond);
-		g_cond_broadcast (timer_cond);
+		g_assert (timer_heap);
+		timer->serial = timer_serial++;
+		heap_insert (timer);
+
+		/* Only wake the timer thread when it has to wait less */
+		if (timer->index == 0) {
+			g_assert (timer_cond);
+			g_cond_broadcast (timer_cond);
+		}
 
 	g_mutex_unlock (&timer_mutex);
 
@@ -201,32 +338,23 @@ gkm_timer_start (GkmModule *module, glong seconds, GkmTimerFunc callback, gpoint
 void
 gkm_timer_cancel (GkmTimer *timer)
 {
-	GList *link;
-
-	g_return_if_fail (timer_queue);
+	g_return_if_fail (timer_heap);
 
 	g_mutex_lock (&timer_mutex);
 
-		g_assert (timer_queue);
+		g_assert (timer_heap);
 
-		link = g_queue_find (timer_queue, timer);
-		if (link) {
-
-			/*
-			 * For thread safety the timer struct must be freed
-			 * from the timer thread. So to cancel, what we do
-			 * is move the timer to the front of the queue,
-			 * and reset the callback and when.
-			 */
+		if (timer->index >= 0) {
+			heap_remove (timer, TIMER_FIRED);
+			g_slice_free (GkmTimer, timer);
 
-			timer->when = 0;
+		/*
+		 * For thread safety a timer that the timer thread has already
+		 * taken off the heap must be freed from the timer thread. So
+		 * all we do is reset the callback.
+		 */
+		} else {
 			timer->callback = NULL;
-
-			g_queue_delete_link (timer_queue, link);
-			g_queue_push_head (timer_queue, timer);
-
-			g_assert (timer_cond);
-			g_cond_broadcast (timer_cond);
 		}
 
 	g_mutex_unlock (&timer_mutex);
@@ -48,5 +48,6 @@ typedef struct _GkmStore GkmStore;
 typedef struct _GkmTimer GkmTimer;
 typedef struct _GkmTransaction GkmTransaction;
 typedef struct _GkmTrust GkmTrust;
+typedef struct _GkmX25519Key GkmX25519Key;
 
 #endif /* __GKM_TYPES_H__ */
@@ -56,6 +56,8 @@
 
 #include "gkm-util.h"
 
+#include "egg/egg-error.h"
+
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gstdio.h>
@@ -170,3 +172,39 @@ gkm_util_locate_keyrings_directory (void)
 	g_free (new_directory);
 	return directory;
 }
+
+void
+gkm_util_run_in_parallel (GPtrArray *jobs,
+                          GFunc func,
+                          gpointer user_data)
+{
+	GThreadPool *pool = NULL;
+	GError *error = NULL;
+	guint n_threads;
+	guint i;
+
+	g_return_if_fail (jobs != NULL);
+	g_return_if_fail (func != NULL);
+
+	/* Not worth starting threads for a single job */
+	n_threads = MIN ((guint)g_get_num_processors (), jobs->len);
+	if (n_threads > 1) {
+		pool = g_thread_pool_new (func, user_data, n_threads, TRUE, &error);
+		if (pool == NULL) {
+			g_message ("couldn't start worker threads: %s", egg_error_message (error));
+			g_clear_error (&error);
+		}
+	}
+
+	if (pool == NULL) {
+		for (i = 0; i < jobs->len; i++)
+			(func) (jobs->pdata[i], user_data);
+		return;
+	}
+
+	for (i = 0; i < jobs->len; i++)
+		g_thread_pool_push (pool, jobs->pdata[i], NULL);
+
+	/* Waits for all the jobs to complete */
+	g_thread_pool_free (pool, FALSE, TRUE);
+}
@@ -65,4 +65,8 @@ void                  gkm_util_dispose_unref                      (gpointer obje
 
 gchar *               gkm_util_locate_keyrings_directory          (void);
 
+void                  gkm_util_run_in_parallel                    (GPtrArray *jobs,
+                                                                   GFunc func,
+                                                                   gpointer user_data);
+
 #endif /* GKM_UTIL_H_ */
@@ -0,0 +1,110 @@
+/*
+ * gnome-keyring
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gkm-attributes.h"
+#include "gkm-crypto.h"
+#include "gkm-session.h"
+#include "gkm-transaction.h"
+#include "gkm-x25519-key.h"
+#include "gkm-x25519-mechanism.h"
+
+#include "egg/egg-secure-memory.h"
+
+#include <gcrypt.h>
+
+#include <string.h>
+
+EGG_SECURE_DECLARE (x25519_mechanism);
+
+CK_RV
+gkm_x25519_mechanism_derive (GkmSession *session, CK_MECHANISM_PTR mech, GkmObject *base,
+                             CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs, GkmObject **derived)
+{
+	CK_ATTRIBUTE attr;
+	GArray *array;
+	CK_ULONG n_value = 0;
+	guchar *value;
+	GkmTransaction *transaction;
+	CK_KEY_TYPE type;
+	gcry_error_t gcry;
+	guchar check = 0;
+	gsize i;
+
+	g_return_val_if_fail (GKM_IS_X25519_KEY (base), CKR_GENERAL_ERROR);
+
+	if (!mech->pParameter || mech->ulParameterLen != GKM_X25519_KEY_LENGTH)
+		return CKR_MECHANISM_PARAM_INVALID;
+
+	/* What length should we truncate to? */
+	if (!gkm_attributes_find_ulong (attrs, n_attrs, CKA_VALUE_LEN, &n_value)) {
+		if (gkm_attributes_find_ulong (attrs, n_attrs, CKA_KEY_TYPE, &type))
+			n_value = gkm_crypto_secret_key_length (type);
+	}
+
+	/* Default to the full shared secret, and never more */
+	if (n_value == 0)
+		n_value = GKM_X25519_KEY_LENGTH;
+	if (n_value > GKM_X25519_KEY_LENGTH)
+		return CKR_TEMPLATE_INCONSISTENT;
+
+	value = egg_secure_alloc (GKM_X25519_KEY_LENGTH);
+	gcry = gcry_ecc_mul_point (GCRY_ECC_CURVE25519, value,
+	                           gkm_x25519_key_get_value (GKM_X25519_KEY (base)),
+	                           mech->pParameter);
+	if (gcry != 0) {
+		g_message ("couldn't calculate x25519 shared secret: %s", gcry_strerror (gcry));
+		egg_secure_free (value);
+		return CKR_FUNCTION_FAILED;
+	}
+
+	/* A peer value of small order gives an all zero secret */
+	for (i = 0; i < GKM_X25519_KEY_LENGTH; i++)
+		check |= value[i];
+	if (check == 0) {
+		egg_secure_free (value);
+		return CKR_MECHANISM_PARAM_INVALID;
+	}
+
+	/* Now setup the attributes with our new value */
+	array = g_array_new (FALSE, FALSE, sizeof (CK_ATTRIBUTE));
+
+	/* Prepend the value, truncated from the front like DH */
+	attr.type = CKA_VALUE;
+	attr.ulValueLen = n_value;
+	attr.pValue = value + (GKM_X25519_KEY_LENGTH - n_value);
+	g_array_append_val (array, attr);
+
+	/* Add the remainder of the attributes */
+	g_array_append_vals (array, attrs, n_attrs);
+
+	transaction = gkm_transaction_new ();
+
+	/* Now create an object with these attributes */
+	*derived = gkm_session_create_object_for_attributes (session, transaction,
+	                                                     (CK_ATTRIBUTE_PTR)array->data, array->len);
+
+	egg_secure_clear (value, GKM_X25519_KEY_LENGTH);
+	egg_secure_free (value);
+	g_array_free (array, TRUE);
+
+	return gkm_transaction_complete_and_unref (transaction);
+}
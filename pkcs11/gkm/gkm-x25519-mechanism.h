@@ -0,0 +1,45 @@
+/*
+ * gnome-keyring
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GKM_X25519_MECHANISM_H_
+#define GKM_X25519_MECHANISM_H_
+
+#include "gkm-types.h"
+
+#include "pkcs11/pkcs11.h"
+#include "pkcs11/pkcs11i.h"
+
+#include <glib.h>
+
+/* Length of X25519 private keys, public keys and shared secrets */
+#define GKM_X25519_KEY_LENGTH 32
+
+static const CK_MECHANISM_TYPE GKM_X25519_MECHANISMS[] = {
+	CKM_G_X25519_DERIVE
+};
+
+CK_RV                    gkm_x25519_mechanism_derive                   (GkmSession *session,
+                                                                        CK_MECHANISM_PTR mech,
+                                                                        GkmObject *base,
+                                                                        CK_ATTRIBUTE_PTR attrs,
+                                                                        CK_ULONG n_attrs,
+                                                                        GkmObject **derived);
+
+#endif /* GKM_X25519_MECHANISM_H_ */
@@ -187,6 +187,111 @@ test_hash (Test* test,
 	g_free (hash);
 }
 
+static void
+test_hash_md5 (Test* test,
+               gconstpointer unused)
+{
+	gpointer hash;
+	gsize n_hash;
+
+	hash = gkm_certificate_hash (test->certificate, GCRY_MD_MD5, &n_hash);
+
+	egg_assert_cmpmem (hash, n_hash, ==, "\x3A\xB2\xDE\x22\x9A\x20\x93\x49\xF9\xED\xC8\xD2\x8A\xE7\x68\x0D", 16);
+	g_free (hash);
+}
+
+static GkmCertificate *
+create_certificate_from_file (GkmSession *session,
+                              const gchar *filename)
+{
+	GkmCertificate *certificate;
+	GBytes *bytes;
+	gchar *data;
+	gsize length;
+
+	if (!g_file_get_contents (filename, &data, &length, NULL))
+		g_assert_not_reached ();
+
+	bytes = g_bytes_new_take (data, length);
+	certificate = create_certificate_object (session, bytes);
+	g_bytes_unref (bytes);
+
+	return certificate;
+}
+
+static void
+test_extension (Test* test,
+                gconstpointer unused)
+{
+	GBytes *extension;
+	gboolean critical;
+
+	extension = gkm_certificate_get_extension (test->certificate,
+	                                           g_quark_from_static_string ("2.5.29.19"),
+	                                           &critical);
+	g_assert (extension != NULL);
+	g_assert (critical == TRUE);
+	egg_assert_cmpbytes (extension, ==, "\x30\x03\x01\x01\xFF", 5);
+	g_bytes_unref (extension);
+
+	extension = gkm_certificate_get_extension (test->certificate,
+	                                           g_quark_from_static_string ("2.5.29.15"),
+	                                           &critical);
+	g_assert (extension == NULL);
+}
+
+static void
+test_category (Test* test,
+               gconstpointer unused)
+{
+	GkmCertificate *other;
+	CK_ULONG category;
+
+	if (!gkm_object_get_attribute_ulong (GKM_OBJECT (test->certificate), test->session,
+	                                     CKA_CERTIFICATE_CATEGORY, &category))
+		g_assert_not_reached ();
+	g_assert_cmpuint (category, ==, 2); /* authority */
+
+	other = create_certificate_from_file (test->session, SRCDIR "/pkcs11/gkm/fixtures/test-certificate-2.der");
+	if (!gkm_object_get_attribute_ulong (GKM_OBJECT (other), test->session,
+	                                     CKA_CERTIFICATE_CATEGORY, &category))
+		g_assert_not_reached ();
+	g_assert_cmpuint (category, ==, 3); /* other entity */
+	g_object_unref (other);
+}
+
+static void
+test_attributes_perf (Test* test,
+                      gconstpointer unused)
+{
+	const guint count = 100000;
+	CK_ULONG category;
+	GTimer *timer;
+	gdouble elapsed;
+	gpointer data;
+	gsize n_data;
+	guint i;
+
+	if (!g_test_perf ())
+		return;
+
+	/* Like trust lookups reading the same certificate over and over */
+	timer = g_timer_new ();
+	for (i = 0; i < count; i++) {
+		if (!gkm_object_get_attribute_ulong (GKM_OBJECT (test->certificate), test->session,
+		                                     CKA_CERTIFICATE_CATEGORY, &category))
+			g_assert_not_reached ();
+		data = gkm_object_get_attribute_data (GKM_OBJECT (test->certificate),
+		                                      test->session, CKA_CHECK_VALUE, &n_data);
+		g_free (data);
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_test_minimized_result (elapsed, "read %u category and check value pairs in %.3f seconds, %.2f us each",
+	                         count, elapsed, (elapsed * 1000000.0) / count);
+	g_timer_destroy (timer);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -201,6 +306,10 @@ main (int argc, char **argv)
 	g_test_add ("/gkm/certificate/serial-number", Test, NULL, setup, test_attribute_serial_number, teardown);
 	g_test_add ("/gkm/certificate/value", Test, NULL, setup, test_attribute_value, teardown);
 	g_test_add ("/gkm/certificate/hash", Test, NULL, setup, test_hash, teardown);
+	g_test_add ("/gkm/certificate/hash-md5", Test, NULL, setup, test_hash_md5, teardown);
+	g_test_add ("/gkm/certificate/extension", Test, NULL, setup, test_extension, teardown);
+	g_test_add ("/gkm/certificate/category", Test, NULL, setup, test_category, teardown);
+	g_test_add ("/gkm/certificate/attributes-perf", Test, NULL, setup, test_attributes_perf, teardown);
 
 	return egg_tests_run_in_thread_with_loop ();
 }
@@ -304,6 +304,40 @@ test_read_certificate (Test *test, gconstpointer unused)
 	egg_asn1x_destroy (asn);
 }
 
+static void
+test_read_certificate_bad_name (Test *test, gconstpointer unused)
+{
+	GNode *asn = NULL;
+	GkmDataResult res;
+	GBytes *name;
+	GBytes *data;
+	const guchar *raw;
+	guchar *copy;
+	guchar *at;
+	gsize n_raw;
+
+	name = egg_asn1x_get_element_raw (egg_asn1x_node (test->certificate, "tbsCertificate", "issuer", NULL));
+	g_assert (name != NULL);
+	raw = g_bytes_get_data (name, &n_raw);
+
+	copy = g_memdup (test->certificate_data, test->n_certificate_data);
+	at = memmem (copy, test->n_certificate_data, raw, n_raw);
+	g_assert (at != NULL);
+
+	/* Replace the tag of the first RDN, the lengths all stay the same */
+	at += (at[1] & 0x80) ? 2 + (at[1] & 0x7F) : 2;
+	g_assert (*at == 0x31);
+	*at = 0x04;
+
+	data = g_bytes_new_take (copy, test->n_certificate_data);
+	res = gkm_data_der_read_certificate (data, &asn);
+	g_assert (res == GKM_DATA_UNRECOGNIZED);
+	g_assert (asn == NULL);
+
+	g_bytes_unref (data);
+	g_bytes_unref (name);
+}
+
 static void
 test_write_certificate (Test *test, gconstpointer unused)
 {
@@ -612,6 +646,7 @@ main (int argc, char **argv)
 	g_test_add ("/gkm/data-der/der_dsa_private_parts", Test, NULL, setup, test_der_dsa_private_parts, teardown);
 	g_test_add ("/gkm/data-der/read_public_key_info", Test, NULL, setup, test_read_public_key_info, teardown);
 	g_test_add ("/gkm/data-der/read_certificate", Test, NULL, setup, test_read_certificate, teardown);
+	g_test_add ("/gkm/data-der/read_certificate_bad_name", Test, NULL, setup, test_read_certificate_bad_name, teardown);
 	g_test_add ("/gkm/data-der/write_certificate", Test, NULL, setup, test_write_certificate, teardown);
 	g_test_add ("/gkm/data-der/read_ca_certificates_public_key_info", Test, NULL, setup, test_read_ca_certificates_public_key_info, teardown);
 	g_test_add ("/gkm/data-der/read_basic_constraints", Test, NULL, setup, test_read_basic_constraints, teardown);
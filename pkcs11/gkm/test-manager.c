@@ -0,0 +1,277 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* test-manager.c: Test GkmManager
+
+   Copyright (C) 2026 agent <agent@local>
+
+   The Gnome Keyring Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Keyring Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include "mock-module.h"
+
+#include "gkm/gkm-attributes.h"
+#include "gkm/gkm-manager.h"
+#include "gkm/gkm-object.h"
+#include "gkm/gkm-session.h"
+
+#include "egg/egg-testing.h"
+
+#include <string.h>
+
+#define N_DATA_OBJECTS 8
+
+/*
+ * An object which notes when its label is read. The label isn't indexed,
+ * so reading it means the object was examined as a candidate during a find.
+ */
+
+typedef struct {
+	GkmObject parent;
+	CK_OBJECT_CLASS klass;
+	gchar *id;
+	gboolean examined;
+} CountedObject;
+
+typedef struct {
+	GkmObjectClass parent_class;
+} CountedObjectClass;
+
+static GType counted_object_get_type (void);
+
+G_DEFINE_TYPE (CountedObject, counted_object, GKM_TYPE_OBJECT);
+
+static CK_RV
+counted_object_get_attribute (GkmObject *base, GkmSession *session, CK_ATTRIBUTE *attr)
+{
+	CountedObject *self = (CountedObject *)base;
+
+	switch (attr->type) {
+	case CKA_CLASS:
+		return gkm_attribute_set_ulong (attr, self->klass);
+	case CKA_ID:
+		return gkm_attribute_set_string (attr, self->id);
+	case CKA_LABEL:
+		self->examined = TRUE;
+		return gkm_attribute_set_string (attr, "counted");
+	};
+
+	return GKM_OBJECT_CLASS (counted_object_parent_class)->get_attribute (base, session, attr);
+}
+
+static void
+counted_object_init (CountedObject *self)
+{
+
+}
+
+static void
+counted_object_finalize (GObject *obj)
+{
+	CountedObject *self = (CountedObject *)obj;
+	g_free (self->id);
+	G_OBJECT_CLASS (counted_object_parent_class)->finalize (obj);
+}
+
+static void
+counted_object_class_init (CountedObjectClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	GkmObjectClass *gkm_class = GKM_OBJECT_CLASS (klass);
+	gobject_class->finalize = counted_object_finalize;
+	gkm_class->get_attribute = counted_object_get_attribute;
+}
+
+typedef struct {
+	GkmModule *module;
+	GkmSession *session;
+	GkmManager *manager;
+	GkmObject *object;
+	gchar *label;
+	gsize n_label;
+	GPtrArray *counted;
+} Test;
+
+static void
+add_counted_object (Test *test, CK_OBJECT_CLASS klass)
+{
+	CountedObject *object;
+
+	object = g_object_new (counted_object_get_type (),
+	                       "module", test->module,
+	                       "manager", test->manager,
+	                       NULL);
+	object->klass = klass;
+	object->id = g_strdup_printf ("%u", test->counted->len);
+
+	gkm_object_expose (GKM_OBJECT (object), TRUE);
+	g_ptr_array_add (test->counted, object);
+}
+
+static guint
+count_examined (Test *test)
+{
+	CountedObject *object;
+	guint n_examined = 0;
+	guint i;
+
+	for (i = 0; i < test->counted->len; i++) {
+		object = test->counted->pdata[i];
+		if (object->examined)
+			n_examined++;
+		object->examined = FALSE;
+	}
+
+	return n_examined;
+}
+
+static void
+setup (Test* test, gconstpointer unused)
+{
+	guint i;
+
+	test->module = mock_module_initialize_and_enter ();
+	test->session = mock_module_open_session (TRUE);
+	test->manager = gkm_session_get_manager (test->session);
+
+	test->object = mock_module_object_new (test->session);
+	g_assert (GKM_IS_OBJECT (test->object));
+
+	test->label = gkm_object_get_attribute_data (test->object, test->session,
+	                                             CKA_LABEL, &test->n_label);
+	g_assert (test->label != NULL);
+
+	/* Several data objects, and one secret key, all with the same label */
+	test->counted = g_ptr_array_new ();
+	for (i = 0; i < N_DATA_OBJECTS; i++)
+		add_counted_object (test, CKO_DATA);
+	add_counted_object (test, CKO_SECRET_KEY);
+	count_examined (test);
+}
+
+static void
+teardown (Test* test, gconstpointer unused)
+{
+	GkmObject *object;
+	guint i;
+
+	for (i = 0; i < test->counted->len; i++) {
+		object = test->counted->pdata[i];
+		gkm_object_expose (object, FALSE);
+		g_object_unref (object);
+	}
+	g_ptr_array_free (test->counted, TRUE);
+
+	g_free (test->label);
+	mock_module_leave_and_finalize ();
+}
+
+static GList*
+find_counted (Test *test, CK_ATTRIBUTE_PTR attrs, CK_ULONG n_attrs)
+{
+	return gkm_manager_find_by_attributes (test->manager, test->session, attrs, n_attrs);
+}
+
+static void
+test_find_indexed_not_first (Test* test, gconstpointer unused)
+{
+	CK_OBJECT_CLASS klass = CKO_SECRET_KEY;
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_LABEL, "counted", 7 },
+		{ CKA_CLASS, &klass, sizeof (klass) },
+	};
+	GList *objects;
+
+	objects = find_counted (test, attrs, G_N_ELEMENTS (attrs));
+	g_assert (objects != NULL);
+	g_assert (objects->data == test->counted->pdata[N_DATA_OBJECTS]);
+	g_assert (objects->next == NULL);
+	g_list_free (objects);
+
+	/* CKA_CLASS is indexed even though it's not first, only the key is examined */
+	g_assert_cmpuint (count_examined (test), ==, 1);
+}
+
+static void
+test_find_most_selective (Test* test, gconstpointer unused)
+{
+	CK_OBJECT_CLASS klass = CKO_DATA;
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+		{ CKA_ID, "3", 1 },
+		{ CKA_LABEL, "counted", 7 },
+	};
+	GList *objects;
+
+	objects = find_counted (test, attrs, G_N_ELEMENTS (attrs));
+	g_assert (objects != NULL);
+	g_assert (objects->data == test->counted->pdata[3]);
+	g_assert (objects->next == NULL);
+	g_list_free (objects);
+
+	/* CKA_ID has fewer candidates than CKA_CLASS */
+	g_assert_cmpuint (count_examined (test), ==, 1);
+}
+
+static void
+test_find_indexed_no_match (Test* test, gconstpointer unused)
+{
+	CK_OBJECT_CLASS klass = CKO_PUBLIC_KEY;
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_LABEL, "counted", 7 },
+		{ CKA_CLASS, &klass, sizeof (klass) },
+	};
+	GList *objects;
+
+	objects = find_counted (test, attrs, G_N_ELEMENTS (attrs));
+	g_assert (objects == NULL);
+
+	/* Nothing has that class, so nothing is examined */
+	g_assert_cmpuint (count_examined (test), ==, 0);
+}
+
+static void
+test_find_scanned (Test* test, gconstpointer unused)
+{
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_LABEL, test->label, test->n_label },
+	};
+	GList *objects;
+
+	objects = find_counted (test, attrs, G_N_ELEMENTS (attrs));
+	g_assert (objects != NULL);
+	g_assert (objects->data == test->object);
+	g_assert (objects->next == NULL);
+	g_list_free (objects);
+
+	/* No indexed attributes at all, so every object is examined */
+	g_assert_cmpuint (count_examined (test), ==, N_DATA_OBJECTS + 1);
+}
+
+int
+main (int argc, char **argv)
+{
+#if !GLIB_CHECK_VERSION(2,35,0)
+	g_type_init ();
+#endif
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add ("/gkm/manager/find_indexed_not_first", Test, NULL, setup, test_find_indexed_not_first, teardown);
+	g_test_add ("/gkm/manager/find_most_selective", Test, NULL, setup, test_find_most_selective, teardown);
+	g_test_add ("/gkm/manager/find_indexed_no_match", Test, NULL, setup, test_find_indexed_no_match, teardown);
+	g_test_add ("/gkm/manager/find_scanned", Test, NULL, setup, test_find_scanned, teardown);
+
+	return g_test_run ();
+}
@@ -28,7 +28,10 @@
 
 #include "gkm/gkm-secret.h"
 
+#include "egg/egg-libgcrypt.h"
 #include "egg/egg-secure-memory.h"
+#include "egg/egg-symkey.h"
+#include "egg/egg-testing.h"
 
 EGG_SECURE_DEFINE_GLIB_GLOBALS ();
 
@@ -190,6 +193,55 @@ test_equal (void)
 	g_object_unref (two);
 }
 
+static void
+test_derive_simple (void)
+{
+	const guchar salt[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	guchar check_salt[8];
+	GkmSecret *secret;
+	guchar *key, *iv;
+	guchar *check_key, *check_iv;
+	int iterations;
+	gboolean ret;
+	gint i;
+
+	secret = gkm_secret_new_from_password ("booo");
+
+	ret = gkm_secret_lookup_derived (secret, GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+	                                 check_salt, sizeof (check_salt), &iterations);
+	g_assert (ret == FALSE);
+
+	ret = egg_symkey_generate_simple (GCRY_CIPHER_AES128, GCRY_MD_SHA256, "booo", 4,
+	                                  salt, sizeof (salt), 1000, &check_key, &check_iv);
+	g_assert (ret == TRUE);
+
+	/* The second time around comes from the cache */
+	for (i = 0; i < 2; i++) {
+		ret = gkm_secret_derive_simple (secret, GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+		                                salt, sizeof (salt), 1000, &key, &iv);
+		g_assert (ret == TRUE);
+		egg_assert_cmpmem (key, 16, ==, check_key, 16);
+		egg_assert_cmpmem (iv, 16, ==, check_iv, 16);
+		egg_secure_free (key);
+		g_free (iv);
+	}
+
+	ret = gkm_secret_lookup_derived (secret, GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+	                                 check_salt, sizeof (check_salt), &iterations);
+	g_assert (ret == TRUE);
+	egg_assert_cmpmem (check_salt, 8, ==, salt, 8);
+	g_assert_cmpint (iterations, ==, 1000);
+
+	/* Different algorithms aren't mixed up */
+	ret = gkm_secret_lookup_derived (secret, GCRY_CIPHER_3DES, GCRY_MD_SHA256,
+	                                 check_salt, sizeof (check_salt), &iterations);
+	g_assert (ret == FALSE);
+
+	egg_secure_free (check_key);
+	g_free (check_iv);
+	g_object_unref (secret);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -197,6 +249,7 @@ main (int argc, char **argv)
 	g_type_init ();
 #endif
 	g_test_init (&argc, &argv, NULL);
+	egg_libgcrypt_initialize ();
 
 	g_test_add_func ("/gkm/secret/secret", test_secret);
 	g_test_add_func ("/gkm/secret/secret_from_login", test_secret_from_login);
@@ -205,6 +258,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/gkm/secret/null", test_null);
 	g_test_add_func ("/gkm/secret/empty", test_empty);
 	g_test_add_func ("/gkm/secret/equal", test_equal);
+	g_test_add_func ("/gkm/secret/derive_simple", test_derive_simple);
 
 	return g_test_run ();
 }
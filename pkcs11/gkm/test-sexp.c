@@ -29,6 +29,8 @@
 #include "gkm/gkm-crypto.h"
 #include "gkm/gkm-sexp.h"
 
+#include "pkcs11/pkcs11i.h"
+
 #include "egg/egg-secure-memory.h"
 
 #include <gcrypt.h>
@@ -56,8 +58,27 @@ EGG_SECURE_DEFINE_GLIB_GLOBALS ();
 typedef struct {
 	gcry_sexp_t rsakey;
 	gcry_sexp_t dsakey;
+	gcry_sexp_t ecdsakey;
+	gcry_sexp_t eddsakey;
 } Test;
 
+static gcry_sexp_t
+generate_private_key (const gchar *params)
+{
+	gcry_sexp_t sparams, skey, spriv;
+	gcry_error_t gcry;
+
+	gcry = gcry_sexp_new (&sparams, params, strlen (params), 1);
+	g_return_val_if_fail (gcry == 0, NULL);
+	gcry = gcry_pk_genkey (&skey, sparams);
+	gcry_sexp_release (sparams);
+	g_return_val_if_fail (gcry == 0, NULL);
+
+	spriv = gcry_sexp_find_token (skey, "private-key", 0);
+	gcry_sexp_release (skey);
+	return spriv;
+}
+
 static void
 setup (Test *test, gconstpointer unused)
 {
@@ -69,6 +90,11 @@ setup (Test *test, gconstpointer unused)
 	g_return_if_fail (gcry == 0);
 	gcry = gcry_sexp_new (&test->dsakey, TEST_DSA, strlen (TEST_DSA), 1);
 	g_return_if_fail (gcry == 0);
+
+	test->ecdsakey = generate_private_key ("(genkey (ecc (curve \"NIST P-256\")))");
+	g_return_if_fail (test->ecdsakey);
+	test->eddsakey = generate_private_key ("(genkey (ecc (curve Ed25519) (flags eddsa)))");
+	g_return_if_fail (test->eddsakey);
 }
 
 static void
@@ -78,6 +104,10 @@ teardown (Test *test, gconstpointer unused)
 	test->rsakey = NULL;
 	gcry_sexp_release (test->dsakey);
 	test->dsakey = NULL;
+	gcry_sexp_release (test->ecdsakey);
+	test->ecdsakey = NULL;
+	gcry_sexp_release (test->eddsakey);
+	test->eddsakey = NULL;
 }
 
 static void
@@ -140,6 +170,169 @@ test_key_to_public (Test *test, gconstpointer unused)
 
 	gcry_sexp_release (pubkey);
 
+
+	/* ECDSA */
+	ret = gkm_sexp_key_to_public (test->ecdsakey, &pubkey);
+	g_assert (ret);
+	g_assert (pubkey != NULL);
+
+	p = gcry_pk_get_keygrip (test->ecdsakey, id1);
+	g_return_if_fail (p == id1);
+	p = gcry_pk_get_keygrip (pubkey, id2);
+	g_return_if_fail (p == id2);
+
+	g_assert (memcmp (id1, id2, sizeof (id1)) == 0);
+
+	gcry_sexp_release (pubkey);
+
+
+	/* Ed25519 */
+	ret = gkm_sexp_key_to_public (test->eddsakey, &pubkey);
+	g_assert (ret);
+	g_assert (pubkey != NULL);
+
+	p = gcry_pk_get_keygrip (test->eddsakey, id1);
+	g_return_if_fail (p == id1);
+	p = gcry_pk_get_keygrip (pubkey, id2);
+	g_return_if_fail (p == id2);
+
+	g_assert (memcmp (id1, id2, sizeof (id1)) == 0);
+
+	gcry_sexp_release (pubkey);
+}
+
+static void
+test_ec_params (Test *test, gconstpointer unused)
+{
+	gconstpointer params;
+	gsize n_params;
+
+	g_assert (gkm_sexp_ec_params_for_curve (GKM_SEXP_CURVE_P384, &params, &n_params));
+	g_assert_cmpstr (gkm_sexp_curve_for_ec_params (params, n_params), ==, GKM_SEXP_CURVE_P384);
+
+	g_assert (gkm_sexp_ec_params_for_curve (GKM_SEXP_CURVE_ED25519, &params, &n_params));
+	g_assert_cmpuint (n_params, ==, 5);
+	g_assert_cmpstr (gkm_sexp_curve_for_ec_params (params, n_params), ==, GKM_SEXP_CURVE_ED25519);
+
+	g_assert (!gkm_sexp_ec_params_for_curve ("secp256k1", &params, &n_params));
+	g_assert (gkm_sexp_curve_for_ec_params ("\x06\x01\x00", 3) == NULL);
+}
+
+static void
+test_curves (Test *test, gconstpointer unused)
+{
+	const GkmSexpCurve *curves;
+	guint n_curves, i;
+	gchar *keytype;
+
+	curves = gkm_sexp_get_curves (&n_curves);
+	g_assert_cmpuint (n_curves, ==, 4);
+
+	for (i = 0; i < n_curves; i++) {
+		g_assert_cmpstr (gkm_sexp_curve_for_ec_params (curves[i].params, curves[i].n_params), ==, curves[i].curve);
+
+		/* The SSH names of a curve go together */
+		if (curves[i].ssh_keytype) {
+			keytype = g_strconcat ("ecdsa-sha2-", curves[i].ssh_identifier, NULL);
+			g_assert_cmpstr (curves[i].ssh_keytype, ==, keytype);
+			g_assert (curves[i].ssh_hash_algo != 0);
+			g_free (keytype);
+		} else {
+			g_assert_cmpstr (curves[i].curve, ==, GKM_SEXP_CURVE_ED25519);
+		}
+	}
+}
+
+static void
+check_sign_verify (gcry_sexp_t privkey, CK_MECHANISM_TYPE mech,
+                   CK_BYTE_PTR data, CK_ULONG n_data, CK_ULONG n_expected)
+{
+	gcry_sexp_t pubkey;
+	guchar signature[256];
+	CK_ULONG n_signature;
+	CK_RV rv;
+
+	if (!gkm_sexp_key_to_public (privkey, &pubkey))
+		g_assert_not_reached ();
+
+	n_signature = sizeof (signature);
+	rv = gkm_crypto_sign_xsa (privkey, mech, data, n_data, signature, &n_signature);
+	g_assert_cmpuint (rv, ==, CKR_OK);
+	g_assert_cmpuint (n_signature, ==, n_expected);
+
+	rv = gkm_crypto_verify_xsa (pubkey, mech, data, n_data, signature, n_signature);
+	g_assert_cmpuint (rv, ==, CKR_OK);
+
+	signature[4] ^= 0x01;
+	rv = gkm_crypto_verify_xsa (pubkey, mech, data, n_data, signature, n_signature);
+	g_assert_cmpuint (rv, ==, CKR_SIGNATURE_INVALID);
+
+	gcry_sexp_release (pubkey);
+}
+
+static void
+test_sign_ecdsa (Test *test, gconstpointer unused)
+{
+	guchar hash[32];
+
+	memset (hash, 0xAA, sizeof (hash));
+	hash[0] = 0x00;
+	check_sign_verify (test->ecdsakey, CKM_ECDSA, hash, sizeof (hash), 64);
+}
+
+static void
+test_sign_eddsa (Test *test, gconstpointer unused)
+{
+	const gchar *message = "The quick brown fox jumps over the lazy dog";
+
+	check_sign_verify (test->eddsakey, CKM_EDDSA, (CK_BYTE_PTR)message,
+	                   strlen (message), 64);
+}
+
+static gdouble
+time_signatures (gcry_sexp_t privkey, CK_MECHANISM_TYPE mech,
+                 CK_BYTE_PTR data, CK_ULONG n_data, guint count)
+{
+	guchar signature[1024];
+	CK_ULONG n_signature;
+	CK_RV rv;
+	guint i;
+
+	g_test_timer_start ();
+	for (i = 0; i < count; i++) {
+		n_signature = sizeof (signature);
+		rv = gkm_crypto_sign_xsa (privkey, mech, data, n_data, signature, &n_signature);
+		g_assert_cmpuint (rv, ==, CKR_OK);
+	}
+
+	return g_test_timer_elapsed () / count;
+}
+
+static void
+test_sign_perf (Test *test, gconstpointer unused)
+{
+	gcry_sexp_t rsakey;
+	guchar data[32];
+	gdouble elapsed;
+
+	if (!g_test_perf ())
+		return;
+
+	memset (data, 0x55, sizeof (data));
+
+	/* RSA keys the size that ssh-keygen makes by default */
+	rsakey = generate_private_key ("(genkey (rsa (nbits 4:3072)))");
+	g_assert (rsakey != NULL);
+
+	elapsed = time_signatures (rsakey, CKM_RSA_PKCS, data, sizeof (data), 50);
+	g_test_minimized_result (elapsed, "RSA-3072 sign: %.3f msec", elapsed * 1000);
+	gcry_sexp_release (rsakey);
+
+	elapsed = time_signatures (test->ecdsakey, CKM_ECDSA, data, sizeof (data), 200);
+	g_test_minimized_result (elapsed, "ECDSA P-256 sign: %.3f msec", elapsed * 1000);
+
+	elapsed = time_signatures (test->eddsakey, CKM_EDDSA, data, sizeof (data), 200);
+	g_test_minimized_result (elapsed, "Ed25519 sign: %.3f msec", elapsed * 1000);
 }
 
 int
@@ -152,6 +345,11 @@ main (int argc, char **argv)
 
 	g_test_add ("/gkm/sexp/parse_key", Test, NULL, setup, test_parse_key, teardown);
 	g_test_add ("/gkm/sexp/key_to_public", Test, NULL, setup, test_key_to_public, teardown);
+	g_test_add ("/gkm/sexp/ec_params", Test, NULL, setup, test_ec_params, teardown);
+	g_test_add ("/gkm/sexp/curves", Test, NULL, setup, test_curves, teardown);
+	g_test_add ("/gkm/sexp/sign_ecdsa", Test, NULL, setup, test_sign_ecdsa, teardown);
+	g_test_add ("/gkm/sexp/sign_eddsa", Test, NULL, setup, test_sign_eddsa, teardown);
+	g_test_add ("/gkm/sexp/sign_perf", Test, NULL, setup, test_sign_perf, teardown);
 
 	return g_test_run ();
 }
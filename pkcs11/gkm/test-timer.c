@@ -148,6 +148,72 @@ test_multiple (Test* test, gconstpointer unused)
 	g_assert (timer_check == 4);
 }
 
+static gint batch_count = 0;
+
+static void
+batch_callback (GkmTimer *timer, gpointer user_data)
+{
+	GkmTimer **value = user_data;
+	g_assert (timer == *value);
+	*value = NULL;
+	batch_count++;
+}
+
+static void
+test_batch (Test* test, gconstpointer unused)
+{
+	GkmTimer *timers[1000];
+	guint i;
+
+	batch_count = 0;
+
+	/* Lots of timers due at the same time, cancel half of them */
+	for (i = 0; i < G_N_ELEMENTS (timers); i++)
+		timers[i] = gkm_timer_start (test->module, 1, batch_callback, &timers[i]);
+	for (i = 0; i < G_N_ELEMENTS (timers); i += 2)
+		gkm_timer_cancel (timers[i]);
+
+	mock_module_leave ();
+	egg_test_wait_until (2200);
+	mock_module_enter ();
+
+	g_assert_cmpint (batch_count, ==, G_N_ELEMENTS (timers) / 2);
+	for (i = 0; i < G_N_ELEMENTS (timers); i++) {
+		if (i % 2 == 0)
+			g_assert (timers[i] != NULL);
+		else
+			g_assert (timers[i] == NULL);
+	}
+}
+
+static void
+test_start_cancel_perf (Test* test, gconstpointer unused)
+{
+	GkmTimer **timers;
+	GTimer *watch;
+	guint count = 100000;
+	guint i;
+
+	if (!g_test_perf ())
+		return;
+
+	timers = g_new0 (GkmTimer *, count);
+	watch = g_timer_new ();
+
+	/* Spread out like idle timers on many objects */
+	for (i = 0; i < count; i++)
+		timers[i] = gkm_timer_start (test->module, 600 + (i * 7919) % 3600, timer_callback, NULL);
+	for (i = 0; i < count; i++)
+		gkm_timer_cancel (timers[(i * 7919) % count]);
+
+	g_test_minimized_result (g_timer_elapsed (watch, NULL),
+	                         "started and cancelled %u timers in %.3f seconds",
+	                         count, g_timer_elapsed (watch, NULL));
+
+	g_timer_destroy (watch);
+	g_free (timers);
+}
+
 static void
 test_outstanding (Test* test, gconstpointer unused)
 {
@@ -170,6 +236,8 @@ main (int argc, char **argv)
 	g_test_add ("/gkm/timer/cancel", Test, NULL, setup, test_cancel, teardown);
 	g_test_add ("/gkm/timer/immediate", Test, NULL, setup, test_immediate, teardown);
 	g_test_add ("/gkm/timer/multiple", Test, NULL, setup, test_multiple, teardown);
+	g_test_add ("/gkm/timer/batch", Test, NULL, setup, test_batch, teardown);
+	g_test_add ("/gkm/timer/start_cancel_perf", Test, NULL, setup, test_start_cancel_perf, teardown);
 	g_test_add ("/gkm/timer/outstanding", Test, NULL, setup, test_outstanding, teardown);
 
 	return egg_tests_run_in_thread_with_loop ();
@@ -0,0 +1,214 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* test-x25519-mechanism.c: Test X25519 key derivation
+
+   Copyright (C) 2026 agent <agent@local>
+
+   The Gnome Keyring Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Keyring Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   <http://www.gnu.org/licenses/>.
+
+   Author: agent <agent@local>
+*/
+
+#include "config.h"
+
+#include "mock-module.h"
+
+#include "egg/egg-libgcrypt.h"
+#include "egg/egg-testing.h"
+
+#include "gkm/gkm-module.h"
+#include "gkm/gkm-session.h"
+#include "gkm/gkm-test.h"
+#include "gkm/gkm-x25519-mechanism.h"
+
+#include "pkcs11i.h"
+
+#include <string.h>
+
+/* The test vectors from RFC 7748 section 6.1 */
+
+static const guchar ALICE_PRIVATE[] = {
+	0x77, 0x07, 0x6d, 0x0a, 0x73, 0x18, 0xa5, 0x7d, 0x3c, 0x16, 0xc1, 0x72, 0x51, 0xb2, 0x66, 0x45,
+	0xdf, 0x4c, 0x2f, 0x87, 0xeb, 0xc0, 0x99, 0x2a, 0xb1, 0x77, 0xfb, 0xa5, 0x1d, 0xb9, 0x2c, 0x2a,
+};
+
+static const guchar ALICE_PUBLIC[] = {
+	0x85, 0x20, 0xf0, 0x09, 0x89, 0x30, 0xa7, 0x54, 0x74, 0x8b, 0x7d, 0xdc, 0xb4, 0x3e, 0xf7, 0x5a,
+	0x0d, 0xbf, 0x3a, 0x0d, 0x26, 0x38, 0x1a, 0xf4, 0xeb, 0xa4, 0xa9, 0x8e, 0xaa, 0x9b, 0x4e, 0x6a,
+};
+
+static const guchar BOB_PRIVATE[] = {
+	0x5d, 0xab, 0x08, 0x7e, 0x62, 0x4a, 0x8a, 0x4b, 0x79, 0xe1, 0x7f, 0x8b, 0x83, 0x80, 0x0e, 0xe6,
+	0x6f, 0x3b, 0xb1, 0x29, 0x26, 0x18, 0xb6, 0xfd, 0x1c, 0x2f, 0x8b, 0x27, 0xff, 0x88, 0xe0, 0xeb,
+};
+
+static const guchar BOB_PUBLIC[] = {
+	0xde, 0x9e, 0xdb, 0x7d, 0x7b, 0x7d, 0xc1, 0xb4, 0xd3, 0x5b, 0x61, 0xc2, 0xec, 0xe4, 0x35, 0x37,
+	0x3f, 0x83, 0x43, 0xc8, 0x5b, 0x78, 0x67, 0x4d, 0xad, 0xfc, 0x7e, 0x14, 0x6f, 0x88, 0x2b, 0x4f,
+};
+
+static const guchar SHARED_SECRET[] = {
+	0x4a, 0x5d, 0x9d, 0x5b, 0xa4, 0xce, 0x2d, 0xe1, 0x72, 0x8e, 0x3b, 0xf4, 0x80, 0x35, 0x0f, 0x25,
+	0xe0, 0x7e, 0x21, 0xc9, 0x47, 0xd1, 0x9e, 0x33, 0x76, 0xf0, 0x9b, 0x3c, 0x1e, 0x16, 0x17, 0x42,
+};
+
+typedef struct {
+	GkmModule *module;
+	GkmSession *session;
+} Test;
+
+static void
+setup (Test *test, gconstpointer unused)
+{
+	CK_RV rv;
+
+	test->module = mock_module_initialize_and_enter ();
+	test->session = mock_module_open_session (TRUE);
+
+	rv = gkm_module_C_Login (test->module, gkm_session_get_handle (test->session), CKU_USER, NULL, 0);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+}
+
+static void
+teardown (Test *test, gconstpointer unused)
+{
+	mock_module_leave_and_finalize ();
+}
+
+static CK_OBJECT_HANDLE
+create_private_key (Test *test,
+                    const guchar *value)
+{
+	CK_OBJECT_CLASS klass = CKO_PRIVATE_KEY;
+	CK_KEY_TYPE type = CKK_EC_MONTGOMERY;
+	CK_BBOOL token = CK_FALSE;
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+		{ CKA_KEY_TYPE, &type, sizeof (type) },
+		{ CKA_TOKEN, &token, sizeof (token) },
+		{ CKA_VALUE, (CK_VOID_PTR)value, GKM_X25519_KEY_LENGTH },
+	};
+	CK_OBJECT_HANDLE handle;
+	CK_RV rv;
+
+	rv = gkm_session_C_CreateObject (test->session, attrs, G_N_ELEMENTS (attrs), &handle);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	g_assert (handle != 0);
+
+	return handle;
+}
+
+static CK_RV
+derive_secret (Test *test,
+               const guchar *private,
+               const guchar *peer,
+               gsize n_peer,
+               CK_KEY_TYPE type,
+               guchar *value,
+               CK_ULONG n_value)
+{
+	CK_OBJECT_CLASS klass = CKO_SECRET_KEY;
+	CK_MECHANISM mech = { CKM_G_X25519_DERIVE, (CK_VOID_PTR)peer, n_peer };
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+		{ CKA_KEY_TYPE, &type, sizeof (type) },
+	};
+	CK_ATTRIBUTE attr = { CKA_VALUE, value, n_value };
+	CK_OBJECT_HANDLE base;
+	CK_OBJECT_HANDLE derived;
+	CK_RV rv;
+
+	base = create_private_key (test, private);
+
+	rv = gkm_session_C_DeriveKey (test->session, &mech, base, attrs, G_N_ELEMENTS (attrs), &derived);
+	if (rv == CKR_OK) {
+		rv = gkm_session_C_GetAttributeValue (test->session, derived, &attr, 1);
+		gkm_assert_cmprv (rv, ==, CKR_OK);
+		gkm_assert_cmpulong (attr.ulValueLen, ==, n_value);
+	}
+
+	return rv;
+}
+
+static void
+test_derive_rfc7748 (Test *test, gconstpointer unused)
+{
+	guchar value[GKM_X25519_KEY_LENGTH];
+	CK_RV rv;
+
+	/* Alice and Bob arrive at the same secret */
+	rv = derive_secret (test, ALICE_PRIVATE, BOB_PUBLIC, sizeof (BOB_PUBLIC), CKK_GENERIC_SECRET, value, sizeof (value));
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	egg_assert_cmpmem (value, sizeof (value), ==, SHARED_SECRET, sizeof (SHARED_SECRET));
+
+	rv = derive_secret (test, BOB_PRIVATE, ALICE_PUBLIC, sizeof (ALICE_PUBLIC), CKK_GENERIC_SECRET, value, sizeof (value));
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	egg_assert_cmpmem (value, sizeof (value), ==, SHARED_SECRET, sizeof (SHARED_SECRET));
+}
+
+static void
+test_derive_truncated (Test *test, gconstpointer unused)
+{
+	guchar value[16];
+	CK_RV rv;
+
+	/* An AES key is truncated from the front, like DH */
+	rv = derive_secret (test, ALICE_PRIVATE, BOB_PUBLIC, sizeof (BOB_PUBLIC), CKK_AES, value, sizeof (value));
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	egg_assert_cmpmem (value, sizeof (value), ==, SHARED_SECRET + 16, 16);
+}
+
+static void
+test_derive_small_order (Test *test, gconstpointer unused)
+{
+	guchar peer[GKM_X25519_KEY_LENGTH] = { 0, };
+	guchar value[GKM_X25519_KEY_LENGTH];
+	CK_RV rv;
+
+	/* A peer value of zero gives an all zero secret */
+	rv = derive_secret (test, ALICE_PRIVATE, peer, sizeof (peer), CKK_GENERIC_SECRET, value, sizeof (value));
+	gkm_assert_cmprv (rv, ==, CKR_MECHANISM_PARAM_INVALID);
+
+	/* As does one */
+	peer[0] = 1;
+	rv = derive_secret (test, ALICE_PRIVATE, peer, sizeof (peer), CKK_GENERIC_SECRET, value, sizeof (value));
+	gkm_assert_cmprv (rv, ==, CKR_MECHANISM_PARAM_INVALID);
+}
+
+static void
+test_derive_bad_length (Test *test, gconstpointer unused)
+{
+	guchar value[GKM_X25519_KEY_LENGTH];
+	CK_RV rv;
+
+	rv = derive_secret (test, ALICE_PRIVATE, BOB_PUBLIC, sizeof (BOB_PUBLIC) - 1, CKK_GENERIC_SECRET, value, sizeof (value));
+	gkm_assert_cmprv (rv, ==, CKR_MECHANISM_PARAM_INVALID);
+}
+
+int
+main (int argc, char **argv)
+{
+#if !GLIB_CHECK_VERSION(2,35,0)
+	g_type_init ();
+#endif
+	g_test_init (&argc, &argv, NULL);
+	egg_libgcrypt_initialize ();
+
+	g_test_add ("/gkm/x25519-mechanism/derive_rfc7748", Test, NULL, setup, test_derive_rfc7748, teardown);
+	g_test_add ("/gkm/x25519-mechanism/derive_truncated", Test, NULL, setup, test_derive_truncated, teardown);
+	g_test_add ("/gkm/x25519-mechanism/derive_small_order", Test, NULL, setup, test_derive_small_order, teardown);
+	g_test_add ("/gkm/x25519-mechanism/derive_bad_length", Test, NULL, setup, test_derive_bad_length, teardown);
+
+	return g_test_run ();
+}
@@ -25,6 +25,7 @@
 #include "gkm/gkm-attributes.h"
 #include "gkm/gkm-crypto.h"
 #include "gkm/gkm-data-types.h"
+#include "gkm/gkm-secret.h"
 #include "gkm/gkm-util.h"
 
 #include "gkm-marshal.h"
@@ -32,7 +33,6 @@
 #include "egg/egg-buffer.h"
 #include "egg/egg-hex.h"
 #include "egg/egg-secure-memory.h"
-#include "egg/egg-symkey.h"
 
 #include <glib/gstdio.h>
 
@@ -345,55 +345,33 @@ validate_buffer (EggBuffer *buffer, gsize *offset)
 }
 
 static gboolean
-create_cipher (GkmSecret *login, int calgo, int halgo, const guchar *salt,
-               gsize n_salt, guint iterations, gcry_cipher_hd_t *cipher)
+crypt_buffer (GkmSecret *login, int calgo, int halgo, const guchar *salt,
+              gsize n_salt, guint iterations, gboolean encrypt,
+              guchar *output, const guchar *input, gsize n_data)
 {
-	gsize n_key, n_block;
-	const gchar *password;
-	gsize n_password;
 	guchar *key, *iv;
-	gcry_error_t gcry;
+	gboolean ret;
 
 	g_assert (login);
 	g_assert (salt);
-	g_assert (cipher);
-
-	n_key = gcry_cipher_get_algo_keylen (calgo);
-	g_return_val_if_fail (n_key, FALSE);
-	n_block = gcry_cipher_get_algo_blklen (calgo);
-	g_return_val_if_fail (n_block, FALSE);
-
-	password = gkm_secret_get_password (login, &n_password);
 
-	if (!egg_symkey_generate_simple (calgo, halgo, password, n_password,
-	                                 salt, n_salt, iterations, &key, &iv)) {
+	/* Remembered, so reading back what we wrote doesn't derive again */
+	if (!gkm_secret_derive_simple (login, calgo, halgo, salt, n_salt,
+	                               iterations, &key, &iv)) {
 		return FALSE;
 	}
 
-	gcry = gcry_cipher_open (cipher, calgo, GCRY_CIPHER_MODE_CBC, 0);
-	if (gcry) {
-		g_warning ("couldn't create cipher context: %s", gcry_strerror (gcry));
-		egg_secure_free (key);
-		g_free (iv);
-		return FALSE;
-	}
+	ret = gkm_crypto_cbc_transform (calgo, key, iv, encrypt, output, input, n_data);
 
-	gcry = gcry_cipher_setkey (*cipher, key, n_key);
-	g_return_val_if_fail (!gcry, FALSE);
 	egg_secure_free (key);
-
-	gcry = gcry_cipher_setiv (*cipher, iv, n_block);
-	g_return_val_if_fail (!gcry, FALSE);
 	g_free (iv);
 
-	return TRUE;
+	return ret;
 }
 
 static gboolean
 encrypt_buffer (EggBuffer *input, GkmSecret *login, EggBuffer *output)
 {
-	gcry_cipher_hd_t cipher;
-	gcry_error_t gcry;
 	guchar salt[8];
 	guint32 iterations;
 	int calgo, halgo;
@@ -409,7 +387,11 @@ encrypt_buffer (EggBuffer *input, GkmSecret *login, EggBuffer *output)
 	calgo = GCRY_CIPHER_AES128;
 	halgo = GCRY_MD_SHA256;
 
-	/* Prepare us some salt */
+	/*
+	 * Prepare us some salt. Unlike the secret store keyrings, nothing
+	 * at the start of the data changes between writes, so always use
+	 * a new salt and iv.
+	 */
 	gcry_create_nonce (salt, sizeof (salt));
 
 	/* Prepare us the iterations */
@@ -431,10 +413,6 @@ encrypt_buffer (EggBuffer *input, GkmSecret *login, EggBuffer *output)
 	/* And write out the salt */
 	egg_buffer_add_byte_array (output, salt, sizeof (salt));
 
-	/* Okay now use the above info to create our cipher context */
-	if (!create_cipher (login, calgo, halgo, salt, sizeof (salt), iterations, &cipher))
-		return FALSE;
-
 	/* Significant block sizes */
 	n_block = gcry_cipher_get_algo_blklen (calgo);
 	g_return_val_if_fail (n_block, FALSE);
@@ -447,19 +425,13 @@ encrypt_buffer (EggBuffer *input, GkmSecret *login, EggBuffer *output)
 	dest = egg_buffer_add_byte_array_empty (output, input->len);
 	g_return_val_if_fail (dest, FALSE);
 
-	gcry = gcry_cipher_encrypt (cipher, dest, input->len, input->buf, input->len);
-	g_return_val_if_fail (!gcry, FALSE);
-
-	gcry_cipher_close (cipher);
-
-	return TRUE;
+	return crypt_buffer (login, calgo, halgo, salt, sizeof (salt), iterations,
+	                     TRUE, dest, input->buf, input->len);
 }
 
 static gboolean
 decrypt_buffer (EggBuffer *input, gsize *offset, GkmSecret *login, EggBuffer *output)
 {
-	gcry_cipher_hd_t cipher;
-	gcry_error_t gcry;
 	const guchar *salt, *data;
 	gsize n_block, n_salt, n_data;
 	guint32 iterations;
@@ -509,20 +481,12 @@ decrypt_buffer (EggBuffer *input, gsize *offset, GkmSecret *login, EggBuffer *ou
 		return FALSE;
 	}
 
-	/* Create the cipher context */
-	if (!create_cipher (login, calgo, halgo, salt, n_salt, iterations, &cipher))
-		return FALSE;
-
 	/* Now reserve space for it in the output block, and encrypt */
 	egg_buffer_reset (output);
 	egg_buffer_resize (output, n_data);
 
-	gcry = gcry_cipher_decrypt (cipher, output->buf, output->len, data, n_data);
-	g_return_val_if_fail (!gcry, FALSE);
-
-	gcry_cipher_close (cipher);
-
-	return TRUE;
+	return crypt_buffer (login, calgo, halgo, salt, n_salt, iterations,
+	                     FALSE, output->buf, data, n_data);
 }
 
 /* ----------------------------------------------------------------------------------------
@@ -113,8 +113,31 @@ typedef CK_G_APPLICATION* CK_G_APPLICATION_PTR;
 
 #define CKM_G_HKDF_SHA256_DERIVE             (CKM_GNOME + 101)
 
+/*
+ * X25519 key agreement (RFC 7748) with a CKK_EC_MONTGOMERY private key.
+ * Like CKM_DH_PKCS_DERIVE the parameter is the peer's raw public value,
+ * here 32 bytes, and the derived key is the raw 32 byte shared secret.
+ */
+#define CKM_G_X25519_DERIVE                  (CKM_GNOME + 103)
+
 #define CKK_G_NULL                           (CKK_GNOME + 100)
 
+/*
+ * Edwards curve keys and EdDSA, as defined in PKCS#11 v3.0. CKA_EC_PARAMS
+ * holds the curve OID, and CKA_EC_POINT the encoded public key.
+ */
+#ifndef CKK_EC_EDWARDS
+#define CKK_EC_EDWARDS                       (0x40UL)
+#endif
+
+#ifndef CKM_EDDSA
+#define CKM_EDDSA                            (0x1057UL)
+#endif
+
+#ifndef CKK_EC_MONTGOMERY
+#define CKK_EC_MONTGOMERY                    (0x41UL)
+#endif
+
 /* -------------------------------------------------------------------
  * AUTO DESTRUCT
  */
@@ -0,0 +1,238 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* frob-rpc-contention.c - Drive concurrent callers through a PKCS#11 module
+
+   Copyright (C) 2026 agent <agent@local>
+
+   The Gnome Keyring Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Keyring Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Usage: frob-rpc-contention [-t threads] [-s seconds] [--sign] module.so
+ *
+ * Usually pointed at the gnome-keyring-pkcs11.so RPC module with a running
+ * daemon, so that all calls go through the RPC layer. Each thread opens its
+ * own session and loops over C_FindObjects (and optionally C_Sign with the
+ * first private key it finds). Reports the throughput across all threads.
+ */
+
+#include "config.h"
+
+#include "pkcs11/pkcs11.h"
+
+#include <glib.h>
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static gint n_threads = 8;
+static gint n_seconds = 5;
+static gboolean do_sign = FALSE;
+
+static CK_FUNCTION_LIST_PTR funcs = NULL;
+static CK_SLOT_ID slot_id = 0;
+static gint64 deadline = 0;
+
+typedef struct {
+	GThread *thread;
+	guint finds;
+	guint signs;
+	CK_RV failure;
+} Worker;
+
+static GOptionEntry option_entries[] = {
+	{ "threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
+	  "Number of concurrent callers", "N" },
+	{ "seconds", 's', 0, G_OPTION_ARG_INT, &n_seconds,
+	  "How long to run for", "S" },
+	{ "sign", 0, 0, G_OPTION_ARG_NONE, &do_sign,
+	  "Also sign with the first private key found", NULL },
+	{ NULL }
+};
+
+static CK_RV
+find_objects (CK_SESSION_HANDLE session, CK_OBJECT_CLASS klass,
+              CK_OBJECT_HANDLE *object)
+{
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+	};
+	CK_OBJECT_HANDLE objects[32];
+	CK_ULONG n_objects;
+	CK_RV rv;
+
+	rv = (funcs->C_FindObjectsInit) (session, attrs, G_N_ELEMENTS (attrs));
+	if (rv != CKR_OK)
+		return rv;
+
+	do {
+		rv = (funcs->C_FindObjects) (session, objects, G_N_ELEMENTS (objects), &n_objects);
+		if (rv == CKR_OK && object && n_objects > 0 && *object == 0)
+			*object = objects[0];
+	} while (rv == CKR_OK && n_objects == G_N_ELEMENTS (objects));
+
+	(funcs->C_FindObjectsFinal) (session);
+	return rv;
+}
+
+static CK_RV
+sign_data (CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key)
+{
+	CK_KEY_TYPE key_type;
+	CK_ATTRIBUTE attr = { CKA_KEY_TYPE, &key_type, sizeof (key_type) };
+	CK_MECHANISM mech = { 0, NULL, 0 };
+	CK_BYTE data[20] = { 0, };
+	CK_BYTE signature[1024];
+	CK_ULONG n_signature = sizeof (signature);
+	CK_RV rv;
+
+	rv = (funcs->C_GetAttributeValue) (session, key, &attr, 1);
+	if (rv != CKR_OK)
+		return rv;
+
+	mech.mechanism = (key_type == CKK_DSA) ? CKM_DSA : CKM_RSA_PKCS;
+
+	rv = (funcs->C_SignInit) (session, &mech, key);
+	if (rv != CKR_OK)
+		return rv;
+
+	return (funcs->C_Sign) (session, data, sizeof (data), signature, &n_signature);
+}
+
+static gpointer
+worker_thread (gpointer user_data)
+{
+	Worker *worker = user_data;
+	CK_SESSION_HANDLE session;
+	CK_OBJECT_HANDLE key = 0;
+	CK_RV rv;
+
+	rv = (funcs->C_OpenSession) (slot_id, CKF_SERIAL_SESSION, NULL, NULL, &session);
+	if (rv != CKR_OK) {
+		worker->failure = rv;
+		return NULL;
+	}
+
+	while (g_get_monotonic_time () < deadline) {
+		rv = find_objects (session, CKO_PRIVATE_KEY, &key);
+		if (rv != CKR_OK)
+			break;
+		worker->finds++;
+
+		if (do_sign && key != 0) {
+			rv = sign_data (session, key);
+			if (rv != CKR_OK)
+				break;
+			worker->signs++;
+		}
+	}
+
+	worker->failure = rv;
+	(funcs->C_CloseSession) (session);
+	return NULL;
+}
+
+static void G_GNUC_NORETURN
+failure (const gchar* message, ...)
+{
+	va_list va;
+	va_start (va, message);
+	vfprintf (stderr, message, va);
+	fputc ('\n', stderr);
+	va_end (va);
+	exit (1);
+}
+
+int
+main (int argc, char *argv[])
+{
+	CK_C_INITIALIZE_ARGS init_args;
+	CK_C_GetFunctionList func_get_list;
+	GOptionContext *context;
+	GError *error = NULL;
+	CK_SLOT_ID slots[8];
+	CK_ULONG n_slots;
+	Worker *workers;
+	guint finds = 0;
+	guint signs = 0;
+	void *module;
+	gint64 start;
+	gdouble elapsed;
+	CK_RV rv;
+	gint i;
+
+	context = g_option_context_new ("module.so");
+	g_option_context_add_main_entries (context, option_entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+		failure ("frob-rpc-contention: %s", error->message);
+	g_option_context_free (context);
+
+	if (argc != 2 || n_threads < 1 || n_seconds < 1)
+		failure ("usage: frob-rpc-contention [-t threads] [-s seconds] [--sign] module.so");
+
+	module = dlopen (argv[1], RTLD_NOW);
+	if (!module)
+		failure ("couldn't open library: %s: %s", argv[1], dlerror ());
+
+	func_get_list = (CK_C_GetFunctionList)dlsym (module, "C_GetFunctionList");
+	if (!func_get_list)
+		failure ("couldn't find C_GetFunctionList in library: %s: %s", argv[1], dlerror ());
+
+	rv = (func_get_list) (&funcs);
+	if (rv != CKR_OK || !funcs)
+		failure ("couldn't get function list: %s: 0x%08x", argv[1], (int)rv);
+
+	memset (&init_args, 0, sizeof (init_args));
+	init_args.flags = CKF_OS_LOCKING_OK;
+	rv = (funcs->C_Initialize) (&init_args);
+	if (rv != CKR_OK)
+		failure ("couldn't initialize module: %s: 0x%08x", argv[1], (int)rv);
+
+	n_slots = G_N_ELEMENTS (slots);
+	rv = (funcs->C_GetSlotList) (CK_TRUE, slots, &n_slots);
+	if (rv != CKR_OK || n_slots == 0)
+		failure ("no slots with tokens in module: %s: 0x%08x", argv[1], (int)rv);
+	slot_id = slots[0];
+
+	workers = g_new0 (Worker, n_threads);
+	start = g_get_monotonic_time ();
+	deadline = start + (gint64)n_seconds * G_USEC_PER_SEC;
+
+	for (i = 0; i < n_threads; i++)
+		workers[i].thread = g_thread_new ("contention", worker_thread, &workers[i]);
+
+	for (i = 0; i < n_threads; i++) {
+		g_thread_join (workers[i].thread);
+		if (workers[i].failure != CKR_OK)
+			fprintf (stderr, "thread %d failed: 0x%08x\n", i, (int)workers[i].failure);
+		finds += workers[i].finds;
+		signs += workers[i].signs;
+	}
+
+	elapsed = (gdouble)(g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+
+	printf ("threads: %d\n", n_threads);
+	printf ("finds: %u (%.1f/s)\n", finds, finds / elapsed);
+	if (do_sign)
+		printf ("signs: %u (%.1f/s)\n", signs, signs / elapsed);
+
+	g_free (workers);
+	(funcs->C_Finalize) (NULL);
+	dlclose (module);
+
+	return 0;
+}
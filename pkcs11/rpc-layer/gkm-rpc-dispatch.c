@@ -37,6 +37,8 @@
 #include <sys/un.h>
 #include <pthread.h>
 
+#include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -81,7 +83,8 @@ typedef struct _CallState {
 	GkmRpcMessage *req;
 	GkmRpcMessage *resp;
 	void *allocated;
-	CK_G_APPLICATION application;
+	CK_G_APPLICATION *application;
+	GMutex *application_lock;    /* When calls on the connection run in parallel */
 } CallState;
 
 static int
@@ -97,8 +100,8 @@ call_init (CallState *cs)
 		return 0;
 	}
 
-	memset (&cs->application, 0, sizeof (cs->application));
-	cs->application.applicationData = cs;
+	cs->application = NULL;
+	cs->application_lock = NULL;
 
 	cs->allocated = NULL;
 	return 1;
@@ -798,7 +801,7 @@ rpc_C_Finalize (CallState *cs)
 	 * we call C_CloseAllSessions for each slot for this client application.
 	 */
 
-	if (cs->application.applicationId) {
+	if (cs->application->applicationId) {
 		ret = (pkcs11_module->C_GetSlotList) (TRUE, NULL, &n_slots);
 		if (ret == CKR_OK) {
 			slots = calloc (n_slots, sizeof (CK_SLOT_ID));
@@ -807,7 +810,7 @@ rpc_C_Finalize (CallState *cs)
 			} else {
 				ret = (pkcs11_module->C_GetSlotList) (TRUE, slots, &n_slots);
 				for (i = 0; ret == CKR_OK && i < n_slots; ++i)
-					ret = (pkcs11_module->C_CloseAllSessions) (slots[i] | cs->application.applicationId);
+					ret = (pkcs11_module->C_CloseAllSessions) (slots[i] | cs->application->applicationId);
 				free (slots);
 			}
 		}
@@ -961,7 +964,13 @@ rpc_C_OpenSession (CallState *cs)
 		IN_ULONG (slot_id);
 		IN_ULONG (flags);
 		flags |= CKF_G_APPLICATION_SESSION;
-	PROCESS_CALL ((slot_id, flags, &cs->application, NULL, &session));
+
+	/* The first session opened assigns the application id */
+	if (cs->application_lock)
+		g_mutex_lock (cs->application_lock);
+	PROCESS_CALL ((slot_id, flags, cs->application, NULL, &session));
+	if (cs->application_lock)
+		g_mutex_unlock (cs->application_lock);
 		OUT_ULONG (session);
 	END_CALL;
 }
@@ -987,7 +996,7 @@ rpc_C_CloseAllSessions (CallState *cs)
 
 	BEGIN_CALL (C_CloseAllSessions);
 		IN_ULONG (slot_id);
-		slot_id |= cs->application.applicationId;
+		slot_id |= cs->application->applicationId;
 	PROCESS_CALL ((slot_id));
 	END_CALL;
 }
@@ -1866,6 +1875,14 @@ rpc_C_GenerateRandom (CallState *cs)
 	END_CALL;
 }
 
+static CK_RV
+rpc_G_Multiplex (CallState *cs)
+{
+	/* Only valid as the first call on a connection, see connection_handshake() */
+	gkm_rpc_warn ("multiplexing requested after the connection was set up");
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
 /* ---------------------------------------------------------------------------
  * DISPATCH THREAD HANDLING
  */
@@ -1964,6 +1981,7 @@ dispatch_call (CallState *cs)
 	CASE_CALL(C_DeriveKey)
 	CASE_CALL(C_SeedRandom)
 	CASE_CALL(C_GenerateRandom)
+	CASE_CALL(G_Multiplex)
 	#undef CASE_CALL
 
 	default:
@@ -2076,21 +2094,55 @@ write_all (int sock, unsigned char* data, size_t len)
 	return 1;
 }
 
+/* ---------------------------------------------------------------------------
+ * DEDICATED DISPATCH THREADS
+ *
+ * Clients that don't ask for multiplexing get their own thread, which
+ * processes one call at a time, until the connection is closed.
+ */
+
+typedef struct _DispatchState {
+	struct _DispatchState *next;
+	GThread *thread;
+	int socket;
+	unsigned char *pending;      /* Already read from the socket */
+	size_t n_pending;
+} DispatchState;
+
+/* A linked list of dispatcher threads */
+static DispatchState *pkcs11_dispatchers = NULL;
+static GMutex pkcs11_dispatchers_mutex;
+
+static int
+dispatch_read (DispatchState *ds, unsigned char* data, size_t len)
+{
+	size_t n_copy;
+
+	/* Use up what the handshake had already read */
+	if (ds->n_pending > 0) {
+		n_copy = MIN (len, ds->n_pending);
+		memcpy (data, ds->pending, n_copy);
+		memmove (ds->pending, ds->pending + n_copy, ds->n_pending - n_copy);
+		ds->n_pending -= n_copy;
+		data += n_copy;
+		len -= n_copy;
+	}
+
+	if (len == 0)
+		return 1;
+
+	return read_all (ds->socket, data, len);
+}
+
 static void
-run_dispatch_loop (int sock)
+run_dispatch_loop (DispatchState *ds)
 {
+	CK_G_APPLICATION application;
 	CallState cs;
-	pid_t pid;
-	uid_t uid;
 	unsigned char buf[4];
 	uint32_t len;
 
-	assert (sock != -1);
-
-	if (egg_unix_credentials_read (sock, &pid, &uid) < 0) {
-		gkm_rpc_warn ("couldn't read socket credentials");
-		return;
-	}
+	assert (ds->socket != -1);
 
 	/* Setup our buffers */
 	if (!call_init (&cs)) {
@@ -2098,13 +2150,17 @@ run_dispatch_loop (int sock)
 		return;
 	}
 
+	memset (&application, 0, sizeof (application));
+	application.applicationData = ds;
+	cs.application = &application;
+
 	/* The main thread loop */
 	while (TRUE) {
 
 		call_reset (&cs);
 
 		/* Read the number of bytes ... */
-		if (!read_all (sock, buf, 4))
+		if (!dispatch_read (ds, buf, 4))
 			break;
 
 		/* Calculate the number of bytes */
@@ -2122,7 +2178,7 @@ run_dispatch_loop (int sock)
 		}
 
 		/* ... and read/parse in the actual message */
-		if (!read_all (sock, cs.req->buffer.buf, len))
+		if (!dispatch_read (ds, cs.req->buffer.buf, len))
 			break;
 
 		egg_buffer_add_empty (&cs.req->buffer, len);
@@ -2136,8 +2192,8 @@ run_dispatch_loop (int sock)
 
 		/* .. send back response length, and then response data */
 		egg_buffer_encode_uint32 (buf, cs.resp->buffer.len);
-		if(!write_all (sock, buf, 4) ||
-		   !write_all (sock, cs.resp->buffer.buf, cs.resp->buffer.len))
+		if(!write_all (ds->socket, buf, 4) ||
+		   !write_all (ds->socket, cs.resp->buffer.buf, cs.resp->buffer.len))
 			break;
 	}
 
@@ -2149,8 +2205,8 @@ run_dispatch_loop (int sock)
 	 * as slot ids. Calling with an application identifier closes all
 	 * sessions for just that application identifier.
 	 */
-	if (cs.application.applicationId)
-		(pkcs11_module->C_CloseAllSessions) (cs.application.applicationId);
+	if (application.applicationId)
+		(pkcs11_module->C_CloseAllSessions) (application.applicationId);
 
 	call_uninit (&cs);
 }
@@ -2158,28 +2214,736 @@ run_dispatch_loop (int sock)
 static void*
 run_dispatch_thread (void *arg)
 {
-	int *sock = arg;
-	assert (*sock != -1);
+	DispatchState *ds = arg;
+	int sock;
 
-	run_dispatch_loop (*sock);
+	assert (ds->socket != -1);
+
+	run_dispatch_loop (ds);
 
 	/* The thread closes the socket and marks as done */
-	assert (*sock != -1);
-	close (*sock);
-	*sock = -1;
+	g_mutex_lock (&pkcs11_dispatchers_mutex);
+	sock = ds->socket;
+	ds->socket = -1;
+	g_mutex_unlock (&pkcs11_dispatchers_mutex);
+
+	assert (sock != -1);
+	close (sock);
 
 	return NULL;
 }
 
+static int
+start_dispatch_thread (int sock, const unsigned char *pending, size_t n_pending)
+{
+	DispatchState *ds;
+
+	ds = calloc (1, sizeof (DispatchState));
+	if (ds == NULL) {
+		gkm_rpc_warn ("out of memory");
+		return 0;
+	}
+
+	if (n_pending > 0) {
+		ds->pending = malloc (n_pending);
+		if (ds->pending == NULL) {
+			gkm_rpc_warn ("out of memory");
+			free (ds);
+			return 0;
+		}
+		memcpy (ds->pending, pending, n_pending);
+		ds->n_pending = n_pending;
+	}
+
+	ds->socket = sock;
+
+	g_mutex_lock (&pkcs11_dispatchers_mutex);
+
+	ds->thread = g_thread_try_new ("dispatch", run_dispatch_thread, ds, NULL);
+	if (ds->thread) {
+		ds->next = pkcs11_dispatchers;
+		pkcs11_dispatchers = ds;
+	}
+
+	g_mutex_unlock (&pkcs11_dispatchers_mutex);
+
+	if (!ds->thread) {
+		gkm_rpc_warn ("couldn't start thread");
+		free (ds->pending);
+		free (ds);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void
+cleanup_dispatch_threads (gboolean all)
+{
+	DispatchState *ds, **here;
+	DispatchState *done = NULL;
+
+	g_mutex_lock (&pkcs11_dispatchers_mutex);
+
+	for (here = &pkcs11_dispatchers, ds = *here; ds != NULL; ds = *here) {
+		if (all || ds->socket == -1) {
+			/* Forcibly shutdown the connection */
+			if (ds->socket != -1)
+				shutdown (ds->socket, SHUT_RDWR);
+			*here = ds->next;
+			ds->next = done;
+			done = ds;
+		} else {
+			here = &ds->next;
+		}
+	}
+
+	g_mutex_unlock (&pkcs11_dispatchers_mutex);
+
+	while (done != NULL) {
+		ds = done;
+		done = ds->next;
+		g_thread_join (ds->thread);
+
+		/* This is always closed by dispatch thread */
+		assert (ds->socket == -1);
+		free (ds->pending);
+		free (ds);
+	}
+}
+
 /* ---------------------------------------------------------------------------
- * MAIN THREAD
+ * MULTIPLEXED CONNECTIONS
+ *
+ * All connections start out being watched by a single I/O thread. When
+ * the first message asks for multiplexing, the connection stays there, and
+ * each complete request is handed to a bounded pool of worker threads. Calls
+ * that may wait on the user for a prompt go to a separate unbounded pool, so
+ * they can't hold up everyone else. The responses are queued on the
+ * connection and written out by the I/O thread. Any other first message hands
+ * the connection off to a dedicated thread.
  */
 
-typedef struct _DispatchState {
-	struct _DispatchState *next;
-	GThread *thread;
+enum {
+	CONNECTION_CREDENTIALS,      /* Waiting for unix credentials */
+	CONNECTION_HANDSHAKE,        /* Waiting for first message */
+	CONNECTION_MULTIPLEX,        /* Requests with ids, in any order */
+};
+
+typedef struct _Connection {
+	gint refs;
 	int socket;
-} DispatchState;
+	int state;
+	gint n_calls;                /* Requests queued or being processed */
+	EggBuffer input;             /* Partially received messages */
+	EggBuffer output;            /* Responses not yet written */
+	CK_G_APPLICATION application;
+	GMutex application_lock;
+	GMutex output_lock;          /* Workers append, the I/O thread writes */
+} Connection;
+
+typedef struct _DispatchJob {
+	Connection *conn;
+	gboolean drop;               /* Just release the connection */
+	uint32_t request_id;
+	unsigned char *data;
+	size_t n_data;
+} DispatchJob;
+
+/* Upper limit on the number of calls processed at once */
+#define MAX_DISPATCH_WORKERS 16
+
+/* Stop reading from a connection with this many calls outstanding */
+#define MAX_CONNECTION_CALLS 32
+
+/* Or when it isn't reading its responses */
+#define MAX_CONNECTION_OUTPUT (256 * 1024)
+
+static GThread *mux_thread = NULL;
+static GThreadPool *mux_workers = NULL;
+static GThreadPool *mux_prompters = NULL;
+static int mux_wakeup[2] = { -1, -1 };
+
+/* Protects the variables below */
+static GMutex mux_mutex;
+static GPtrArray *mux_incoming = NULL;
+static gboolean mux_quit = FALSE;
+
+static void
+call_free (gpointer data)
+{
+	CallState *cs = data;
+	call_uninit (cs);
+	free (cs);
+}
+
+/* A call state for each worker thread, reused between jobs */
+static GPrivate mux_call_state = G_PRIVATE_INIT (call_free);
+
+static void
+mux_wake (void)
+{
+	unsigned char ch = 0;
+	int r;
+
+	do {
+		r = write (mux_wakeup[1], &ch, 1);
+	} while (r < 0 && errno == EINTR);
+}
+
+static Connection*
+connection_new (int sock)
+{
+	Connection *conn;
+
+	conn = g_slice_new0 (Connection);
+	conn->refs = 1;
+	conn->socket = sock;
+	conn->state = CONNECTION_CREDENTIALS;
+	egg_buffer_init_full (&conn->input, 256, (EggBufferAllocator)realloc);
+	egg_buffer_init_full (&conn->output, 256, (EggBufferAllocator)realloc);
+	conn->application.applicationData = conn;
+	g_mutex_init (&conn->application_lock);
+	g_mutex_init (&conn->output_lock);
+
+	return conn;
+}
+
+static Connection*
+connection_ref (Connection *conn)
+{
+	g_atomic_int_inc (&conn->refs);
+	return conn;
+}
+
+static void
+connection_unref (Connection *conn)
+{
+	if (!g_atomic_int_dec_and_test (&conn->refs))
+		return;
+
+	/* Same as a dedicated dispatch thread, see run_dispatch_loop() */
+	if (conn->application.applicationId && pkcs11_module)
+		(pkcs11_module->C_CloseAllSessions) (conn->application.applicationId);
+
+	if (conn->socket != -1)
+		close (conn->socket);
+
+	egg_buffer_uninit (&conn->input);
+	egg_buffer_uninit (&conn->output);
+	g_mutex_clear (&conn->application_lock);
+	g_mutex_clear (&conn->output_lock);
+	g_slice_free (Connection, conn);
+}
+
+static int
+connection_queue (Connection *conn, unsigned char *header, size_t n_header,
+                  GkmRpcMessage *msg)
+{
+	int ret;
+
+	/* Written out by the I/O thread, as the client reads it */
+	g_mutex_lock (&conn->output_lock);
+	ret = egg_buffer_append (&conn->output, header, n_header) &&
+	      egg_buffer_append (&conn->output, msg->buffer.buf, msg->buffer.len);
+	g_mutex_unlock (&conn->output_lock);
+
+	mux_wake ();
+	return ret;
+}
+
+static void
+run_dispatch_job (gpointer data, gpointer unused)
+{
+	DispatchJob *job = data;
+	Connection *conn = job->conn;
+	unsigned char header[8];
+	CallState *cs;
+	int ret = 0;
+
+	cs = g_private_get (&mux_call_state);
+	if (cs == NULL) {
+		cs = calloc (1, sizeof (CallState));
+		if (cs == NULL || !call_init (cs)) {
+			gkm_rpc_warn ("out of memory");
+			free (cs);
+			cs = NULL;
+		} else {
+			g_private_set (&mux_call_state, cs);
+		}
+	}
+
+	if (cs != NULL) {
+		call_reset (cs);
+		cs->application = &conn->application;
+		cs->application_lock = &conn->application_lock;
+
+		ret = egg_buffer_append (&cs->req->buffer, job->data, job->n_data) &&
+		      gkm_rpc_message_parse (cs->req, GKM_RPC_REQUEST) &&
+		      dispatch_call (cs);
+	}
+
+	/* Before the I/O thread wakes up, so it reads more requests */
+	g_atomic_int_add (&conn->n_calls, -1);
+
+	if (ret) {
+		/* Response length, request id, and then response data */
+		egg_buffer_encode_uint32 (header, cs->resp->buffer.len + 4);
+		egg_buffer_encode_uint32 (header + 4, job->request_id);
+		ret = connection_queue (conn, header, sizeof (header), cs->resp);
+	}
+
+	/* The I/O thread will notice, and drop the connection */
+	if (!ret) {
+		shutdown (conn->socket, SHUT_RDWR);
+		mux_wake ();
+	}
+
+	connection_unref (conn);
+	free (job->data);
+	free (job);
+}
+
+static void
+run_connection_job (gpointer data, gpointer unused)
+{
+	DispatchJob *job = data;
+
+	/* Releasing the connection may close its sessions, which can take a while */
+	if (job->drop) {
+		connection_unref (job->conn);
+		free (job);
+	} else {
+		run_dispatch_job (job, unused);
+	}
+}
+
+static gboolean
+call_may_prompt (uint32_t call_id)
+{
+	switch (call_id) {
+	case GKM_RPC_CALL_C_InitPIN:
+	case GKM_RPC_CALL_C_SetPIN:
+	case GKM_RPC_CALL_C_Login:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static int
+connection_handshake (Connection *conn, const unsigned char *data, size_t n_data)
+{
+	GkmRpcMessage *msg;
+	unsigned char header[4];
+	CK_ULONG version;
+	int ret = 0;
+
+	msg = gkm_rpc_message_new ((EggBufferAllocator)realloc);
+	if (msg == NULL) {
+		gkm_rpc_warn ("out of memory");
+		return 0;
+	}
+
+	if (!egg_buffer_append (&msg->buffer, data, n_data) ||
+	    !gkm_rpc_message_parse (msg, GKM_RPC_REQUEST)) {
+		gkm_rpc_message_free (msg);
+		return 0;
+	}
+
+	if (msg->call_id != GKM_RPC_CALL_G_Multiplex) {
+		gkm_rpc_message_free (msg);
+		return 1;
+	}
+
+	/* Answer with our version, or an error if we can't speak theirs */
+	if (gkm_rpc_message_read_ulong (msg, &version) &&
+	    version == GKM_RPC_MULTIPLEX_VERSION) {
+		gkm_rpc_message_reset (msg);
+		ret = gkm_rpc_message_prep (msg, GKM_RPC_CALL_G_Multiplex, GKM_RPC_RESPONSE) &&
+		      gkm_rpc_message_write_ulong (msg, GKM_RPC_MULTIPLEX_VERSION);
+		if (ret)
+			conn->state = CONNECTION_MULTIPLEX;
+	} else {
+		gkm_rpc_message_reset (msg);
+		ret = gkm_rpc_message_prep (msg, GKM_RPC_CALL_ERROR, GKM_RPC_RESPONSE) &&
+		      gkm_rpc_message_write_ulong (msg, CKR_FUNCTION_NOT_SUPPORTED);
+	}
+
+	/* No calls yet, so nothing else is writing to the socket */
+	if (ret && !gkm_rpc_message_buffer_error (msg)) {
+		egg_buffer_encode_uint32 (header, msg->buffer.len);
+		ret = write_all (conn->socket, header, sizeof (header)) &&
+		      write_all (conn->socket, msg->buffer.buf, msg->buffer.len);
+	} else {
+		gkm_rpc_warn ("out of memory responding to handshake");
+		ret = 0;
+	}
+
+	/* From now on the I/O thread never waits on the socket */
+	if (ret && conn->state == CONNECTION_MULTIPLEX)
+		fcntl (conn->socket, F_SETFL, fcntl (conn->socket, F_GETFL) | O_NONBLOCK);
+
+	gkm_rpc_message_free (msg);
+	return ret;
+}
+
+static int
+connection_request (Connection *conn, const unsigned char *data, size_t n_data)
+{
+	DispatchJob *job;
+
+	if (n_data < 4) {
+		gkm_rpc_warn ("invalid message from module: missing request id");
+		return 0;
+	}
+
+	job = calloc (1, sizeof (DispatchJob));
+	if (job != NULL)
+		job->data = malloc (n_data - 4);
+	if (job == NULL || (job->data == NULL && n_data > 4)) {
+		gkm_rpc_warn ("out of memory");
+		free (job);
+		return 0;
+	}
+
+	job->request_id = egg_buffer_decode_uint32 ((unsigned char *)data);
+	memcpy (job->data, data + 4, n_data - 4);
+	job->n_data = n_data - 4;
+	job->conn = connection_ref (conn);
+
+	g_atomic_int_inc (&conn->n_calls);
+
+	/* The call id comes first in the message, after the request id */
+	if (n_data >= 8 && call_may_prompt (egg_buffer_decode_uint32 ((unsigned char *)data + 4)))
+		g_thread_pool_push (mux_prompters, job, NULL);
+	else
+		g_thread_pool_push (mux_workers, job, NULL);
+	return 1;
+}
+
+/* These return FALSE when the I/O thread should stop watching the connection */
+
+static gboolean
+connection_process (Connection *conn)
+{
+	size_t offset = 0;
+	uint32_t len;
+
+	/* Process each complete message */
+	while (conn->input.len - offset >= 4) {
+
+		/* The rest wait until some of the calls are done */
+		if (conn->state == CONNECTION_MULTIPLEX &&
+		    g_atomic_int_get (&conn->n_calls) >= MAX_CONNECTION_CALLS)
+			break;
+
+		len = egg_buffer_decode_uint32 (conn->input.buf + offset);
+		if (len >= 0x0FFFFFFF) {
+			gkm_rpc_warn ("invalid message size from module: %u bytes", len);
+			return FALSE;
+		}
+
+		if (conn->input.len - offset - 4 < len)
+			break;
+
+		if (conn->state == CONNECTION_MULTIPLEX) {
+			if (!connection_request (conn, conn->input.buf + offset + 4, len))
+				return FALSE;
+
+		} else {
+			if (!connection_handshake (conn, conn->input.buf + offset + 4, len))
+				return FALSE;
+
+			/* Not multiplexing, a dedicated thread takes over from here */
+			if (conn->state != CONNECTION_MULTIPLEX) {
+				if (start_dispatch_thread (conn->socket, conn->input.buf + offset,
+				                           conn->input.len - offset))
+					conn->socket = -1;
+				return FALSE;
+			}
+		}
+
+		offset += 4 + len;
+	}
+
+	/* Keep any partial message around for next time */
+	memmove (conn->input.buf, conn->input.buf + offset, conn->input.len - offset);
+	conn->input.len -= offset;
+
+	return TRUE;
+}
+
+static gboolean
+connection_read (Connection *conn)
+{
+	pid_t pid;
+	uid_t uid;
+	int r;
+
+	if (conn->state == CONNECTION_CREDENTIALS) {
+		if (egg_unix_credentials_read (conn->socket, &pid, &uid) < 0) {
+			gkm_rpc_warn ("couldn't read socket credentials");
+			return FALSE;
+		}
+		conn->state = CONNECTION_HANDSHAKE;
+		return TRUE;
+	}
+
+	if (!egg_buffer_reserve (&conn->input, conn->input.len + 4096)) {
+		gkm_rpc_warn ("error allocating buffer for message");
+		return FALSE;
+	}
+
+	r = read (conn->socket, conn->input.buf + conn->input.len, 4096);
+	if (r == 0) {
+		/* Connection was closed on client */
+		return FALSE;
+	} else if (r == -1) {
+		if (errno == EAGAIN || errno == EINTR)
+			return TRUE;
+		gkm_rpc_warn ("couldn't receive data: %s", strerror (errno));
+		return FALSE;
+	}
+
+	egg_buffer_add_empty (&conn->input, r);
+	return connection_process (conn);
+}
+
+static gboolean
+connection_flush (Connection *conn)
+{
+	gboolean ret = TRUE;
+	int r;
+
+	g_mutex_lock (&conn->output_lock);
+
+	if (egg_buffer_has_error (&conn->output)) {
+		gkm_rpc_warn ("out of memory queuing response");
+		ret = FALSE;
+
+	} else if (conn->output.len > 0) {
+		r = write (conn->socket, conn->output.buf, conn->output.len);
+		if (r < 0) {
+			if (errno != EAGAIN && errno != EINTR) {
+				if (errno != EPIPE)
+					gkm_rpc_warn ("couldn't send data: %s", strerror (errno));
+				ret = FALSE;
+			}
+		} else {
+			memmove (conn->output.buf, conn->output.buf + r, conn->output.len - r);
+			conn->output.len -= r;
+		}
+	}
+
+	g_mutex_unlock (&conn->output_lock);
+	return ret;
+}
+
+static short
+connection_events (Connection *conn)
+{
+	size_t n_output;
+	short events = 0;
+
+	g_mutex_lock (&conn->output_lock);
+	n_output = conn->output.len;
+	g_mutex_unlock (&conn->output_lock);
+
+	if (n_output > 0)
+		events |= POLLOUT;
+
+	/* Don't read requests faster than they're done, or than the client reads */
+	if (n_output < MAX_CONNECTION_OUTPUT &&
+	    g_atomic_int_get (&conn->n_calls) < MAX_CONNECTION_CALLS)
+		events |= POLLIN;
+
+	return events;
+}
+
+static void
+connection_drop (Connection *conn)
+{
+	DispatchJob *job = NULL;
+
+	if (conn->socket != -1)
+		shutdown (conn->socket, SHUT_RDWR);
+
+	/* Don't close the sessions on the I/O thread, a worker does that */
+	if (mux_workers)
+		job = calloc (1, sizeof (DispatchJob));
+	if (job != NULL) {
+		job->conn = conn;
+		job->drop = TRUE;
+		g_thread_pool_push (mux_workers, job, NULL);
+	} else {
+		connection_unref (conn);
+	}
+}
+
+static gpointer
+run_mux_thread (gpointer unused)
+{
+	GPtrArray *connections;
+	struct pollfd *fds = NULL;
+	Connection *conn;
+	unsigned char buf[64];
+	guint i, n_fds;
+	gboolean quit;
+	gboolean ret;
+
+	connections = g_ptr_array_new ();
+
+	for (;;) {
+		g_mutex_lock (&mux_mutex);
+		quit = mux_quit;
+		for (i = 0; i < mux_incoming->len; i++)
+			g_ptr_array_add (connections, mux_incoming->pdata[i]);
+		g_ptr_array_set_size (mux_incoming, 0);
+		g_mutex_unlock (&mux_mutex);
+
+		if (quit)
+			break;
+
+		n_fds = connections->len + 1;
+		fds = g_renew (struct pollfd, fds, n_fds);
+		fds[0].fd = mux_wakeup[0];
+		fds[0].events = POLLIN;
+		for (i = 0; i < connections->len; i++) {
+			conn = connections->pdata[i];
+			fds[i + 1].fd = conn->socket;
+			fds[i + 1].events = connection_events (conn);
+		}
+
+		if (poll (fds, n_fds, -1) < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			gkm_rpc_warn ("couldn't watch pkcs11 connections: %s", strerror (errno));
+			break;
+		}
+
+		/* Drain the wakeup pipe, we look at the state above anyway */
+		if (fds[0].revents)
+			while (read (mux_wakeup[0], buf, sizeof (buf)) > 0);
+
+		/* Go backwards, so removing doesn't upset the indexes */
+		for (i = connections->len; i > 0; i--) {
+			conn = connections->pdata[i - 1];
+
+			ret = TRUE;
+			if (fds[i].revents & POLLOUT)
+				ret = connection_flush (conn);
+
+			/* Look at everyone, since calls may have finished */
+			if (ret && fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				ret = connection_read (conn);
+			else if (ret)
+				ret = connection_process (conn);
+
+			if (!ret) {
+				g_ptr_array_remove_index_fast (connections, i - 1);
+				connection_drop (conn);
+			}
+		}
+	}
+
+	for (i = 0; i < connections->len; i++)
+		connection_drop (connections->pdata[i]);
+	g_ptr_array_free (connections, TRUE);
+	g_free (fds);
+
+	return NULL;
+}
+
+static int
+start_multiplexing (void)
+{
+	GError *error = NULL;
+	gint n_workers;
+	int i;
+
+	if (pipe (mux_wakeup) < 0) {
+		gkm_rpc_warn ("couldn't create wakeup pipe: %s", strerror (errno));
+		return 0;
+	}
+
+	for (i = 0; i < 2; i++) {
+		fcntl (mux_wakeup[i], F_SETFD, FD_CLOEXEC);
+		fcntl (mux_wakeup[i], F_SETFL, O_NONBLOCK);
+	}
+
+	n_workers = CLAMP (g_get_num_processors () * 2, 4, MAX_DISPATCH_WORKERS);
+	mux_workers = g_thread_pool_new (run_connection_job, NULL, n_workers, FALSE, &error);
+	if (mux_workers == NULL) {
+		gkm_rpc_warn ("couldn't create worker threads: %s", egg_error_message (error));
+		g_clear_error (&error);
+		return 0;
+	}
+
+	/* Each of these may be waiting on a prompt, so no limit */
+	mux_prompters = g_thread_pool_new (run_dispatch_job, NULL, -1, FALSE, &error);
+	if (mux_prompters == NULL) {
+		gkm_rpc_warn ("couldn't create worker threads: %s", egg_error_message (error));
+		g_clear_error (&error);
+		return 0;
+	}
+
+	mux_incoming = g_ptr_array_new ();
+	mux_quit = FALSE;
+
+	mux_thread = g_thread_try_new ("dispatch-io", run_mux_thread, NULL, &error);
+	if (mux_thread == NULL) {
+		gkm_rpc_warn ("couldn't start thread: %s", egg_error_message (error));
+		g_clear_error (&error);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void
+stop_multiplexing (void)
+{
+	guint i;
+	int j;
+
+	if (mux_thread) {
+		g_mutex_lock (&mux_mutex);
+		mux_quit = TRUE;
+		g_mutex_unlock (&mux_mutex);
+		mux_wake ();
+		g_thread_join (mux_thread);
+		mux_thread = NULL;
+	}
+
+	/* Wait for any calls in progress */
+	if (mux_prompters) {
+		g_thread_pool_free (mux_prompters, FALSE, TRUE);
+		mux_prompters = NULL;
+	}
+
+	if (mux_workers) {
+		g_thread_pool_free (mux_workers, FALSE, TRUE);
+		mux_workers = NULL;
+	}
+
+	if (mux_incoming) {
+		for (i = 0; i < mux_incoming->len; i++)
+			connection_drop (mux_incoming->pdata[i]);
+		g_ptr_array_free (mux_incoming, TRUE);
+		mux_incoming = NULL;
+	}
+
+	for (j = 0; j < 2; j++) {
+		if (mux_wakeup[j] != -1)
+			close (mux_wakeup[j]);
+		mux_wakeup[j] = -1;
+	}
+}
+
+/* ---------------------------------------------------------------------------
+ * MAIN THREAD
+ */
 
 /* The main daemon socket that we're listening on */
 static int pkcs11_socket = -1;
@@ -2187,30 +2951,17 @@ static int pkcs11_socket = -1;
 /* The unix socket path, that we listen on */
 static char *pkcs11_socket_path = NULL;
 
-/* A linked list of dispatcher threads */
-static DispatchState *pkcs11_dispatchers = NULL;
-
 void
 gkm_rpc_layer_accept (void)
 {
 	struct sockaddr_un addr;
-	DispatchState *ds, **here;
-	GError *error = NULL;
 	socklen_t addrlen;
 	int new_fd;
 
 	assert (pkcs11_socket != -1);
 
 	/* Cleanup any completed dispatch threads */
-	for (here = &pkcs11_dispatchers, ds = *here; ds != NULL; ds = *here) {
-		if (ds->socket == -1) {
-			g_thread_join (ds->thread);
-			*here = ds->next;
-			free (ds);
-		} else {
-			here = &ds->next;
-		}
-	}
+	cleanup_dispatch_threads (FALSE);
 
 	addrlen = sizeof (addr);
 	new_fd = accept (pkcs11_socket, (struct sockaddr*) &addr, &addrlen);
@@ -2219,25 +2970,15 @@ gkm_rpc_layer_accept (void)
 		return;
 	}
 
-	ds = calloc (1, sizeof (DispatchState));
-	if (ds == NULL) {
-		gkm_rpc_warn ("out of memory");
+	/* The I/O thread figures out how the client wants to talk */
+	g_mutex_lock (&mux_mutex);
+	if (mux_incoming)
+		g_ptr_array_add (mux_incoming, connection_new (new_fd));
+	else
 		close (new_fd);
-		return;
-	}
-
-	ds->socket = new_fd;
-
-	ds->thread = g_thread_new ("dispatch", run_dispatch_thread, &(ds->socket));
-	if (!ds->thread) {
-		gkm_rpc_warn ("couldn't start thread: %s", egg_error_message (error));
-		close (new_fd);
-		free (ds);
-		return;
-	}
+	g_mutex_unlock (&mux_mutex);
 
-	ds->next = pkcs11_dispatchers;
-	pkcs11_dispatchers = ds;
+	mux_wake ();
 }
 
 int
@@ -2254,8 +2995,6 @@ gkm_rpc_layer_initialize (CK_FUNCTION_LIST_PTR module)
 void
 gkm_rpc_layer_uninitialize (void)
 {
-	DispatchState *ds, *next;
-
 	if (!pkcs11_module)
 		return;
 
@@ -2271,22 +3010,9 @@ gkm_rpc_layer_uninitialize (void)
 		pkcs11_socket_path = NULL;
 	}
 
-	ds = pkcs11_dispatchers;
-	pkcs11_dispatchers = NULL;
-
 	/* Stop all of the dispatch threads */
-	for (; ds; ds = next) {
-		next = ds->next;
-
-		/* Forcibly shutdown the connection */
-		if (ds->socket)
-			shutdown (ds->socket, SHUT_RDWR);
-		g_thread_join (ds->thread);
-
-		/* This is always closed by dispatch thread */
-		assert (ds->socket == -1);
-		free (ds);
-	}
+	stop_multiplexing ();
+	cleanup_dispatch_threads (TRUE);
 
 	pkcs11_module = NULL;
 }
@@ -2337,6 +3063,12 @@ gkm_rpc_layer_startup (const char *prefix)
 		return -1;
 	}
 
+	if (!start_multiplexing ()) {
+		stop_multiplexing ();
+		close (sock);
+		return -1;
+	}
+
 	pkcs11_socket = sock;
 	pkcs11_dispatchers = NULL;
 
@@ -2346,8 +3078,6 @@ gkm_rpc_layer_startup (const char *prefix)
 void
 gkm_rpc_layer_shutdown (void)
 {
-	DispatchState *ds, *next;
-
 	/* Close our main listening socket */
 	if (pkcs11_socket != -1)
 		close (pkcs11_socket);
@@ -2360,20 +3090,7 @@ gkm_rpc_layer_shutdown (void)
 		pkcs11_socket_path = NULL;
 	}
 
-	ds = pkcs11_dispatchers;
-	pkcs11_dispatchers = NULL;
-
 	/* Stop all of the dispatch threads */
-	for (; ds; ds = next) {
-		next = ds->next;
-
-		/* Forcibly shutdown the connection */
-		if (ds->socket)
-			shutdown (ds->socket, SHUT_RDWR);
-		g_thread_join (ds->thread);
-
-		/* This is always closed by dispatch thread */
-		assert (ds->socket == -1);
-		free (ds);
-	}
+	stop_multiplexing ();
+	cleanup_dispatch_threads (TRUE);
 }
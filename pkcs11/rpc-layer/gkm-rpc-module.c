@@ -189,8 +189,11 @@ enum CallStatus {
 	CALL_PARSE
 };
 
+struct _CallMux;
+
 typedef struct _CallState {
 	int socket;                  /* The connection we're sending on */
+	struct _CallMux *mux;        /* Or the shared connection we're sending on */
 	GkmRpcMessage *req;          /* The current request */
 	GkmRpcMessage *resp;         /* The current response */
 	int call_status;
@@ -207,6 +210,50 @@ static unsigned int n_call_state_pool = 0;
 /* Mutex to protect above call state list */
 static pthread_mutex_t call_state_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * A connection to the daemon that many calls can use at once. See
+ * GKM_RPC_MULTIPLEX_VERSION. Whichever caller isn't waiting on someone
+ * else reads the next response, and hands it to the right caller.
+ */
+
+typedef struct _CallWaiter {
+	uint32_t id;
+	GkmRpcMessage *resp;
+	int done;
+	CK_RV ret;
+	struct _CallWaiter *next;
+} CallWaiter;
+
+typedef struct _CallMux {
+	int refs;
+	int socket;
+	pid_t pid;                   /* The process that opened the connection */
+	int broken;
+	uint32_t last_id;
+	int reading;                 /* A caller is reading a response */
+	CallWaiter *waiting;         /* Callers with a request in flight */
+	pthread_mutex_t write_mutex; /* Requests are written whole */
+	pthread_mutex_t mutex;       /* Protects everything above */
+	pthread_cond_t cond;
+} CallMux;
+
+enum CallMuxStatus {
+	MUX_UNKNOWN,
+	MUX_ACTIVE,
+	MUX_UNSUPPORTED
+};
+
+/* The shared connection, if the daemon supports multiplexing */
+static CallMux *call_mux = NULL;
+static int call_mux_status = MUX_UNKNOWN;
+
+/* Mutex to protect above shared connection */
+static pthread_mutex_t call_mux_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void call_mux_unref (CallMux *mux);
+static CK_RV call_prepare (CallState *cs, int call_id);
+static CK_RV call_run (CallState *cs);
+
 /* Allocator for call session buffers */
 static void*
 call_allocator (void* p, size_t sz)
@@ -293,6 +340,9 @@ call_destroy (void *value)
 		call_disconnect (cs);
 		assert (cs->socket == -1);
 
+		if (cs->mux)
+			call_mux_unref (cs->mux);
+
 		gkm_rpc_message_free (cs->req);
 		gkm_rpc_message_free (cs->resp);
 
@@ -302,14 +352,340 @@ call_destroy (void *value)
 	}
 }
 
+static CallMux*
+call_mux_ref (CallMux *mux)
+{
+	pthread_mutex_lock (&mux->mutex);
+	++mux->refs;
+	pthread_mutex_unlock (&mux->mutex);
+	return mux;
+}
+
+static void
+call_mux_unref (CallMux *mux)
+{
+	int last;
+
+	pthread_mutex_lock (&mux->mutex);
+	last = (--mux->refs == 0);
+	pthread_mutex_unlock (&mux->mutex);
+
+	if (!last)
+		return;
+
+	assert (mux->waiting == NULL);
+	debug (("disconnected shared socket"));
+	close (mux->socket);
+	pthread_mutex_destroy (&mux->write_mutex);
+	pthread_mutex_destroy (&mux->mutex);
+	pthread_cond_destroy (&mux->cond);
+	free (mux);
+}
+
+static CK_RV
+call_mux_write (CallMux *mux, unsigned char* data, size_t len)
+{
+	int r;
+
+	while (len > 0) {
+		r = write (mux->socket, data, len);
+		if (r == -1) {
+			if (errno != EAGAIN && errno != EINTR) {
+				warning (("couldn't send data: %s", strerror (errno)));
+				return CKR_DEVICE_ERROR;
+			}
+		} else {
+			data += r;
+			len -= r;
+		}
+	}
+
+	return CKR_OK;
+}
+
+static CK_RV
+call_mux_read (CallMux *mux, unsigned char* data, size_t len)
+{
+	int r;
+
+	while (len > 0) {
+		r = read (mux->socket, data, len);
+		if (r == 0) {
+			warning (("couldn't receive data: daemon closed connection"));
+			return CKR_DEVICE_ERROR;
+		} else if (r == -1) {
+			if (errno != EAGAIN && errno != EINTR) {
+				warning (("couldn't receive data: %s", strerror (errno)));
+				return CKR_DEVICE_ERROR;
+			}
+		} else {
+			data += r;
+			len -= r;
+		}
+	}
+
+	return CKR_OK;
+}
+
+/* Fail all calls in flight. Called with mux->mutex held */
+static void
+call_mux_fail (CallMux *mux)
+{
+	CallWaiter *waiter;
+
+	mux->broken = 1;
+	for (waiter = mux->waiting; waiter != NULL; waiter = waiter->next) {
+		waiter->ret = CKR_DEVICE_ERROR;
+		waiter->done = 1;
+	}
+	mux->waiting = NULL;
+	pthread_cond_broadcast (&mux->cond);
+}
+
+/* Read the next response, for any caller. Called with mux->reading set */
+static CK_RV
+call_mux_receive (CallMux *mux, CallWaiter **received)
+{
+	CallWaiter *waiter;
+	unsigned char buf[8];
+	uint32_t len, id;
+	CK_RV ret;
+
+	ret = call_mux_read (mux, buf, 8);
+	if (ret != CKR_OK)
+		return ret;
+
+	len = egg_buffer_decode_uint32 (buf);
+	id = egg_buffer_decode_uint32 (buf + 4);
+	if (len < 4) {
+		warning (("invalid response from gnome-keyring-daemon: too short"));
+		return CKR_DEVICE_ERROR;
+	}
+	len -= 4;
+
+	pthread_mutex_lock (&mux->mutex);
+	for (waiter = mux->waiting; waiter != NULL; waiter = waiter->next) {
+		if (waiter->id == id)
+			break;
+	}
+	pthread_mutex_unlock (&mux->mutex);
+
+	if (waiter == NULL) {
+		warning (("invalid response from gnome-keyring-daemon: unknown request"));
+		return CKR_DEVICE_ERROR;
+	}
+
+	/* The waiter doesn't touch its response until it's done */
+	if (!egg_buffer_reserve (&waiter->resp->buffer, len + waiter->resp->buffer.len)) {
+		warning (("couldn't allocate %u byte response area: out of memory", len));
+		return CKR_HOST_MEMORY;
+	}
+	if (len > 0) {
+		ret = call_mux_read (mux, waiter->resp->buffer.buf, len);
+		if (ret != CKR_OK)
+			return ret;
+	}
+
+	egg_buffer_add_empty (&waiter->resp->buffer, len);
+	*received = waiter;
+	return CKR_OK;
+}
+
+static CK_RV
+call_mux_transact (CallMux *mux, GkmRpcMessage *req, GkmRpcMessage *resp)
+{
+	CallWaiter waiter, *received, **here;
+	unsigned char buf[8];
+	CK_RV ret;
+
+	memset (&waiter, 0, sizeof (waiter));
+	waiter.resp = resp;
+
+	pthread_mutex_lock (&mux->mutex);
+
+		if (mux->broken) {
+			pthread_mutex_unlock (&mux->mutex);
+			return CKR_DEVICE_ERROR;
+		}
+
+		waiter.id = ++mux->last_id;
+		waiter.next = mux->waiting;
+		mux->waiting = &waiter;
+
+	pthread_mutex_unlock (&mux->mutex);
+
+	/* Send the number of bytes, the request id, and then the data */
+	egg_buffer_encode_uint32 (buf, req->buffer.len + 4);
+	egg_buffer_encode_uint32 (buf + 4, waiter.id);
+
+	pthread_mutex_lock (&mux->write_mutex);
+		ret = call_mux_write (mux, buf, 8);
+		if (ret == CKR_OK)
+			ret = call_mux_write (mux, req->buffer.buf, req->buffer.len);
+	pthread_mutex_unlock (&mux->write_mutex);
+
+	pthread_mutex_lock (&mux->mutex);
+
+		/* Whoever is reading notices the connection going away */
+		if (ret != CKR_OK) {
+			mux->broken = 1;
+			shutdown (mux->socket, SHUT_RDWR);
+		}
+
+		while (!waiter.done) {
+
+			/* Someone else is reading, they'll wake us up */
+			if (mux->reading) {
+				pthread_cond_wait (&mux->cond, &mux->mutex);
+				continue;
+			}
+
+			if (mux->broken) {
+				call_mux_fail (mux);
+				break;
+			}
+
+			/* Read the next response ourselves */
+			mux->reading = 1;
+			pthread_mutex_unlock (&mux->mutex);
+			ret = call_mux_receive (mux, &received);
+			pthread_mutex_lock (&mux->mutex);
+			mux->reading = 0;
+
+			if (ret == CKR_OK) {
+				for (here = &mux->waiting; *here != received; here = &(*here)->next)
+					assert (*here != NULL);
+				*here = received->next;
+				received->ret = CKR_OK;
+				received->done = 1;
+				pthread_cond_broadcast (&mux->cond);
+			} else {
+				shutdown (mux->socket, SHUT_RDWR);
+				call_mux_fail (mux);
+			}
+		}
+
+		ret = waiter.ret;
+
+	pthread_mutex_unlock (&mux->mutex);
+
+	return ret;
+}
+
+/* Ask the daemon for a shared connection. Called with call_mux_mutex held */
+static void
+call_mux_negotiate (void)
+{
+	CallState *cs;
+	CallMux *mux;
+	CK_ULONG version;
+	CK_RV ret;
+
+	assert (call_mux == NULL);
+
+	cs = calloc (1, sizeof (CallState));
+	if (cs == NULL)
+		return;
+	cs->socket = -1;
+	cs->call_status = CALL_INVALID;
+
+	/* No daemon, try again next time */
+	ret = call_connect (cs);
+	if (ret != CKR_OK) {
+		free (cs);
+		return;
+	}
+
+	ret = call_prepare (cs, GKM_RPC_CALL_G_Multiplex);
+	if (ret == CKR_OK && !gkm_rpc_message_write_ulong (cs->req, GKM_RPC_MULTIPLEX_VERSION))
+		ret = CKR_HOST_MEMORY;
+	if (ret == CKR_OK)
+		ret = call_run (cs);
+	if (ret == CKR_OK && (!gkm_rpc_message_read_ulong (cs->resp, &version) ||
+	                      version != GKM_RPC_MULTIPLEX_VERSION))
+		ret = CKR_DEVICE_ERROR;
+
+	if (ret == CKR_OK) {
+		mux = calloc (1, sizeof (CallMux));
+		if (mux == NULL) {
+			ret = CKR_HOST_MEMORY;
+		} else {
+			mux->refs = 1;
+			mux->socket = cs->socket;
+			mux->pid = getpid ();
+			pthread_mutex_init (&mux->write_mutex, NULL);
+			pthread_mutex_init (&mux->mutex, NULL);
+			pthread_cond_init (&mux->cond, NULL);
+			cs->socket = -1;
+			call_mux = mux;
+			call_mux_status = MUX_ACTIVE;
+			debug (("multiplexing calls over shared socket"));
+		}
+	}
+
+	/* Older daemons close the connection, stick with one call per socket */
+	if (ret != CKR_OK && ret != CKR_HOST_MEMORY)
+		call_mux_status = MUX_UNSUPPORTED;
+
+	call_destroy (cs);
+}
+
+/* Returns a reference to the shared connection, if there is one */
+static CallMux*
+call_mux_lookup (void)
+{
+	CallMux *mux = NULL;
+	int broken;
+
+	pthread_mutex_lock (&call_mux_mutex);
+
+		/* Start over if the daemon went away, or after a fork */
+		if (call_mux != NULL) {
+			pthread_mutex_lock (&call_mux->mutex);
+			broken = call_mux->broken;
+			pthread_mutex_unlock (&call_mux->mutex);
+			if (broken || call_mux->pid != getpid ()) {
+				call_mux_unref (call_mux);
+				call_mux = NULL;
+				call_mux_status = MUX_UNKNOWN;
+			}
+		}
+
+		if (call_mux_status == MUX_UNKNOWN)
+			call_mux_negotiate ();
+
+		if (call_mux != NULL)
+			mux = call_mux_ref (call_mux);
+
+	pthread_mutex_unlock (&call_mux_mutex);
+
+	return mux;
+}
+
+static void
+call_mux_reset (void)
+{
+	pthread_mutex_lock (&call_mux_mutex);
+
+		if (call_mux != NULL)
+			call_mux_unref (call_mux);
+		call_mux = NULL;
+		call_mux_status = MUX_UNKNOWN;
+
+	pthread_mutex_unlock (&call_mux_mutex);
+}
+
 static CK_RV
 call_lookup (CallState **ret)
 {
 	CallState *cs = NULL;
+	CallMux *mux;
 	CK_RV rv;
 
 	assert (ret);
 
+	mux = call_mux_lookup ();
+
 	pthread_mutex_lock (&call_state_mutex);
 
 		/* Pop one from the pool if possible */
@@ -323,23 +699,40 @@ call_lookup (CallState **ret)
 
 	pthread_mutex_unlock (&call_state_mutex);
 
+	/* A dedicated socket is of no use when multiplexing */
+	if (cs != NULL && mux != NULL && cs->socket != -1) {
+		call_destroy (cs);
+		cs = NULL;
+	}
+
 	if (cs == NULL) {
 		cs = calloc(1, sizeof (CallState));
-		if (cs == NULL)
+		if (cs == NULL) {
+			if (mux)
+				call_mux_unref (mux);
 			return CKR_HOST_MEMORY;
+		}
 		cs->socket = -1;
 		cs->call_status = CALL_INVALID;
+	}
+
+	if (mux != NULL) {
+		assert (cs->mux == NULL);
+		cs->mux = mux;
+		cs->call_status = CALL_READY;
 
-		/* Try to connect the call */
+	/* Try to connect the call */
+	} else if (cs->socket == -1) {
+		cs->call_status = CALL_INVALID;
 		rv = call_connect (cs);
 		if (rv != CKR_OK) {
-			free (cs);
+			call_destroy (cs);
 			return rv;
 		}
 	}
 
 	assert (cs->call_status == CALL_READY);
-	assert (cs->socket != -1);
+	assert (cs->socket != -1 || cs->mux != NULL);
 	assert (cs->next == NULL);
 	*ret = cs;
 	return CKR_OK;
@@ -489,30 +882,39 @@ call_send_recv (CallState *cs)
 	resp = cs->resp;
 	cs->req = cs->resp = NULL;
 
-	/* Send the number of bytes, and then the data */
-	egg_buffer_encode_uint32 (buf, req->buffer.len);
-	ret = call_write (cs, buf, 4);
-	if (ret != CKR_OK)
-		goto cleanup;
-	ret = call_write (cs, req->buffer.buf, req->buffer.len);
-	if (ret != CKR_OK)
-		goto cleanup;
+	/* Other calls may be in flight on a shared connection */
+	if (cs->mux) {
+		ret = call_mux_transact (cs->mux, req, resp);
+		if (ret != CKR_OK)
+			goto cleanup;
 
-	/* Now read out the number of bytes, and then the data */
-	ret = call_read (cs, buf, 4);
-	if (ret != CKR_OK)
-		goto cleanup;
-	len = egg_buffer_decode_uint32 (buf);
-	if (!egg_buffer_reserve (&resp->buffer, len + resp->buffer.len)) {
-		warning (("couldn't allocate %u byte response area: out of memory", len));
-		ret = CKR_HOST_MEMORY;
-		goto cleanup;
+	} else {
+		/* Send the number of bytes, and then the data */
+		egg_buffer_encode_uint32 (buf, req->buffer.len);
+		ret = call_write (cs, buf, 4);
+		if (ret != CKR_OK)
+			goto cleanup;
+		ret = call_write (cs, req->buffer.buf, req->buffer.len);
+		if (ret != CKR_OK)
+			goto cleanup;
+
+		/* Now read out the number of bytes, and then the data */
+		ret = call_read (cs, buf, 4);
+		if (ret != CKR_OK)
+			goto cleanup;
+		len = egg_buffer_decode_uint32 (buf);
+		if (!egg_buffer_reserve (&resp->buffer, len + resp->buffer.len)) {
+			warning (("couldn't allocate %u byte response area: out of memory", len));
+			ret = CKR_HOST_MEMORY;
+			goto cleanup;
+		}
+		ret = call_read (cs, resp->buffer.buf, len);
+		if (ret != CKR_OK)
+			goto cleanup;
+
+		egg_buffer_add_empty (&resp->buffer, len);
 	}
-	ret = call_read (cs, resp->buffer.buf, len);
-	if (ret != CKR_OK)
-		goto cleanup;
 
-	egg_buffer_add_empty (&resp->buffer, len);
 	if (!gkm_rpc_message_parse (resp, GKM_RPC_RESPONSE))
 		goto cleanup;
 
@@ -542,7 +944,7 @@ call_run (CallState *cs)
 	assert (cs);
 	assert (cs->req);
 	assert (cs->call_status == CALL_PREP);
-	assert (cs->socket != -1);
+	assert (cs->socket != -1 || cs->mux != NULL);
 
 	/* Did building the call fail? */
 	if (gkm_rpc_message_buffer_error (cs->req)) {
@@ -612,12 +1014,17 @@ call_done (CallState *cs, CK_RV ret)
 	}
 
 	/* Certain error codes cause us to discard the conenction */
-	if (ret != CKR_DEVICE_ERROR && ret != CKR_DEVICE_REMOVED && cs->socket != -1) {
+	if (ret != CKR_DEVICE_ERROR && ret != CKR_DEVICE_REMOVED &&
+	    (cs->socket != -1 || cs->mux != NULL)) {
 
 		/* Try and stash it away for later use */
 		pthread_mutex_lock (&call_state_mutex);
 
 			if (n_call_state_pool < MAX_CALL_STATE_POOL) {
+				/* The shared connection is looked up again on next use */
+				if (cs->mux)
+					call_mux_unref (cs->mux);
+				cs->mux = NULL;
 				cs->call_status = CALL_READY;
 				assert (cs->next == NULL);
 				cs->next = call_state_pool;
@@ -1285,6 +1692,9 @@ rpc_C_Finalize (CK_VOID_PTR reserved)
 			call_destroy (cs);
 		}
 
+		/* And the shared connection, the next process negotiates again */
+		call_mux_reset ();
+
 		/* This should stop all other calls in */
 		pkcs11_initialized = 0;
 		pkcs11_initialized_pid = 0;
@@ -110,6 +110,8 @@ enum {
 	GKM_RPC_CALL_C_SeedRandom,
 	GKM_RPC_CALL_C_GenerateRandom,
 
+	GKM_RPC_CALL_G_Multiplex,
+
 	GKM_RPC_CALL_MAX
 };
 
@@ -201,6 +203,7 @@ static const GkmRpcCall gkm_rpc_calls[] = {
 	{ GKM_RPC_CALL_C_DeriveKey,            "C_DeriveKey",            "uMuaA",   "u"                    },
 	{ GKM_RPC_CALL_C_SeedRandom,           "C_SeedRandom",           "uay",     ""                     },
 	{ GKM_RPC_CALL_C_GenerateRandom,       "C_GenerateRandom",       "ufy",     "ay"                   },
+	{ GKM_RPC_CALL_G_Multiplex,            "G_Multiplex",            "u",       "u"                    },
 };
 
 #ifdef _DEBUG
@@ -215,6 +218,19 @@ static const GkmRpcCall gkm_rpc_calls[] = {
 
 #define GKM_RPC_SOCKET_EXT 	"pkcs11"
 
+/*
+ * EXTENSION: A client may send G_Multiplex as the very first call on a
+ * connection. If the daemon answers with the same version, then every
+ * message after that has a request id right after the length, and the
+ * response with that request id may come back in any order:
+ *
+ *   uint32 length (of what follows), uint32 request id, message
+ *
+ * Daemons that don't know about this close the connection, and clients
+ * that never send it keep using one call at a time per connection.
+ */
+#define GKM_RPC_MULTIPLEX_VERSION 	1
+
 typedef enum _GkmRpcMessageType {
 	GKM_RPC_REQUEST = 1,
 	GKM_RPC_RESPONSE
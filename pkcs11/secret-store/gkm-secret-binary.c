@@ -35,6 +35,7 @@
 #include "egg/egg-symkey.h"
 #include "egg/egg-secure-memory.h"
 
+#include "gkm/gkm-crypto.h"
 #include "gkm/gkm-secret.h"
 
 #include <glib.h>
@@ -330,62 +331,33 @@ static gboolean
 encrypt_buffer (EggBuffer *buffer, GkmSecret *master,
 		guchar salt[8], int iterations)
 {
-	const gchar *password;
-	gcry_cipher_hd_t cih;
-	gcry_error_t gerr;
         guchar *key, *iv;
-	gsize n_password;
-	size_t pos;
+	gboolean ret;
 
 	g_assert (buffer->len % 16 == 0);
 	g_assert (16 == gcry_cipher_get_algo_blklen (GCRY_CIPHER_AES128));
 	g_assert (16 == gcry_cipher_get_algo_keylen (GCRY_CIPHER_AES128));
 
-	password = gkm_secret_get_password (master, &n_password);
-	if (!egg_symkey_generate_simple (GCRY_CIPHER_AES128, GCRY_MD_SHA256,
-	                                 password, n_password, salt, 8, iterations, &key, &iv))
+	if (!gkm_secret_derive_simple (master, GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+	                               salt, 8, iterations, &key, &iv))
 		return FALSE;
 
-	gerr = gcry_cipher_open (&cih, GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_CBC, 0);
-	if (gerr) {
-		g_warning ("couldn't create aes cipher context: %s",
-			   gcry_strerror (gerr));
-		egg_secure_free (key);
-		g_free (iv);
-		return FALSE;
-	}
+	/* In place encryption */
+	ret = gkm_crypto_cbc_transform (GCRY_CIPHER_AES128, key, iv, TRUE,
+	                                buffer->buf, buffer->buf, buffer->len);
 
-	/* 16 = 128 bits */
-	gerr = gcry_cipher_setkey (cih, key, 16);
-	g_return_val_if_fail (!gerr, FALSE);
 	egg_secure_free (key);
-
-	/* 16 = 128 bits */
-	gerr = gcry_cipher_setiv (cih, iv, 16);
-	g_return_val_if_fail (!gerr, FALSE);
 	g_free (iv);
 
-	for (pos = 0; pos < buffer->len; pos += 16) {
-		/* In place encryption */
-		gerr = gcry_cipher_encrypt (cih, buffer->buf + pos, 16, NULL, 0);
-		g_return_val_if_fail (!gerr, FALSE);
-	}
-
-	gcry_cipher_close (cih);
-
-	return TRUE;
+	return ret;
 }
 
 static gboolean
 decrypt_buffer (EggBuffer *buffer, GkmSecret *master,
 		guchar salt[8], int iterations)
 {
-	const gchar *password = NULL;
-	gcry_cipher_hd_t cih;
-	gcry_error_t gerr;
         guchar *key, *iv;
-        gsize n_password = 0;
-	size_t pos;
+	gboolean ret;
 
 	g_assert (buffer->len % 16 == 0);
 	g_assert (16 == gcry_cipher_get_algo_blklen (GCRY_CIPHER_AES128));
@@ -393,44 +365,23 @@ decrypt_buffer (EggBuffer *buffer, GkmSecret *master,
 
 	/* No password is set, try an null password */
 	if (master == NULL) {
-		password = NULL;
-		n_password = 0;
+		if (!egg_symkey_generate_simple (GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+		                                 NULL, 0, salt, 8, iterations, &key, &iv))
+			return FALSE;
 	} else {
-		password = gkm_secret_get_password (master, &n_password);
+		if (!gkm_secret_derive_simple (master, GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+		                               salt, 8, iterations, &key, &iv))
+			return FALSE;
 	}
 
-	if (!egg_symkey_generate_simple (GCRY_CIPHER_AES128, GCRY_MD_SHA256,
-	                                 password, n_password, salt, 8, iterations, &key, &iv))
-		return FALSE;
-
-	gerr = gcry_cipher_open (&cih, GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_CBC, 0);
-	if (gerr) {
-		g_warning ("couldn't create aes cipher context: %s",
-			   gcry_strerror (gerr));
-		egg_secure_free (key);
-		g_free (iv);
-		return FALSE;
-	}
+	/* In place decryption */
+	ret = gkm_crypto_cbc_transform (GCRY_CIPHER_AES128, key, iv, FALSE,
+	                                buffer->buf, buffer->buf, buffer->len);
 
-	/* 16 = 128 bits */
-	gerr = gcry_cipher_setkey (cih, key, 16);
-	g_return_val_if_fail (!gerr, FALSE);
 	egg_secure_free (key);
-
-	/* 16 = 128 bits */
-	gerr = gcry_cipher_setiv (cih, iv, 16);
-	g_return_val_if_fail (!gerr, FALSE);
 	g_free (iv);
 
-	for (pos = 0; pos < buffer->len; pos += 16) {
-		/* In place encryption */
-		gerr = gcry_cipher_decrypt (cih, buffer->buf + pos, 16, NULL, 0);
-		g_return_val_if_fail (!gerr, FALSE);
-	}
-
-	gcry_cipher_close (cih);
-
-	return TRUE;
+	return ret;
 }
 
 static gboolean
@@ -473,18 +424,48 @@ generate_acl_data (EggBuffer *buffer, GList *acl)
 }
 
 static gboolean
-generate_encrypted_data (EggBuffer *buffer, GkmSecretCollection *collection,
-                         GkmSecretData *data)
+generate_item_data (EggBuffer *buffer, GkmSecretItem *item, GkmSecretData *data)
 {
-	GkmSecretObject *obj;
-	GkmSecretItem *item;
-	GList *items, *l;
+	GkmSecretObject *obj = GKM_SECRET_OBJECT (item);
 	GHashTable *attributes;
 	const gchar *label;
 	GkmSecret *secret;
 	GList *acl;
 	int i;
 
+	label = gkm_secret_object_get_label (obj);
+	buffer_add_utf8_string (buffer, label);
+
+	secret = gkm_secret_data_get_secret (data, gkm_secret_object_get_identifier (obj));
+	buffer_add_secret (buffer, secret);
+
+	if (!buffer_add_time (buffer, gkm_secret_object_get_created (obj)) ||
+	    !buffer_add_time (buffer, gkm_secret_object_get_modified (obj)))
+		return FALSE;
+
+	/* reserved: */
+	if (!buffer_add_utf8_string (buffer, NULL))
+		return FALSE;
+	for (i = 0; i < 4; i++)
+		egg_buffer_add_uint32 (buffer, 0);
+
+	attributes = gkm_secret_item_get_fields (item);
+	if (!buffer_add_attributes (buffer, attributes, FALSE))
+		return FALSE;
+
+	acl = g_object_get_data (G_OBJECT (item), "compat-acl");
+	if (!generate_acl_data (buffer, acl))
+		return FALSE;
+
+	return !egg_buffer_has_error (buffer);
+}
+
+static gboolean
+generate_encrypted_data (EggBuffer *buffer, GkmSecretCollection *collection,
+                         GkmSecretData *data)
+{
+	GList *items, *l;
+
 	g_assert (buffer);
 	g_assert (GKM_IS_SECRET_COLLECTION (collection));
 	g_assert (GKM_IS_SECRET_DATA (data));
@@ -494,31 +475,7 @@ generate_encrypted_data (EggBuffer *buffer, GkmSecretCollection *collection,
 
 	items = gkm_secret_collection_get_items (collection);
 	for (l = items; l && !egg_buffer_has_error(buffer); l = g_list_next (l)) {
-		item = GKM_SECRET_ITEM (l->data);
-		obj = GKM_SECRET_OBJECT (l->data);
-
-		label = gkm_secret_object_get_label (obj);
-		buffer_add_utf8_string (buffer, label);
-
-		secret = gkm_secret_data_get_secret (data, gkm_secret_object_get_identifier (obj));
-		buffer_add_secret (buffer, secret);
-
-		if (!buffer_add_time (buffer, gkm_secret_object_get_created (obj)) ||
-		    !buffer_add_time (buffer, gkm_secret_object_get_modified (obj)))
-			break;
-
-		/* reserved: */
-		if (!buffer_add_utf8_string (buffer, NULL))
-			break;
-		for (i = 0; i < 4; i++)
-			egg_buffer_add_uint32 (buffer, 0);
-
-		attributes = gkm_secret_item_get_fields (item);
-		if (!buffer_add_attributes (buffer, attributes, FALSE))
-			break;
-
-		acl = g_object_get_data (G_OBJECT (item), "compat-acl");
-		if (!generate_acl_data (buffer, acl))
+		if (!generate_item_data (buffer, GKM_SECRET_ITEM (l->data), data))
 			break;
 	}
 
@@ -529,33 +486,38 @@ generate_encrypted_data (EggBuffer *buffer, GkmSecretCollection *collection,
 }
 
 static gboolean
-generate_hashed_items (GkmSecretCollection *collection, EggBuffer *buffer)
+generate_hashed_item (EggBuffer *buffer, GkmSecretItem *item)
 {
 	GHashTable *attributes;
 	const gchar *value;
-	GList *items, *l;
 	guint32 id, type;
 
-	items = gkm_secret_collection_get_items (collection);
-	egg_buffer_add_uint32 (buffer, g_list_length (items));
+	value = gkm_secret_object_get_identifier (GKM_SECRET_OBJECT (item));
+	if (!convert_to_integer (value, &id)) {
+		g_warning ("trying to save a non-numeric item identifier '%s' into "
+		           "the keyring file format which only supports numeric.", value);
+		return FALSE;
+	}
+	egg_buffer_add_uint32 (buffer, id);
 
-	for (l = items; l; l = g_list_next (l)) {
+	value = gkm_secret_item_get_schema (item);
+	type = gkm_secret_compat_parse_item_type (value);
+	egg_buffer_add_uint32 (buffer, type);
 
-		value = gkm_secret_object_get_identifier (l->data);
-		if (!convert_to_integer (value, &id)) {
-			g_warning ("trying to save a non-numeric item identifier '%s' into "
-			           "the keyring file format which only supports numeric.", value);
-			continue;
-		}
-		egg_buffer_add_uint32 (buffer, id);
+	attributes = gkm_secret_item_get_fields (item);
+	return buffer_add_attributes (buffer, attributes, TRUE);
+}
 
-		value = gkm_secret_item_get_schema (l->data);
-		type = gkm_secret_compat_parse_item_type (value);
-		egg_buffer_add_uint32 (buffer, type);
+static gboolean
+generate_hashed_items (GkmSecretCollection *collection, EggBuffer *buffer)
+{
+	GList *items, *l;
 
-		attributes = gkm_secret_item_get_fields (l->data);
-		buffer_add_attributes (buffer, attributes, TRUE);
-	}
+	items = gkm_secret_collection_get_items (collection);
+	egg_buffer_add_uint32 (buffer, g_list_length (items));
+
+	for (l = items; l; l = g_list_next (l))
+		generate_hashed_item (buffer, l->data);
 
 	g_list_free (items);
 	return !egg_buffer_has_error (buffer);
@@ -583,11 +545,23 @@ gkm_secret_binary_write (GkmSecretCollection *collection, GkmSecretData *sdata,
 
 	obj = GKM_SECRET_OBJECT (collection);
 
+	/* If no master password is set, we shouldn't be writing binary... */
+	master = gkm_secret_data_get_master (sdata);
+	g_return_val_if_fail (master, GKM_DATA_FAILURE);
+
 	egg_buffer_init_full (&buffer, 256, g_realloc);
 
-	/* Prepare the keyring for encryption */
-	hash_iterations = g_random_int_range (1000, 4096);
-	gcry_create_nonce (salt, sizeof (salt));
+	/*
+	 * Prepare the keyring for encryption. Reuse the salt of a key we've
+	 * already derived, so that saving doesn't derive the key again. The
+	 * digest at the start of the encrypted data differs when anything
+	 * else does, so the derived IV being the same doesn't matter.
+	 */
+	if (!gkm_secret_lookup_derived (master, GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+	                                salt, sizeof (salt), &hash_iterations)) {
+		hash_iterations = g_random_int_range (1000, 4096);
+		gcry_create_nonce (salt, sizeof (salt));
+	}
 
 	egg_buffer_append (&buffer, (guchar*)KEYRING_FILE_HEADER, KEYRING_FILE_HEADER_LEN);
 	egg_buffer_add_byte (&buffer, 0); /* Major version */
@@ -640,10 +614,6 @@ gkm_secret_binary_write (GkmSecretCollection *collection, GkmSecretData *sdata,
 			     (guchar*)to_encrypt.buf + 16, to_encrypt.len - 16);
 	memcpy (to_encrypt.buf, digest, 16);
 
-	/* If no master password is set, we shouldn't be writing binary... */
-	master = gkm_secret_data_get_master (sdata);
-	g_return_val_if_fail (master, GKM_DATA_FAILURE);
-
 	if (!encrypt_buffer (&to_encrypt, master, salt, hash_iterations)) {
 		egg_buffer_uninit (&buffer);
 		egg_buffer_uninit (&to_encrypt);
@@ -995,3 +965,349 @@ bail:
 
 	return res;
 }
+
+/* -----------------------------------------------------------------------------
+ * JOURNAL
+ *
+ * A journal sits next to a binary keyring file, and records changes to
+ * individual items since that file was written. The header ties it to the
+ * exact keyring file contents, so that a journal left behind after the
+ * keyring was rewritten is never replayed.
+ *
+ * Each entry is length prefixed, and ends in a digest of itself, so that
+ * a partially written entry at the end (ie: after a crash) is ignored.
+ * The parts of an item that are encrypted in the keyring file are also
+ * encrypted in the journal, with a key derived from the master password
+ * and the journal salt, and a random IV for each entry.
+ */
+
+#define JOURNAL_FILE_HEADER "GnomeKeyringJnl\n"
+#define JOURNAL_FILE_HEADER_LEN 16
+
+/* Magic, version, reserved, keyring digest, salt, iterations */
+#define JOURNAL_HEADER_LEN GKM_SECRET_BINARY_JOURNAL_HEADER_LEN
+
+enum {
+	JOURNAL_PUT_ITEM = 1,
+	JOURNAL_REMOVE_ITEM = 2,
+};
+
+static gboolean
+crypt_journal_buffer (EggBuffer *buffer, GkmSecret *master, const guchar salt[8],
+                      int iterations, const guchar iv[16], gboolean encrypt)
+{
+	gboolean ret;
+	guchar *key;
+
+	g_assert (buffer->len % 16 == 0);
+
+	if (master == NULL) {
+		if (!egg_symkey_generate_simple (GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+		                                 NULL, 0, salt, 8, iterations, &key, NULL))
+			return FALSE;
+	} else {
+		if (!gkm_secret_derive_simple (master, GCRY_CIPHER_AES128, GCRY_MD_SHA256,
+		                               salt, 8, iterations, &key, NULL))
+			return FALSE;
+	}
+
+	/* Each entry has its own IV, rather than the derived one */
+	ret = gkm_crypto_cbc_transform (GCRY_CIPHER_AES128, key, iv, encrypt,
+	                                buffer->buf, buffer->buf, buffer->len);
+
+	egg_secure_free (key);
+	return ret;
+}
+
+static gboolean
+parse_journal_header (gconstpointer journal, gsize n_journal, gconstpointer keyring,
+                      gsize n_keyring, guchar salt[8], guint32 *iterations)
+{
+	guchar digest[16];
+	EggBuffer buffer;
+	gsize offset;
+	gboolean ret;
+
+	egg_buffer_init_static (&buffer, journal, n_journal);
+
+	if (buffer.len < JOURNAL_HEADER_LEN ||
+	    memcmp (buffer.buf, JOURNAL_FILE_HEADER, JOURNAL_FILE_HEADER_LEN) != 0)
+		return FALSE;
+
+	/* Version, and reserved */
+	offset = JOURNAL_FILE_HEADER_LEN;
+	if (buffer.buf[offset] != 0)
+		return FALSE;
+	offset += 4;
+
+	/* Must be for exactly this keyring file */
+	gcry_md_hash_buffer (GCRY_MD_MD5, digest, keyring, n_keyring);
+	if (memcmp (buffer.buf + offset, digest, 16) != 0)
+		return FALSE;
+	offset += 16;
+
+	ret = buffer_get_bytes (&buffer, offset, &offset, salt, 8) &&
+	      egg_buffer_get_uint32 (&buffer, offset, &offset, iterations);
+
+	egg_buffer_uninit (&buffer);
+	return ret;
+}
+
+GkmDataResult
+gkm_secret_binary_journal_start (gconstpointer keyring, gsize n_keyring,
+                                 gpointer *header, gsize *n_header)
+{
+	guchar digest[16];
+	guchar salt[8];
+	EggBuffer buffer;
+	int i;
+
+	g_return_val_if_fail (keyring != NULL, GKM_DATA_FAILURE);
+	g_return_val_if_fail (header && n_header, GKM_DATA_FAILURE);
+
+	egg_buffer_init_full (&buffer, JOURNAL_HEADER_LEN, g_realloc);
+
+	egg_buffer_append (&buffer, (guchar*)JOURNAL_FILE_HEADER, JOURNAL_FILE_HEADER_LEN);
+	egg_buffer_add_byte (&buffer, 0); /* Version */
+	for (i = 0; i < 3; i++)
+		egg_buffer_add_byte (&buffer, 0); /* Reserved */
+
+	gcry_md_hash_buffer (GCRY_MD_MD5, digest, keyring, n_keyring);
+	egg_buffer_append (&buffer, digest, 16);
+
+	gcry_create_nonce (salt, sizeof (salt));
+	egg_buffer_append (&buffer, salt, 8);
+	egg_buffer_add_uint32 (&buffer, g_random_int_range (1000, 4096));
+
+	if (egg_buffer_has_error (&buffer)) {
+		egg_buffer_uninit (&buffer);
+		return GKM_DATA_FAILURE;
+	}
+
+	*header = egg_buffer_uninit_steal (&buffer, n_header);
+	return GKM_DATA_SUCCESS;
+}
+
+GkmDataResult
+gkm_secret_binary_journal_append (GkmSecretCollection *collection, GkmSecretData *sdata,
+                                  gconstpointer header, gsize n_header,
+                                  const gchar *identifier, gpointer *entry, gsize *n_entry)
+{
+	EggBuffer to_encrypt;
+	GkmSecretItem *item;
+	EggBuffer buffer;
+	GkmSecret *master;
+	guint32 iterations;
+	guchar digest[16];
+	guchar salt[8];
+	guchar iv[16];
+	guint32 id;
+
+	g_return_val_if_fail (GKM_IS_SECRET_COLLECTION (collection), GKM_DATA_FAILURE);
+	g_return_val_if_fail (GKM_IS_SECRET_DATA (sdata), GKM_DATA_LOCKED);
+	g_return_val_if_fail (header != NULL, GKM_DATA_FAILURE);
+	g_return_val_if_fail (identifier != NULL, GKM_DATA_FAILURE);
+	g_return_val_if_fail (entry && n_entry, GKM_DATA_FAILURE);
+
+	/* Only the items with numeric identifiers can be stored */
+	if (!convert_to_integer (identifier, &id))
+		return GKM_DATA_UNRECOGNIZED;
+
+	if (n_header < JOURNAL_HEADER_LEN ||
+	    memcmp (header, JOURNAL_FILE_HEADER, JOURNAL_FILE_HEADER_LEN) != 0)
+		return GKM_DATA_UNRECOGNIZED;
+	memcpy (salt, (guchar *)header + JOURNAL_HEADER_LEN - 12, 8);
+	iterations = egg_buffer_decode_uint32 ((guchar *)header + JOURNAL_HEADER_LEN - 4);
+
+	master = gkm_secret_data_get_master (sdata);
+	g_return_val_if_fail (master, GKM_DATA_FAILURE);
+
+	egg_buffer_init_full (&buffer, 256, g_realloc);
+	egg_buffer_add_uint32 (&buffer, 0); /* Space for length */
+
+	item = gkm_secret_collection_get_item (collection, identifier);
+	egg_buffer_add_byte (&buffer, item ? JOURNAL_PUT_ITEM : JOURNAL_REMOVE_ITEM);
+	buffer_add_time (&buffer, gkm_secret_object_get_modified (GKM_SECRET_OBJECT (collection)));
+
+	if (item == NULL) {
+		egg_buffer_add_uint32 (&buffer, id);
+
+	} else {
+		if (!generate_hashed_item (&buffer, item)) {
+			egg_buffer_uninit (&buffer);
+			return GKM_DATA_FAILURE;
+		}
+
+		/* Encrypted data. Use non-pageable memory */
+		egg_buffer_init_full (&to_encrypt, 1024, egg_secure_realloc);
+		egg_buffer_append (&to_encrypt, (guchar*)digest, 16); /* Space for hash */
+
+		if (!generate_item_data (&to_encrypt, item, sdata)) {
+			egg_buffer_uninit (&to_encrypt);
+			egg_buffer_uninit (&buffer);
+			return GKM_DATA_FAILURE;
+		}
+
+		/* Pad with zeros to multiple of 16 bytes */
+		while (to_encrypt.len % 16 != 0)
+			egg_buffer_add_byte (&to_encrypt, 0);
+
+		gcry_md_hash_buffer (GCRY_MD_MD5, (void*)digest,
+		                     (guchar*)to_encrypt.buf + 16, to_encrypt.len - 16);
+		memcpy (to_encrypt.buf, digest, 16);
+
+		gcry_create_nonce (iv, sizeof (iv));
+		if (!crypt_journal_buffer (&to_encrypt, master, salt, iterations, iv, TRUE)) {
+			egg_buffer_uninit (&to_encrypt);
+			egg_buffer_uninit (&buffer);
+			return GKM_DATA_FAILURE;
+		}
+
+		egg_buffer_append (&buffer, iv, 16);
+		egg_buffer_add_uint32 (&buffer, to_encrypt.len);
+		egg_buffer_append (&buffer, to_encrypt.buf, to_encrypt.len);
+		egg_buffer_uninit (&to_encrypt);
+	}
+
+	/* Digest of the entry, so a partially written one can be detected */
+	gcry_md_hash_buffer (GCRY_MD_MD5, (void*)digest,
+	                     (guchar*)buffer.buf + 4, buffer.len - 4);
+	egg_buffer_append (&buffer, digest, 16);
+
+	if (egg_buffer_has_error (&buffer)) {
+		egg_buffer_uninit (&buffer);
+		return GKM_DATA_FAILURE;
+	}
+
+	egg_buffer_set_uint32 (&buffer, 0, buffer.len - 4);
+	*entry = egg_buffer_uninit_steal (&buffer, n_entry);
+
+	return GKM_DATA_SUCCESS;
+}
+
+static GkmDataResult
+replay_journal_entry (GkmSecretCollection *collection, GkmSecretData *sdata,
+                      EggBuffer *buffer, gsize offset, const guchar salt[8],
+                      guint32 iterations)
+{
+	EggBuffer to_decrypt = EGG_BUFFER_EMPTY;
+	GkmDataResult res = GKM_DATA_FAILURE;
+	GkmSecretItem *item;
+	ItemInfo info;
+	guint32 crypto_size;
+	guchar iv[16];
+	time_t mtime;
+	gsize n_inner;
+	guchar op;
+
+	memset (&info, 0, sizeof (info));
+
+	if (!egg_buffer_get_byte (buffer, offset, &offset, &op) ||
+	    !buffer_get_time (buffer, offset, &offset, &mtime))
+		return GKM_DATA_FAILURE;
+
+	if (op == JOURNAL_REMOVE_ITEM) {
+		if (!egg_buffer_get_uint32 (buffer, offset, &offset, &info.id))
+			return GKM_DATA_FAILURE;
+		info.identifier = g_strdup_printf ("%u", info.id);
+		item = gkm_secret_collection_get_item (collection, info.identifier);
+		if (item != NULL)
+			gkm_secret_collection_remove_item (collection, item);
+		gkm_secret_object_set_modified (GKM_SECRET_OBJECT (collection), mtime);
+		g_free (info.identifier);
+		return GKM_DATA_SUCCESS;
+
+	} else if (op != JOURNAL_PUT_ITEM) {
+		return GKM_DATA_UNRECOGNIZED;
+	}
+
+	if (!read_hashed_item_info (buffer, &offset, &info, 1) ||
+	    !buffer_get_bytes (buffer, offset, &offset, iv, 16) ||
+	    !egg_buffer_get_uint32 (buffer, offset, &offset, &crypto_size) ||
+	    crypto_size % 16 != 0 || crypto_size < 16 ||
+	    buffer->len < offset + crypto_size)
+		goto bail;
+
+	if (sdata != NULL) {
+		/* Copy the data into to_decrypt into non-pageable memory */
+		egg_buffer_set_allocator (&to_decrypt, egg_secure_realloc);
+		egg_buffer_reserve (&to_decrypt, crypto_size);
+		memcpy (to_decrypt.buf, buffer->buf + offset, crypto_size);
+		to_decrypt.len = crypto_size;
+
+		if (!crypt_journal_buffer (&to_decrypt, gkm_secret_data_get_master (sdata),
+		                           salt, iterations, iv, FALSE))
+			goto bail;
+		if (!verify_decrypted_buffer (&to_decrypt)) {
+			res = GKM_DATA_LOCKED;
+			goto bail;
+		}
+
+		n_inner = 16; /* Skip hash */
+		if (!read_full_item_info (&to_decrypt, &n_inner, &info, 1))
+			goto bail;
+	}
+
+	item = gkm_secret_collection_get_item (collection, info.identifier);
+	if (item == NULL)
+		item = gkm_secret_collection_new_item (collection, info.identifier);
+	setup_item_from_info (item, sdata, &info);
+	gkm_secret_object_set_modified (GKM_SECRET_OBJECT (collection), mtime);
+	res = GKM_DATA_SUCCESS;
+
+bail:
+	egg_buffer_uninit (&to_decrypt);
+	free_item_info (&info);
+	return res;
+}
+
+GkmDataResult
+gkm_secret_binary_journal_replay (GkmSecretCollection *collection, GkmSecretData *sdata,
+                                  gconstpointer keyring, gsize n_keyring,
+                                  gconstpointer journal, gsize n_journal,
+                                  gsize *n_valid)
+{
+	GkmDataResult res = GKM_DATA_SUCCESS;
+	EggBuffer buffer;
+	guint32 iterations;
+	guchar digest[16];
+	guchar salt[8];
+	guint32 length;
+	gsize offset;
+
+	g_return_val_if_fail (GKM_IS_SECRET_COLLECTION (collection), GKM_DATA_FAILURE);
+	g_return_val_if_fail (keyring != NULL, GKM_DATA_FAILURE);
+	g_return_val_if_fail (journal != NULL, GKM_DATA_FAILURE);
+	g_return_val_if_fail (n_valid != NULL, GKM_DATA_FAILURE);
+
+	*n_valid = 0;
+
+	/* Left over from a previous keyring file, or not a journal at all */
+	if (!parse_journal_header (journal, n_journal, keyring, n_keyring, salt, &iterations))
+		return GKM_DATA_UNRECOGNIZED;
+
+	egg_buffer_init_static (&buffer, journal, n_journal);
+	offset = JOURNAL_HEADER_LEN;
+	*n_valid = offset;
+
+	while (offset < buffer.len) {
+
+		/* Stop at an entry that was not completely written */
+		if (!egg_buffer_get_uint32 (&buffer, offset, &offset, &length) ||
+		    length < 16 || length > buffer.len - offset)
+			break;
+		gcry_md_hash_buffer (GCRY_MD_MD5, digest, buffer.buf + offset, length - 16);
+		if (memcmp (digest, buffer.buf + offset + length - 16, 16) != 0)
+			break;
+
+		res = replay_journal_entry (collection, sdata, &buffer, offset, salt, iterations);
+		if (res != GKM_DATA_SUCCESS)
+			break;
+
+		offset += length;
+		*n_valid = offset;
+	}
+
+	egg_buffer_uninit (&buffer);
+	return res;
+}
@@ -26,6 +26,8 @@
 #include "gkm/gkm-data-types.h"
 #include "gkm/gkm-types.h"
 
+#define GKM_SECRET_BINARY_JOURNAL_HEADER_LEN   (16 + 4 + 16 + 8 + 4)
+
 GkmDataResult          gkm_secret_binary_read        (GkmSecretCollection *collection,
                                                       GkmSecretData *sdata,
                                                       gconstpointer data,
@@ -36,4 +38,25 @@ GkmDataResult          gkm_secret_binary_write       (GkmSecretCollection *colle
                                                       gpointer *data,
                                                       gsize *n_data);
 
+GkmDataResult          gkm_secret_binary_journal_start   (gconstpointer keyring,
+                                                          gsize n_keyring,
+                                                          gpointer *header,
+                                                          gsize *n_header);
+
+GkmDataResult          gkm_secret_binary_journal_append  (GkmSecretCollection *collection,
+                                                          GkmSecretData *sdata,
+                                                          gconstpointer header,
+                                                          gsize n_header,
+                                                          const gchar *identifier,
+                                                          gpointer *entry,
+                                                          gsize *n_entry);
+
+GkmDataResult          gkm_secret_binary_journal_replay  (GkmSecretCollection *collection,
+                                                          GkmSecretData *sdata,
+                                                          gconstpointer keyring,
+                                                          gsize n_keyring,
+                                                          gconstpointer journal,
+                                                          gsize n_journal,
+                                                          gsize *n_valid);
+
 #endif /* __GKM_SECRET_BINARY_H__ */
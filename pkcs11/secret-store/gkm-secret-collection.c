@@ -32,9 +32,16 @@
 #include "gkm/gkm-credential.h"
 #include "gkm/gkm-secret.h"
 #include "gkm/gkm-session.h"
+#include "gkm/gkm-timer.h"
 #include "gkm/gkm-transaction.h"
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "pkcs11/pkcs11i.h"
 
@@ -50,8 +57,21 @@ struct _GkmSecretCollection {
 	gchar *filename;
 	guint32 watermark;
 	GArray *template;
+
+	/* Item changes since the keyring file was written */
+	gboolean journal;
+	GBytes *journal_header;
+	gsize journal_length;
+	gsize keyring_size;
+	GkmTimer *compact_timer;
 };
 
+/* Write out the whole keyring after this many seconds without changes */
+#define JOURNAL_COMPACT_IDLE 30
+
+/* Or once the journal grows beyond the keyring file, or this many bytes */
+#define JOURNAL_COMPACT_SIZE (16 * 1024)
+
 G_DEFINE_TYPE (GkmSecretCollection, gkm_secret_collection, GKM_TYPE_SECRET_OBJECT);
 
 /* Forward declarations */
@@ -62,6 +82,85 @@ static void remove_item (GkmSecretCollection *, GkmTransaction *, GkmSecretItem
  * INTERNAL
  */
 
+static gchar*
+journal_filename (GkmSecretCollection *self)
+{
+	return g_strconcat (self->filename, ".journal", NULL);
+}
+
+static void
+journal_reset (GkmSecretCollection *self, gconstpointer keyring, gsize n_keyring)
+{
+	gpointer header;
+	gsize n_header;
+
+	if (self->journal_header)
+		g_bytes_unref (self->journal_header);
+	self->journal_header = NULL;
+	self->journal_length = 0;
+	self->keyring_size = n_keyring;
+
+	/* Only encrypted keyrings can have a journal */
+	if (keyring != NULL &&
+	    gkm_secret_binary_journal_start (keyring, n_keyring, &header, &n_header) == GKM_DATA_SUCCESS)
+		self->journal_header = g_bytes_new_take (header, n_header);
+}
+
+static GkmDataResult
+load_journal (GkmSecretCollection *self, GkmSecretData *sdata, const gchar *path,
+              gconstpointer keyring, gsize n_keyring)
+{
+	GkmDataResult res;
+	GError *error = NULL;
+	gchar *filename;
+	guchar *data;
+	gsize n_data;
+	gsize n_valid;
+
+	journal_reset (self, keyring, n_keyring);
+
+	filename = g_strconcat (path, ".journal", NULL);
+	if (!g_file_get_contents (filename, (gchar**)&data, &n_data, &error)) {
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_message ("problem reading keyring journal: %s: %s",
+			           filename, egg_error_message (error));
+		g_clear_error (&error);
+		g_free (filename);
+		return GKM_DATA_SUCCESS;
+	}
+
+	res = gkm_secret_binary_journal_replay (self, sdata, keyring, n_keyring,
+	                                        data, n_data, &n_valid);
+
+	switch (res) {
+	case GKM_DATA_SUCCESS:
+		/* Anything after n_valid was a partial write, and is overwritten */
+		g_bytes_unref (self->journal_header);
+		self->journal_header = g_bytes_new (data, GKM_SECRET_BINARY_JOURNAL_HEADER_LEN);
+		self->journal_length = n_valid;
+		break;
+	case GKM_DATA_UNRECOGNIZED:
+		/* Left over from before the keyring was last written */
+		g_message ("ignoring stale keyring journal: %s", filename);
+		res = GKM_DATA_SUCCESS;
+		break;
+	case GKM_DATA_FAILURE:
+		g_message ("ignoring invalid keyring journal entries: %s", filename);
+		g_bytes_unref (self->journal_header);
+		self->journal_header = g_bytes_new (data, GKM_SECRET_BINARY_JOURNAL_HEADER_LEN);
+		self->journal_length = n_valid;
+		res = GKM_DATA_SUCCESS;
+		break;
+	case GKM_DATA_LOCKED:
+	default:
+		break;
+	}
+
+	g_free (filename);
+	g_free (data);
+	return res;
+}
+
 static GkmDataResult
 load_collection_and_secret_data (GkmSecretCollection *self, GkmSecretData *sdata,
                                  const gchar *path)
@@ -81,14 +180,140 @@ load_collection_and_secret_data (GkmSecretCollection *self, GkmSecretData *sdata
 
 	/* Try to load from an encrypted file, and otherwise plain text */
 	res = gkm_secret_binary_read (self, sdata, data, n_data);
-	if (res == GKM_DATA_UNRECOGNIZED)
+	if (res == GKM_DATA_SUCCESS) {
+		res = load_journal (self, sdata, path, data, n_data);
+
+	} else if (res == GKM_DATA_UNRECOGNIZED) {
 		res = gkm_secret_textual_read (self, sdata, data, n_data);
+		journal_reset (self, NULL, n_data);
+	}
 
 	g_free (data);
 
 	return res;
 }
 
+static void
+on_compact_timeout (GkmTimer *timer, gpointer user_data)
+{
+	GkmSecretCollection *self = GKM_SECRET_COLLECTION (user_data);
+	GkmTransaction *transaction;
+
+	g_return_if_fail (self->compact_timer == timer);
+	self->compact_timer = NULL;
+
+	/* Nothing to fold in, or we can't write the keyring any more */
+	if (self->journal_length == 0 || self->sdata == NULL)
+		return;
+
+	transaction = gkm_transaction_new ();
+	gkm_secret_collection_save (self, transaction);
+	if (gkm_transaction_complete_and_unref (transaction) != CKR_OK)
+		g_message ("couldn't compact keyring journal: %s", self->filename);
+}
+
+static void
+schedule_compact (GkmSecretCollection *self)
+{
+	if (self->compact_timer)
+		gkm_timer_cancel (self->compact_timer);
+	self->compact_timer = gkm_timer_start (gkm_object_get_module (GKM_OBJECT (self)),
+	                                       JOURNAL_COMPACT_IDLE, on_compact_timeout, self);
+}
+
+typedef struct {
+	GBytes *header;
+	gsize keyring_size;
+} JournalState;
+
+static gboolean
+complete_save (GkmTransaction *transaction, GObject *object, gpointer user_data)
+{
+	GkmSecretCollection *self = GKM_SECRET_COLLECTION (object);
+	JournalState *state = user_data;
+
+	/* The journal now starts over from the new keyring file */
+	if (!gkm_transaction_get_failed (transaction)) {
+		if (self->journal_header)
+			g_bytes_unref (self->journal_header);
+		self->journal_header = state->header;
+		self->journal_length = 0;
+		self->keyring_size = state->keyring_size;
+		state->header = NULL;
+	}
+
+	if (state->header)
+		g_bytes_unref (state->header);
+	g_slice_free (JournalState, state);
+	return TRUE;
+}
+
+static gboolean
+complete_append (GkmTransaction *transaction, GObject *object, gpointer user_data)
+{
+	GkmSecretCollection *self = GKM_SECRET_COLLECTION (object);
+	gsize length = GPOINTER_TO_SIZE (user_data);
+	gchar *filename;
+
+	/* Chop off the entry we appended, so it isn't replayed */
+	if (gkm_transaction_get_failed (transaction)) {
+		if (self->journal_length > 0) {
+			filename = journal_filename (self);
+			if (truncate (filename, self->journal_length) < 0)
+				g_warning ("couldn't roll back keyring journal: %s: %s",
+				           filename, g_strerror (errno));
+			g_free (filename);
+		}
+
+	} else {
+		self->journal_length = length;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+append_journal (GkmSecretCollection *self, const gchar *filename,
+                gconstpointer entry, gsize n_entry)
+{
+	const guchar *data = entry;
+	gssize res;
+	int errsv;
+	int fd;
+
+	fd = g_open (filename, O_WRONLY, 0);
+	if (fd < 0)
+		return FALSE;
+
+	/* Discard any partially written entry from before */
+	if (ftruncate (fd, self->journal_length) < 0 ||
+	    lseek (fd, self->journal_length, SEEK_SET) < 0)
+		goto failure;
+
+	while (n_entry > 0) {
+		res = write (fd, data, n_entry);
+		if (res < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			goto failure;
+		}
+		data += res;
+		n_entry -= res;
+	}
+
+	if (fsync (fd) < 0)
+		goto failure;
+
+	return close (fd) == 0;
+
+failure:
+	/* The caller reports the original error, not that of close() */
+	errsv = errno;
+	close (fd);
+	errno = errsv;
+	return FALSE;
+}
+
 static GkmCredential*
 lookup_unassociated_credential (GkmSession *session, CK_OBJECT_HANDLE handle)
 {
@@ -599,6 +824,10 @@ gkm_secret_collection_dispose (GObject *obj)
 	track_secret_data (self, NULL);
 	g_hash_table_remove_all (self->items);
 
+	if (self->compact_timer)
+		gkm_timer_cancel (self->compact_timer);
+	self->compact_timer = NULL;
+
 	G_OBJECT_CLASS (gkm_secret_collection_parent_class)->dispose (obj);
 }
 
@@ -615,6 +844,10 @@ gkm_secret_collection_finalize (GObject *obj)
 	g_free (self->filename);
 	self->filename = NULL;
 
+	if (self->journal_header)
+		g_bytes_unref (self->journal_header);
+	self->journal_header = NULL;
+
 	gkm_template_free (self->template);
 	self->template = NULL;
 
@@ -887,8 +1120,13 @@ gkm_secret_collection_load (GkmSecretCollection *self)
 void
 gkm_secret_collection_save (GkmSecretCollection *self, GkmTransaction *transaction)
 {
+	JournalState *state;
 	GkmSecret *master;
 	GkmDataResult res;
+	gboolean binary;
+	gpointer header;
+	gsize n_header;
+	gchar *filename;
 	gpointer data;
 	gsize n_data;
 
@@ -907,7 +1145,8 @@ gkm_secret_collection_save (GkmSecretCollection *self, GkmTransaction *transacti
 		return;
 
 	master = gkm_secret_data_get_master (self->sdata);
-	if (master == NULL || gkm_secret_equals (master, NULL, 0))
+	binary = !(master == NULL || gkm_secret_equals (master, NULL, 0));
+	if (!binary)
 		res = gkm_secret_textual_write (self, self->sdata, &data, &n_data);
 	else
 		res = gkm_secret_binary_write (self, self->sdata, &data, &n_data);
@@ -924,6 +1163,19 @@ gkm_secret_collection_save (GkmSecretCollection *self, GkmTransaction *transacti
 		break;
 	case GKM_DATA_SUCCESS:
 		gkm_transaction_write_file (transaction, self->filename, data, n_data);
+
+		/* Everything in the journal is now in the keyring file */
+		filename = journal_filename (self);
+		if (!gkm_transaction_get_failed (transaction))
+			gkm_transaction_remove_file (transaction, filename);
+		g_free (filename);
+
+		state = g_slice_new0 (JournalState);
+		state->keyring_size = n_data;
+		if (binary && gkm_secret_binary_journal_start (data, n_data, &header, &n_header) == GKM_DATA_SUCCESS)
+			state->header = g_bytes_new_take (header, n_header);
+		gkm_transaction_add (transaction, self, complete_save, state);
+
 		g_free (data);
 		break;
 	default:
@@ -931,16 +1183,115 @@ gkm_secret_collection_save (GkmSecretCollection *self, GkmTransaction *transacti
 	};
 }
 
+void
+gkm_secret_collection_save_item (GkmSecretCollection *self, GkmTransaction *transaction,
+                                 const gchar *identifier)
+{
+	GkmDataResult res;
+	gconstpointer header;
+	gsize n_header;
+	gchar *filename;
+	gpointer entry;
+	gsize n_entry;
+	gpointer data;
+	gsize n_data = 0;
+
+	g_return_if_fail (GKM_IS_SECRET_COLLECTION (self));
+	g_return_if_fail (GKM_IS_TRANSACTION (transaction));
+	g_return_if_fail (!gkm_transaction_get_failed (transaction));
+	g_return_if_fail (identifier != NULL);
+
+	/* Only need to journal when the whole keyring is expensive to write */
+	if (!self->journal || !self->journal_header || !self->sdata || !self->filename ||
+	    self->journal_length > MAX (JOURNAL_COMPACT_SIZE, self->keyring_size)) {
+		gkm_secret_collection_save (self, transaction);
+		return;
+	}
+
+	header = g_bytes_get_data (self->journal_header, &n_header);
+	res = gkm_secret_binary_journal_append (self, self->sdata, header, n_header,
+	                                        identifier, &entry, &n_entry);
+
+	switch (res) {
+	case GKM_DATA_SUCCESS:
+		break;
+	case GKM_DATA_UNRECOGNIZED:
+		/* Not something that can go in a journal entry */
+		gkm_secret_collection_save (self, transaction);
+		return;
+	case GKM_DATA_FAILURE:
+	case GKM_DATA_LOCKED:
+		g_warning ("couldn't prepare to write out keyring journal: %s", self->filename);
+		gkm_transaction_fail (transaction, CKR_GENERAL_ERROR);
+		return;
+	default:
+		g_assert_not_reached ();
+	}
+
+	filename = journal_filename (self);
+
+	/* A new journal is written in one go, along with its header */
+	if (self->journal_length == 0) {
+		n_data = n_header + n_entry;
+		data = g_malloc (n_data);
+		memcpy (data, header, n_header);
+		memcpy ((guchar *)data + n_header, entry, n_entry);
+		gkm_transaction_write_file (transaction, filename, data, n_data);
+		g_free (data);
+
+	} else if (append_journal (self, filename, entry, n_entry)) {
+		n_data = self->journal_length + n_entry;
+
+	/* Write the whole keyring instead, which starts a new journal */
+	} else {
+		g_message ("couldn't append to keyring journal: %s: %s",
+		           filename, g_strerror (errno));
+		gkm_secret_collection_save (self, transaction);
+		g_free (filename);
+		g_free (entry);
+		return;
+	}
+
+	if (!gkm_transaction_get_failed (transaction)) {
+		gkm_transaction_add (transaction, self, complete_append, GSIZE_TO_POINTER (n_data));
+		schedule_compact (self);
+	}
+
+	g_free (filename);
+	g_free (entry);
+}
+
 void
 gkm_secret_collection_destroy (GkmSecretCollection *self, GkmTransaction *transaction)
 {
+	gchar *filename;
+
 	g_return_if_fail (GKM_IS_SECRET_COLLECTION (self));
 	g_return_if_fail (GKM_IS_TRANSACTION (transaction));
 	g_return_if_fail (!gkm_transaction_get_failed (transaction));
 
 	gkm_object_expose_full (GKM_OBJECT (self), transaction, FALSE);
-	if (self->filename)
+	if (self->filename) {
+		filename = journal_filename (self);
 		gkm_transaction_remove_file (transaction, self->filename);
+		if (!gkm_transaction_get_failed (transaction))
+			gkm_transaction_remove_file (transaction, filename);
+		g_free (filename);
+	}
+}
+
+gboolean
+gkm_secret_collection_get_journal (GkmSecretCollection *self)
+{
+	g_return_val_if_fail (GKM_IS_SECRET_COLLECTION (self), FALSE);
+	return self->journal;
+}
+
+void
+gkm_secret_collection_set_journal (GkmSecretCollection *self, gboolean journal)
+{
+	g_return_if_fail (GKM_IS_SECRET_COLLECTION (self));
+	self->journal = journal;
 }
 
 gint
@@ -54,9 +54,18 @@ GkmDataResult        gkm_secret_collection_load            (GkmSecretCollection
 void                 gkm_secret_collection_save            (GkmSecretCollection *self,
                                                             GkmTransaction *transaction);
 
+void                 gkm_secret_collection_save_item       (GkmSecretCollection *self,
+                                                            GkmTransaction *transaction,
+                                                            const gchar *identifier);
+
 void                 gkm_secret_collection_destroy         (GkmSecretCollection *self,
                                                             GkmTransaction *transaction);
 
+gboolean             gkm_secret_collection_get_journal     (GkmSecretCollection *self);
+
+void                 gkm_secret_collection_set_journal     (GkmSecretCollection *self,
+                                                            gboolean journal);
+
 const gchar*         gkm_secret_collection_get_filename    (GkmSecretCollection *self);
 
 void                 gkm_secret_collection_set_filename    (GkmSecretCollection *self,
@@ -318,6 +318,39 @@ gkm_secret_fields_match_one (GHashTable *haystack,
 	return match;
 }
 
+gboolean
+gkm_secret_fields_get_compat_lookups (const gchar *needle_key,
+                                      const gchar *needle_value,
+                                      gchar **hashed_key,
+                                      gchar **hashed_string,
+                                      gchar **hashed_uint32)
+{
+	guint32 number;
+
+	g_return_val_if_fail (needle_key != NULL, FALSE);
+	g_return_val_if_fail (needle_value != NULL, FALSE);
+	g_return_val_if_fail (hashed_key != NULL, FALSE);
+	g_return_val_if_fail (hashed_string != NULL, FALSE);
+	g_return_val_if_fail (hashed_uint32 != NULL, FALSE);
+
+	/* Compat attributes in the needle make no difference, see above */
+	if (is_compat_name (needle_key))
+		return FALSE;
+
+	/*
+	 * These are the forms that gkm_secret_fields_match_one() might find
+	 * a match for the needle under, when the haystack only has a hashed value.
+	 */
+
+	*hashed_key = make_compat_hashed_name (needle_key);
+	*hashed_string = compat_hash_value_as_string (needle_value);
+	*hashed_uint32 = NULL;
+	if (compat_hash_value_as_uint32 (needle_value, &number))
+		*hashed_uint32 = format_uint32 (number);
+
+	return TRUE;
+}
+
 gboolean
 gkm_secret_fields_match (GHashTable *haystack,
                          GHashTable *needle)
@@ -82,6 +82,12 @@ gboolean        gkm_secret_fields_match_one                   (GHashTable *hayst
 
 GList*          gkm_secret_fields_get_names                   (GHashTable *fields);
 
+gboolean        gkm_secret_fields_get_compat_lookups          (const gchar *needle_key,
+                                                               const gchar *needle_value,
+                                                               gchar **hashed_key,
+                                                               gchar **hashed_string,
+                                                               gchar **hashed_uint32);
+
 /* COMPAT ------------------------------------------------------------------------ */
 
 GList*          gkm_secret_fields_get_compat_hashed_names     (GHashTable *fields);
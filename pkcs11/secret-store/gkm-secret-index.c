@@ -0,0 +1,293 @@
+/*
+ * gnome-keyring
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gkm-secret-fields.h"
+#include "gkm-secret-index.h"
+#include "gkm-secret-item.h"
+
+#include "gkm/gkm-manager.h"
+
+#include "pkcs11i.h"
+
+#include <string.h>
+
+#define INDEX_DATA_KEY "gkm-secret-index"
+
+struct _GkmSecretIndex {
+	GkmManager *manager;
+	GHashTable *by_name;            /* name -> (value -> set of objects) */
+	GHashTable *by_object;          /* object -> fields it's indexed under */
+};
+
+static GHashTable*
+lookup_objects (GkmSecretIndex *self, const gchar *name, const gchar *value)
+{
+	GHashTable *values;
+
+	if (name == NULL || value == NULL)
+		return NULL;
+
+	values = g_hash_table_lookup (self->by_name, name);
+	if (values == NULL)
+		return NULL;
+
+	return g_hash_table_lookup (values, value);
+}
+
+static void
+index_add_field (GkmSecretIndex *self, const gchar *name, const gchar *value,
+                 GkmObject *object)
+{
+	GHashTable *values;
+	GHashTable *objects;
+
+	values = g_hash_table_lookup (self->by_name, name);
+	if (values == NULL) {
+		values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+		                                (GDestroyNotify)g_hash_table_unref);
+		g_hash_table_insert (self->by_name, g_strdup (name), values);
+	}
+
+	objects = g_hash_table_lookup (values, value);
+	if (objects == NULL) {
+		objects = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_hash_table_insert (values, g_strdup (value), objects);
+	}
+
+	g_hash_table_add (objects, object);
+}
+
+static void
+index_remove_field (GkmSecretIndex *self, const gchar *name, const gchar *value,
+                    GkmObject *object)
+{
+	GHashTable *values;
+	GHashTable *objects;
+
+	values = g_hash_table_lookup (self->by_name, name);
+	g_return_if_fail (values != NULL);
+
+	objects = g_hash_table_lookup (values, value);
+	g_return_if_fail (objects != NULL);
+
+	g_hash_table_remove (objects, object);
+	if (g_hash_table_size (objects) == 0)
+		g_hash_table_remove (values, value);
+	if (g_hash_table_size (values) == 0)
+		g_hash_table_remove (self->by_name, name);
+}
+
+static void
+index_remove_object (GkmSecretIndex *self, GkmObject *object)
+{
+	GHashTableIter iter;
+	GHashTable *fields;
+	gpointer name, value;
+
+	/* We don't touch the object, it may be on its way out */
+	fields = g_hash_table_lookup (self->by_object, object);
+	if (fields == NULL)
+		return;
+
+	g_hash_table_iter_init (&iter, fields);
+	while (g_hash_table_iter_next (&iter, &name, &value))
+		index_remove_field (self, name, value, object);
+
+	g_hash_table_remove (self->by_object, object);
+}
+
+static void
+index_add_object (GkmSecretIndex *self, GkmObject *object)
+{
+	GHashTableIter iter;
+	GHashTable *fields;
+	gpointer name, value;
+
+	if (!GKM_IS_SECRET_ITEM (object))
+		return;
+
+	index_remove_object (self, object);
+
+	/*
+	 * Keep our own copy of what we indexed, so we can remove the
+	 * object again even if its fields are replaced under us.
+	 */
+	fields = gkm_secret_fields_new ();
+	g_hash_table_iter_init (&iter, gkm_secret_item_get_fields (GKM_SECRET_ITEM (object)));
+	while (g_hash_table_iter_next (&iter, &name, &value)) {
+		if (value == NULL)
+			continue;
+		g_hash_table_insert (fields, g_strdup (name), g_strdup (value));
+		index_add_field (self, name, value, object);
+	}
+
+	g_hash_table_insert (self->by_object, object, fields);
+}
+
+static void
+on_manager_added_object (GkmManager *manager, GkmObject *object, gpointer user_data)
+{
+	index_add_object (user_data, object);
+}
+
+static void
+on_manager_removed_object (GkmManager *manager, GkmObject *object, gpointer user_data)
+{
+	index_remove_object (user_data, object);
+}
+
+static void
+on_manager_changed_object (GkmManager *manager, GkmObject *object,
+                           CK_ATTRIBUTE_TYPE type, gpointer user_data)
+{
+	if (type == CKA_G_FIELDS)
+		index_add_object (user_data, object);
+}
+
+static void
+index_free (gpointer data)
+{
+	GkmSecretIndex *self = data;
+
+	/* Called when the manager is finalized, handlers are already gone */
+	g_hash_table_destroy (self->by_name);
+	g_hash_table_destroy (self->by_object);
+	g_slice_free (GkmSecretIndex, self);
+}
+
+static gboolean
+find_candidates (GkmSecretIndex *self, const gchar *name, const gchar *value,
+                 GHashTable **sources, guint *count)
+{
+	gchar *hashed_key;
+	gchar *hashed_string;
+	gchar *hashed_uint32;
+	guint i;
+
+	/* Some fields (ie: compat ones) don't narrow down a match */
+	if (!gkm_secret_fields_get_compat_lookups (name, value, &hashed_key,
+	                                           &hashed_string, &hashed_uint32))
+		return FALSE;
+
+	/* Items loaded from old keyrings may only have a hashed value */
+	sources[0] = lookup_objects (self, name, value);
+	sources[1] = lookup_objects (self, hashed_key, hashed_string);
+	sources[2] = lookup_objects (self, hashed_key, hashed_uint32);
+
+	g_free (hashed_key);
+	g_free (hashed_string);
+	g_free (hashed_uint32);
+
+	*count = 0;
+	for (i = 0; i < 3; i++) {
+		if (sources[i])
+			*count += g_hash_table_size (sources[i]);
+	}
+
+	return TRUE;
+}
+
+GkmSecretIndex*
+gkm_secret_index_for_manager (GkmManager *manager)
+{
+	GkmSecretIndex *self;
+	GList *objects, *l;
+
+	g_return_val_if_fail (GKM_IS_MANAGER (manager), NULL);
+
+	self = g_object_get_data (G_OBJECT (manager), INDEX_DATA_KEY);
+	if (self != NULL)
+		return self;
+
+	self = g_slice_new0 (GkmSecretIndex);
+	self->manager = manager;
+	self->by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+	                                       (GDestroyNotify)g_hash_table_unref);
+	self->by_object = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+	                                         (GDestroyNotify)g_hash_table_unref);
+
+	g_object_set_data_full (G_OBJECT (manager), INDEX_DATA_KEY, self, index_free);
+
+	objects = gkm_manager_find_by_class (manager, NULL, CKO_SECRET_KEY);
+	for (l = objects; l; l = g_list_next (l))
+		index_add_object (self, l->data);
+	g_list_free (objects);
+
+	g_signal_connect (manager, "object-added", G_CALLBACK (on_manager_added_object), self);
+	g_signal_connect (manager, "object-removed", G_CALLBACK (on_manager_removed_object), self);
+	g_signal_connect (manager, "attribute-changed", G_CALLBACK (on_manager_changed_object), self);
+
+	return self;
+}
+
+gboolean
+gkm_secret_index_lookup (GkmSecretIndex *self, GHashTable *fields, GList **objects)
+{
+	GHashTable *sources[3];
+	GHashTable *best[3] = { NULL, NULL, NULL };
+	GHashTable *results;
+	GHashTableIter iter;
+	gpointer key, value;
+	gboolean found = FALSE;
+	guint count, n_best = 0;
+	guint i;
+
+	g_return_val_if_fail (self != NULL, FALSE);
+	g_return_val_if_fail (fields != NULL, FALSE);
+	g_return_val_if_fail (objects != NULL, FALSE);
+
+	/* Find the field that narrows things down the most */
+	g_hash_table_iter_init (&iter, fields);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (value == NULL)
+			continue;
+		if (!find_candidates (self, key, value, sources, &count))
+			continue;
+
+		if (!found || count < n_best) {
+			memcpy (best, sources, sizeof (best));
+			n_best = count;
+			found = TRUE;
+		}
+
+		if (n_best == 0)
+			break;
+	}
+
+	/* No usable fields, caller has to look at everything */
+	if (!found)
+		return FALSE;
+
+	/* The same item can be present under more than one form */
+	results = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (i = 0; i < 3; i++) {
+		if (!best[i])
+			continue;
+		g_hash_table_iter_init (&iter, best[i]);
+		while (g_hash_table_iter_next (&iter, &key, NULL))
+			g_hash_table_add (results, key);
+	}
+
+	*objects = g_hash_table_get_keys (results);
+	g_hash_table_destroy (results);
+	return TRUE;
+}
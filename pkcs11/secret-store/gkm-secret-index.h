@@ -0,0 +1,45 @@
+/*
+ * gnome-keyring
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GKM_SECRET_INDEX_H__
+#define __GKM_SECRET_INDEX_H__
+
+#include "gkm-secret-types.h"
+
+#include <glib.h>
+
+/*
+ * An inverted index from (field name, value) to the secret items in a
+ * GkmManager which carry that field. There is one per manager, created
+ * on demand, and kept up to date from the manager's signals.
+ *
+ * Lookups return candidates only. Callers still need to match each
+ * candidate against the full criteria.
+ */
+
+typedef struct _GkmSecretIndex GkmSecretIndex;
+
+GkmSecretIndex*      gkm_secret_index_for_manager      (GkmManager *manager);
+
+gboolean             gkm_secret_index_lookup           (GkmSecretIndex *index,
+                                                        GHashTable *fields,
+                                                        GList **objects);
+
+#endif /* __GKM_SECRET_INDEX_H__ */
@@ -27,6 +27,7 @@
 #include "gkm-secret-store.h"
 
 #include "gkm/gkm-credential.h"
+#include "gkm/gkm-crypto.h"
 #define DEBUG_FLAG GKM_DEBUG_STORAGE
 #include "gkm/gkm-debug.h"
 #include "gkm/gkm-transaction.h"
@@ -45,6 +46,7 @@ struct _GkmSecretModule {
 	EggFileTracker *tracker;
 	GHashTable *collections;
 	gchar *directory;
+	gboolean journal;
 	GkmCredential *session_credential;
 };
 
@@ -119,6 +121,7 @@ add_collection (GkmSecretModule *self, GkmTransaction *transaction, GkmSecretCol
 	g_return_if_fail (filename);
 
 	g_hash_table_replace (self->collections, g_strdup (filename), g_object_ref (collection));
+	gkm_secret_collection_set_journal (collection, self->journal);
 
 	gkm_object_expose_full (GKM_OBJECT (collection), transaction, TRUE);
 	if (transaction)
@@ -292,6 +295,9 @@ gkm_secret_module_real_parse_argument (GkmModule *base, const gchar *name, const
 	if (g_str_equal (name, "directory")) {
 		g_free (self->directory);
 		self->directory = g_strdup (value);
+	} else if (g_str_equal (name, "journal")) {
+		self->journal = value && (g_ascii_strcasecmp (value, "yes") == 0 ||
+		                          g_ascii_strcasecmp (value, "true") == 0);
 	}
 }
 
@@ -335,11 +341,12 @@ gkm_secret_module_real_store_object (GkmModule *module, GkmTransaction *transact
 	GkmSecretModule *self = GKM_SECRET_MODULE (module);
 	GkmSecretCollection *collection = NULL;
 
-	/* Store the item's collection */
+	/* Store the item in its collection */
 	if (GKM_IS_SECRET_ITEM (object)) {
 		collection = gkm_secret_item_get_collection (GKM_SECRET_ITEM (object));
 		g_return_if_fail (GKM_IS_SECRET_COLLECTION (collection));
-		gkm_module_store_token_object (GKM_MODULE (self), transaction, GKM_OBJECT (collection));
+		gkm_secret_collection_save_item (collection, transaction,
+		                                 gkm_secret_object_get_identifier (GKM_SECRET_OBJECT (object)));
 
 	/* Storing a collection */
 	} else if (GKM_IS_SECRET_COLLECTION (object)) {
@@ -371,7 +378,8 @@ gkm_secret_module_real_remove_object (GkmModule *module, GkmTransaction *transac
 		g_return_if_fail (GKM_IS_SECRET_COLLECTION (collection));
 		gkm_secret_collection_destroy_item (collection, transaction, GKM_SECRET_ITEM (object));
 		if (!gkm_transaction_get_failed (transaction))
-			gkm_secret_collection_save (collection, transaction);
+			gkm_secret_collection_save_item (collection, transaction,
+			                                 gkm_secret_object_get_identifier (GKM_SECRET_OBJECT (object)));
 
 	/* Removing a collection */
 	} else if (GKM_IS_SECRET_COLLECTION (object)) {
@@ -508,6 +516,55 @@ gkm_secret_store_get_functions (void)
 	return gkm_secret_module_function_list;
 }
 
+/*
+ * Wraps the secrets of several items with one call. Each item is wrapped
+ * with the mechanism and its own IV, and the wrapped values are concatenated
+ * in the output. Items that are locked or gone away are marked as such in
+ * results, and don't fail the whole call.
+ *
+ * This is only for use by the daemon in process, and deliberately not
+ * available through C_WrapKey, since it reads and writes through pointers.
+ */
+CK_RV
+gkm_secret_store_wrap_batch (CK_SESSION_HANDLE handle,
+                             CK_MECHANISM_TYPE mechanism,
+                             CK_OBJECT_HANDLE wrapping_key,
+                             CK_OBJECT_HANDLE_PTR objects,
+                             CK_ULONG n_objects,
+                             CK_BYTE_PTR ivs,
+                             CK_ULONG n_iv,
+                             CK_ULONG_PTR results,
+                             CK_ULONG_PTR lengths,
+                             CK_BYTE_PTR output,
+                             CK_ULONG_PTR n_output)
+{
+	CK_RV rv = CKR_CRYPTOKI_NOT_INITIALIZED;
+	GkmSession *session;
+	GkmObject *wrapper;
+
+	if ((n_objects && (!objects || !results || !lengths)) || (n_iv && !ivs) || !n_output)
+		return CKR_ARGUMENTS_BAD;
+
+	g_mutex_lock (&pkcs11_module_mutex);
+
+		if (pkcs11_module != NULL) {
+			session = gkm_module_lookup_session (pkcs11_module, handle);
+			if (session == NULL)
+				rv = CKR_SESSION_HANDLE_INVALID;
+			else
+				rv = gkm_session_lookup_readable_object (session, wrapping_key, &wrapper);
+			if (rv == CKR_OBJECT_HANDLE_INVALID)
+				rv = CKR_WRAPPING_KEY_HANDLE_INVALID;
+			else if (rv == CKR_OK)
+				rv = gkm_crypto_wrap_batch (session, mechanism, wrapper, objects, n_objects,
+				                            ivs, n_iv, results, lengths, output, n_output);
+		}
+
+	g_mutex_unlock (&pkcs11_module_mutex);
+
+	return rv;
+}
+
 GkmModule*
 _gkm_secret_store_get_module_for_testing (void)
 {
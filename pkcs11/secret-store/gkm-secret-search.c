@@ -22,6 +22,7 @@
 
 #include "gkm-secret-collection.h"
 #include "gkm-secret-fields.h"
+#include "gkm-secret-index.h"
 #include "gkm-secret-item.h"
 #include "gkm-secret-search.h"
 
@@ -171,12 +172,15 @@ on_manager_gone_away (gpointer user_data, GObject *where_the_object_was)
 static void
 populate_search_from_manager (GkmSecretSearch *self, GkmSession *session, GkmManager *manager)
 {
+	GkmSecretIndex *index;
 	GList *objects, *o;
 
 	self->managers = g_list_append (self->managers, manager);
 
-	/* Add in all the objects */
-	objects = gkm_manager_find_by_class (manager, session, CKO_SECRET_KEY);
+	/* Add in the candidate objects, or all of them if the fields don't narrow it down */
+	index = gkm_secret_index_for_manager (manager);
+	if (!gkm_secret_index_lookup (index, self->fields, &objects))
+		objects = gkm_manager_find_by_class (manager, session, CKO_SECRET_KEY);
 	for (o = objects; o; o = g_list_next (o))
 		on_manager_added_object (manager, o->data, self);
 	g_list_free (objects);
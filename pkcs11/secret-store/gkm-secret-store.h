@@ -25,4 +25,16 @@
 
 CK_FUNCTION_LIST_PTR  gkm_secret_store_get_functions  (void);
 
+CK_RV                 gkm_secret_store_wrap_batch     (CK_SESSION_HANDLE handle,
+                                                       CK_MECHANISM_TYPE mechanism,
+                                                       CK_OBJECT_HANDLE wrapping_key,
+                                                       CK_OBJECT_HANDLE_PTR objects,
+                                                       CK_ULONG n_objects,
+                                                       CK_BYTE_PTR ivs,
+                                                       CK_ULONG n_iv,
+                                                       CK_ULONG_PTR results,
+                                                       CK_ULONG_PTR lengths,
+                                                       CK_BYTE_PTR output,
+                                                       CK_ULONG_PTR n_output);
+
 #endif /* __GKM_SECRET_STORE_H__ */
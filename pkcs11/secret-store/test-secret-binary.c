@@ -245,6 +245,276 @@ test_read_with_schema (Test *test,
 	g_assert_cmpstr (gkm_secret_item_get_schema (item), ==, "se.lostca.is.rishi.secret");
 }
 
+static void
+test_write_read_perf (Test *test, gconstpointer unused)
+{
+	GkmDataResult res;
+	GkmSecretItem *item;
+	GkmSecret *secret;
+	gdouble elapsed;
+	gpointer data;
+	gsize n_data;
+	gchar *identifier;
+	gchar *value;
+	guint i;
+
+	if (!g_test_perf ())
+		return;
+
+	/* About 10 MB of secrets, so that the cipher dominates */
+	value = g_malloc (64 * 1024);
+	memset (value, 'x', 64 * 1024);
+
+	for (i = 0; i < 160; i++) {
+		identifier = g_strdup_printf ("%u", i + 100);
+		item = gkm_secret_collection_new_item (test->collection, identifier);
+		gkm_secret_object_set_label (GKM_SECRET_OBJECT (item), "Perf");
+		secret = gkm_secret_new ((guchar *)value, 64 * 1024);
+		gkm_secret_data_set_secret (test->sdata, identifier, secret);
+		g_object_unref (secret);
+		g_free (identifier);
+	}
+
+	g_free (value);
+
+	g_test_timer_start ();
+	res = gkm_secret_binary_write (test->collection, test->sdata, &data, &n_data);
+	elapsed = g_test_timer_elapsed ();
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+
+	g_test_maximized_result ((n_data / (1024.0 * 1024.0)) / elapsed,
+	                         "gkm_secret_binary_write: %.1f MB/s",
+	                         (n_data / (1024.0 * 1024.0)) / elapsed);
+
+	g_test_timer_start ();
+	res = gkm_secret_binary_read (test->collection, test->sdata, data, n_data);
+	elapsed = g_test_timer_elapsed ();
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+
+	g_test_maximized_result ((n_data / (1024.0 * 1024.0)) / elapsed,
+	                         "gkm_secret_binary_read: %.1f MB/s",
+	                         (n_data / (1024.0 * 1024.0)) / elapsed);
+
+	g_free (data);
+}
+
+static GByteArray*
+build_journal (Test *test, gpointer *keyring, gsize *n_keyring, gsize *last_entry)
+{
+	GkmDataResult res;
+	GkmSecretItem *item;
+	GByteArray *journal;
+	GkmSecret *secret;
+	gpointer data;
+	gsize n_data;
+	const gchar *identifiers[] = { "5", "4", "7" };
+	guint i;
+
+	test_secret_collection_populate (test->collection, test->sdata);
+	res = gkm_secret_binary_write (test->collection, test->sdata, keyring, n_keyring);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+
+	res = gkm_secret_binary_journal_start (*keyring, *n_keyring, &data, &n_data);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+	g_assert_cmpuint (n_data, ==, GKM_SECRET_BINARY_JOURNAL_HEADER_LEN);
+	journal = g_byte_array_new ();
+	g_byte_array_append (journal, data, n_data);
+	g_free (data);
+
+	/* Modify one item, remove another, and add a new one */
+	item = gkm_secret_collection_get_item (test->collection, "5");
+	gkm_secret_object_set_label (GKM_SECRET_OBJECT (item), "Changed");
+
+	item = gkm_secret_collection_get_item (test->collection, "4");
+	gkm_secret_collection_remove_item (test->collection, item);
+
+	item = gkm_secret_collection_new_item (test->collection, "7");
+	gkm_secret_object_set_label (GKM_SECRET_OBJECT (item), "Added");
+	gkm_secret_fields_add (gkm_secret_item_get_fields (item), "added", "yes");
+	secret = gkm_secret_new_from_password ("7's secret");
+	gkm_secret_data_set_secret (test->sdata, "7", secret);
+	g_object_unref (secret);
+
+	for (i = 0; i < G_N_ELEMENTS (identifiers); i++) {
+		*last_entry = journal->len;
+		res = gkm_secret_binary_journal_append (test->collection, test->sdata,
+		                                        journal->data, GKM_SECRET_BINARY_JOURNAL_HEADER_LEN,
+		                                        identifiers[i], &data, &n_data);
+		g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+		g_byte_array_append (journal, data, n_data);
+		g_free (data);
+	}
+
+	/* Back to what's in the keyring file */
+	res = gkm_secret_binary_read (test->collection, test->sdata, *keyring, *n_keyring);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+	g_assert (gkm_secret_collection_get_item (test->collection, "4") != NULL);
+	g_assert (gkm_secret_collection_get_item (test->collection, "7") == NULL);
+
+	return journal;
+}
+
+static void
+test_journal_replay (Test *test, gconstpointer unused)
+{
+	GkmDataResult res;
+	GkmSecretItem *item;
+	GByteArray *journal;
+	const guchar *raw;
+	gpointer keyring;
+	gsize n_keyring;
+	gsize last_entry;
+	gsize n_valid;
+	gsize n_raw;
+
+	journal = build_journal (test, &keyring, &n_keyring, &last_entry);
+
+	res = gkm_secret_binary_journal_replay (test->collection, test->sdata, keyring, n_keyring,
+	                                        journal->data, journal->len, &n_valid);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+	g_assert_cmpuint (n_valid, ==, journal->len);
+
+	item = gkm_secret_collection_get_item (test->collection, "5");
+	g_assert_cmpstr (gkm_secret_object_get_label (GKM_SECRET_OBJECT (item)), ==, "Changed");
+	g_assert (gkm_secret_collection_get_item (test->collection, "4") == NULL);
+
+	item = gkm_secret_collection_get_item (test->collection, "7");
+	g_assert (item != NULL);
+	g_assert_cmpstr (gkm_secret_object_get_label (GKM_SECRET_OBJECT (item)), ==, "Added");
+	g_assert_cmpstr (g_hash_table_lookup (gkm_secret_item_get_fields (item), "added"), ==, "yes");
+	raw = gkm_secret_data_get_raw (test->sdata, "7", &n_raw);
+	g_assert (raw != NULL);
+	g_assert_cmpuint (n_raw, ==, 10);
+	g_assert (memcmp (raw, "7's secret", 10) == 0);
+
+	g_byte_array_unref (journal);
+	g_free (keyring);
+}
+
+static void
+test_journal_torn_tail (Test *test, gconstpointer unused)
+{
+	GkmDataResult res;
+	GByteArray *journal;
+	gpointer keyring;
+	gsize n_keyring;
+	gsize last_entry;
+	gsize n_valid;
+
+	journal = build_journal (test, &keyring, &n_keyring, &last_entry);
+
+	/* Crashed part way through writing the last entry */
+	g_byte_array_set_size (journal, journal->len - 7);
+
+	res = gkm_secret_binary_journal_replay (test->collection, test->sdata, keyring, n_keyring,
+	                                        journal->data, journal->len, &n_valid);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+	g_assert_cmpuint (n_valid, ==, last_entry);
+
+	/* Earlier entries applied, but not the partial one */
+	g_assert (gkm_secret_collection_get_item (test->collection, "4") == NULL);
+	g_assert (gkm_secret_collection_get_item (test->collection, "7") == NULL);
+
+	/* Only got as far as the length */
+	g_byte_array_set_size (journal, last_entry + 2);
+	res = gkm_secret_binary_journal_replay (test->collection, test->sdata, keyring, n_keyring,
+	                                        journal->data, journal->len, &n_valid);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+	g_assert_cmpuint (n_valid, ==, last_entry);
+
+	g_byte_array_unref (journal);
+	g_free (keyring);
+}
+
+static void
+test_journal_corrupt (Test *test, gconstpointer unused)
+{
+	GkmDataResult res;
+	GByteArray *journal;
+	gpointer keyring;
+	gsize n_keyring;
+	gsize last_entry;
+	gsize n_valid;
+
+	journal = build_journal (test, &keyring, &n_keyring, &last_entry);
+
+	/* Flip a byte in the middle of the last entry */
+	journal->data[last_entry + (journal->len - last_entry) / 2] ^= 0xFF;
+
+	res = gkm_secret_binary_journal_replay (test->collection, test->sdata, keyring, n_keyring,
+	                                        journal->data, journal->len, &n_valid);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+	g_assert_cmpuint (n_valid, ==, last_entry);
+	g_assert (gkm_secret_collection_get_item (test->collection, "7") == NULL);
+
+	g_byte_array_unref (journal);
+	g_free (keyring);
+}
+
+static void
+test_journal_stale (Test *test, gconstpointer unused)
+{
+	GkmDataResult res;
+	GByteArray *journal;
+	gpointer keyring;
+	gpointer other;
+	gsize n_keyring;
+	gsize n_other;
+	gsize last_entry;
+	gsize n_valid;
+
+	journal = build_journal (test, &keyring, &n_keyring, &last_entry);
+
+	/* The keyring file was written again since the journal was started */
+	res = gkm_secret_binary_write (test->collection, test->sdata, &other, &n_other);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+
+	res = gkm_secret_binary_journal_replay (test->collection, test->sdata, other, n_other,
+	                                        journal->data, journal->len, &n_valid);
+	g_assert_cmpint (res, ==, GKM_DATA_UNRECOGNIZED);
+	g_assert_cmpuint (n_valid, ==, 0);
+	g_assert (gkm_secret_collection_get_item (test->collection, "4") != NULL);
+
+	g_byte_array_unref (journal);
+	g_free (keyring);
+	g_free (other);
+}
+
+static void
+test_journal_locked (Test *test, gconstpointer unused)
+{
+	GkmDataResult res;
+	GkmSecretItem *item;
+	GByteArray *journal;
+	GHashTable *fields;
+	gpointer keyring;
+	gsize n_keyring;
+	gsize last_entry;
+	gsize n_valid;
+
+	journal = build_journal (test, &keyring, &n_keyring, &last_entry);
+
+	res = gkm_secret_binary_read (test->collection, NULL, keyring, n_keyring);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+
+	res = gkm_secret_binary_journal_replay (test->collection, NULL, keyring, n_keyring,
+	                                        journal->data, journal->len, &n_valid);
+	g_assert_cmpint (res, ==, GKM_DATA_SUCCESS);
+	g_assert_cmpuint (n_valid, ==, journal->len);
+
+	/* Only the hashed fields are available */
+	g_assert (gkm_secret_collection_get_item (test->collection, "4") == NULL);
+	item = gkm_secret_collection_get_item (test->collection, "7");
+	g_assert (item != NULL);
+	fields = gkm_secret_fields_new ();
+	gkm_secret_fields_add (fields, "added", "yes");
+	g_assert (gkm_secret_fields_match (gkm_secret_item_get_fields (item), fields));
+	g_hash_table_unref (fields);
+
+	g_byte_array_unref (journal);
+	g_free (keyring);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -262,6 +532,12 @@ main (int argc, char **argv)
 	g_test_add ("/secret-store/binary/created_on_rhel", Test, NULL, setup, test_read_created_on_rhel, teardown);
 	g_test_add ("/secret-store/binary/created_on_solaris_opencsw", Test, NULL, setup, test_read_created_on_solaris_opencsw, teardown);
 	g_test_add ("/secret-store/binary/read_with_schema", Test, NULL, setup, test_read_with_schema, teardown);
+	g_test_add ("/secret-store/binary/write_read_perf", Test, NULL, setup, test_write_read_perf, teardown);
+	g_test_add ("/secret-store/binary/journal_replay", Test, NULL, setup, test_journal_replay, teardown);
+	g_test_add ("/secret-store/binary/journal_torn_tail", Test, NULL, setup, test_journal_torn_tail, teardown);
+	g_test_add ("/secret-store/binary/journal_corrupt", Test, NULL, setup, test_journal_corrupt, teardown);
+	g_test_add ("/secret-store/binary/journal_stale", Test, NULL, setup, test_journal_stale, teardown);
+	g_test_add ("/secret-store/binary/journal_locked", Test, NULL, setup, test_journal_locked, teardown);
 
 	return g_test_run ();
 }
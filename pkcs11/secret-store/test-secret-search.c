@@ -232,6 +232,71 @@ test_and_change_to_match (Test *test, gconstpointer unused)
 	g_object_unref (object);
 }
 
+static void
+test_changed_then_match (Test *test, gconstpointer unused)
+{
+	CK_ATTRIBUTE attrs[] = {
+	        { CKA_G_FIELDS, "name3\0value3", 13 },
+	};
+
+	GkmObject *object = NULL;
+	GHashTable *fields;
+	gpointer vdata;
+	gsize vsize;
+
+	/* Change the fields before the search exists */
+	fields = gkm_secret_fields_new ();
+	gkm_secret_fields_add (fields, "name3", "value3");
+	gkm_secret_item_set_fields (test->item, fields);
+	g_hash_table_unref (fields);
+
+	object = gkm_session_create_object_for_factory (test->session, test->factory, NULL, attrs, 1);
+	g_assert (object != NULL);
+	g_assert (GKM_IS_SECRET_SEARCH (object));
+
+	/* One object matched */
+	vdata = gkm_object_get_attribute_data (object, test->session, CKA_G_MATCHED, &vsize);
+	g_assert (vdata);
+	g_assert (vsize == sizeof (CK_OBJECT_HANDLE));
+	g_assert (*((CK_OBJECT_HANDLE_PTR)vdata) == gkm_object_get_handle (GKM_OBJECT (test->item)));
+	g_free (vdata);
+
+	g_object_unref (object);
+}
+
+static void
+test_and_match_compat_hashed (Test *test, gconstpointer unused)
+{
+	CK_ATTRIBUTE attrs[] = {
+	        { CKA_G_FIELDS, "name1\0value1\0number\0" "1234", 25 },
+	};
+
+	GkmObject *object = NULL;
+	GHashTable *fields;
+	gpointer vdata;
+	gsize vsize;
+
+	/* Like an item loaded from an old keyring without its secrets */
+	fields = gkm_secret_fields_new ();
+	gkm_secret_fields_add_compat_hashed_string (fields, "name1", "value1");
+	gkm_secret_fields_add_compat_hashed_uint32 (fields, "number", 1234);
+	gkm_secret_item_set_fields (test->item, fields);
+	g_hash_table_unref (fields);
+
+	object = gkm_session_create_object_for_factory (test->session, test->factory, NULL, attrs, 1);
+	g_assert (object != NULL);
+	g_assert (GKM_IS_SECRET_SEARCH (object));
+
+	/* One object matched */
+	vdata = gkm_object_get_attribute_data (object, test->session, CKA_G_MATCHED, &vsize);
+	g_assert (vdata);
+	g_assert (vsize == sizeof (CK_OBJECT_HANDLE));
+	g_assert (*((CK_OBJECT_HANDLE_PTR)vdata) == gkm_object_get_handle (GKM_OBJECT (test->item)));
+	g_free (vdata);
+
+	g_object_unref (object);
+}
+
 static void
 test_and_change_to_not_match (Test *test, gconstpointer unused)
 {
@@ -445,6 +510,8 @@ main (int argc, char **argv)
 	g_test_add ("/secret-store/search/and_match", Test, NULL, setup, test_and_match, teardown);
 	g_test_add ("/secret-store/search/and_change_to_match", Test, NULL, setup, test_and_change_to_match, teardown);
 	g_test_add ("/secret-store/search/and_change_to_not_match", Test, NULL, setup, test_and_change_to_not_match, teardown);
+	g_test_add ("/secret-store/search/changed_then_match", Test, NULL, setup, test_changed_then_match, teardown);
+	g_test_add ("/secret-store/search/and_match_compat_hashed", Test, NULL, setup, test_and_match_compat_hashed, teardown);
 	g_test_add ("/secret-store/search/for_bad_collection", Test, NULL, setup, test_for_bad_collection, teardown);
 	g_test_add ("/secret-store/search/for_collection", Test, NULL, setup, test_for_collection, teardown);
 	g_test_add ("/secret-store/search/for_collection_no_match", Test, NULL, setup, test_for_collection_no_match, teardown);
@@ -27,6 +27,8 @@
 #include "egg/egg-error.h"
 #include "egg/egg-file-tracker.h"
 
+#include "gkm/gkm-util.h"
+
 #include <string.h>
 
 struct _GkmSshModule {
@@ -34,8 +36,17 @@ struct _GkmSshModule {
 	EggFileTracker *tracker;
 	gchar *directory;
 	GHashTable *keys_by_path;
+	GPtrArray *pending;
 };
 
+typedef struct {
+	gchar *path;
+	gchar *private_path;
+	GkmSshPrivateKey *key;
+	GError *error;
+	gboolean parsed;
+} ParseJob;
+
 static const CK_SLOT_INFO gkm_ssh_module_slot_info = {
 	"SSH Keys",
 	"Gnome Keyring",
@@ -96,6 +107,51 @@ private_path_for_public (const gchar *public_path)
 	return NULL;
 }
 
+static void
+parse_job_free (gpointer data)
+{
+	ParseJob *job = data;
+
+	g_free (job->path);
+	g_free (job->private_path);
+	g_object_unref (job->key);
+	g_clear_error (&job->error);
+	g_slice_free (ParseJob, job);
+}
+
+/* Called on a worker thread, the key isn't exposed yet */
+static void
+parse_job_run (gpointer data,
+               gpointer unused)
+{
+	ParseJob *job = data;
+
+	job->parsed = gkm_ssh_private_key_parse (job->key, job->path,
+	                                         job->private_path, &job->error);
+}
+
+static void
+parse_pending_keys (GkmSshModule *self,
+                    GPtrArray *pending)
+{
+	ParseJob *job;
+	guint i;
+
+	/* Read and parse all the new keys at once */
+	gkm_util_run_in_parallel (pending, parse_job_run, NULL);
+
+	/* And then register them with the object manager */
+	for (i = 0; i < pending->len; i++) {
+		job = pending->pdata[i];
+		if (job->parsed) {
+			gkm_object_expose (GKM_OBJECT (job->key), TRUE);
+		} else if (job->error) {
+			g_message ("couldn't parse data: %s: %s", job->path,
+			           egg_error_message (job->error));
+		}
+	}
+}
+
 static void
 file_load (EggFileTracker *tracker,
            const gchar *path,
@@ -104,6 +160,7 @@ file_load (EggFileTracker *tracker,
 	GkmSshPrivateKey *key;
 	gchar *private_path;
 	GError *error = NULL;
+	ParseJob *job;
 	gchar *unique;
 
 	g_return_if_fail (path);
@@ -124,6 +181,16 @@ file_load (EggFileTracker *tracker,
 		g_free (unique);
 
 		g_hash_table_replace (self->keys_by_path, g_strdup (path), key);
+
+		/* During a refresh, new keys are parsed together afterwards */
+		if (self->pending != NULL) {
+			job = g_slice_new0 (ParseJob);
+			job->path = g_strdup (path);
+			job->private_path = private_path;
+			job->key = g_object_ref (key);
+			g_ptr_array_add (self->pending, job);
+			return;
+		}
 	}
 
 	/* Parse the data into the key */
@@ -183,7 +250,18 @@ static CK_RV
 gkm_ssh_module_real_refresh_token (GkmModule *base)
 {
 	GkmSshModule *self = GKM_SSH_MODULE (base);
+	GPtrArray *pending;
+
+	g_return_val_if_fail (self->pending == NULL, CKR_GENERAL_ERROR);
+
+	self->pending = g_ptr_array_new_with_free_func (parse_job_free);
 	egg_file_tracker_refresh (self->tracker, FALSE);
+	pending = self->pending;
+	self->pending = NULL;
+
+	parse_pending_keys (self, pending);
+	g_ptr_array_unref (pending);
+
 	return CKR_OK;
 }
 
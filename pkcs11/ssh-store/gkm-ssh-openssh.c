@@ -4,6 +4,7 @@
 #include "gkm/gkm-data-asn1.h"
 #include "gkm/gkm-data-der.h"
 #include "gkm/gkm-data-types.h"
+#include "gkm/gkm-sexp.h"
 
 #include "egg/egg-armor.h"
 #include "egg/egg-asn1x.h"
@@ -23,17 +24,45 @@ typedef struct _ParsePrivate {
  * INTERNAL
  */
 
+#define OPENSSH_KEY_V1_MAGIC "openssh-key-v1"
+
 static int
 keytype_to_algo (const gchar *salgo)
 {
+	const GkmSexpCurve *curves;
+	guint n_curves, i;
+
 	g_return_val_if_fail (salgo, 0);
 	if (strcmp (salgo, "ssh-rsa") == 0)
 		return GCRY_PK_RSA;
 	else if (strcmp (salgo, "ssh-dss") == 0)
 		return GCRY_PK_DSA;
+	else if (strcmp (salgo, "ssh-ed25519") == 0)
+		return GCRY_PK_ECC;
+	curves = gkm_sexp_get_curves (&n_curves);
+	for (i = 0; i < n_curves; i++) {
+		if (curves[i].ssh_keytype && strcmp (salgo, curves[i].ssh_keytype) == 0)
+			return GCRY_PK_ECC;
+	}
 	return 0;
 }
 
+static const gchar*
+keytype_to_curve (const gchar *salgo, const gchar *identifier)
+{
+	const GkmSexpCurve *curves;
+	guint n_curves, i;
+
+	curves = gkm_sexp_get_curves (&n_curves);
+	for (i = 0; i < n_curves; i++) {
+		if (curves[i].ssh_keytype && strcmp (salgo, curves[i].ssh_keytype) == 0 &&
+		    strcmp (identifier, curves[i].ssh_identifier) == 0)
+			return curves[i].curve;
+	}
+
+	return NULL;
+}
+
 static gboolean
 read_mpi (EggBuffer *req, gsize *offset, gcry_mpi_t *mpi)
 {
@@ -113,6 +142,65 @@ read_public_rsa (EggBuffer *req, gsize *offset, gcry_sexp_t *sexp)
 	return TRUE;
 }
 
+#define SEXP_PUBLIC_ECDSA  \
+	"(public-key"      \
+	"  (ecc"           \
+	"    (curve %s)"   \
+	"    (q %b)))"
+
+static gboolean
+read_public_ecdsa (EggBuffer *req, gsize *offset, const gchar *stype, gcry_sexp_t *sexp)
+{
+	const guchar *q;
+	const gchar *curve;
+	gchar *identifier;
+	gsize n_q;
+	int gcry;
+
+	if (!egg_buffer_get_string (req, *offset, offset, &identifier, (EggBufferAllocator)g_realloc))
+		return FALSE;
+
+	curve = keytype_to_curve (stype, identifier);
+	g_free (identifier);
+
+	if (!curve || !egg_buffer_get_byte_array (req, *offset, offset, &q, &n_q))
+		return FALSE;
+
+	gcry = gcry_sexp_build (sexp, NULL, SEXP_PUBLIC_ECDSA, curve, (int)n_q, q);
+	if (gcry) {
+		g_warning ("couldn't parse incoming public ECDSA key: %s", gcry_strerror (gcry));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+#define SEXP_PUBLIC_ED25519  \
+	"(public-key"        \
+	"  (ecc"             \
+	"    (curve Ed25519)" \
+	"    (flags eddsa)"  \
+	"    (q %b)))"
+
+static gboolean
+read_public_ed25519 (EggBuffer *req, gsize *offset, gcry_sexp_t *sexp)
+{
+	const guchar *q;
+	gsize n_q;
+	int gcry;
+
+	if (!egg_buffer_get_byte_array (req, *offset, offset, &q, &n_q) || n_q != 32)
+		return FALSE;
+
+	gcry = gcry_sexp_build (sexp, NULL, SEXP_PUBLIC_ED25519, (int)n_q, q);
+	if (gcry) {
+		g_warning ("couldn't parse incoming public Ed25519 key: %s", gcry_strerror (gcry));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static gboolean
 read_public (EggBuffer *req, gsize *offset, gcry_sexp_t *key, int *algo)
 {
@@ -125,10 +213,9 @@ read_public (EggBuffer *req, gsize *offset, gcry_sexp_t *key, int *algo)
 		return FALSE;
 
 	alg = keytype_to_algo (stype);
-	g_free (stype);
-
 	if (!alg) {
 		g_warning ("unsupported algorithm from SSH: %s", stype);
+		g_free (stype);
 		return FALSE;
 	}
 
@@ -139,11 +226,19 @@ read_public (EggBuffer *req, gsize *offset, gcry_sexp_t *key, int *algo)
 	case GCRY_PK_DSA:
 		ret = read_public_dsa (req, offset, key);
 		break;
+	case GCRY_PK_ECC:
+		if (strcmp (stype, "ssh-ed25519") == 0)
+			ret = read_public_ed25519 (req, offset, key);
+		else
+			ret = read_public_ecdsa (req, offset, stype, key);
+		break;
 	default:
 		g_assert_not_reached ();
 		return FALSE;
 	}
 
+	g_free (stype);
+
 	if (!ret) {
 		g_warning ("couldn't read incoming SSH private key");
 		return FALSE;
@@ -190,6 +285,216 @@ load_encrypted_key (GBytes *data,
 	return GKM_DATA_LOCKED;
 }
 
+static gboolean
+read_private_rsa (EggBuffer *buf, gsize *offset, gcry_sexp_t *sexp)
+{
+	gcry_mpi_t n, e, d, iqmp, p, q, u;
+	gboolean ret = FALSE;
+	int gcry;
+
+	n = e = d = iqmp = p = q = u = NULL;
+
+	if (!read_mpi (buf, offset, &n) ||
+	    !read_mpi (buf, offset, &e) ||
+	    !read_mpi (buf, offset, &d) ||
+	    !read_mpi (buf, offset, &iqmp) ||
+	    !read_mpi (buf, offset, &p) ||
+	    !read_mpi (buf, offset, &q))
+		goto done;
+
+	/* libgcrypt wants p < q, and u = p^-1 mod q */
+	if (gcry_mpi_cmp (p, q) > 0)
+		gcry_mpi_swap (p, q);
+	u = gcry_mpi_snew (gcry_mpi_get_nbits (n));
+	gcry_mpi_invm (u, p, q);
+
+	gcry = gcry_sexp_build (sexp, NULL,
+	                        "(private-key (rsa (n %m) (e %m) (d %m) (p %m) (q %m) (u %m)))",
+	                        n, e, d, p, q, u);
+	ret = (gcry == 0);
+
+done:
+	gcry_mpi_release (n);
+	gcry_mpi_release (e);
+	gcry_mpi_release (d);
+	gcry_mpi_release (iqmp);
+	gcry_mpi_release (p);
+	gcry_mpi_release (q);
+	gcry_mpi_release (u);
+	return ret;
+}
+
+static gboolean
+read_private_dsa (EggBuffer *buf, gsize *offset, gcry_sexp_t *sexp)
+{
+	gcry_mpi_t p, q, g, y, x;
+	gboolean ret = FALSE;
+	int gcry;
+
+	p = q = g = y = x = NULL;
+
+	if (!read_mpi (buf, offset, &p) ||
+	    !read_mpi (buf, offset, &q) ||
+	    !read_mpi (buf, offset, &g) ||
+	    !read_mpi (buf, offset, &y) ||
+	    !read_mpi (buf, offset, &x))
+		goto done;
+
+	gcry = gcry_sexp_build (sexp, NULL,
+	                        "(private-key (dsa (p %m) (q %m) (g %m) (y %m) (x %m)))",
+	                        p, q, g, y, x);
+	ret = (gcry == 0);
+
+done:
+	gcry_mpi_release (p);
+	gcry_mpi_release (q);
+	gcry_mpi_release (g);
+	gcry_mpi_release (y);
+	gcry_mpi_release (x);
+	return ret;
+}
+
+static gboolean
+read_private_ecdsa (EggBuffer *buf, gsize *offset, const gchar *stype, gcry_sexp_t *sexp)
+{
+	const guchar *q;
+	const gchar *curve;
+	gchar *identifier;
+	gcry_mpi_t d;
+	gsize n_q;
+	int gcry;
+
+	if (!egg_buffer_get_string (buf, *offset, offset, &identifier, (EggBufferAllocator)g_realloc))
+		return FALSE;
+
+	curve = keytype_to_curve (stype, identifier);
+	g_free (identifier);
+
+	if (!curve ||
+	    !egg_buffer_get_byte_array (buf, *offset, offset, &q, &n_q) ||
+	    !read_mpi (buf, offset, &d))
+		return FALSE;
+
+	gcry = gcry_sexp_build (sexp, NULL, "(private-key (ecc (curve %s) (q %b) (d %m)))",
+	                        curve, (int)n_q, q, d);
+	gcry_mpi_release (d);
+
+	return (gcry == 0);
+}
+
+static gboolean
+read_private_ed25519 (EggBuffer *buf, gsize *offset, gcry_sexp_t *sexp)
+{
+	const guchar *pk, *sk;
+	gsize n_pk, n_sk;
+	int gcry;
+
+	/* The secret is the 32 byte seed followed by the public key */
+	if (!egg_buffer_get_byte_array (buf, *offset, offset, &pk, &n_pk) || n_pk != 32 ||
+	    !egg_buffer_get_byte_array (buf, *offset, offset, &sk, &n_sk) || n_sk != 64)
+		return FALSE;
+
+	gcry = gcry_sexp_build (sexp, NULL,
+	                        "(private-key (ecc (curve Ed25519) (flags eddsa) (q %b) (d %b)))",
+	                        (int)n_pk, pk, 32, sk);
+
+	return (gcry == 0);
+}
+
+static GkmDataResult
+load_openssh_key_v1 (GBytes *data, gcry_sexp_t *skey)
+{
+	EggBuffer buf;
+	const guchar *section;
+	gsize n_section;
+	guint32 n_keys, check1, check2;
+	gchar *cipher = NULL;
+	gchar *stype = NULL;
+	gsize offset;
+	gboolean ret;
+	GkmDataResult result = GKM_DATA_UNRECOGNIZED;
+
+	egg_buffer_init_static (&buf, g_bytes_get_data (data, NULL), g_bytes_get_size (data));
+
+	if (buf.len < sizeof (OPENSSH_KEY_V1_MAGIC) ||
+	    memcmp (buf.buf, OPENSSH_KEY_V1_MAGIC, sizeof (OPENSSH_KEY_V1_MAGIC)) != 0)
+		return GKM_DATA_UNRECOGNIZED;
+	offset = sizeof (OPENSSH_KEY_V1_MAGIC);
+
+	/* Cipher name, KDF name and options */
+	if (!egg_buffer_get_string (&buf, offset, &offset, &cipher, (EggBufferAllocator)g_realloc) ||
+	    !egg_buffer_get_byte_array (&buf, offset, &offset, NULL, NULL) ||
+	    !egg_buffer_get_byte_array (&buf, offset, &offset, NULL, NULL))
+		goto done;
+
+	/*
+	 * Encrypted keys in this format use the bcrypt_pbkdf KDF, which we
+	 * don't have. The public half still gets loaded from the .pub file.
+	 */
+	if (strcmp (cipher, "none") != 0) {
+		g_message ("encrypted OpenSSH private keys are not supported: %s", cipher);
+		goto done;
+	}
+
+	/* Only ever one key in these files, and its public key blob */
+	if (!egg_buffer_get_uint32 (&buf, offset, &offset, &n_keys) || n_keys != 1 ||
+	    !egg_buffer_get_byte_array (&buf, offset, &offset, NULL, NULL) ||
+	    !egg_buffer_get_byte_array (&buf, offset, &offset, &section, &n_section)) {
+		result = GKM_DATA_FAILURE;
+		goto done;
+	}
+
+	egg_buffer_init_static (&buf, section, n_section);
+	offset = 0;
+
+	if (!egg_buffer_get_uint32 (&buf, offset, &offset, &check1) ||
+	    !egg_buffer_get_uint32 (&buf, offset, &offset, &check2) || check1 != check2 ||
+	    !egg_buffer_get_string (&buf, offset, &offset, &stype, (EggBufferAllocator)g_realloc)) {
+		result = GKM_DATA_FAILURE;
+		goto done;
+	}
+
+	switch (keytype_to_algo (stype)) {
+	case GCRY_PK_RSA:
+		ret = read_private_rsa (&buf, &offset, skey);
+		break;
+	case GCRY_PK_DSA:
+		ret = read_private_dsa (&buf, &offset, skey);
+		break;
+	case GCRY_PK_ECC:
+		if (strcmp (stype, "ssh-ed25519") == 0)
+			ret = read_private_ed25519 (&buf, &offset, skey);
+		else
+			ret = read_private_ecdsa (&buf, &offset, stype, skey);
+		break;
+	default:
+		g_message ("unsupported algorithm in OpenSSH private key: %s", stype);
+		ret = FALSE;
+		break;
+	}
+
+	result = ret ? GKM_DATA_SUCCESS : GKM_DATA_FAILURE;
+
+done:
+	g_free (cipher);
+	g_free (stype);
+	return result;
+}
+
+static GQuark
+openssh_private_key_type (void)
+{
+	static GQuark PEM_OPENSSH_PRIVATE_KEY;
+	static gsize quark_inited = 0;
+
+	if (g_once_init_enter (&quark_inited)) {
+		PEM_OPENSSH_PRIVATE_KEY = g_quark_from_static_string ("OPENSSH PRIVATE KEY");
+		g_once_init_leave (&quark_inited, 1);
+	}
+
+	return PEM_OPENSSH_PRIVATE_KEY;
+}
+
 static gboolean
 is_private_key_type (GQuark type)
 {
@@ -205,7 +510,8 @@ is_private_key_type (GQuark type)
 	}
 
 	/* Only handle SSHv2 private keys */
-	return (type == PEM_RSA_PRIVATE_KEY || type == PEM_DSA_PRIVATE_KEY);
+	return (type == PEM_RSA_PRIVATE_KEY || type == PEM_DSA_PRIVATE_KEY ||
+	        type == openssh_private_key_type ());
 }
 
 static void
@@ -227,6 +533,12 @@ parsed_pem_block (GQuark type,
 	if (ctx->sexp)
 		return;
 
+	/* The newer OpenSSH format, which has no headers */
+	if (type == openssh_private_key_type ()) {
+		ctx->result = load_openssh_key_v1 (data, &ctx->sexp);
+		return;
+	}
+
 	/* If it's encrypted ... */
 	dekinfo = egg_openssl_get_dekinfo (headers);
 	if (dekinfo) {
@@ -30,6 +30,8 @@
 
 #include "ssh-store/gkm-ssh-store.h"
 
+#include <string.h>
+
 EGG_SECURE_DEFINE_GLIB_GLOBALS ();
 
 static GMutex *mutex = NULL;
@@ -39,13 +41,27 @@ GMutex* _gkm_module_get_scary_mutex_that_you_should_not_touch (GkmModule *module
 
 GkmModule*
 test_ssh_module_initialize_and_enter (void)
+{
+	return test_ssh_module_initialize_with_directory_and_enter (NULL);
+}
+
+GkmModule*
+test_ssh_module_initialize_with_directory_and_enter (const gchar *directory)
 {
 	CK_FUNCTION_LIST_PTR funcs;
+	CK_C_INITIALIZE_ARGS args;
 	GkmModule *module;
+	gchar *string;
 	CK_RV rv;
 
+	memset (&args, 0, sizeof (args));
+	string = directory ? g_strdup_printf ("directory='%s'", directory) : NULL;
+	args.pReserved = string;
+	args.flags = CKF_OS_LOCKING_OK;
+
 	funcs = gkm_ssh_store_get_functions ();
-	rv = (funcs->C_Initialize) (NULL);
+	rv = (funcs->C_Initialize) (directory ? &args : NULL);
+	g_free (string);
 	g_return_val_if_fail (rv == CKR_OK, NULL);
 
 	module = _gkm_ssh_store_get_module_for_testing ();
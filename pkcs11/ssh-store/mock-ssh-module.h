@@ -35,6 +35,8 @@ void                   test_ssh_module_enter                    (void);
 
 GkmModule*             test_ssh_module_initialize_and_enter     (void);
 
+GkmModule*             test_ssh_module_initialize_with_directory_and_enter (const gchar *directory);
+
 void                   test_ssh_module_leave_and_finalize       (void);
 
 GkmSession*            test_ssh_module_open_session             (gboolean writable);
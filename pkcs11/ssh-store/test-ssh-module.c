@@ -0,0 +1,195 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* test-ssh-module.c: Test loading a directory of SSH keys
+
+   Copyright (C) 2026 agent <agent@local>
+
+   The Gnome Keyring Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Keyring Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   <http://www.gnu.org/licenses/>.
+
+   Author: agent <agent@local>
+*/
+
+#include "config.h"
+
+#include "mock-ssh-module.h"
+
+#include "gkm/gkm-manager.h"
+#include "gkm/gkm-module.h"
+#include "gkm/gkm-object.h"
+#include "gkm/gkm-test.h"
+
+#include "ssh-store/gkm-ssh-private-key.h"
+
+#include "egg/egg-testing.h"
+
+#define FIXTURES SRCDIR "/pkcs11/ssh-store/fixtures/"
+
+static const gchar *PARSED_KEYS[] = {
+	"id_dsa_plain",
+	"id_rsa_plain",
+	"id_rsa_encrypted",
+	"id_ecdsa_plain",
+	"id_ed25519_plain",
+};
+
+typedef struct {
+	GkmModule *module;
+	gchar *directory;
+	GHashTable *added;
+} Test;
+
+static void
+on_object_added (GkmManager *manager,
+                 GkmObject *object,
+                 gpointer user_data)
+{
+	Test *test = user_data;
+	guint count;
+
+	if (!GKM_IS_SSH_PRIVATE_KEY (object))
+		return;
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (test->added, gkm_object_get_unique (object)));
+	g_hash_table_replace (test->added, g_strdup (gkm_object_get_unique (object)),
+	                      GUINT_TO_POINTER (count + 1));
+}
+
+static void
+write_scratch_file (Test *test,
+                    const gchar *name,
+                    const gchar *contents,
+                    gssize length)
+{
+	GError *error = NULL;
+	gchar *filename;
+
+	filename = g_build_filename (test->directory, name, NULL);
+	g_file_set_contents (filename, contents, length, &error);
+	g_assert_no_error (error);
+	g_free (filename);
+}
+
+static void
+copy_scratch_file (Test *test,
+                   const gchar *fixture,
+                   const gchar *name)
+{
+	GError *error = NULL;
+	gchar *contents;
+	gsize length;
+
+	g_file_get_contents (fixture, &contents, &length, &error);
+	g_assert_no_error (error);
+	write_scratch_file (test, name, contents, length);
+	g_free (contents);
+}
+
+static void
+setup (Test *test,
+       gconstpointer unused)
+{
+	test->directory = egg_tests_create_scratch_directory (
+		FIXTURES "id_dsa_plain", FIXTURES "id_dsa_plain.pub",
+		FIXTURES "id_rsa_plain", FIXTURES "id_rsa_plain.pub",
+		FIXTURES "id_rsa_encrypted", FIXTURES "id_rsa_encrypted.pub",
+		FIXTURES "id_ecdsa_plain", FIXTURES "id_ecdsa_plain.pub",
+		FIXTURES "id_ed25519_plain", FIXTURES "id_ed25519_plain.pub",
+		NULL);
+
+	/* A public key that doesn't parse, with a private key beside it */
+	write_scratch_file (test, "id_corrupt.pub", "ssh-rsa AAAA!!!! corrupt\n", -1);
+	copy_scratch_file (test, FIXTURES "id_rsa_plain", "id_corrupt");
+
+	/* And a public key without a private key */
+	copy_scratch_file (test, FIXTURES "id_dsa_plain.pub", "id_lonely.pub");
+
+	test->added = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	test->module = test_ssh_module_initialize_with_directory_and_enter (test->directory);
+	g_signal_connect (gkm_module_get_manager (test->module), "object-added",
+	                  G_CALLBACK (on_object_added), test);
+}
+
+static void
+teardown (Test *test,
+          gconstpointer unused)
+{
+	g_signal_handlers_disconnect_by_func (gkm_module_get_manager (test->module),
+	                                      on_object_added, test);
+	test_ssh_module_leave_and_finalize ();
+
+	g_hash_table_destroy (test->added);
+	egg_tests_remove_scratch_directory (test->directory);
+	g_free (test->directory);
+}
+
+static guint
+count_added (Test *test,
+             const gchar *name)
+{
+	gchar *unique;
+	guint count;
+
+	unique = g_strdup_printf ("ssh-store:%s/%s", test->directory, name);
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (test->added, unique));
+	g_free (unique);
+
+	return count;
+}
+
+static void
+test_refresh_directory (Test *test,
+                        gconstpointer unused)
+{
+	GList *objects;
+	CK_RV rv;
+	guint i;
+
+	rv = gkm_module_refresh_token (test->module);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+
+	/* Each key that parsed is exposed once */
+	for (i = 0; i < G_N_ELEMENTS (PARSED_KEYS); i++)
+		g_assert_cmpuint (count_added (test, PARSED_KEYS[i]), ==, 1);
+
+	/* And the ones that didn't are not exposed at all */
+	g_assert_cmpuint (count_added (test, "id_corrupt"), ==, 0);
+	g_assert_cmpuint (count_added (test, "id_lonely"), ==, 0);
+	g_assert_cmpuint (g_hash_table_size (test->added), ==, G_N_ELEMENTS (PARSED_KEYS));
+
+	objects = gkm_manager_find_by_class (gkm_module_get_manager (test->module),
+	                                     NULL, CKO_PRIVATE_KEY);
+	g_assert_cmpuint (g_list_length (objects), ==, G_N_ELEMENTS (PARSED_KEYS));
+	g_list_free (objects);
+
+	/* Nothing changed, so a second refresh exposes nothing new */
+	rv = gkm_module_refresh_token (test->module);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+
+	for (i = 0; i < G_N_ELEMENTS (PARSED_KEYS); i++)
+		g_assert_cmpuint (count_added (test, PARSED_KEYS[i]), ==, 1);
+	g_assert_cmpuint (count_added (test, "id_corrupt"), ==, 0);
+}
+
+int
+main (int argc, char **argv)
+{
+#if !GLIB_CHECK_VERSION(2,35,0)
+	g_type_init ();
+#endif
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add ("/ssh-store/module/refresh_directory", Test, NULL, setup, test_refresh_directory, teardown);
+
+	return g_test_run ();
+}
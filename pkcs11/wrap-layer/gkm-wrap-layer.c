@@ -1575,6 +1575,26 @@ gkm_wrap_layer_get_functions_no_prompts (void)
 	return &wrap_function_list;
 }
 
+CK_RV
+gkm_wrap_layer_map_session (CK_SESSION_HANDLE handle,
+                            CK_FUNCTION_LIST_PTR *funcs,
+                            CK_SESSION_HANDLE *real_handle)
+{
+	Mapping map;
+	CK_RV rv;
+
+	g_return_val_if_fail (funcs, CKR_ARGUMENTS_BAD);
+	g_return_val_if_fail (real_handle, CKR_ARGUMENTS_BAD);
+
+	rv = map_session_to_real (&handle, &map, NULL);
+	if (rv == CKR_OK) {
+		*funcs = map.funcs;
+		*real_handle = handle;
+	}
+
+	return rv;
+}
+
 void
 gkm_wrap_layer_reset_modules (void)
 {
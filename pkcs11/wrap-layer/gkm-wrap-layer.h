@@ -29,6 +29,10 @@ CK_FUNCTION_LIST_PTR    gkm_wrap_layer_get_functions               (void);
 
 CK_FUNCTION_LIST_PTR    gkm_wrap_layer_get_functions_no_prompts    (void);
 
+CK_RV                   gkm_wrap_layer_map_session                 (CK_SESSION_HANDLE handle,
+                                                                    CK_FUNCTION_LIST_PTR *funcs,
+                                                                    CK_SESSION_HANDLE *real_handle);
+
 void                    gkm_wrap_layer_reset_modules               (void);
 
 void                    gkm_wrap_layer_add_module                  (CK_FUNCTION_LIST_PTR funcs);
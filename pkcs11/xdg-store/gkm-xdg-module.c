@@ -49,9 +49,16 @@ struct _GkmXdgModule {
 	gchar *directory;
 	GHashTable *objects_by_path;
 	EggFileTracker *tracker;
+	GPtrArray *pending;
 	CK_TOKEN_INFO token_info;
 };
 
+typedef struct {
+	gchar *path;
+	GkmObject *object;
+	gboolean loaded;
+} LoadJob;
+
 static const CK_SLOT_INFO user_module_slot_info = {
 	"User Key Storage",
 	"Gnome Keyring",
@@ -197,11 +204,65 @@ remove_object_from_module (GkmXdgModule *self, GkmObject *object,
 	g_hash_table_remove (self->objects_by_path, filename);
 }
 
+static void
+load_job_free (gpointer data)
+{
+	LoadJob *job = data;
+
+	g_free (job->path);
+	g_object_unref (job->object);
+	g_slice_free (LoadJob, job);
+}
+
+/* Called on a worker thread, the object isn't visible to anyone else yet */
+static void
+load_job_run (gpointer data,
+              gpointer unused)
+{
+	LoadJob *job = data;
+	GError *error = NULL;
+	GBytes *bytes;
+	guchar *contents;
+	gsize n_contents;
+
+	if (!g_file_get_contents (job->path, (gchar**)&contents, &n_contents, &error)) {
+		g_warning ("couldn't read file in key store: %s: %s", job->path,
+		           egg_error_message (error));
+		g_clear_error (&error);
+		return;
+	}
+
+	bytes = g_bytes_new_take (contents, n_contents);
+	job->loaded = gkm_serializable_load (GKM_SERIALIZABLE (job->object), NULL, bytes);
+	g_bytes_unref (bytes);
+}
+
+static void
+load_pending_files (GkmXdgModule *self,
+                    GPtrArray *pending)
+{
+	LoadJob *job;
+	guint i;
+
+	/* Read and parse all the new files at once */
+	gkm_util_run_in_parallel (pending, load_job_run, NULL);
+
+	/* And then expose them to the manager in one go */
+	for (i = 0; i < pending->len; i++) {
+		job = pending->pdata[i];
+		if (job->loaded)
+			add_object_to_module (self, job->object, job->path, NULL);
+		else
+			g_message ("failed to load file in user store: %s", job->path);
+	}
+}
+
 static void
 file_load (EggFileTracker *tracker,
            const gchar *path,
            GkmXdgModule *self)
 {
+	LoadJob *job;
 	GkmObject *object;
 	GkmManager *manager;
 	gboolean added = FALSE;
@@ -234,6 +295,15 @@ file_load (EggFileTracker *tracker,
 		g_return_if_fail (GKM_IS_SERIALIZABLE (object));
 		g_return_if_fail (GKM_SERIALIZABLE_GET_INTERFACE (object)->extension);
 
+		/* During a refresh, new files are loaded together afterwards */
+		if (self->pending != NULL) {
+			job = g_slice_new0 (LoadJob);
+			job->path = g_strdup (path);
+			job->object = object;
+			g_ptr_array_add (self->pending, job);
+			return;
+		}
+
 		added = TRUE;
 
 	} else {
@@ -389,7 +459,18 @@ static CK_RV
 gkm_xdg_module_real_refresh_token (GkmModule *base)
 {
 	GkmXdgModule *self = GKM_XDG_MODULE (base);
+	GPtrArray *pending;
+
+	g_return_val_if_fail (self->pending == NULL, CKR_GENERAL_ERROR);
+
+	self->pending = g_ptr_array_new_with_free_func (load_job_free);
 	egg_file_tracker_refresh (self->tracker, FALSE);
+	pending = self->pending;
+	self->pending = NULL;
+
+	load_pending_files (self, pending);
+	g_ptr_array_unref (pending);
+
 	return CKR_OK;
 }
 
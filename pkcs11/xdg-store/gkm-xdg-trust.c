@@ -43,12 +43,21 @@
 
 #include <glib/gi18n.h>
 
+#include <gcrypt.h>
+
+#include <string.h>
+
 extern const struct _EggAsn1xDef xdg_asn1_tab[];
 
 struct _GkmXdgTrustPrivate {
 	GHashTable *assertions;
 	GNode *asn;
 	GBytes *bytes;
+
+	/* Digests of certComplete, looked up on every find */
+	gboolean have_hashes;
+	guchar sha1[20];
+	guchar md5[16];
 };
 
 static void gkm_xdg_trust_serializable (GkmSerializableIface *iface);
@@ -153,32 +162,58 @@ trust_get_integer (GkmXdgTrust *self, const gchar *part, CK_ATTRIBUTE_PTR attr)
 	return rv;
 }
 
-static CK_RV
-trust_get_hash (GkmXdgTrust *self, GChecksumType ctype, CK_ATTRIBUTE_PTR attr)
+static gboolean
+trust_calculate_hashes (GkmXdgTrust *self)
 {
-	GNode *cert;
+	guchar sha1[sizeof (self->pv->sha1)];
+	guchar md5[sizeof (self->pv->md5)];
+	gboolean had_hashes;
 	GBytes *element;
-	CK_RV rv;
+	GNode *cert;
+
+	g_assert (GKM_XDG_IS_TRUST (self));
+
+	memcpy (sha1, self->pv->sha1, sizeof (sha1));
+	memcpy (md5, self->pv->md5, sizeof (md5));
+	had_hashes = self->pv->have_hashes;
+	self->pv->have_hashes = FALSE;
 
 	cert = egg_asn1x_node (self->pv->asn, "reference", "certComplete", NULL);
-	g_return_val_if_fail (cert, CKR_GENERAL_ERROR);
+	if (cert && egg_asn1x_have (cert)) {
+		element = egg_asn1x_get_element_raw (cert);
+		g_return_val_if_fail (element != NULL, had_hashes);
+
+		gcry_md_hash_buffer (GCRY_MD_SHA1, self->pv->sha1,
+		                     g_bytes_get_data (element, NULL),
+		                     g_bytes_get_size (element));
+		gcry_md_hash_buffer (GCRY_MD_MD5, self->pv->md5,
+		                     g_bytes_get_data (element, NULL),
+		                     g_bytes_get_size (element));
+		self->pv->have_hashes = TRUE;
+		g_bytes_unref (element);
+	}
+
+	/* Whether the hashes changed */
+	if (had_hashes != self->pv->have_hashes)
+		return TRUE;
+	return had_hashes &&
+	       (memcmp (sha1, self->pv->sha1, sizeof (sha1)) != 0 ||
+	        memcmp (md5, self->pv->md5, sizeof (md5)) != 0);
+}
+
+static CK_RV
+trust_get_hash (GkmXdgTrust *self, const guchar *hash, gsize n_hash, CK_ATTRIBUTE_PTR attr)
+{
+	g_assert (GKM_XDG_IS_TRUST (self));
 
 	/* If it's not stored, then this attribute is not present */
-	if (!egg_asn1x_have (cert)) {
+	if (!self->pv->have_hashes) {
 		gkm_debug ("CKR_ATTRIBUTE_TYPE_INVALID: %s wants certComplete which is not part of assertion",
 		           gkm_log_attr_type (attr->type));
 		return CKR_ATTRIBUTE_TYPE_INVALID;
 	}
 
-	element = egg_asn1x_get_element_raw (cert);
-	g_return_val_if_fail (element != NULL, CKR_GENERAL_ERROR);
-
-	rv = gkm_attribute_set_checksum (attr, ctype,
-	                                 g_bytes_get_data (element, NULL),
-	                                 g_bytes_get_size (element));
-
-	g_bytes_unref (element);
-	return rv;
+	return gkm_attribute_set_data (attr, hash, n_hash);
 }
 
 static CK_RV
@@ -570,6 +605,7 @@ create_trust_for_reference (GkmModule *module, GkmManager *manager,
 		return NULL;
 	}
 
+	trust_calculate_hashes (trust);
 	return trust;
 }
 
@@ -602,6 +638,7 @@ create_trust_for_complete (GkmModule *module, GkmManager *manager,
 		return NULL;
 	}
 
+	trust_calculate_hashes (trust);
 	return trust;
 }
 
@@ -637,9 +674,9 @@ gkm_xdg_trust_get_attribute (GkmObject *base, GkmSession *session, CK_ATTRIBUTE_
 
 	/* Certificate hash values */
 	case CKA_CERT_MD5_HASH:
-		return trust_get_hash (self, G_CHECKSUM_MD5, attr);
+		return trust_get_hash (self, self->pv->md5, sizeof (self->pv->md5), attr);
 	case CKA_CERT_SHA1_HASH:
-		return trust_get_hash (self, G_CHECKSUM_SHA1, attr);
+		return trust_get_hash (self, self->pv->sha1, sizeof (self->pv->sha1), attr);
 
 	default:
 		break;
@@ -765,6 +802,12 @@ gkm_xdg_trust_real_load (GkmSerializable *base,
 	egg_asn1x_destroy (self->pv->asn);
 	self->pv->asn = asn;
 
+	/* Keep any find indexes on the hashes up to date */
+	if (trust_calculate_hashes (self)) {
+		gkm_object_notify_attribute (GKM_OBJECT (self), CKA_CERT_SHA1_HASH);
+		gkm_object_notify_attribute (GKM_OBJECT (self), CKA_CERT_MD5_HASH);
+	}
+
 	return TRUE;
 }
 
@@ -77,6 +77,30 @@ mock_xdg_module_empty_file (const gchar *name)
 	g_free (basename);
 }
 
+void
+mock_xdg_module_copy_file (const gchar *fixture, const gchar *name)
+{
+	gchar *filename;
+	gchar *basename;
+	gchar *contents;
+	gchar *path;
+	gsize length;
+
+	path = g_build_filename (SRCDIR "/pkcs11/xdg-store/fixtures", fixture, NULL);
+	if (!g_file_get_contents (path, &contents, &length, NULL))
+		g_error ("couldn't read: %s", path);
+
+	basename = g_path_get_basename (name);
+	filename = g_build_filename (directory, basename, NULL);
+	if (!g_file_set_contents (filename, contents, length, NULL))
+		g_error ("couldn't write: %s", filename);
+
+	g_free (filename);
+	g_free (basename);
+	g_free (contents);
+	g_free (path);
+}
+
 void
 mock_xdg_module_touch_file (const gchar *name, gint future)
 {
@@ -99,6 +123,13 @@ mock_xdg_module_touch_file (const gchar *name, gint future)
 	g_free (filename);
 }
 
+const gchar *
+mock_xdg_module_get_directory (void)
+{
+	g_assert (directory);
+	return directory;
+}
+
 GkmModule*
 mock_xdg_module_initialize_and_enter (void)
 {
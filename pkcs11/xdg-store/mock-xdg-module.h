@@ -42,9 +42,14 @@ GkmSession*            mock_xdg_module_open_session             (gboolean writab
 
 void                   mock_xdg_module_empty_file               (const gchar *name);
 
+void                   mock_xdg_module_copy_file                (const gchar *fixture,
+                                                                 const gchar *name);
+
 void                   mock_xdg_module_touch_file               (const gchar *name,
                                                                  gint future);
 
 void                   mock_xdg_module_remove_file              (const gchar *name);
 
+const gchar *          mock_xdg_module_get_directory            (void);
+
 #endif /* MOCK_XDG_MODULE_H_ */
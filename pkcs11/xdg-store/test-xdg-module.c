@@ -32,8 +32,14 @@
 
 #include "egg/egg-testing.h"
 
+#include "pkcs11/pkcs11n.h"
+
+#include <glib/gstdio.h>
+
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/times.h>
+#include <unistd.h>
 
 #include <string.h>
 
@@ -163,6 +169,302 @@ test_module_file_remove (Test *test, gconstpointer unused)
 	gkm_assert_cmpulong (n_check, <, n_objects);
 }
 
+static void
+test_find_objects_init_perf (Test *test, gconstpointer unused)
+{
+	CK_OBJECT_CLASS klass = CKO_CERTIFICATE;
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+	};
+	CK_OBJECT_HANDLE objects[16];
+	CK_ULONG n_objects;
+	gdouble elapsed;
+	gchar *name;
+	CK_RV rv;
+	guint i;
+
+	if (!g_test_perf ())
+		return;
+
+	for (i = 0; i < 1000; i++) {
+		name = g_strdup_printf ("test-perf-%04u.cer", i);
+		mock_xdg_module_copy_file ("test-certificate-1.cer", name);
+		g_free (name);
+	}
+
+	/* The first find loads all the files */
+	rv = gkm_session_C_FindObjectsInit (test->session, attrs, G_N_ELEMENTS (attrs));
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	rv = gkm_session_C_FindObjects (test->session, objects, G_N_ELEMENTS (objects), &n_objects);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	rv = gkm_session_C_FindObjectsFinal (test->session);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+
+	gkm_assert_cmpulong (n_objects, ==, G_N_ELEMENTS (objects));
+
+	/* After that nothing has changed, which is the common case */
+	g_test_timer_start ();
+	for (i = 0; i < 100; i++) {
+		rv = gkm_session_C_FindObjectsInit (test->session, attrs, G_N_ELEMENTS (attrs));
+		gkm_assert_cmprv (rv, ==, CKR_OK);
+		rv = gkm_session_C_FindObjectsFinal (test->session);
+		gkm_assert_cmprv (rv, ==, CKR_OK);
+	}
+	elapsed = g_test_timer_elapsed () / 100;
+
+	g_test_minimized_result (elapsed, "C_FindObjectsInit with 1000 files: %.3f msec",
+	                         elapsed * 1000);
+}
+
+static CK_ULONG
+count_objects_of_class (Test *test,
+                        CK_OBJECT_CLASS klass)
+{
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+	};
+	CK_OBJECT_HANDLE objects[256];
+	CK_ULONG n_objects;
+	CK_ULONG count = 0;
+	CK_RV rv;
+
+	rv = gkm_session_C_FindObjectsInit (test->session, attrs, G_N_ELEMENTS (attrs));
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	do {
+		rv = gkm_session_C_FindObjects (test->session, objects, G_N_ELEMENTS (objects), &n_objects);
+		gkm_assert_cmprv (rv, ==, CKR_OK);
+		count += n_objects;
+	} while (n_objects > 0);
+	rv = gkm_session_C_FindObjectsFinal (test->session);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+
+	return count;
+}
+
+static void
+copy_many_files (guint count)
+{
+	gchar *name;
+	guint i;
+
+	for (i = 0; i < count; i++) {
+		name = g_strdup_printf ("test-many-%04u.cer", i);
+		mock_xdg_module_copy_file ("test-certificate-1.cer", name);
+		g_free (name);
+
+		name = g_strdup_printf ("test-many-%04u.trust", i);
+		mock_xdg_module_copy_file ("test-refer-1.trust", name);
+		g_free (name);
+	}
+}
+
+static void
+test_module_load_many (Test *test, gconstpointer unused)
+{
+	copy_many_files (100);
+
+	/* Along with the ones in the fixture directory */
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 101);
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_NETSCAPE_TRUST), ==, 101);
+
+	/* Nothing is loaded twice */
+	mock_xdg_module_touch_file ("test-many-0000.cer", 1);
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 101);
+}
+
+static CK_ULONG
+count_certificates_like (Test *test,
+                         const gchar *fixture)
+{
+	CK_OBJECT_CLASS klass = CKO_CERTIFICATE;
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+		{ CKA_VALUE, NULL, 0 },
+	};
+	CK_OBJECT_HANDLE objects[16];
+	CK_ULONG n_objects;
+	gchar *path;
+	gchar *data;
+	gsize n_data;
+	CK_RV rv;
+
+	path = g_build_filename (SRCDIR "/pkcs11/xdg-store/fixtures", fixture, NULL);
+	if (!g_file_get_contents (path, &data, &n_data, NULL))
+		g_assert_not_reached ();
+	attrs[1].pValue = data;
+	attrs[1].ulValueLen = n_data;
+
+	rv = gkm_session_C_FindObjectsInit (test->session, attrs, G_N_ELEMENTS (attrs));
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	rv = gkm_session_C_FindObjects (test->session, objects, G_N_ELEMENTS (objects), &n_objects);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	rv = gkm_session_C_FindObjectsFinal (test->session);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+
+	g_free (data);
+	g_free (path);
+	return n_objects;
+}
+
+static void
+test_module_file_add (Test *test, gconstpointer unused)
+{
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+
+	mock_xdg_module_copy_file ("test-certificate-2.cer", "test-added.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 2);
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-2.cer"), ==, 1);
+
+	/* And another, once the first change has been seen */
+	mock_xdg_module_copy_file ("test-certificate-2.cer", "test-added-again.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 3);
+}
+
+static void
+test_module_file_change (Test *test, gconstpointer unused)
+{
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-1.cer"), ==, 1);
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-2.cer"), ==, 0);
+
+	mock_xdg_module_copy_file ("test-certificate-2.cer", "test-certificate-1.cer");
+	mock_xdg_module_touch_file ("test-certificate-1.cer", 1);
+
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-1.cer"), ==, 0);
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-2.cer"), ==, 1);
+}
+
+static void
+test_module_file_remove_and_add (Test *test, gconstpointer unused)
+{
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+
+	mock_xdg_module_remove_file ("test-certificate-1.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 0);
+
+	mock_xdg_module_copy_file ("test-certificate-2.cer", "test-certificate-2.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-2.cer"), ==, 1);
+}
+
+static void
+remove_directory_contents (const gchar *directory)
+{
+	const gchar *name;
+	gchar *path;
+	GDir *dir;
+
+	dir = g_dir_open (directory, 0, NULL);
+	g_assert (dir != NULL);
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		path = g_build_filename (directory, name, NULL);
+		if (g_unlink (path) < 0)
+			g_error ("couldn't remove: %s: %s", path, g_strerror (errno));
+		g_free (path);
+	}
+	g_dir_close (dir);
+}
+
+static void
+test_module_directory_recreate (Test *test, gconstpointer unused)
+{
+	const gchar *directory;
+
+	directory = mock_xdg_module_get_directory ();
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+
+	remove_directory_contents (directory);
+	if (g_rmdir (directory) < 0)
+		g_error ("couldn't remove: %s: %s", directory, g_strerror (errno));
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 0);
+
+	if (g_mkdir (directory, 0700) < 0)
+		g_error ("couldn't create: %s: %s", directory, g_strerror (errno));
+	mock_xdg_module_copy_file ("test-certificate-2.cer", "test-certificate-2.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-2.cer"), ==, 1);
+
+	/* Changes in the new directory are still seen */
+	mock_xdg_module_copy_file ("test-certificate-1.cer", "test-certificate-1.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 2);
+	mock_xdg_module_remove_file ("test-certificate-2.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+}
+
+static void
+flood_directory (const gchar *directory)
+{
+	gchar *contents;
+	gchar *path;
+	gint64 count;
+	gint64 i;
+	int fd;
+
+	/* More events than the queue holds, in a file the module ignores */
+	count = 16384;
+	if (g_file_get_contents ("/proc/sys/fs/inotify/max_queued_events", &contents, NULL, NULL)) {
+		count = MAX (g_ascii_strtoll (contents, NULL, 10), 1);
+		g_free (contents);
+	}
+
+	path = g_build_filename (directory, ".flood", NULL);
+	for (i = 0; i < count; i++) {
+		fd = g_open (path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+		if (fd < 0 || write (fd, "x", 1) != 1)
+			g_error ("couldn't write: %s: %s", path, g_strerror (errno));
+		close (fd);
+	}
+
+	g_free (path);
+}
+
+static void
+test_module_event_overflow (Test *test, gconstpointer unused)
+{
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+
+	mock_xdg_module_copy_file ("test-certificate-2.cer", "test-added.cer");
+	flood_directory (mock_xdg_module_get_directory ());
+	mock_xdg_module_remove_file ("test-certificate-1.cer");
+
+	/* Whatever was lost in the overflow is found by looking */
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+	gkm_assert_cmpulong (count_certificates_like (test, "test-certificate-2.cer"), ==, 1);
+
+	/* And after that, changes are seen as usual */
+	mock_xdg_module_copy_file ("test-certificate-1.cer", "test-certificate-1.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 2);
+	mock_xdg_module_remove_file ("test-added.cer");
+	gkm_assert_cmpulong (count_objects_of_class (test, CKO_CERTIFICATE), ==, 1);
+}
+
+static void
+test_module_load_perf (Test *test, gconstpointer unused)
+{
+	CK_OBJECT_CLASS klass = CKO_CERTIFICATE;
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_CLASS, &klass, sizeof (klass) },
+	};
+	gdouble elapsed;
+	CK_RV rv;
+
+	if (!g_test_perf ())
+		return;
+
+	copy_many_files (2500);
+
+	/* The first find loads all the files */
+	g_test_timer_start ();
+	rv = gkm_session_C_FindObjectsInit (test->session, attrs, G_N_ELEMENTS (attrs));
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+	elapsed = g_test_timer_elapsed ();
+	rv = gkm_session_C_FindObjectsFinal (test->session);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+
+	g_test_minimized_result (elapsed, "first C_FindObjectsInit with 5000 files: %.1f msec",
+	                         elapsed * 1000);
+}
+
 static void
 test_create_and_add_object (Test *test, gconstpointer unused)
 {
@@ -277,6 +579,14 @@ main (int argc, char **argv)
 	g_test_add ("/xdg-store/module/module_find_twice_is_same", Test, NULL, setup, test_module_find_twice_is_same, teardown);
 	g_test_add ("/xdg-store/module/module_file_becomes_invalid", Test, NULL, setup, test_module_file_becomes_invalid, teardown);
 	g_test_add ("/xdg-store/module/module_file_remove", Test, NULL, setup, test_module_file_remove, teardown);
+	g_test_add ("/xdg-store/module/module_file_add", Test, NULL, setup, test_module_file_add, teardown);
+	g_test_add ("/xdg-store/module/module_file_change", Test, NULL, setup, test_module_file_change, teardown);
+	g_test_add ("/xdg-store/module/module_file_remove_and_add", Test, NULL, setup, test_module_file_remove_and_add, teardown);
+	g_test_add ("/xdg-store/module/module_directory_recreate", Test, NULL, setup, test_module_directory_recreate, teardown);
+	g_test_add ("/xdg-store/module/module_event_overflow", Test, NULL, setup, test_module_event_overflow, teardown);
+	g_test_add ("/xdg-store/module/module_load_many", Test, NULL, setup, test_module_load_many, teardown);
+	g_test_add ("/xdg-store/module/module_load_perf", Test, NULL, setup, test_module_load_perf, teardown);
+	g_test_add ("/xdg-store/module/find_objects_init_perf", Test, NULL, setup, test_find_objects_init_perf, teardown);
 	g_test_add ("/xdg-store/module/create_and_add_object", Test, NULL, setup, test_create_and_add_object, teardown);
 	g_test_add ("/xdg-store/module/destroy_object", Test, NULL, setup, test_destroy_object, teardown);
 	g_test_add ("/xdg-store/module/get_slot_info", Test, NULL, setup, test_get_slot_info, teardown);
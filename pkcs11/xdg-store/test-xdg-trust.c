@@ -26,7 +26,9 @@
 
 #include "egg/egg-testing.h"
 
+#include "gkm/gkm-manager.h"
 #include "gkm/gkm-module.h"
+#include "gkm/gkm-object.h"
 #include "gkm/gkm-session.h"
 
 #include "pkcs11/pkcs11.h"
@@ -308,6 +310,49 @@ test_complete_assertion_netscape_sha1_hash (Test *test, gconstpointer unused)
 	gkm_assert_cmpulong (n_objects, >, 0);
 }
 
+static void
+test_complete_assertion_hash_indexed (Test *test, gconstpointer unused)
+{
+	CK_OBJECT_CLASS klass = CKO_X_TRUST_ASSERTION;
+	CK_X_ASSERTION_TYPE atype = CKT_X_PINNED_CERTIFICATE;
+	CK_OBJECT_HANDLE object = 0;
+	GkmManager *manager;
+	GList *objects;
+	CK_RV rv;
+
+	CK_ATTRIBUTE attrs[] = {
+		{ CKA_X_CERTIFICATE_VALUE, test->cert_data, test->n_cert_data },
+		{ CKA_CLASS, &klass, sizeof (klass) },
+		{ CKA_X_ASSERTION_TYPE, &atype, sizeof (atype) },
+		{ CKA_X_PURPOSE, "test-purpose", 12 },
+	};
+
+	CK_ATTRIBUTE sha1[] = {
+		{ CKA_CERT_SHA1_HASH, (void*)SHA1_CHECKSUM, XL (SHA1_CHECKSUM) },
+	};
+
+	CK_ATTRIBUTE md5[] = {
+		{ CKA_CERT_MD5_HASH, (void*)MD5_CHECKSUM, XL (MD5_CHECKSUM) },
+	};
+
+	rv = gkm_session_C_CreateObject (test->session, attrs, G_N_ELEMENTS (attrs), &object);
+	gkm_assert_cmprv (rv, ==, CKR_OK);
+
+	manager = gkm_session_get_manager (test->session);
+
+	objects = gkm_manager_find_by_attributes (manager, test->session, sha1, G_N_ELEMENTS (sha1));
+	g_assert (objects != NULL);
+	g_assert (objects->next == NULL);
+	g_assert (gkm_object_get_attribute_ulong (objects->data, test->session, CKA_CLASS, &klass));
+	gkm_assert_cmpulong (klass, ==, CKO_NETSCAPE_TRUST);
+	g_list_free (objects);
+
+	objects = gkm_manager_find_by_attributes (manager, test->session, md5, G_N_ELEMENTS (md5));
+	g_assert (objects != NULL);
+	g_assert (objects->next == NULL);
+	g_list_free (objects);
+}
+
 static void
 test_create_assertion_missing_type (Test *test, gconstpointer unused)
 {
@@ -856,6 +901,7 @@ main (int argc, char **argv)
 	g_test_add ("/xdg-store/trust/complete_assertion_has_no_serial_or_issuer", Test, NULL, setup, test_complete_assertion_has_no_serial_or_issuer, teardown);
 	g_test_add ("/xdg-store/trust/complete_assertion_netscape_md5_hash", Test, NULL, setup, test_complete_assertion_netscape_md5_hash, teardown);
 	g_test_add ("/xdg-store/trust/complete_assertion_netscape_sha1_hash", Test, NULL, setup, test_complete_assertion_netscape_sha1_hash, teardown);
+	g_test_add ("/xdg-store/trust/complete_assertion_hash_indexed", Test, NULL, setup, test_complete_assertion_hash_indexed, teardown);
 	g_test_add ("/xdg-store/trust/create_assertion_missing_type", Test, NULL, setup, test_create_assertion_missing_type, teardown);
 	g_test_add ("/xdg-store/trust/create_assertion_bad_type", Test, NULL, setup, test_create_assertion_bad_type, teardown);
 	g_test_add ("/xdg-store/trust/create_assertion_missing_cert_value", Test, NULL, setup, test_create_assertion_missing_cert_value, teardown);